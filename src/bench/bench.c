@@ -0,0 +1,237 @@
+#include <pthread.h>
+#include <getopt.h>
+#include <time.h>
+#include "../common/common.h"
+#include "../common/protocol.h"
+#include "../lib/bacheca.h"
+
+#define MAX_SAMPLES 200000
+
+/**
+ * Stato di un thread di carico: una connessione che ripete la stessa
+ * richiesta fino alla scadenza, con `depth` richieste in volo, e registra la
+ * latenza di ognuna. `busy` indica una connessione rifiutata dal server
+ * sovraccarico (`BUSY`), che non partecipa al test.
+ */
+typedef struct bench_worker {
+    pthread_t thread;
+    int id;
+    uint64_t requests;
+    uint64_t errors;
+    bool busy;
+    uint32_t* samples;
+    size_t n_samples;
+} bench_worker;
+
+/** Una delle richieste in volo di un worker, riemessa a ogni risposta. */
+typedef struct bench_slot {
+    bench_worker* worker;
+    uint64_t start;
+} bench_slot;
+
+static const char* host = "127.0.0.1";
+static int port = 8080;
+static int duration_sec = 5;
+static int depth = 1;
+static int mode = C_GET_BOARD;
+static int batch_size = 100;
+static bacheca_post_item* batch_items = NULL;
+static volatile int stop = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void on_reply(bacheca* b, const bacheca_result* res, void* ctx);
+
+static int issue(bacheca* b, bench_slot* slot) {
+    static const char body[] = "messaggio di prova del benchmark";
+    slot->start = now_us();
+    switch (mode) {
+        case C_POST_MESSAGE:
+            return bacheca_post_async(b, "bench", body, sizeof(body) - 1, on_reply, slot);
+        case C_POST_BATCH:
+            return bacheca_post_batch_async(b, batch_items, (size_t)batch_size, on_reply, slot);
+        case C_STATS:
+            return bacheca_stats_async(b, on_reply, slot);
+        default:
+            return bacheca_board_async(b, NULL, on_reply, slot);
+    }
+}
+
+/**
+ * @brief Registra la latenza di una risposta e, se il test non è finito, riemette la richiesta.
+ */
+static void on_reply(bacheca* b, const bacheca_result* res, void* ctx) {
+    bench_slot* slot = (bench_slot*)ctx;
+    bench_worker* w = slot->worker;
+    if (res->status == BACHECA_IO_ERROR) {
+        w->errors++;
+        return;
+    }
+    w->requests++;
+    if (w->n_samples < MAX_SAMPLES) {
+        w->samples[w->n_samples++] = (uint32_t)(now_us() - slot->start);
+    }
+    if (!stop && issue(b, slot) < 0) {
+        w->errors++;
+    }
+}
+
+static void* bench_thread(void* arg) {
+    bench_worker* w = (bench_worker*)arg;
+    bacheca* b = bacheca_connect(host, port);
+    if (!b) {
+        perror("Connessione fallita");
+        w->errors++;
+        return NULL;
+    }
+
+    char user[32];
+    snprintf(user, sizeof(user), "bench%d", w->id);
+    if (bacheca_register(b, user, "pw") == BUSY) {
+        w->busy = true;
+        bacheca_close(b);
+        return NULL;
+    }
+    if (bacheca_login(b, user, "pw") != AUTH_SUCCESS) {
+        fprintf(stderr, "Login fallito per %s\n", user);
+        w->errors++;
+        bacheca_close(b);
+        return NULL;
+    }
+
+    bench_slot* slots = calloc(depth, sizeof(bench_slot));
+    if (!slots) {
+        w->errors++;
+        bacheca_close(b);
+        return NULL;
+    }
+    for (int i = 0; i < depth; i++) {
+        slots[i].worker = w;
+        if (issue(b, &slots[i]) < 0) w->errors++;
+    }
+    // Le callback riemettono le richieste finché `stop` non viene impostato.
+    while (bacheca_pending(b) > 0) {
+        if (bacheca_run(b, 100) < 0) break;
+    }
+    bacheca_close(b);
+    free(slots);
+    return NULL;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Generatore di carico per il server: apre `-c` connessioni, ognuna con un
+ * proprio thread che ripete la richiesta scelta con `-m` per `-d` secondi
+ * tenendone `-q` in volo (con libbacheca; `-m batch` pubblica lotti di `-b`
+ * messaggi con `C_POST_BATCH`), e stampa throughput e percentili
+ * di latenza. Serve a confrontare i backend
+ * (bloccante, `--io-uring`, `--reuseport`) e i trasporti (TCP, oppure il
+ * socket Unix con `-h unix:percorso`) sulla stessa macchina.
+ */
+int main(int argc, char* argv[]) {
+    int n_conns = 8;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:d:q:m:b:")) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': n_conns = atoi(optarg); break;
+            case 'd': duration_sec = atoi(optarg); break;
+            case 'q': depth = atoi(optarg); break;
+            case 'b': batch_size = atoi(optarg); break;
+            case 'm':
+                if (strcmp(optarg, "board") == 0) mode = C_GET_BOARD;
+                else if (strcmp(optarg, "post") == 0) mode = C_POST_MESSAGE;
+                else if (strcmp(optarg, "stats") == 0) mode = C_STATS;
+                else if (strcmp(optarg, "batch") == 0) mode = C_POST_BATCH;
+                else {
+                    fprintf(stderr, "Modalità sconosciuta: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Uso: %s [-h host|unix:percorso] [-p porta] [-c connessioni] [-d secondi] [-q in_volo] "
+                                "[-m board|post|stats|batch] [-b messaggi_per_lotto]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_conns < 1) n_conns = 1;
+    if (depth < 1) depth = 1;
+    if (batch_size < 1) batch_size = 1;
+    if (batch_size > BATCH_MAX_ITEMS) batch_size = BATCH_MAX_ITEMS;
+    if (mode == C_POST_BATCH) {
+        static const char body[] = "messaggio di prova del benchmark";
+        batch_items = malloc(batch_size * sizeof(bacheca_post_item));
+        if (!batch_items) return 1;
+        for (int i = 0; i < batch_size; i++) {
+            batch_items[i] = (bacheca_post_item){ "bench", body, sizeof(body) - 1 };
+        }
+    }
+
+    bench_worker* workers = calloc(n_conns, sizeof(bench_worker));
+    if (!workers) return 1;
+    for (int i = 0; i < n_conns; i++) {
+        workers[i].id = i;
+        workers[i].samples = malloc(MAX_SAMPLES * sizeof(uint32_t));
+        if (!workers[i].samples) return 1;
+    }
+
+    uint64_t start = now_us();
+    for (int i = 0; i < n_conns; i++) {
+        pthread_create(&workers[i].thread, NULL, bench_thread, &workers[i]);
+    }
+    struct timespec ts = { .tv_sec = duration_sec, .tv_nsec = 0 };
+    nanosleep(&ts, NULL);
+    stop = 1;
+
+    uint64_t requests = 0, errors = 0;
+    size_t n_samples = 0;
+    int n_busy = 0;
+    for (int i = 0; i < n_conns; i++) {
+        pthread_join(workers[i].thread, NULL);
+        requests += workers[i].requests;
+        errors += workers[i].errors;
+        n_busy += workers[i].busy;
+        n_samples += workers[i].n_samples;
+    }
+    double elapsed = (now_us() - start) / 1e6;
+
+    uint32_t* all = malloc((n_samples + 1) * sizeof(uint32_t));
+    size_t k = 0;
+    for (int i = 0; all && i < n_conns; i++) {
+        memcpy(all + k, workers[i].samples, workers[i].n_samples * sizeof(uint32_t));
+        k += workers[i].n_samples;
+    }
+    if (all && k > 0) {
+        qsort(all, k, sizeof(uint32_t), compare_u32);
+    }
+
+    printf("connessioni %d, in volo %d, durata %.1f s\n", n_conns, depth, elapsed);
+    if (n_busy > 0) {
+        printf("connessioni rifiutate dal server (BUSY): %d\n", n_busy);
+    }
+    printf("richieste %llu (%.0f/s), errori %llu\n",
+           (unsigned long long)requests, requests / elapsed, (unsigned long long)errors);
+    if (mode == C_POST_BATCH) {
+        printf("messaggi %llu (%.0f/s) in lotti da %d\n", (unsigned long long)requests * batch_size,
+               requests * batch_size / elapsed, batch_size);
+    }
+    if (all && k > 0) {
+        printf("latenza us: p50 %u, p99 %u, max %u\n", all[k / 2], all[k * 99 / 100], all[k - 1]);
+    }
+
+    free(all);
+    for (int i = 0; i < n_conns; i++) free(workers[i].samples);
+    free(workers);
+    free(batch_items);
+    return errors > 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Verifica del sovraccarico (`make check`): avvia il server con 4 lavoratori
+# in una directory temporanea e gli invia più client attivi che lavoratori.
+# Il server non è saturo, quindi nessun client deve ricevere BUSY: prima
+# 8 client che pubblicano senza sosta, poi un client che si registra e
+# pubblica mentre 4 client leggono la bacheca con più richieste in volo.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${CHECK_PORT:-18081}
+WORK=$(mktemp -d)
+SERVER=
+READERS=
+
+cleanup() {
+    for pid in $SERVER $READERS; do kill -9 "$pid" 2>/dev/null || true; done
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "overload_check: $1" >&2
+    cat "$WORK/out.txt" >&2
+    exit 1
+}
+
+mkdir -p "$WORK/data"
+cd "$WORK"
+"$ROOT/server_executable" --port "$PORT" --threads 4 -q > server.log 2>&1 &
+SERVER=$!
+sleep 1
+
+"$ROOT/bench_executable" -p "$PORT" -c 8 -d 3 -m post > out.txt
+if grep -q BUSY out.txt; then fail "8 client su 4 lavoratori hanno ricevuto BUSY"; fi
+
+for i in 1 2 3 4; do
+    "$ROOT/bench_executable" -p "$PORT" -c 4 -q 4 -d 4 -m board > "board$i.txt" &
+    READERS="$READERS $!"
+done
+sleep 1
+"$ROOT/bench_executable" -p "$PORT" -c 1 -d 2 -m post > out.txt
+if grep -q BUSY out.txt; then fail "un client che pubblica durante le letture ha ricevuto BUSY"; fi
+if grep -q "^richieste 0 " out.txt; then fail "un client che pubblica durante le letture non è stato servito"; fi
+for pid in $READERS; do wait "$pid"; done
+READERS=
+echo "overload_check: nessun client rifiutato"
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Carico di addestramento della build PGO (`make pgo`): avvia il server
+# strumentato in una directory temporanea, popola la bacheca con i messaggi
+# del benchmark e la legge, con login, pubblicazioni e letture come nel
+# traffico reale. La conservazione limita la bacheca a 2000 messaggi, le
+# dimensioni di una bacheca in uso, così le letture non dominano il carico.
+# Allo spegnimento il server scrive i profili (.gcda).
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${PGO_PORT:-18080}
+WORK=$(mktemp -d)
+SERVER=
+
+cleanup() {
+    if [ -n "$SERVER" ]; then kill -9 "$SERVER" 2>/dev/null || true; fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir -p "$WORK/data"
+cd "$WORK"
+"$ROOT/server_executable" --port "$PORT" --retention max=2000 -q > server.log 2>&1 &
+SERVER=$!
+sleep 1
+
+"$ROOT/bench_executable" -p "$PORT" -c 4 -d 2 -m post
+"$ROOT/bench_executable" -p "$PORT" -c 8 -d 4 -q 2 -m board
+"$ROOT/bench_executable" -p "$PORT" -c 4 -d 2 -q 4 -m post
+"$ROOT/bench_executable" -p "$PORT" -c 2 -d 1 -m stats
+
+# Uno spegnimento ordinato (SIGINT) esegue gli handler di uscita che
+# scrivono i profili.
+kill -INT "$SERVER"
+wait "$SERVER" || true
+SERVER=
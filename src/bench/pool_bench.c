@@ -0,0 +1,302 @@
+#include <pthread.h>
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../server/thread_pool.h"
+
+#define MAX_PRODUCERS 64
+
+static int n_threads = 4;
+static int n_producers = 8;
+static long n_tasks = 200000;
+static unsigned long_task_us = 20;
+
+/** Task completati, contati da ogni task al termine. */
+static atomic_long done = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void spin_ns(uint64_t ns) {
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+/** Argomento di un task: durata del lavoro e, per le latenze, istante di accodamento ed esecuzione. */
+typedef struct pool_task {
+    uint64_t work_ns;
+    uint64_t queued_ns;
+    uint64_t started_ns;
+} pool_task;
+
+static void* run_task(void* arg) {
+    pool_task* task = (pool_task*)arg;
+    task->started_ns = now_ns();
+    if (task->work_ns > 0) spin_ns(task->work_ns);
+    atomic_fetch_add(&done, 1);
+    return NULL;
+}
+
+static void wait_done(long target) {
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 20000 };
+    while (atomic_load(&done) < target) {
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Stampa p50, p99 e massimo di `n` latenze in nanosecondi, in microsecondi.
+ */
+static void print_percentiles(const char* label, uint64_t* ns, size_t n) {
+    if (n == 0) return;
+    qsort(ns, n, sizeof(uint64_t), compare_u64);
+    printf("  %-24s p50 %.1f us, p99 %.1f us, max %.1f us\n", label, ns[n / 2] / 1e3,
+           ns[n * 99 / 100] / 1e3, ns[n - 1] / 1e3);
+}
+
+/** Un produttore dello scenario di throughput: accoda `count` task da `tasks`. */
+typedef struct producer {
+    pthread_t thread;
+    thread_pool* pool;
+    pool_task* tasks;
+    long count;
+} producer;
+
+static void* produce(void* arg) {
+    producer* p = (producer*)arg;
+    for (long i = 0; i < p->count; i++) {
+        if (add_task(p->pool, run_task, &p->tasks[i]) < 0) {
+            atomic_fetch_add(&done, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Throughput di `add_task` e dei lavoratori con `producers_count` produttori.
+ *
+ * Ogni produttore accoda la propria parte degli `n` task senza pause;
+ * `add_task/s` misura il solo accodamento (fino all'uscita dell'ultimo
+ * produttore), `task/s` il tempo fino all'esecuzione dell'ultimo task.
+ */
+static void scenario_throughput(int producers_count, long n, uint64_t work_ns) {
+    thread_pool* pool = thread_pool_create((size_t)n_threads);
+    pool_task* tasks = calloc((size_t)n, sizeof(pool_task));
+    producer producers[MAX_PRODUCERS];
+    if (!pool || !tasks) {
+        fprintf(stderr, "Memoria esaurita\n");
+        exit(1);
+    }
+    for (long i = 0; i < n; i++) tasks[i].work_ns = work_ns;
+
+    atomic_store(&done, 0);
+    long per_producer = n / producers_count;
+    uint64_t start = now_ns();
+    for (int i = 0; i < producers_count; i++) {
+        producers[i].pool = pool;
+        producers[i].tasks = tasks + i * per_producer;
+        producers[i].count = i == producers_count - 1 ? n - i * per_producer : per_producer;
+        pthread_create(&producers[i].thread, NULL, produce, &producers[i]);
+    }
+    for (int i = 0; i < producers_count; i++) {
+        pthread_join(producers[i].thread, NULL);
+    }
+    double submit_elapsed = (now_ns() - start) / 1e9;
+    wait_done(n);
+    double elapsed = (now_ns() - start) / 1e9;
+
+    printf("throughput: %d produttori, task da %.0f us\n", producers_count, work_ns / 1e3);
+    printf("  add_task/s %.0f, task/s %.0f\n", n / submit_elapsed, n / elapsed);
+    pool_destroy(pool);
+    free(tasks);
+}
+
+/**
+ * @brief Latenza dal `pthread_cond_signal` di `add_task` all'inizio del task.
+ *
+ * I task vengono accodati uno alla volta, dopo che il precedente è
+ * terminato: ogni task trova i lavoratori addormentati sulla variabile di
+ * condizione, quindi la latenza è quella del risveglio, senza code.
+ */
+static void scenario_wakeup(void) {
+    long n = n_tasks < 20000 ? n_tasks : 20000;
+    thread_pool* pool = thread_pool_create((size_t)n_threads);
+    pool_task* tasks = calloc((size_t)n, sizeof(pool_task));
+    uint64_t* lat = malloc((size_t)n * sizeof(uint64_t));
+    if (!pool || !tasks || !lat) {
+        fprintf(stderr, "Memoria esaurita\n");
+        exit(1);
+    }
+    atomic_store(&done, 0);
+    struct timespec pause = { .tv_sec = 0, .tv_nsec = 50000 };
+    for (long i = 0; i < n; i++) {
+        tasks[i].queued_ns = now_ns();
+        add_task(pool, run_task, &tasks[i]);
+        wait_done(i + 1);
+        lat[i] = tasks[i].started_ns - tasks[i].queued_ns;
+        // Lascia riaddormentare i lavoratori prima del prossimo task.
+        nanosleep(&pause, NULL);
+    }
+    printf("wakeup: %ld task, uno alla volta\n", n);
+    print_percentiles("segnale -> esecuzione", lat, (size_t)n);
+    pool_destroy(pool);
+    free(lat);
+    free(tasks);
+}
+
+/**
+ * @brief Attesa in coda dei task interattivi dietro a una fila di task di lettura.
+ *
+ * Un produttore accoda `n_tasks` task `TASK_BULK` lunghi e, ogni 10, un task
+ * `TASK_INTERACTIVE` breve; misura l'attesa in coda di entrambe le classi,
+ * per valutare i pesi e la protezione dalla fame delle code del pool.
+ */
+static void scenario_lanes(void) {
+    long n = n_tasks < 50000 ? n_tasks : 50000;
+    thread_pool* pool = thread_pool_create((size_t)n_threads);
+    pool_task* tasks = calloc((size_t)n, sizeof(pool_task));
+    uint64_t* bulk = malloc((size_t)n * sizeof(uint64_t));
+    uint64_t* interactive = malloc((size_t)n * sizeof(uint64_t));
+    if (!pool || !tasks || !bulk || !interactive) {
+        fprintf(stderr, "Memoria esaurita\n");
+        exit(1);
+    }
+    atomic_store(&done, 0);
+    for (long i = 0; i < n; i++) {
+        bool is_interactive = i % 10 == 0;
+        tasks[i].work_ns = is_interactive ? 0 : (uint64_t)long_task_us * 1000;
+        tasks[i].queued_ns = now_ns();
+        add_task_class(pool, is_interactive ? TASK_INTERACTIVE : TASK_BULK, run_task, &tasks[i]);
+    }
+    wait_done(n);
+    size_t n_bulk = 0, n_interactive = 0;
+    for (long i = 0; i < n; i++) {
+        uint64_t wait = tasks[i].started_ns - tasks[i].queued_ns;
+        if (i % 10 == 0) {
+            interactive[n_interactive++] = wait;
+        } else {
+            bulk[n_bulk++] = wait;
+        }
+    }
+    printf("lanes: %ld task, 1 interattivo ogni 10 dietro a letture da %u us\n", n, long_task_us);
+    print_percentiles("attesa interattivi", interactive, n_interactive);
+    print_percentiles("attesa letture", bulk, n_bulk);
+    pool_destroy(pool);
+    free(interactive);
+    free(bulk);
+    free(tasks);
+}
+
+/** Trattiene i lavoratori dello scenario di chiusura finché non viene azzerato. */
+static atomic_bool gate_closed = false;
+
+static void* wait_gate(void* arg) {
+    (void)arg;
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 20000 };
+    while (atomic_load(&gate_closed)) {
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Costo di `pool_destroy` con `n_tasks` task brevi ancora in coda.
+ *
+ * Ogni lavoratore viene prima trattenuto da un task che attende il
+ * cancello, così tutti i task restano in coda. I lavoratori terminano solo
+ * a coda vuota: `pool_destroy`, chiamata subito dopo l'apertura del
+ * cancello, esegue tutti i task pendenti, e il tempo per task è il costo
+ * del drain.
+ */
+static void scenario_destroy(void) {
+    thread_pool* pool = thread_pool_create((size_t)n_threads);
+    pool_task* tasks = calloc((size_t)n_tasks, sizeof(pool_task));
+    if (!pool || !tasks) {
+        fprintf(stderr, "Memoria esaurita\n");
+        exit(1);
+    }
+    atomic_store(&done, 0);
+    atomic_store(&gate_closed, true);
+    for (int i = 0; i < n_threads; i++) {
+        add_task(pool, wait_gate, NULL);
+    }
+    uint64_t start = now_ns();
+    for (long i = 0; i < n_tasks; i++) {
+        add_task(pool, run_task, &tasks[i]);
+    }
+    double submit_elapsed = (now_ns() - start) / 1e9;
+    long pending = n_tasks - atomic_load(&done);
+    start = now_ns();
+    atomic_store(&gate_closed, false);
+    pool_destroy(pool);
+    uint64_t elapsed = now_ns() - start;
+    printf("destroy: %ld task in coda (accodati a %.0f add_task/s)\n", pending, n_tasks / submit_elapsed);
+    printf("  pool_destroy %.2f ms (%.0f ns per task pendente)\n", elapsed / 1e6,
+           pending > 0 ? (double)elapsed / pending : 0.0);
+    free(tasks);
+}
+
+/**
+ * Benchmark del thread pool del server (`server/thread_pool.h`), senza rete:
+ * throughput di `add_task` con uno o `-p` produttori e task vuoti o da `-w`
+ * microsecondi,
+ * latenza di risveglio di un lavoratore, attesa dei task interattivi dietro
+ * alle letture e costo di `pool_destroy` con task pendenti. Serve a valutare
+ * le modifiche allo scheduler in isolamento.
+ */
+int main(int argc, char* argv[]) {
+    const char* scenario = "all";
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:n:w:s:")) != -1) {
+        switch (opt) {
+            case 't': n_threads = atoi(optarg); break;
+            case 'p': n_producers = atoi(optarg); break;
+            case 'n': n_tasks = atol(optarg); break;
+            case 'w': long_task_us = (unsigned)atoi(optarg); break;
+            case 's': scenario = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [-t thread] [-p produttori] [-n task] [-w us_task_lungo] "
+                                "[-s all|throughput|wakeup|lanes|destroy]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (n_threads < 1) n_threads = 1;
+    if (n_producers < 1) n_producers = 1;
+    if (n_producers > MAX_PRODUCERS) n_producers = MAX_PRODUCERS;
+    if (n_tasks < 100) n_tasks = 100;
+    bool all = strcmp(scenario, "all") == 0;
+
+    printf("thread %d, task %ld\n", n_threads, n_tasks);
+    if (all || strcmp(scenario, "throughput") == 0) {
+        // I task lunghi sono un decimo, perché la durata resti confrontabile.
+        scenario_throughput(1, n_tasks, 0);
+        scenario_throughput(n_producers, n_tasks, 0);
+        scenario_throughput(1, n_tasks / 10, (uint64_t)long_task_us * 1000);
+        scenario_throughput(n_producers, n_tasks / 10, (uint64_t)long_task_us * 1000);
+    }
+    if (all || strcmp(scenario, "wakeup") == 0) {
+        scenario_wakeup();
+    }
+    if (all || strcmp(scenario, "lanes") == 0) {
+        scenario_lanes();
+    }
+    if (all || strcmp(scenario, "destroy") == 0) {
+        scenario_destroy();
+    }
+    return 0;
+}
@@ -0,0 +1,414 @@
+#include <pthread.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <errno.h>
+#include "../common/common.h"
+#include "../common/protocol.h"
+#include "../common/net_utils.h"
+#include "../common/capture_format.h"
+#include "../lib/bacheca.h"
+
+#define REPLAY_STACK_SIZE (256 * 1024)
+#define REPLAY_COMMANDS (C_DELETE_BATCH + 1)
+
+static const char* const command_names[REPLAY_COMMANDS] = {
+    [C_REGISTER]       = "register",
+    [C_LOGIN]          = "login",
+    [C_GET_BOARD]      = "board",
+    [C_POST_MESSAGE]   = "post",
+    [C_DELETE_MESSAGE] = "delete",
+    [C_LOGOUT]         = "logout",
+    [C_STATS]          = "stats",
+    [C_SUBSCRIBE]      = "subscribe",
+    [C_UNSUBSCRIBE]    = "unsubscribe",
+    [C_REPLICATE]      = "replicate",
+    [C_CREATE_BOARD]   = "create_board",
+    [C_LIST_BOARDS]    = "list_boards",
+    [C_JOIN_BOARD]     = "join_board",
+    [C_POST_BATCH]     = "post_batch",
+    [C_DELETE_BATCH]   = "delete_batch",
+};
+
+/** Un record della cattura; `payload` punta nel file caricato in memoria. */
+typedef struct replay_request {
+    uint64_t time_us;
+    uint64_t conn;
+    size_t seq;
+    uint32_t length;
+    uint32_t captured;
+    uint8_t type;
+    const char* payload;
+} replay_request;
+
+/** Latenze in microsecondi raccolte per un comando. */
+typedef struct latency_samples {
+    uint32_t* values;
+    size_t size;
+    size_t capacity;
+} latency_samples;
+
+/**
+ * Una connessione della cattura, rieseguita da un proprio thread: le sue
+ * richieste (`requests`, in ordine) vengono inviate all'ora originale
+ * riscalata, e ognuna attende la propria risposta, come il client originale.
+ */
+typedef struct replay_conn {
+    pthread_t thread;
+    const replay_request* requests;
+    size_t n_requests;
+    latency_samples samples[REPLAY_COMMANDS];
+    uint64_t errors;
+    uint64_t max_lag_us;
+} replay_conn;
+
+static const char* host = "127.0.0.1";
+static int port = 8080;
+static double speed = 1.0;
+static uint64_t capture_start_us;
+static uint64_t replay_start_us;
+static char filler[4096];
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Attende l'ora a cui va inviata `req`; a velocità massima (0) non attende.
+ *
+ * @return Il ritardo in microsecondi rispetto all'ora prevista.
+ */
+static uint64_t wait_for(const replay_request* req) {
+    if (speed <= 0) return 0;
+    uint64_t due = replay_start_us + (uint64_t)((req->time_us - capture_start_us) / speed);
+    uint64_t now = now_us();
+    if (now >= due) return now - due;
+    struct timespec ts = { .tv_sec = (due - now) / 1000000, .tv_nsec = ((due - now) % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+    return 0;
+}
+
+static int connect_server(void) {
+    if (strncmp(host, BACHECA_UNIX_PREFIX, strlen(BACHECA_UNIX_PREFIX)) == 0) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        const char* path = host + strlen(BACHECA_UNIX_PREFIX);
+        if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, path);
+        int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock >= 0 && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            sock = -1;
+        }
+        return sock;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* res;
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) return -1;
+    int sock = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, 0);
+    if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    if (sock >= 0) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return sock;
+}
+
+/**
+ * @brief Invia una richiesta, completando con byte di riempimento il corpo
+ *        dei messaggi lunghi registrati solo in parte.
+ *
+ * Header e payload registrato partono con una sola `writev`, come da un
+ * client che invia la richiesta in un'unica scrittura.
+ */
+static int send_request(int sock, const replay_request* req) {
+    packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = req->type;
+    header.length = req->length;
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void*)req->payload, .iov_len = req->captured },
+    };
+    size_t total = sizeof(header) + req->captured;
+    ssize_t sent = writev(sock, iov, 2);
+    if (sent < 0) return -1;
+    if ((size_t)sent < sizeof(header)) {
+        if (send_all(sock, (char*)&header + sent, sizeof(header) - sent) != 0) return -1;
+        sent = sizeof(header);
+    }
+    if ((size_t)sent < total && send_all(sock, req->payload + (sent - sizeof(header)), total - sent) != 0) {
+        return -1;
+    }
+    for (size_t left = req->length - req->captured; left > 0;) {
+        size_t n = left < sizeof(filler) ? left : sizeof(filler);
+        if (send_all(sock, filler, n) != 0) return -1;
+        left -= n;
+    }
+    return 0;
+}
+
+static bool is_event(uint8_t type) {
+    return type == EVENT_ADDED || type == EVENT_DELETED || type == EVENT_RESYNC || type == EVENT_HEARTBEAT;
+}
+
+/**
+ * @brief Legge la risposta a una richiesta di tipo `type`.
+ *
+ * Gli eventi push di una connessione in modalità push vengono scartati; la
+ * risposta a `C_GET_BOARD` è una sequenza di pacchetti `OK` chiusa da un
+ * pacchetto con un altro stato, quella degli altri comandi un solo pacchetto.
+ */
+static int read_response(int sock, uint8_t type) {
+    char buffer[4096];
+    while (1) {
+        packet_header header;
+        if (recv_all(sock, &header, sizeof(header)) != 0) return -1;
+        for (uint32_t left = header.length; left > 0;) {
+            uint32_t n = left < sizeof(buffer) ? left : sizeof(buffer);
+            if (recv_all(sock, buffer, n) != 0) return -1;
+            left -= n;
+        }
+        if (is_event(header.type)) continue;
+        if (type == C_GET_BOARD && header.type == OK) continue;
+        return 0;
+    }
+}
+
+static void sample_add(latency_samples* s, uint32_t value) {
+    if (s->size == s->capacity) {
+        size_t capacity = s->capacity ? s->capacity * 2 : 64;
+        uint32_t* values = realloc(s->values, capacity * sizeof(uint32_t));
+        if (!values) return;
+        s->values = values;
+        s->capacity = capacity;
+    }
+    s->values[s->size++] = value;
+}
+
+static void* replay_thread(void* arg) {
+    replay_conn* c = (replay_conn*)arg;
+    int sock = -1;
+    for (size_t i = 0; i < c->n_requests; i++) {
+        const replay_request* req = &c->requests[i];
+        uint64_t lag = wait_for(req);
+        if (lag > c->max_lag_us) c->max_lag_us = lag;
+        if (req->type == CAPTURE_CLOSE) break;
+        if (sock < 0 && (sock = connect_server()) < 0) {
+            c->errors++;
+            break;
+        }
+        uint64_t start = now_us();
+        if (send_request(sock, req) != 0 || read_response(sock, req->type) != 0) {
+            c->errors++;
+            break;
+        }
+        if (req->type < REPLAY_COMMANDS) {
+            sample_add(&c->samples[req->type], (uint32_t)(now_us() - start));
+        }
+    }
+    if (sock >= 0) close(sock);
+    return NULL;
+}
+
+static int compare_request(const void* a, const void* b) {
+    const replay_request* r_a = (const replay_request*)a;
+    const replay_request* r_b = (const replay_request*)b;
+    if (r_a->conn != r_b->conn) return (r_a->conn > r_b->conn) ? 1 : -1;
+    return (r_a->seq > r_b->seq) - (r_a->seq < r_b->seq);
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Carica la cattura in memoria e ne decodifica i record.
+ *
+ * @param data Riceve il contenuto del file, a cui puntano i payload.
+ * @return Il numero di record, o -1 se il file non è una cattura valida.
+ */
+static ssize_t load_capture(const char* path, char** data, replay_request** requests) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror("Impossibile aprire la cattura");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = malloc(size > 0 ? (size_t)size : 1);
+    if (!*data || size < (long)sizeof(capture_file_header) || fread(*data, 1, (size_t)size, file) != (size_t)size) {
+        fclose(file);
+        fprintf(stderr, "Cattura non leggibile: %s\n", path);
+        return -1;
+    }
+    fclose(file);
+
+    capture_file_header header;
+    memcpy(&header, *data, sizeof(header));
+    if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+        fprintf(stderr, "%s non è una cattura della versione %d\n", path, CAPTURE_VERSION);
+        return -1;
+    }
+
+    size_t capacity = 1024, n = 0;
+    *requests = malloc(capacity * sizeof(replay_request));
+    size_t off = sizeof(header);
+    while (*requests && off + sizeof(capture_record) <= (size_t)size) {
+        capture_record record;
+        memcpy(&record, *data + off, sizeof(record));
+        off += sizeof(record);
+        if (record.captured > (size_t)size - off || record.captured > record.length) {
+            fprintf(stderr, "Cattura troncata dopo %zu record\n", n);
+            break;
+        }
+        if (n == capacity) {
+            capacity *= 2;
+            replay_request* grown = realloc(*requests, capacity * sizeof(replay_request));
+            if (!grown) break;
+            *requests = grown;
+        }
+        (*requests)[n] = (replay_request){ record.time_us, record.conn, n, record.length,
+                                           record.captured, record.type, *data + off };
+        n++;
+        off += record.captured;
+    }
+    return *requests ? (ssize_t)n : -1;
+}
+
+/**
+ * Riesegue una cattura del traffico (`server_executable --capture FILE`)
+ * contro un server: ogni connessione catturata diventa una connessione con
+ * un proprio thread, che ne invia le richieste alla stessa distanza di tempo
+ * dall'inizio della cattura divisa per `-s` (0 = il più veloce possibile,
+ * ogni richiesta appena arrivata la risposta alla precedente). Stampa la
+ * distribuzione delle latenze per comando, per confrontare il server sul
+ * carico reale. Le connessioni di replica (`C_REPLICATE`) vengono saltate.
+ *
+ * Il server va avviato con gli stessi dati (utenti e bacheche) che aveva
+ * all'inizio della cattura: ogni replay aggiunge i propri messaggi, e le
+ * letture della bacheca di un replay successivo costerebbero di più.
+ */
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:s:")) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 's': speed = atof(optarg); break;
+            default:
+                fprintf(stderr, "Uso: %s [-h host|unix:percorso] [-p porta] [-s velocità, 0 = massima] cattura\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Uso: %s [-h host|unix:percorso] [-p porta] [-s velocità, 0 = massima] cattura\n", argv[0]);
+        return 1;
+    }
+
+    char* data = NULL;
+    replay_request* requests = NULL;
+    ssize_t n = load_capture(argv[optind], &data, &requests);
+    if (n <= 0) {
+        if (n == 0) fprintf(stderr, "La cattura è vuota\n");
+        return 1;
+    }
+    capture_start_us = requests[0].time_us;
+    for (ssize_t i = 1; i < n; i++) {
+        if (requests[i].time_us < capture_start_us) capture_start_us = requests[i].time_us;
+    }
+    qsort(requests, (size_t)n, sizeof(replay_request), compare_request);
+
+    size_t n_conns = 0;
+    replay_conn* conns = calloc((size_t)n, sizeof(replay_conn));
+    if (!conns) return 1;
+    size_t skipped = 0;
+    for (ssize_t i = 0; i < n;) {
+        ssize_t j = i;
+        bool replica = false;
+        while (j < n && requests[j].conn == requests[i].conn) {
+            if (requests[j].type == C_REPLICATE) replica = true;
+            j++;
+        }
+        if (replica) {
+            skipped++;
+        } else {
+            conns[n_conns].requests = &requests[i];
+            conns[n_conns].n_requests = (size_t)(j - i);
+            n_conns++;
+        }
+        i = j;
+    }
+
+    memset(filler, 'x', sizeof(filler));
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, REPLAY_STACK_SIZE);
+    replay_start_us = now_us();
+    size_t started = 0;
+    for (; started < n_conns; started++) {
+        if (pthread_create(&conns[started].thread, &attr, replay_thread, &conns[started]) != 0) {
+            perror("Impossibile avviare un thread di replay");
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    uint64_t errors = 0, max_lag = 0, total = 0;
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(conns[i].thread, NULL);
+        errors += conns[i].errors;
+        if (conns[i].max_lag_us > max_lag) max_lag = conns[i].max_lag_us;
+    }
+    double elapsed = (now_us() - replay_start_us) / 1e6;
+
+    printf("connessioni %zu (%zu repliche saltate), durata %.1f s, ", n_conns, skipped, elapsed);
+    if (speed > 0) {
+        printf("velocità %gx\n", speed);
+    } else {
+        printf("velocità massima\n");
+    }
+    printf("%-13s %9s %9s %9s %9s %9s\n", "comando", "richieste", "p50 us", "p90 us", "p99 us", "max us");
+    for (int t = 0; t < REPLAY_COMMANDS; t++) {
+        size_t count = 0;
+        for (size_t i = 0; i < started; i++) count += conns[i].samples[t].size;
+        if (count == 0) continue;
+        uint32_t* all = malloc(count * sizeof(uint32_t));
+        if (!all) continue;
+        size_t k = 0;
+        for (size_t i = 0; i < started; i++) {
+            memcpy(all + k, conns[i].samples[t].values, conns[i].samples[t].size * sizeof(uint32_t));
+            k += conns[i].samples[t].size;
+        }
+        qsort(all, count, sizeof(uint32_t), compare_u32);
+        printf("%-13s %9zu %9u %9u %9u %9u\n", command_names[t], count, all[count / 2], all[count * 9 / 10],
+               all[count * 99 / 100], all[count - 1]);
+        total += count;
+        free(all);
+    }
+    printf("richieste %llu (%.0f/s), errori %llu, ritardo massimo sul programma %llu us\n",
+           (unsigned long long)total, total / elapsed, (unsigned long long)errors, (unsigned long long)max_lag);
+
+    for (size_t i = 0; i < n_conns; i++) {
+        for (int t = 0; t < REPLAY_COMMANDS; t++) free(conns[i].samples[t].values);
+    }
+    free(conns);
+    free(requests);
+    free(data);
+    return errors > 0;
+}
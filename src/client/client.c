@@ -7,7 +7,7 @@
 
 #define PORT 8080
 
-void main_loop(int sock);
+void main_loop(bacheca* b);
 
 int main(int argc, char const *argv[]) {
 
@@ -26,22 +26,29 @@ int main(int argc, char const *argv[]) {
     if (argc > 1) {
         server_ip = argv[1];
     }
+    const char* board_name = argc > 2 ? argv[2] : NULL;
 
-    int sock = connect_to_server(server_ip, PORT);
-    if (sock < 0) {
+    bacheca* b = bacheca_connect(server_ip, PORT);
+    if (!b) {
+        perror("Errore nella connessione al server");
         fprintf(stderr, "Impossibile connettersi al server %s:%d.\n", server_ip, PORT);
         return 1;
     }
     
     printf("Connesso al server della bacheca.\n");
-    main_loop(sock); 
+    c_board_cache_init(server_ip, PORT);
+    if (board_name && !c_join_board(b, board_name)) {
+        bacheca_close(b);
+        return 1;
+    }
+    main_loop(b); 
     
-    close(sock);
+    bacheca_close(b);
     printf("Disconnesso. Arrivederci!\n");
     return 0;
 }
 
-void main_loop(int sock) {
+void main_loop(bacheca* b) {
     bool b_menu = true;
     bool b_log = false;
 
@@ -51,21 +58,33 @@ void main_loop(int sock) {
             printf("1. Visualizza messaggi\n");
             printf("2. Invia un messaggio\n");
             printf("3. Cancella un messaggio\n");
-            printf("4. Esci dal programma\n");
+            printf("4. Statistiche del server\n");
+            printf("5. Bacheca in tempo reale\n");
+            printf("6. Cambia bacheca\n");
+            printf("7. Esci dal programma\n");
             printf("Scelta: ");
             
             int choice = get_int();
             switch (choice) {
                 case 1:
-                    c_get_board(sock);
+                    c_get_board(b);
                     break;
                 case 2:
-                    c_post_message(sock);
+                    c_post_message(b);
                     break;
                 case 3:
-                    c_delete_message(sock);
+                    c_delete_message(b);
                     break;
                 case 4:
+                    c_get_stats(b);
+                    break;
+                case 5:
+                    c_live_view(b);
+                    break;
+                case 6:
+                    c_change_board(b);
+                    break;
+                case 7:
                     b_menu = false; 
                     break;
                 default:
@@ -81,12 +100,12 @@ void main_loop(int sock) {
             int choice = get_int();
             switch (choice) {
                 case 1:
-                    if (c_register(sock)) {
+                    if (c_register(b)) {
                         printf("Registrazione avvenuta con successo! Ora puoi accedere.\n");
                     }
                     break;
                 case 2:
-                    if (c_login(sock)) {
+                    if (c_login(b)) {
                         printf("Accesso effettuato.\n");
                         b_log = true; 
                     }
@@ -2,90 +2,90 @@
 #include "ui_utils.h"
 #include "../common/common.h"
 #include "../common/protocol.h"
-#include "../common/net_utils.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+
+/** Tentativi dopo un `BUSY` e attesa prima del primo, raddoppiata a ogni tentativo. */
+#define BUSY_RETRIES 5
+#define BUSY_BACKOFF_MS 250
 
 /**
- * @brief Stabilisce una connessione TCP con il server.
- * 
- * @param ip L'indirizzo IP del server.
- * @param port La porta su cui il server è in ascolto.
- * @return int Il file descriptor del socket connesso in caso di successo, -1 altrimenti.
+ * @brief Stampa l'esito di una richiesta e verifica che sia quello atteso.
  * 
- * La funzione crea un socket, configura l'indirizzo del server e tenta di connettersi.
- * In caso di errore in qualsiasi passaggio, chiude il socket (se creato) e restituisce -1.
+ * @param status Lo stato restituito da libbacheca (`status_code` o `BACHECA_IO_ERROR`).
+ * @param expected Il codice di stato atteso (definito in protocol.h).
+ * @param error_msg Il messaggio di errore da visualizzare se lo stato ricevuto non è quello atteso.
+ * @return true se il server ha risposto con lo stato atteso, false altrimenti.
  */
-int connect_to_server(const char* ip, int port){
-    int sock;
-    struct sockaddr_in add_server;
-
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0))< 0)
-    {
-        perror("Errore nella creazione del socket");
-        return -1;
+static bool check_status(int status, status_code expected, const char* error_msg) {
+    if (status == (int)expected) {
+        return true;
     }
 
-    add_server.sin_family = AF_INET;
-    add_server.sin_port = htons(port);
-
-    if (inet_pton(AF_INET, ip, &add_server.sin_addr)<=0)
-    {
-        perror("Indirizzo non valido/ Indirizzo non supportato");
-        close(sock);
-        return -1;
+    if (status == BACHECA_IO_ERROR) {
+        printf("Errore nella ricezione della risposta dal server.\n");
+        return false;
     }
 
-    if (connect(sock, (struct sockaddr*)&add_server, sizeof(add_server))<0)
-    {
-        perror("Errore nella connessione al server");
-        close(sock);
-        return -1;
+    if (status == RATE_LIMITED) {
+        printf("Errore: troppe richieste, riprova tra qualche secondo.\n");
+        return false;
     }
-    
-    return sock;
-    
-}
 
-/**
- * @brief Attende e valida una risposta di stato specifica dal server.
- * 
- * @param sock Il socket connesso al server.
- * @param expected Il codice di stato atteso (definito in protocol.h).
- * @param error_msg Il messaggio di errore da visualizzare se lo stato ricevuto non è quello atteso.
- * @return true se il server risponde con lo stato atteso, false altrimenti.
- * 
- * Legge l'header del pacchetto dal server e controlla se il `type` del pacchetto
- * corrisponde al codice di stato `expected`. Se non corrisponde, stampa un errore
- * standard e il messaggio di errore fornito.
- */
-bool wait_for_status(int sock, status_code expected, const char* error_msg){
-    packet_header header;
-    if(recv_all(sock, &header, sizeof(header)) != 0){
-        printf("Errore nella ricezione della risposta dal server.\n");
+    if (status == BUSY) {
+        printf("Errore: il server è sovraccarico, riprova più tardi.\n");
         return false;
     }
 
-    if(header.type == expected){
-        return true;
+    if (status == READ_ONLY) {
+        printf("Errore: il server è una replica in sola lettura, connettiti al primario per scrivere.\n");
+        return false;
     }
 
-    printf("Errore: %s (codice: %d)\n", error_msg, header.type);
+    printf("Errore: %s (codice: %d)\n", error_msg, status);
     return false;
+}
 
+/**
+ * @brief Dopo un `BUSY` attende e riapre la connessione, per ripetere la richiesta.
+ *
+ * @param b La connessione, chiusa dal server.
+ * @param status Lo stato ricevuto.
+ * @param attempt I tentativi già ripetuti.
+ * @return true se la richiesta va ripetuta sulla nuova connessione.
+ *
+ * Il server risponde `BUSY` solo a una connessione che non ha ancora servito,
+ * quindi non c'è stato da ripristinare. L'attesa raddoppia a ogni tentativo,
+ * con una parte casuale: i client rifiutati insieme non tornano insieme.
+ */
+static bool busy_retry(bacheca* b, int status, int attempt) {
+    if (status != BUSY || attempt >= BUSY_RETRIES) {
+        return false;
+    }
+    unsigned delay = BUSY_BACKOFF_MS << attempt;
+    delay += (unsigned)rand() % (delay / 2 + 1);
+    printf("Server occupato, nuovo tentativo tra %u ms...\n", delay);
+    poll(NULL, 0, (int)delay);
+    if (bacheca_reconnect(b) < 0) {
+        perror("Errore nella riconnessione al server");
+        return false;
+    }
+    return true;
 }
 
 /**
  * @brief Gestisce il processo di registrazione di un nuovo utente.
  * 
- * @param sock Il socket connesso al server.
+ * @param b La connessione al server.
  * @return true se la registrazione ha successo, false altrimenti.
  * 
- * La funzione:
- * 1. Chiede all'utente di inserire username e password tramite `get_credentials`.
- * 2. Prepara un payload contenente `username\0password\0`.
- * 3. Invia la richiesta di registrazione al server.
- * 4. Attende una risposta di successo (`REG_SUCCESS`).
+ * Chiede all'utente username e password tramite `get_credentials` e attende
+ * una risposta di successo (`REG_SUCCESS`); se il server è occupato la
+ * ripete su una nuova connessione (`busy_retry`).
  */
-bool c_register(int sock) {
+bool c_register(bacheca* b) {
     char username[MAX_USERNAME_LEN];
     char password[MAX_PASSWORD_LEN];
     
@@ -93,36 +93,23 @@ bool c_register(int sock) {
         return false;
     }
 
-    size_t user_len = strlen(username);
-    size_t pass_len = strlen(password);
-    
-    // Il payload è composto da: [username][\0][password][\0]
-    size_t payload_len = user_len + 1 + pass_len + 1;
-    char* payload = malloc(payload_len);
-    if (!payload) return false;
-
-    memcpy(payload, username, user_len + 1);
-    memcpy(payload + user_len + 1, password, pass_len + 1);
-
-    response(sock, C_REGISTER, payload, payload_len);
-    free(payload);
-
-    return wait_for_status(sock, REG_SUCCESS, "Registrazione fallita. L'utente potrebbe già esistere.");
+    int status;
+    int attempt = 0;
+    do {
+        status = bacheca_register(b, username, password);
+    } while (busy_retry(b, status, attempt++));
+    return check_status(status, REG_SUCCESS, "Registrazione fallita. L'utente potrebbe già esistere.");
 }
 
 /**
  * @brief Gestisce il processo di login di un utente.
  * 
- * @param sock Il socket connesso al server.
+ * @param b La connessione al server.
  * @return true se il login ha successo, false altrimenti.
  * 
- * La funzione è molto simile a `c_register`:
- * 1. Chiede all'utente username e password.
- * 2. Prepara un payload `username\0password\0`.
- * 3. Invia la richiesta di login al server.
- * 4. Attende una risposta di successo (`AUTH_SUCCESS`).
+ * Come `c_register`, ma attende `AUTH_SUCCESS`.
  */
-bool c_login(int sock) {
+bool c_login(bacheca* b) {
     char username[MAX_USERNAME_LEN];
     char password[MAX_PASSWORD_LEN];
 
@@ -130,122 +117,179 @@ bool c_login(int sock) {
         return false;
     }
 
-    size_t user_len = strlen(username);
-    size_t pass_len = strlen(password);
+    int status;
+    int attempt = 0;
+    do {
+        status = bacheca_login(b, username, password);
+    } while (busy_retry(b, status, attempt++));
+    return check_status(status, AUTH_SUCCESS, "Login fallito. Controlla le tue credenziali.");
+}
+
+#define BOARD_CACHE_MAGIC "BACHECA1"
 
-    size_t payload_len = user_len + 1 + pass_len + 1;
-    char* payload = malloc(payload_len);
-    if (!payload) return false;
+/*
+ * Cache su disco dell'ultima bacheca ricevuta: 8 byte di magic, la versione
+ * (uint64) e il testo della bacheca così come è stato stampato. Sopravvive al
+ * riavvio del client, che alla prima richiesta ne invia la versione. Ogni
+ * bacheca del server ha il proprio file.
+ */
+static char board_cache_server[80] = "";
+static char board_cache_path[PATH_MAX] = "";
+static char board_cache_tmp[PATH_MAX + 4] = "";
 
-    memcpy(payload, username, user_len + 1);
-    memcpy(payload + user_len + 1, password, pass_len + 1);
+/**
+ * @brief Sceglie il file della cache per la bacheca `board` del server impostato.
+ *
+ * Il file è `$HOME/.bacheca_cache_<ip>_<porta>`, seguito da `_<bacheca>` per
+ * quelle diverse dalla predefinita; senza `HOME` la cache è disattivata.
+ */
+static void board_cache_select(const char* board) {
+    board_cache_path[0] = '\0';
+    const char* home = getenv("HOME");
+    if (!home || board_cache_server[0] == '\0') return;
+    int len;
+    if (board) {
+        len = snprintf(board_cache_path, sizeof(board_cache_path), "%s/.bacheca_cache_%s_%s",
+                       home, board_cache_server, board);
+    } else {
+        len = snprintf(board_cache_path, sizeof(board_cache_path), "%s/.bacheca_cache_%s", home, board_cache_server);
+    }
+    if (len < 0 || (size_t)len + 4 >= sizeof(board_cache_path)) {
+        board_cache_path[0] = '\0';
+        return;
+    }
+    snprintf(board_cache_tmp, sizeof(board_cache_tmp), "%s.tmp", board_cache_path);
+}
 
-    response(sock, C_LOGIN, payload, payload_len);
-    free(payload);
+/**
+ * @brief Imposta la cache della bacheca predefinita del server `server_ip:port`.
+ */
+void c_board_cache_init(const char* server_ip, int port) {
+    snprintf(board_cache_server, sizeof(board_cache_server), "%s_%d", server_ip, port);
+    // Un indirizzo `unix:PERCORSO` diventa parte del nome del file.
+    for (char* c = board_cache_server; *c; c++) {
+        if (*c == '/') *c = '_';
+    }
+    board_cache_select(NULL);
+}
 
-    return wait_for_status(sock, AUTH_SUCCESS, "Login fallito. Controlla le tue credenziali.");
+/**
+ * @brief Apre la cache della bacheca, posizionata all'inizio del testo.
+ *
+ * @return Il file, o NULL se la cache manca o non è valida.
+ */
+static FILE* board_cache_open(uint64_t* version) {
+    if (board_cache_path[0] == '\0') return NULL;
+    FILE* cache = fopen(board_cache_path, "rb");
+    if (!cache) return NULL;
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), cache) != sizeof(magic) ||
+        memcmp(magic, BOARD_CACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(version, sizeof(*version), 1, cache) != 1) {
+        fclose(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/**
+ * @brief Crea il file temporaneo in cui scrivere la nuova cache, o NULL.
+ *
+ * La versione viene scritta solo alla fine (`board_cache_commit`): un file
+ * lasciato a metà non ha il magic e viene ignorato.
+ */
+static FILE* board_cache_begin(void) {
+    if (board_cache_path[0] == '\0') return NULL;
+    FILE* tmp = fopen(board_cache_tmp, "wb");
+    if (!tmp) return NULL;
+    char header[8 + sizeof(uint64_t)] = {0};
+    if (fwrite(header, 1, sizeof(header), tmp) != sizeof(header)) {
+        fclose(tmp);
+        unlink(board_cache_tmp);
+        return NULL;
+    }
+    return tmp;
+}
+
+/**
+ * @brief Completa la cache con la versione ricevuta e la sostituisce a quella precedente.
+ */
+static void board_cache_commit(FILE* tmp, uint64_t version) {
+    if (!tmp) return;
+    bool ok = !ferror(tmp) && fseek(tmp, 0, SEEK_SET) == 0 &&
+              fwrite(BOARD_CACHE_MAGIC, 1, 8, tmp) == 8 &&
+              fwrite(&version, sizeof(version), 1, tmp) == 1;
+    if (fclose(tmp) != 0) ok = false;
+    if (!ok || rename(board_cache_tmp, board_cache_path) != 0) {
+        unlink(board_cache_tmp);
+    }
 }
 
 /**
  * @brief Richiede e stampa l'intera bacheca dal server.
  * 
- * @param sock Il socket connesso al server.
+ * @param b La connessione al server.
  * 
  * La funzione opera in questo modo:
- * 1. Invia una semplice richiesta `C_GET_BOARD` al server.
- * 2. Entra in un ciclo di ricezione.
- * 3. Per ogni messaggio, il server invia un pacchetto con header `type=OK` e il
- *    contenuto del messaggio come payload. Il client legge l'header, poi il payload
- *    e lo stampa.
- * 4. Il ciclo termina quando il client riceve un pacchetto speciale con `type=END_BOARD`,
- *    che segnala la fine della trasmissione della bacheca.
+ * 1. Richiede la bacheca indicando la versione in cache (0 se non c'è cache).
+ * 2. Se il server risponde `NOT_MODIFIED`, stampa la bacheca dalla cache.
+ * 3. Altrimenti stampa la bacheca ricevuta (i pacchetti `OK` fino a
+ *    `END_BOARD`) e, se il server ne ha inviato la versione, la salva come
+ *    nuova cache.
  */
-void c_get_board(int sock) {
-    status(sock, C_GET_BOARD);
-    packet_header header;
+void c_get_board(bacheca* b) {
+    uint64_t cached_version = 0;
+    FILE* cache = board_cache_open(&cached_version);
+    bacheca_result res;
+    int status = bacheca_board(b, &cached_version, &res);
     bool was_empty = true;
 
-    printf("\n--- Bacheca ---\n");
-
-    while (1) {
-        if (recv_all(sock, &header, sizeof(header)) != 0) {
-            fprintf(stderr, "Errore: connessione persa con il server.\n");
-            return;
-        }
-
-        // Il server invia END_BOARD per segnalare la fine dei messaggi.
-        if (header.type == END_BOARD) {
-            break;
+    if (status == NOT_MODIFIED && cache) {
+        printf("\n--- Bacheca ---\n");
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), cache)) > 0) {
+            fwrite(buffer, 1, n, stdout);
+            was_empty = false;
         }
-        
-        was_empty = false;
-
-        if (header.type != OK) {
-            fprintf(stderr, "Errore: Risposta inaspettata dal server (codice: %d)\n", header.type);
-            return;
-        }
-
-        if (header.length > 0) {
-            char buffer[4096];
-            memset(buffer, 0, sizeof(buffer));
-            
-            if (header.length >= sizeof(buffer)) {
-                fprintf(stderr, "Errore: messaggio troppo grande per il buffer.\n");
-                // Scarta i dati in eccesso
-                char discard[1024];
-                size_t rem = header.length;
-                while (rem > 0) {
-                    size_t len = (rem > sizeof(discard)) ? sizeof(discard) : rem;
-                    if (recv_all(sock, discard, len) != 0) break;
-                    rem -= len;
-                }
-                return;
-            }
-
-            if (recv_all(sock, buffer, header.length) != 0) {
-                perror("Errore nella ricezione del messaggio.");
-                return;
-            }
-            
-            printf("%s", buffer);
+    } else if (status == END_BOARD) {
+        printf("\n--- Bacheca ---\n");
+        fwrite(res.data, 1, res.length, stdout);
+        was_empty = res.length == 0;
+        if (res.has_version) {
+            FILE* new_cache = board_cache_begin();
+            if (new_cache) fwrite(res.data, 1, res.length, new_cache);
+            board_cache_commit(new_cache, res.version);
         }
+    } else {
+        check_status(status, END_BOARD, "Risposta inaspettata dal server");
+        bacheca_result_free(&res);
+        if (cache) fclose(cache);
+        return;
     }
 
     if (was_empty) {
         printf("La bacheca è vuota.\n");
     }
     printf("--- Fine Bacheca ---\n");
+    bacheca_result_free(&res);
+    if (cache) fclose(cache);
 }
 
 /**
  * @brief Gestisce l'invio di un nuovo messaggio alla bacheca.
  * 
- * @param sock Il socket connesso al server.
+ * @param b La connessione al server.
  * 
- * La funzione:
- * 1. Chiede all'utente di inserire oggetto e corpo del messaggio.
- * 2. Prepara un payload contenente `oggetto\0corpo`.
- * 3. Invia la richiesta di pubblicazione al server.
- * 4. Attende una conferma (`OK`) dal server.
+ * Chiede all'utente di inserire oggetto e corpo del messaggio, lo pubblica e
+ * attende una conferma (`OK`) dal server.
  */
-void c_post_message(int sock) {
+void c_post_message(bacheca* b) {
     char subject[MAX_SUBJECT_LEN];
     char body[MAX_BODY_LEN];
     get_content(subject, sizeof(subject), body, sizeof(body));
 
-    size_t subj_len = strlen(subject);
-    size_t body_len = strlen(body);
-    size_t payload_len = subj_len + 1 + body_len;
-    char* payload = malloc(payload_len);
-    if (!payload) return;
-
-    memcpy(payload, subject, subj_len + 1);
-    memcpy(payload + subj_len + 1, body, body_len);
-
-    response(sock, C_POST_MESSAGE, payload, payload_len);
-    free(payload);
-    
-    if (wait_for_status(sock, OK, "Invio messaggio fallito.")) {
+    if (check_status(bacheca_post(b, subject, body, strlen(body)), OK, "Invio messaggio fallito.")) {
         printf("Messaggio inviato con successo.\n");
     }
 }
@@ -253,25 +297,173 @@ void c_post_message(int sock) {
 /**
  * @brief Richiede la cancellazione di un messaggio.
  * 
- * @param sock Il socket connesso al server.
+ * @param b La connessione al server.
  * 
- * La funzione:
- * 1. Chiede all'utente l'ID del messaggio da cancellare.
- * 2. Invia l'ID come payload di una richiesta `C_DELETE_MESSAGE`.
- * 3. Attende una conferma (`OK`) o un errore dal server.
+ * Chiede all'utente l'ID del messaggio da cancellare e attende una conferma
+ * (`OK`) o un errore dal server.
  */
-void c_delete_message(int sock) {
+void c_delete_message(bacheca* b) {
     printf("Inserisci l'ID del messaggio da cancellare: ");
     int id = get_int();
     if (id < 0) {
         printf("ID non valido.\n");
         return;
     }
-    uint32_t msg_id = (uint32_t)id;
 
-    response(sock, C_DELETE_MESSAGE, (char*)&msg_id, sizeof(msg_id));
-
-    if (wait_for_status(sock, OK, "Cancellazione fallita. L'ID potrebbe essere errato o non sei l'autore.")) {
+    if (check_status(bacheca_delete(b, (uint32_t)id), OK,
+                     "Cancellazione fallita. L'ID potrebbe essere errato o non sei l'autore.")) {
         printf("Messaggio cancellato con successo.\n");
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Richiede e stampa le statistiche del server.
+ * 
+ * @param b La connessione al server.
+ * 
+ * Il server risponde con un pacchetto `OK` il cui payload è un testo con una
+ * riga "nome valore" per ogni contatore.
+ */
+void c_get_stats(bacheca* b) {
+    bacheca_result res;
+    if (check_status(bacheca_stats(b, &res), OK, "Risposta inaspettata dal server")) {
+        printf("\n--- Statistiche del server ---\n%s", res.data ? res.data : "");
+    }
+    bacheca_result_free(&res);
+}
+
+/**
+ * @brief Sposta la connessione sulla bacheca `name` e ne sceglie la cache.
+ *
+ * @return true se il server ha accettato, false altrimenti.
+ */
+bool c_join_board(bacheca* b, const char* name) {
+    int status;
+    int attempt = 0;
+    do {
+        status = bacheca_join_board(b, name);
+    } while (busy_retry(b, status, attempt++));
+    if (status == NOT_FOUND) {
+        printf("La bacheca \"%s\" non esiste.\n", name);
+        return false;
+    }
+    if (!check_status(status, OK, "Cambio di bacheca fallito.")) {
+        return false;
+    }
+    board_cache_select(name);
+    return true;
+}
+
+/**
+ * @brief Mostra le bacheche del server e passa a quella scelta, creandola se non esiste.
+ *
+ * @param b La connessione al server.
+ */
+void c_change_board(bacheca* b) {
+    bacheca_result res;
+    if (check_status(bacheca_list_boards(b, &res), OK, "Impossibile ottenere l'elenco delle bacheche.")) {
+        printf("\n--- Bacheche ---\n%s", res.data ? res.data : "");
+    }
+    bacheca_result_free(&res);
+
+    char name[MAX_BOARD_NAME_LEN];
+    get_string("Nome della bacheca (lettere minuscole, cifre, - e _): ", name, sizeof(name));
+    if (name[0] == '\0') {
+        return;
+    }
+
+    int status = bacheca_join_board(b, name);
+    if (status == NOT_FOUND) {
+        printf("La bacheca \"%s\" non esiste. Crearla? (1 = sì): ", name);
+        if (get_int() != 1) {
+            return;
+        }
+        status = bacheca_create_board(b, name);
+        if (status != BOARD_EXISTS && !check_status(status, OK, "Creazione fallita. Il nome potrebbe non essere valido.")) {
+            return;
+        }
+        status = bacheca_join_board(b, name);
+    }
+    if (check_status(status, OK, "Cambio di bacheca fallito.")) {
+        board_cache_select(name);
+        printf("Ora sei sulla bacheca \"%s\".\n", name);
+    }
+}
+
+/**
+ * @brief Stampa un evento push ricevuto dal server (callback di libbacheca).
+ */
+static void print_event(bacheca* b, const bacheca_event* event, void* ctx) {
+    (void)b;
+    (void)ctx;
+    switch (event->type) {
+        case EVENT_ADDED:
+            printf("\n[%u] %s: %s\n", event->id, event->author, event->subject);
+            fwrite(event->body, 1, event->body_length, stdout);
+            printf("\n(%s)\n", event->timestamp);
+            break;
+        case EVENT_DELETED:
+            printf("\nIl messaggio [%u] è stato cancellato.\n", event->id);
+            break;
+        case EVENT_RESYNC:
+            printf("\nAlcuni aggiornamenti sono andati persi: visualizza la bacheca per rileggerla.\n");
+            break;
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Mostra in tempo reale i messaggi pubblicati e cancellati.
+ *
+ * @param b La connessione al server.
+ *
+ * La funzione:
+ * 1. Invia `C_SUBSCRIBE`: da quel momento il server invia un evento per ogni
+ *    modifica della bacheca, senza bisogno di richiederla di nuovo.
+ * 2. Attende con `poll` sia il socket sia lo standard input, stampando ogni
+ *    evento ricevuto.
+ * 3. Quando l'utente preme Invio, invia `C_UNSUBSCRIBE`; gli eventi ancora in
+ *    viaggio fino alla risposta vengono scartati.
+ */
+void c_live_view(bacheca* b) {
+    bacheca_on_event(b, print_event, NULL);
+    if (!check_status(bacheca_subscribe(b), OK, "Impossibile attivare la visualizzazione in tempo reale.")) {
+        bacheca_on_event(b, NULL, NULL);
+        return;
+    }
+
+    printf("\n--- Bacheca in tempo reale (premi Invio per tornare al menu) ---\n");
+    fflush(stdout);
+
+    struct pollfd pfd[2];
+    pfd[0].fd = bacheca_fd(b);
+    pfd[0].events = POLLIN;
+    pfd[1].fd = STDIN_FILENO;
+    pfd[1].events = POLLIN;
+
+    while (1) {
+        pfd[0].revents = 0;
+        pfd[1].revents = 0;
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (pfd[1].revents & POLLIN) {
+            char line[64];
+            if (fgets(line, sizeof(line), stdin) == NULL) {
+                clearerr(stdin);
+            }
+            break;
+        }
+        if ((pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) && bacheca_process(b) < 0) {
+            fprintf(stderr, "Errore: connessione persa con il server.\n");
+            bacheca_on_event(b, NULL, NULL);
+            return;
+        }
+    }
+
+    bacheca_on_event(b, NULL, NULL);
+    bacheca_unsubscribe(b);
+    printf("--- Fine visualizzazione in tempo reale ---\n");
+}
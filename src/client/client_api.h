@@ -2,12 +2,17 @@
 #define CLIENT_API_H
 
 #include <stdbool.h>
+#include "../lib/bacheca.h"
 
-int connect_to_server(const char* ip, int port);
-bool c_register(int sock);
-bool c_login(int sock);
-void c_get_board(int sock);
-void c_post_message(int sock);
-void c_delete_message(int sock);
+void c_board_cache_init(const char* server_ip, int port);
+bool c_join_board(bacheca* b, const char* name);
+void c_change_board(bacheca* b);
+bool c_register(bacheca* b);
+bool c_login(bacheca* b);
+void c_get_board(bacheca* b);
+void c_post_message(bacheca* b);
+void c_delete_message(bacheca* b);
+void c_get_stats(bacheca* b);
+void c_live_view(bacheca* b);
 
 #endif // CLIENT_API_H
\ No newline at end of file
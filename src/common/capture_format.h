@@ -0,0 +1,40 @@
+#ifndef CAPTURE_FORMAT_H
+#define CAPTURE_FORMAT_H
+
+#include <stdint.h>
+
+/**
+ * Formato dei file di cattura del traffico, scritti dal server con
+ * `--capture` e rieseguiti da `replay_executable`.
+ *
+ * Il file inizia con un `capture_file_header`, seguito da un `capture_record`
+ * per ogni richiesta ricevuta, ciascuno seguito da `captured` byte di
+ * payload. `captured` è minore di `length` solo per i `C_POST_MESSAGE` più
+ * lunghi del buffer di richiesta, di cui viene registrato il solo oggetto: il
+ * replay completa il corpo con byte di riempimento.
+ * Un record di tipo `CAPTURE_CLOSE` segna la chiusura della connessione.
+ * Nei `C_REGISTER` e `C_LOGIN` la password è sostituita dal suo hash, che
+ * il replay usa come password: `length` è la lunghezza del payload scritto.
+ *
+ * `time_us` è l'ora di ricezione (CLOCK_REALTIME, in microsecondi) e `conn`
+ * identifica la connessione, anche attraverso un hot restart: il nuovo
+ * processo continua lo stesso file.
+ */
+#define CAPTURE_MAGIC   0x50414342u // "BCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_CLOSE   0xFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} capture_file_header;
+
+typedef struct {
+    uint64_t time_us;
+    uint64_t conn;
+    uint32_t length;
+    uint32_t captured;
+    uint8_t type;
+} capture_record;
+
+#endif // CAPTURE_FORMAT_H
@@ -17,5 +17,6 @@
 #define MAX_SUBJECT_LEN  128
 #define MAX_BODY_LEN     1024
 #define MAX_MESSAGE_LEN  512
+#define MAX_BOARD_NAME_LEN 32
 
 #endif // COMMON_H
\ No newline at end of file
@@ -9,9 +9,24 @@ typedef enum {
     C_GET_BOARD,
     C_POST_MESSAGE,
     C_DELETE_MESSAGE,
-    C_LOGOUT
+    C_LOGOUT,
+    C_STATS,
+    C_SUBSCRIBE,
+    C_UNSUBSCRIBE,
+    C_REPLICATE,    // Replica: copia della bacheca seguita dal flusso delle modifiche
+    C_CREATE_BOARD, // Crea una bacheca, payload "nome\0"
+    C_LIST_BOARDS,  // Elenco delle bacheche, risposta OK con "nome\n" per ognuna
+    C_JOIN_BOARD,   // Sposta la sessione sulla bacheca indicata, payload "nome\0"
+    C_POST_BATCH,   // Più messaggi, payload "oggetto\0corpo\0" per ognuno; risposta OK con
+                    // "primo id(uint32) stato(uint8) per elemento", l'elemento i ha ID primo + i
+    C_DELETE_BATCH  // Più cancellazioni, payload "id(uint32)" per ognuna; risposta OK con
+                    // "stato(uint8) per elemento" (OK, UNAUTHORIZED o NOT_FOUND)
 } command_type;
 
+/** Elementi e dimensione del payload massimi di un `C_POST_BATCH` o `C_DELETE_BATCH`. */
+#define BATCH_MAX_ITEMS 4096
+#define BATCH_MAX_LENGTH (1024 * 1024)
+
 typedef enum {
     OK,
     ERROR,
@@ -21,7 +36,17 @@ typedef enum {
     REG_USER_EXISTS,
     UNAUTHORIZED,
     NOT_FOUND,
-    END_BOARD
+    END_BOARD,
+    EVENT_ADDED,    // Push: nuovo messaggio, payload "id(uint32) autore\0oggetto\0corpo\0timestamp\0"
+    EVENT_DELETED,  // Push: messaggio cancellato, payload "id(uint32)"
+    EVENT_RESYNC,   // Push: eventi persi, il client deve rileggere la bacheca
+    RATE_LIMITED,   // Richiesta rifiutata: troppe richieste, riprovare più tardi
+    NOT_MODIFIED,   // C_GET_BOARD: la bacheca ha ancora la versione indicata dal client
+    READ_ONLY,      // Scrittura rifiutata: il server è una replica in sola lettura
+    EVENT_HEARTBEAT, // Push (C_REPLICATE): payload "prossimo id(uint32) ora del primario in ms(uint64)"
+    BOARD_EXISTS,   // C_CREATE_BOARD: esiste già una bacheca con quel nome
+    BUSY            // Server sovraccarico: la connessione non è stata servita e viene
+                    // chiusa; il client può riconnettersi più tardi
 } status_code;
 
 typedef struct {
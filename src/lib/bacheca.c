@@ -0,0 +1,776 @@
+#include "bacheca.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BACHECA_READ_CHUNK (64 * 1024)
+
+/** Una richiesta inviata (o da inviare) in attesa della sua risposta. */
+typedef struct bacheca_request {
+    struct bacheca_request* next;
+    uint8_t type;
+    bacheca_callback cb;
+    void* ctx;
+} bacheca_request;
+
+typedef struct byte_buffer {
+    char* data;
+    size_t len;
+    size_t cap;
+} byte_buffer;
+
+/**
+ * Stato di una connessione. `out` contiene le richieste serializzate non
+ * ancora inviate (da `out_sent` in poi), `in` i byte ricevuti non ancora
+ * consumati, `board` il testo della bacheca in arrivo per la prima richiesta
+ * in coda. Le richieste in volo formano una FIFO (`head`..`tail`): la
+ * risposta ricevuta appartiene sempre a `head`. `addr` è l'indirizzo del
+ * server, conservato per `bacheca_reconnect`.
+ */
+struct bacheca {
+    int sock;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    bool failed;
+    byte_buffer out;
+    size_t out_sent;
+    byte_buffer in;
+    byte_buffer board;
+    bacheca_request* head;
+    bacheca_request* tail;
+    bacheca_request* free_requests;
+    size_t n_pending;
+    bacheca_event_callback on_event;
+    void* event_ctx;
+};
+
+/**
+ * @brief Garantisce almeno `extra` byte liberi in `buf`, raddoppiandone la capacità.
+ */
+static int buffer_reserve(byte_buffer* buf, size_t extra) {
+    if (buf->cap - buf->len >= extra) return 0;
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap - buf->len < extra) {
+        if (cap > SIZE_MAX / 2) return -1;
+        cap *= 2;
+    }
+    char* data = realloc(buf->data, cap);
+    if (!data) return -1;
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+static int buffer_append(byte_buffer* buf, const void* data, size_t len) {
+    if (buffer_reserve(buf, len + 1) < 0) return -1;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Apre un socket connesso a `addr`, non bloccante e, se TCP, senza Nagle.
+ *
+ * @return Il socket, o -1 con `errno` impostato.
+ */
+static int open_socket(const struct sockaddr_storage* addr, socklen_t addrlen) {
+    int sock = socket(addr->ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (const struct sockaddr*)addr, addrlen) < 0) {
+        int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+    if (addr->ss_family == AF_INET) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    return sock;
+}
+
+/**
+ * @brief Apre una connessione al server.
+ *
+ * @param ip L'indirizzo IPv4 del server, oppure `unix:PERCORSO` per il socket
+ *           Unix di un server sulla stessa macchina (`--unix`).
+ * @param port La porta TCP, ignorata per il socket Unix.
+ * @return La connessione, o NULL con `errno` impostato.
+ *
+ * La `connect` è bloccante; poi il socket diventa non bloccante e, se TCP,
+ * senza Nagle, perché le richieste accodate partono già raggruppate in poche
+ * `send`.
+ */
+bacheca* bacheca_connect(const char* ip, int port) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    memset(&addr, 0, sizeof(addr));
+    if (strncmp(ip, BACHECA_UNIX_PREFIX, strlen(BACHECA_UNIX_PREFIX)) == 0) {
+        struct sockaddr_un* un = (struct sockaddr_un*)&addr;
+        const char* path = ip + strlen(BACHECA_UNIX_PREFIX);
+        if (path[0] == '\0' || strlen(path) >= sizeof(un->sun_path)) {
+            errno = EINVAL;
+            return NULL;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        addrlen = sizeof(*un);
+    } else {
+        struct sockaddr_in* in = (struct sockaddr_in*)&addr;
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        if (inet_pton(AF_INET, ip, &in->sin_addr) <= 0) {
+            errno = EINVAL;
+            return NULL;
+        }
+        addrlen = sizeof(*in);
+    }
+
+    int sock = open_socket(&addr, addrlen);
+    if (sock < 0) return NULL;
+
+    bacheca* b = calloc(1, sizeof(bacheca));
+    if (!b) {
+        close(sock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    b->sock = sock;
+    b->addr = addr;
+    b->addrlen = addrlen;
+    return b;
+}
+
+static void complete(bacheca* b, const bacheca_result* res) {
+    bacheca_request* req = b->head;
+    b->head = req->next;
+    if (!b->head) b->tail = NULL;
+    b->n_pending--;
+    b->board.len = 0;
+    if (req->cb) req->cb(b, res, req->ctx);
+    req->next = b->free_requests;
+    b->free_requests = req;
+}
+
+/**
+ * @brief Segna la connessione come fallita e completa le richieste in volo con `BACHECA_IO_ERROR`.
+ */
+static void fail(bacheca* b) {
+    b->failed = true;
+    bacheca_result res;
+    memset(&res, 0, sizeof(res));
+    res.status = BACHECA_IO_ERROR;
+    while (b->head) {
+        complete(b, &res);
+    }
+}
+
+/**
+ * @brief Chiude la connessione e libera le sue risorse.
+ *
+ * Le richieste ancora in volo vengono completate con `BACHECA_IO_ERROR`.
+ */
+void bacheca_close(bacheca* b) {
+    if (!b) return;
+    fail(b);
+    while (b->free_requests) {
+        bacheca_request* next = b->free_requests->next;
+        free(b->free_requests);
+        b->free_requests = next;
+    }
+    close(b->sock);
+    free(b->out.data);
+    free(b->in.data);
+    free(b->board.data);
+    free(b);
+}
+
+/**
+ * @brief Sostituisce il socket della connessione con uno nuovo verso lo stesso server.
+ *
+ * @return 0, o -1 con `errno` impostato (la connessione resta fallita).
+ *
+ * Le richieste ancora in volo vengono completate con `BACHECA_IO_ERROR` e
+ * quelle non inviate scartate; la callback degli eventi resta. La nuova
+ * connessione non è autenticata e lavora sulla bacheca predefinita: serve
+ * dopo un `BUSY`, quando il server ha chiuso la connessione senza servirla.
+ */
+int bacheca_reconnect(bacheca* b) {
+    fail(b);
+    close(b->sock);
+    b->out.len = 0;
+    b->out_sent = 0;
+    b->in.len = 0;
+    b->board.len = 0;
+    b->sock = open_socket(&b->addr, b->addrlen);
+    if (b->sock < 0) return -1;
+    b->failed = false;
+    return 0;
+}
+
+int bacheca_fd(const bacheca* b) {
+    return b->sock;
+}
+
+/** @brief Numero di richieste in attesa di risposta. */
+size_t bacheca_pending(const bacheca* b) {
+    return b->n_pending;
+}
+
+/** @brief true se ci sono richieste non ancora scritte sul socket (attendere `POLLOUT`). */
+bool bacheca_want_write(const bacheca* b) {
+    return b->out_sent < b->out.len;
+}
+
+/**
+ * @brief Imposta la callback degli eventi push; NULL li scarta.
+ */
+void bacheca_on_event(bacheca* b, bacheca_event_callback fn, void* ctx) {
+    b->on_event = fn;
+    b->event_ctx = ctx;
+}
+
+/**
+ * @brief Accoda una richiesta con un payload di `length` byte e ne scrive l'header in `out`.
+ *
+ * @return 0, o -1 se la connessione è fallita o manca memoria.
+ *
+ * Lo spazio per il payload è già riservato: il chiamante lo aggiunge subito
+ * dopo con `buffer_append`, senza altri errori possibili.
+ */
+static int submit_header(bacheca* b, uint8_t type, size_t length, bacheca_callback cb, void* ctx) {
+    if (b->failed || length > UINT32_MAX) return -1;
+    bacheca_request* req = b->free_requests;
+    if (req) {
+        b->free_requests = req->next;
+    } else {
+        req = malloc(sizeof(bacheca_request));
+        if (!req) return -1;
+    }
+
+    packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.length = (uint32_t)length;
+    if (buffer_reserve(&b->out, sizeof(header) + length + 1) < 0) {
+        req->next = b->free_requests;
+        b->free_requests = req;
+        return -1;
+    }
+    buffer_append(&b->out, &header, sizeof(header));
+
+    req->next = NULL;
+    req->type = type;
+    req->cb = cb;
+    req->ctx = ctx;
+    if (b->tail) {
+        b->tail->next = req;
+    } else {
+        b->head = req;
+    }
+    b->tail = req;
+    b->n_pending++;
+    return 0;
+}
+
+/**
+ * @brief Accoda una richiesta: header e payload (in due parti) vanno in `out`.
+ *
+ * @return 0, o -1 se la connessione è fallita o manca memoria.
+ */
+static int submit(bacheca* b, uint8_t type, const void* part1, size_t len1, const void* part2, size_t len2,
+                  bacheca_callback cb, void* ctx) {
+    if (len1 > SIZE_MAX - len2 || submit_header(b, type, len1 + len2, cb, ctx) < 0) return -1;
+    if (len1 > 0) buffer_append(&b->out, part1, len1);
+    if (len2 > 0) buffer_append(&b->out, part2, len2);
+    return 0;
+}
+
+/**
+ * @brief Scrive sul socket quanto possibile delle richieste accodate.
+ *
+ * @return 0 (anche se resta qualcosa da scrivere), -1 se la connessione è fallita.
+ */
+int bacheca_flush(bacheca* b) {
+    if (b->failed) return -1;
+    while (b->out_sent < b->out.len) {
+        ssize_t n = send(b->sock, b->out.data + b->out_sent, b->out.len - b->out_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            b->out_sent += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            fail(b);
+            return -1;
+        }
+    }
+    b->out.len = 0;
+    b->out_sent = 0;
+    return 0;
+}
+
+/**
+ * @brief Decodifica un evento push e lo passa alla callback degli eventi.
+ *
+ * `payload[length]` è un `\0` temporaneo, quindi ogni campo è una stringa
+ * terminata anche se il pacchetto è malformato.
+ */
+static void deliver_event(bacheca* b, uint8_t type, const char* payload, uint32_t length) {
+    if (!b->on_event) return;
+    bacheca_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    if (length >= sizeof(uint32_t)) {
+        memcpy(&event.id, payload, sizeof(uint32_t));
+    }
+    if (type == EVENT_ADDED) {
+        // Payload: id, poi "autore\0oggetto\0corpo\0timestamp\0".
+        const char* fields[4] = { "", "", "", "" };
+        size_t lengths[4] = { 0, 0, 0, 0 };
+        size_t off = sizeof(uint32_t);
+        for (int i = 0; i < 4 && off < length; i++) {
+            fields[i] = payload + off;
+            lengths[i] = strnlen(payload + off, length - off);
+            off += lengths[i] + 1;
+        }
+        event.author = fields[0];
+        event.subject = fields[1];
+        event.body = fields[2];
+        event.body_length = lengths[2];
+        event.timestamp = fields[3];
+    } else if (type == EVENT_HEARTBEAT && length >= sizeof(uint32_t) + sizeof(uint64_t)) {
+        memcpy(&event.time_ms, payload + sizeof(uint32_t), sizeof(uint64_t));
+    }
+    b->on_event(b, &event, b->event_ctx);
+}
+
+/**
+ * @brief Gestisce un pacchetto ricevuto: evento push, parte della bacheca o risposta finale.
+ *
+ * @param payload `length` byte seguiti da un `\0` temporaneo.
+ * @return 1 se ha completato una richiesta, 0 altrimenti, -1 in caso di errore di protocollo.
+ */
+static int dispatch(bacheca* b, uint8_t type, char* payload, uint32_t length) {
+    if (type == EVENT_ADDED || type == EVENT_DELETED || type == EVENT_RESYNC || type == EVENT_HEARTBEAT) {
+        deliver_event(b, type, payload, length);
+        return 0;
+    }
+    if (type == BUSY) {
+        // Il server chiude la connessione senza averla servita: nessuna
+        // richiesta in volo avrà risposta, tutte ricevono BUSY.
+        bacheca_result res;
+        memset(&res, 0, sizeof(res));
+        res.status = BUSY;
+        int completed = 0;
+        while (b->head) {
+            complete(b, &res);
+            completed++;
+        }
+        b->failed = true;
+        return completed;
+    }
+    bacheca_request* req = b->head;
+    if (!req) return -1;
+
+    if (req->type == C_GET_BOARD && type == OK) {
+        return buffer_append(&b->board, payload, length) < 0 ? -1 : 0;
+    }
+
+    bacheca_result res;
+    memset(&res, 0, sizeof(res));
+    res.status = type;
+    if (req->type == C_GET_BOARD) {
+        if (buffer_append(&b->board, "", 0) < 0) return -1;
+        res.data = b->board.data;
+        res.length = b->board.len;
+        if (type == END_BOARD && length == sizeof(uint64_t)) {
+            res.has_version = true;
+            memcpy(&res.version, payload, sizeof(uint64_t));
+        }
+    } else if (length > 0) {
+        res.data = payload;
+        res.length = length;
+    }
+    complete(b, &res);
+    return 1;
+}
+
+/**
+ * @brief Esegue i pacchetti completi presenti in `in` e compatta il buffer.
+ *
+ * @return Il numero di richieste completate, o -1 in caso di errore.
+ */
+static int parse(bacheca* b) {
+    int completed = 0;
+    size_t off = 0;
+    while (b->in.len - off >= sizeof(packet_header)) {
+        packet_header header;
+        memcpy(&header, b->in.data + off, sizeof(header));
+        size_t frame = sizeof(header) + (size_t)header.length;
+        if (b->in.len - off < frame) {
+            // Riserva subito lo spazio per l'intero pacchetto (più il `\0`).
+            if (off > 0) break;
+            if (buffer_reserve(&b->in, frame - b->in.len + 1) < 0) return -1;
+            break;
+        }
+        char* payload = b->in.data + off + sizeof(header);
+        char saved = payload[header.length];
+        payload[header.length] = '\0';
+        int res = dispatch(b, header.type, payload, header.length);
+        payload[header.length] = saved;
+        if (res < 0) return -1;
+        completed += res;
+        off += frame;
+        if (b->failed) return -1;
+    }
+    if (off > 0) {
+        memmove(b->in.data, b->in.data + off, b->in.len - off);
+        b->in.len -= off;
+    }
+    return completed;
+}
+
+/**
+ * @brief Legge dal socket tutte le risposte disponibili, chiamando le callback.
+ *
+ * @return Il numero di richieste completate, o -1 se la connessione è fallita.
+ *
+ * Il buffer di ricezione tiene sempre un byte libero oltre i dati, usato
+ * come terminatore temporaneo del payload passato alle callback.
+ */
+int bacheca_process(bacheca* b) {
+    if (b->failed) return -1;
+    int completed = 0;
+    while (1) {
+        if (buffer_reserve(&b->in, BACHECA_READ_CHUNK) < 0) {
+            fail(b);
+            return -1;
+        }
+        ssize_t n = recv(b->sock, b->in.data + b->in.len, b->in.cap - b->in.len - 1, 0);
+        if (n > 0) {
+            b->in.len += (size_t)n;
+            int res = parse(b);
+            if (res < 0) {
+                fail(b);
+                return -1;
+            }
+            completed += res;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return completed;
+        } else {
+            fail(b);
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Scrive le richieste accodate e attende al più `timeout_ms` (-1 = senza limite) le risposte.
+ *
+ * @return Il numero di richieste completate, o -1 se la connessione è fallita.
+ */
+int bacheca_run(bacheca* b, int timeout_ms) {
+    if (bacheca_flush(b) < 0) return -1;
+    struct pollfd pfd;
+    pfd.fd = b->sock;
+    pfd.events = POLLIN | (bacheca_want_write(b) ? POLLOUT : 0);
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) return 0;
+        fail(b);
+        return -1;
+    }
+    if (ready == 0) return 0;
+    if ((pfd.revents & POLLOUT) && bacheca_flush(b) < 0) return -1;
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) return bacheca_process(b);
+    return 0;
+}
+
+/**
+ * @brief Attende le risposte di tutte le richieste in volo.
+ *
+ * @return 0, o -1 se la connessione è fallita.
+ */
+int bacheca_wait(bacheca* b) {
+    while (b->n_pending > 0) {
+        if (bacheca_run(b, -1) < 0) return -1;
+    }
+    return 0;
+}
+
+static int credentials_request(bacheca* b, uint8_t type, const char* user, const char* password,
+                               bacheca_callback cb, void* ctx) {
+    return submit(b, type, user, strlen(user) + 1, password, strlen(password) + 1, cb, ctx);
+}
+
+int bacheca_register_async(bacheca* b, const char* user, const char* password, bacheca_callback cb, void* ctx) {
+    return credentials_request(b, C_REGISTER, user, password, cb, ctx);
+}
+
+int bacheca_login_async(bacheca* b, const char* user, const char* password, bacheca_callback cb, void* ctx) {
+    return credentials_request(b, C_LOGIN, user, password, cb, ctx);
+}
+
+int bacheca_logout_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_LOGOUT, NULL, 0, NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda la pubblicazione di un messaggio; il corpo può superare i limiti dell'interfaccia a terminale.
+ */
+int bacheca_post_async(bacheca* b, const char* subject, const char* body, size_t body_length,
+                       bacheca_callback cb, void* ctx) {
+    return submit(b, C_POST_MESSAGE, subject, strlen(subject) + 1, body, body_length, cb, ctx);
+}
+
+int bacheca_delete_async(bacheca* b, uint32_t id, bacheca_callback cb, void* ctx) {
+    return submit(b, C_DELETE_MESSAGE, &id, sizeof(id), NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda la pubblicazione di `n` messaggi con un solo `C_POST_BATCH`.
+ *
+ * @return 0, o -1 se la connessione è fallita, manca memoria o il lotto
+ *         supera `BATCH_MAX_ITEMS` elementi o `BATCH_MAX_LENGTH` byte
+ *         (`errno` = `EINVAL`): i lotti più grandi vanno divisi dal chiamante.
+ *
+ * La risposta `OK` contiene l'ID del primo messaggio e uno stato per
+ * messaggio; il messaggio `i` ha ID primo + `i`.
+ */
+int bacheca_post_batch_async(bacheca* b, const bacheca_post_item* items, size_t n, bacheca_callback cb, void* ctx) {
+    size_t length = 0;
+    for (size_t i = 0; i < n; i++) {
+        length += strlen(items[i].subject) + strnlen(items[i].body, items[i].body_length) + 2;
+    }
+    if (n == 0 || n > BATCH_MAX_ITEMS || length > BATCH_MAX_LENGTH) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (submit_header(b, C_POST_BATCH, length, cb, ctx) < 0) return -1;
+    for (size_t i = 0; i < n; i++) {
+        buffer_append(&b->out, items[i].subject, strlen(items[i].subject) + 1);
+        buffer_append(&b->out, items[i].body, strnlen(items[i].body, items[i].body_length));
+        buffer_append(&b->out, "", 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Accoda la cancellazione di `n` messaggi con un solo `C_DELETE_BATCH`.
+ *
+ * Limiti come `bacheca_post_batch_async`; la risposta `OK` contiene uno stato
+ * per ID (`OK`, `UNAUTHORIZED` o `NOT_FOUND`).
+ */
+int bacheca_delete_batch_async(bacheca* b, const uint32_t* ids, size_t n, bacheca_callback cb, void* ctx) {
+    if (n == 0 || n > BATCH_MAX_ITEMS) {
+        errno = EINVAL;
+        return -1;
+    }
+    return submit(b, C_DELETE_BATCH, ids, n * sizeof(uint32_t), NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda la lettura della bacheca.
+ *
+ * @param known_version La versione che il chiamante ha già (la risposta sarà
+ *                      `NOT_MODIFIED` se non è cambiata), o NULL.
+ */
+int bacheca_board_async(bacheca* b, const uint64_t* known_version, bacheca_callback cb, void* ctx) {
+    return submit(b, C_GET_BOARD, known_version, known_version ? sizeof(*known_version) : 0, NULL, 0, cb, ctx);
+}
+
+int bacheca_stats_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_STATS, NULL, 0, NULL, 0, cb, ctx);
+}
+
+int bacheca_subscribe_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_SUBSCRIBE, NULL, 0, NULL, 0, cb, ctx);
+}
+
+int bacheca_unsubscribe_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_UNSUBSCRIBE, NULL, 0, NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda la richiesta di replica: dopo l'`OK` la callback degli eventi
+ *        riceve la bacheca (`EVENT_ADDED`), un `EVENT_HEARTBEAT` che ne segna la
+ *        fine e poi il flusso delle modifiche.
+ */
+int bacheca_replicate_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_REPLICATE, NULL, 0, NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda la creazione di una bacheca (`OK`, o `BOARD_EXISTS` se il nome è già in uso).
+ */
+int bacheca_create_board_async(bacheca* b, const char* name, bacheca_callback cb, void* ctx) {
+    return submit(b, C_CREATE_BOARD, name, strlen(name) + 1, NULL, 0, cb, ctx);
+}
+
+int bacheca_list_boards_async(bacheca* b, bacheca_callback cb, void* ctx) {
+    return submit(b, C_LIST_BOARDS, NULL, 0, NULL, 0, cb, ctx);
+}
+
+/**
+ * @brief Accoda il passaggio della connessione a un'altra bacheca (`NOT_FOUND` se non esiste).
+ *
+ * Le richieste successive, e gli eventi push se la connessione è in
+ * `C_SUBSCRIBE`, riguardano la nuova bacheca.
+ */
+int bacheca_join_board_async(bacheca* b, const char* name, bacheca_callback cb, void* ctx) {
+    return submit(b, C_JOIN_BOARD, name, strlen(name) + 1, NULL, 0, cb, ctx);
+}
+
+/** Stato di una chiamata sincrona, completato dalla sua callback. */
+typedef struct sync_call {
+    bool done;
+    int status;
+    bacheca_result* res;
+} sync_call;
+
+static void sync_done(bacheca* b, const bacheca_result* res, void* ctx) {
+    (void)b;
+    sync_call* call = (sync_call*)ctx;
+    call->done = true;
+    call->status = res->status;
+    if (!call->res) return;
+    *call->res = *res;
+    call->res->data = NULL;
+    if (res->data) {
+        call->res->data = malloc(res->length + 1);
+        if (call->res->data) {
+            memcpy(call->res->data, res->data, res->length);
+            call->res->data[res->length] = '\0';
+        } else {
+            call->res->status = call->status = BACHECA_IO_ERROR;
+        }
+    }
+}
+
+/**
+ * @brief Attende la risposta di una chiamata sincrona appena accodata.
+ *
+ * Non va chiamata da una callback: la connessione starebbe già eseguendo
+ * una risposta.
+ */
+static int sync_wait(bacheca* b, int submitted, sync_call* call) {
+    if (submitted < 0) {
+        if (call->res) {
+            memset(call->res, 0, sizeof(*call->res));
+            call->res->status = BACHECA_IO_ERROR;
+        }
+        return BACHECA_IO_ERROR;
+    }
+    while (!call->done) {
+        if (bacheca_run(b, -1) < 0 && !call->done) return BACHECA_IO_ERROR;
+    }
+    return call->status;
+}
+
+int bacheca_register(bacheca* b, const char* user, const char* password) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_register_async(b, user, password, sync_done, &call), &call);
+}
+
+int bacheca_login(bacheca* b, const char* user, const char* password) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_login_async(b, user, password, sync_done, &call), &call);
+}
+
+int bacheca_logout(bacheca* b) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_logout_async(b, sync_done, &call), &call);
+}
+
+int bacheca_post(bacheca* b, const char* subject, const char* body, size_t body_length) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_post_async(b, subject, body, body_length, sync_done, &call), &call);
+}
+
+int bacheca_delete(bacheca* b, uint32_t id) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_delete_async(b, id, sync_done, &call), &call);
+}
+
+/**
+ * @brief Pubblica un lotto di messaggi; `res->data` (primo ID e stati) va liberato con `bacheca_result_free`.
+ */
+int bacheca_post_batch(bacheca* b, const bacheca_post_item* items, size_t n, bacheca_result* res) {
+    sync_call call = { false, 0, res };
+    return sync_wait(b, bacheca_post_batch_async(b, items, n, sync_done, &call), &call);
+}
+
+/**
+ * @brief Cancella un lotto di messaggi; `res->data` (stati) va liberato con `bacheca_result_free`.
+ */
+int bacheca_delete_batch(bacheca* b, const uint32_t* ids, size_t n, bacheca_result* res) {
+    sync_call call = { false, 0, res };
+    return sync_wait(b, bacheca_delete_batch_async(b, ids, n, sync_done, &call), &call);
+}
+
+/**
+ * @brief Legge la bacheca; `res->data` va liberato con `bacheca_result_free`.
+ */
+int bacheca_board(bacheca* b, const uint64_t* known_version, bacheca_result* res) {
+    sync_call call = { false, 0, res };
+    return sync_wait(b, bacheca_board_async(b, known_version, sync_done, &call), &call);
+}
+
+int bacheca_stats(bacheca* b, bacheca_result* res) {
+    sync_call call = { false, 0, res };
+    return sync_wait(b, bacheca_stats_async(b, sync_done, &call), &call);
+}
+
+int bacheca_subscribe(bacheca* b) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_subscribe_async(b, sync_done, &call), &call);
+}
+
+int bacheca_unsubscribe(bacheca* b) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_unsubscribe_async(b, sync_done, &call), &call);
+}
+
+int bacheca_replicate(bacheca* b) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_replicate_async(b, sync_done, &call), &call);
+}
+
+int bacheca_create_board(bacheca* b, const char* name) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_create_board_async(b, name, sync_done, &call), &call);
+}
+
+/**
+ * @brief Elenca le bacheche, un nome per riga; `res->data` va liberato con `bacheca_result_free`.
+ */
+int bacheca_list_boards(bacheca* b, bacheca_result* res) {
+    sync_call call = { false, 0, res };
+    return sync_wait(b, bacheca_list_boards_async(b, sync_done, &call), &call);
+}
+
+int bacheca_join_board(bacheca* b, const char* name) {
+    sync_call call = { false, 0, NULL };
+    return sync_wait(b, bacheca_join_board_async(b, name, sync_done, &call), &call);
+}
+
+void bacheca_result_free(bacheca_result* res) {
+    free(res->data);
+    res->data = NULL;
+    res->length = 0;
+}
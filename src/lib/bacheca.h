@@ -0,0 +1,131 @@
+#ifndef BACHECA_H
+#define BACHECA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/protocol.h"
+
+/**
+ * libbacheca: API C non interattiva per il protocollo della bacheca.
+ *
+ * Una `bacheca` è una connessione al server con un socket non bloccante. Le
+ * operazioni `*_async` accodano la richiesta e ritornano subito; le risposte
+ * arrivano nell'ordine delle richieste (il server le esegue in ordine), quindi
+ * più richieste possono essere in volo sulla stessa connessione e ognuna
+ * chiama la propria callback quando la sua risposta è completa.
+ *
+ * Il chiamante fa avanzare la connessione con `bacheca_run` (o, se usa un
+ * proprio ciclo di `poll`/`epoll` su `bacheca_fd`, con `bacheca_flush` e
+ * `bacheca_process`). Le varianti sincrone (`bacheca_login`, ...) accodano la
+ * richiesta e attendono la sua risposta, servendo nel frattempo le altre.
+ *
+ * Una connessione non è thread-safe: va usata da un solo thread alla volta.
+ * Le callback possono accodare nuove richieste `*_async`, ma non chiamare le
+ * varianti sincrone né `bacheca_close`.
+ */
+typedef struct bacheca bacheca;
+
+/** Stato di una risposta non ricevuta: connessione persa o errore di protocollo. */
+#define BACHECA_IO_ERROR (-1)
+
+/** Prefisso dell'indirizzo di `bacheca_connect` per il socket Unix del server. */
+#define BACHECA_UNIX_PREFIX "unix:"
+
+/**
+ * Risposta a una richiesta. `status` è il tipo del pacchetto finale
+ * (`status_code`) o `BACHECA_IO_ERROR`.
+ *
+ * `data` è il testo della bacheca (`C_GET_BOARD`, concatenazione dei pacchetti
+ * `OK`), delle statistiche (`C_STATS`) o dell'elenco delle bacheche
+ * (`C_LIST_BOARDS`), terminato da `\0`, oppure gli stati per elemento di un
+ * lotto (`C_POST_BATCH`, `C_DELETE_BATCH`, vedi `protocol.h`). Nelle callback è
+ * valido solo per la durata della chiamata; nelle varianti sincrone è allocato
+ * e va liberato con `bacheca_result_free`. `version` è la versione della
+ * bacheca inviata dal server con `END_BOARD`, se `has_version`.
+ */
+typedef struct bacheca_result {
+    int status;
+    char* data;
+    size_t length;
+    bool has_version;
+    uint64_t version;
+} bacheca_result;
+
+/**
+ * Evento push ricevuto in modalità `C_SUBSCRIBE` o `C_REPLICATE`. I puntatori
+ * sono validi solo per la durata della callback. Per `EVENT_HEARTBEAT` (solo
+ * in replica) `id` è il prossimo ID del primario e `time_ms` la sua ora.
+ */
+typedef struct bacheca_event {
+    int type;               // EVENT_ADDED, EVENT_DELETED, EVENT_RESYNC o EVENT_HEARTBEAT
+    uint32_t id;
+    const char* author;
+    const char* subject;
+    const char* body;
+    size_t body_length;
+    const char* timestamp;
+    uint64_t time_ms;
+} bacheca_event;
+
+/**
+ * Un messaggio di `bacheca_post_batch`. Il corpo termina al primo `\0`, come
+ * per il resto del server; un corpo vuoto è rifiutato con stato `ERROR`.
+ */
+typedef struct bacheca_post_item {
+    const char* subject;
+    const char* body;
+    size_t body_length;
+} bacheca_post_item;
+
+typedef void (*bacheca_callback)(bacheca* b, const bacheca_result* res, void* ctx);
+typedef void (*bacheca_event_callback)(bacheca* b, const bacheca_event* event, void* ctx);
+
+bacheca* bacheca_connect(const char* ip, int port);
+void bacheca_close(bacheca* b);
+int bacheca_reconnect(bacheca* b);
+int bacheca_fd(const bacheca* b);
+size_t bacheca_pending(const bacheca* b);
+bool bacheca_want_write(const bacheca* b);
+void bacheca_on_event(bacheca* b, bacheca_event_callback fn, void* ctx);
+
+int bacheca_flush(bacheca* b);
+int bacheca_process(bacheca* b);
+int bacheca_run(bacheca* b, int timeout_ms);
+int bacheca_wait(bacheca* b);
+
+int bacheca_register_async(bacheca* b, const char* user, const char* password, bacheca_callback cb, void* ctx);
+int bacheca_login_async(bacheca* b, const char* user, const char* password, bacheca_callback cb, void* ctx);
+int bacheca_logout_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_post_async(bacheca* b, const char* subject, const char* body, size_t body_length,
+                       bacheca_callback cb, void* ctx);
+int bacheca_delete_async(bacheca* b, uint32_t id, bacheca_callback cb, void* ctx);
+int bacheca_post_batch_async(bacheca* b, const bacheca_post_item* items, size_t n, bacheca_callback cb, void* ctx);
+int bacheca_delete_batch_async(bacheca* b, const uint32_t* ids, size_t n, bacheca_callback cb, void* ctx);
+int bacheca_board_async(bacheca* b, const uint64_t* known_version, bacheca_callback cb, void* ctx);
+int bacheca_stats_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_subscribe_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_unsubscribe_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_replicate_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_create_board_async(bacheca* b, const char* name, bacheca_callback cb, void* ctx);
+int bacheca_list_boards_async(bacheca* b, bacheca_callback cb, void* ctx);
+int bacheca_join_board_async(bacheca* b, const char* name, bacheca_callback cb, void* ctx);
+
+int bacheca_register(bacheca* b, const char* user, const char* password);
+int bacheca_login(bacheca* b, const char* user, const char* password);
+int bacheca_logout(bacheca* b);
+int bacheca_post(bacheca* b, const char* subject, const char* body, size_t body_length);
+int bacheca_delete(bacheca* b, uint32_t id);
+int bacheca_post_batch(bacheca* b, const bacheca_post_item* items, size_t n, bacheca_result* res);
+int bacheca_delete_batch(bacheca* b, const uint32_t* ids, size_t n, bacheca_result* res);
+int bacheca_board(bacheca* b, const uint64_t* known_version, bacheca_result* res);
+int bacheca_stats(bacheca* b, bacheca_result* res);
+int bacheca_subscribe(bacheca* b);
+int bacheca_unsubscribe(bacheca* b);
+int bacheca_replicate(bacheca* b);
+int bacheca_create_board(bacheca* b, const char* name);
+int bacheca_list_boards(bacheca* b, bacheca_result* res);
+int bacheca_join_board(bacheca* b, const char* name);
+void bacheca_result_free(bacheca_result* res);
+
+#endif // BACHECA_H
@@ -0,0 +1,225 @@
+#include "boards.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_BOARD_FILE "data/messages.txt"
+#define BOARDS_DIR "data/boards"
+#define BOARD_FILE_SUFFIX ".txt"
+
+/**
+ * Una bacheca aperta o in caricamento. La lista cresce solo in testa e non
+ * viene mai accorciata, quindi chi attende su `loaded` può tenere il puntatore
+ * alla voce dopo aver rilasciato `boards_m`.
+ */
+typedef struct board_entry {
+    struct board_entry* next;
+    char name[MAX_BOARD_NAME_LEN];
+    message_store* store;   // NULL finché la bacheca non è caricata
+    bool loading;           // un thread sta leggendo il file, senza `boards_m`
+    pthread_cond_t loaded;  // segnalata quando `loading` torna falso
+} board_entry;
+
+static pthread_mutex_t boards_m = PTHREAD_MUTEX_INITIALIZER;
+static board_entry* open_boards = NULL;
+static message_store* default_board = NULL;
+static bool persistent_boards = true;
+
+/**
+ * @brief Verifica un nome di bacheca: da 1 a `MAX_BOARD_NAME_LEN - 1` caratteri tra
+ *        lettere minuscole, cifre, `-` e `_`, così il nome è anche un nome di file sicuro.
+ */
+static bool valid_name(const char* name) {
+    size_t len = strnlen(name, MAX_BOARD_NAME_LEN);
+    if (len == 0 || len >= MAX_BOARD_NAME_LEN) return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) return false;
+    }
+    return true;
+}
+
+static void board_path(char* path, size_t size, const char* name) {
+    snprintf(path, size, "%s/%s%s", BOARDS_DIR, name, BOARD_FILE_SUFFIX);
+}
+
+/**
+ * @brief Apre la bacheca predefinita.
+ *
+ * @param pool Il pool usato per caricare in parallelo i file grandi.
+ * @param persistent false per una replica: esiste solo la bacheca
+ *                   predefinita, tenuta in memoria e ricevuta dal primario.
+ *
+ * Termina il processo se la bacheca predefinita non può essere creata. Solo
+ * questa usa `pool`: le altre vengono caricate al primo accesso da un thread
+ * dei pool dei client, che non deve attendere task accodati nel proprio pool,
+ * e vengono quindi lette in modo sequenziale.
+ */
+void boards_init(thread_pool* pool, bool persistent) {
+    persistent_boards = persistent;
+    message_store_init(pool);
+    if (persistent && mkdir(BOARDS_DIR, 0755) == -1 && errno != EEXIST) {
+        perror("Impossibile creare la directory delle bacheche");
+    }
+    default_board = message_store_open(DEFAULT_BOARD_NAME, persistent ? DEFAULT_BOARD_FILE : NULL);
+    if (!default_board) {
+        fprintf(stderr, "Impossibile creare la bacheca predefinita\n");
+        exit(EXIT_FAILURE);
+    }
+    message_store_init(NULL);
+}
+
+message_store* boards_default(void) {
+    return default_board;
+}
+
+static board_entry* find_entry(const char* name) {
+    for (board_entry* e = open_boards; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Restituisce la bacheca `name`, caricandola dal suo file al primo accesso.
+ *
+ * @return La bacheca, o NULL se non esiste (o non può essere caricata).
+ *
+ * Il primo thread inserisce una voce "in caricamento" e legge il file dopo
+ * aver rilasciato `boards_m`, così l'apertura di una bacheca grande non
+ * blocca quella delle altre. Chi apre insieme la stessa bacheca attende sulla
+ * condition variable della voce invece di caricarla una seconda volta; se il
+ * caricamento fallisce riceve NULL, e il file verrà riletto al prossimo accesso.
+ */
+message_store* boards_open(const char* name) {
+    if (strcmp(name, DEFAULT_BOARD_NAME) == 0) return default_board;
+    if (!persistent_boards || !valid_name(name)) return NULL;
+
+    char path[PATH_MAX];
+    board_path(path, sizeof(path), name);
+
+    pthread_mutex_lock(&boards_m);
+    board_entry* entry = find_entry(name);
+    if (!entry) {
+        // Solo le bacheche che esistono su disco ottengono una voce: i nomi
+        // inesistenti non fanno crescere la lista.
+        if (access(path, F_OK) != 0 || (entry = calloc(1, sizeof(board_entry))) == NULL) {
+            pthread_mutex_unlock(&boards_m);
+            return NULL;
+        }
+        memcpy(entry->name, name, strlen(name) + 1);
+        pthread_cond_init(&entry->loaded, NULL);
+        entry->next = open_boards;
+        open_boards = entry;
+    }
+    bool waited = false;
+    while (entry->loading) {
+        pthread_cond_wait(&entry->loaded, &boards_m);
+        waited = true;
+    }
+    message_store* store = entry->store;
+    if (store || waited) {
+        pthread_mutex_unlock(&boards_m);
+        return store;
+    }
+    entry->loading = true;
+    pthread_mutex_unlock(&boards_m);
+
+    store = message_store_open(name, path);
+
+    pthread_mutex_lock(&boards_m);
+    entry->store = store;
+    entry->loading = false;
+    pthread_cond_broadcast(&entry->loaded);
+    pthread_mutex_unlock(&boards_m);
+    return store;
+}
+
+/**
+ * @brief Crea una nuova bacheca vuota, senza caricarla.
+ *
+ * @return 0 in caso di successo, -1 se esiste già, -2 se il nome non è
+ *         valido o il file non può essere creato.
+ *
+ * Il file viene creato subito (vuoto, con `O_EXCL`), così la bacheca compare
+ * nell'elenco e sopravvive a un riavvio anche prima del primo messaggio.
+ */
+int boards_create(const char* name) {
+    if (!valid_name(name)) return -2;
+    if (strcmp(name, DEFAULT_BOARD_NAME) == 0) return -1;
+    if (!persistent_boards) return -2;
+
+    char path[PATH_MAX];
+    board_path(path, sizeof(path), name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return errno == EEXIST ? -1 : -2;
+    }
+    close(fd);
+    return 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Elenca le bacheche esistenti, una per riga, in ordine alfabetico.
+ *
+ * @param length Lunghezza del testo restituito.
+ * @return Il testo, da liberare con `free`, o NULL se manca memoria.
+ *
+ * L'elenco viene letto dalla directory dei file, quindi comprende anche le
+ * bacheche non ancora caricate.
+ */
+char* boards_list(size_t* length) {
+    size_t n = 0, cap = 16;
+    char** names = malloc(cap * sizeof(char*));
+    if (!names) return NULL;
+
+    DIR* dir = persistent_boards ? opendir(BOARDS_DIR) : NULL;
+    struct dirent* de;
+    while (dir && (de = readdir(dir)) != NULL) {
+        size_t len = strlen(de->d_name);
+        size_t suffix = sizeof(BOARD_FILE_SUFFIX) - 1;
+        if (len <= suffix || strcmp(de->d_name + len - suffix, BOARD_FILE_SUFFIX) != 0) continue;
+        de->d_name[len - suffix] = '\0';
+        if (!valid_name(de->d_name) || strcmp(de->d_name, DEFAULT_BOARD_NAME) == 0) continue;
+        if (n == cap) {
+            char** grown = realloc(names, cap * 2 * sizeof(char*));
+            if (!grown) break;
+            names = grown;
+            cap *= 2;
+        }
+        names[n] = strdup(de->d_name);
+        if (names[n]) n++;
+    }
+    if (dir) closedir(dir);
+    qsort(names, n, sizeof(char*), compare_names);
+
+    size_t total = strlen(DEFAULT_BOARD_NAME) + 1;
+    for (size_t i = 0; i < n; i++) {
+        total += strlen(names[i]) + 1;
+    }
+    char* text = malloc(total + 1);
+    size_t off = 0;
+    if (text) {
+        off += sprintf(text, "%s\n", DEFAULT_BOARD_NAME);
+        for (size_t i = 0; i < n; i++) {
+            off += sprintf(text + off, "%s\n", names[i]);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        free(names[i]);
+    }
+    free(names);
+    *length = off;
+    return text;
+}
@@ -0,0 +1,23 @@
+#ifndef BOARDS_H
+#define BOARDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "message_store.h"
+
+/** La bacheca su cui si trova una connessione appena aperta. */
+#define DEFAULT_BOARD_NAME "generale"
+
+/**
+ * Registro delle bacheche con nome. Ogni bacheca è una istanza di
+ * `message_store` con il proprio file in `data/boards/` (la bacheca
+ * predefinita resta in `data/messages.txt`) e viene caricata al primo
+ * accesso. Le bacheche aperte restano in memoria fino allo shutdown.
+ */
+void boards_init(thread_pool* pool, bool persistent);
+message_store* boards_default(void);
+message_store* boards_open(const char* name);
+int boards_create(const char* name);
+char* boards_list(size_t* length);
+
+#endif // BOARDS_H
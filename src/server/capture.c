@@ -0,0 +1,144 @@
+#include "capture.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../common/capture_format.h"
+#include "user_auth.h"
+
+#define CAPTURE_BUFFER_SIZE (1024 * 1024)
+#define CAPTURE_CREDENTIALS_SIZE 4096
+
+static FILE* capture_file = NULL;
+static pthread_mutex_t capture_m = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Apre il file di cattura.
+ *
+ * @param resume true nel processo avviato da un hot restart: il file del
+ *               processo precedente viene continuato invece di essere
+ *               troncato, così la cattura copre anche il restart. Il
+ *               processo precedente ha già scritto l'intestazione, anche se
+ *               ancora nel proprio buffer (`capture_flush` avviene
+ *               all'handoff, dopo questa apertura).
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int capture_open(const char* path, bool resume) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? O_APPEND : O_TRUNC);
+    int fd = open(path, flags, 0600);
+    if (fd < 0) {
+        perror("Impossibile aprire il file di cattura");
+        return -1;
+    }
+    capture_file = fdopen(fd, "a");
+    if (!capture_file) {
+        perror("Impossibile aprire il file di cattura");
+        close(fd);
+        return -1;
+    }
+    setvbuf(capture_file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+    if (!resume) {
+        capture_file_header header = { CAPTURE_MAGIC, CAPTURE_VERSION };
+        fwrite(&header, sizeof(header), 1, capture_file);
+    }
+    return 0;
+}
+
+bool capture_enabled(void) {
+    return capture_file != NULL;
+}
+
+static void capture_write(uint64_t conn, uint8_t type, uint32_t length, const void* payload, uint32_t captured) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    capture_record record;
+    memset(&record, 0, sizeof(record));
+    record.time_us = (uint64_t)now.tv_sec * 1000000u + now.tv_nsec / 1000;
+    record.conn = conn;
+    record.length = length;
+    record.captured = captured;
+    record.type = type;
+
+    pthread_mutex_lock(&capture_m);
+    if (capture_file) {
+        fwrite(&record, sizeof(record), 1, capture_file);
+        if (captured > 0) fwrite(payload, 1, captured, capture_file);
+    }
+    pthread_mutex_unlock(&capture_m);
+}
+
+/**
+ * @brief Copia in `out` il payload `user\0password\0` di un login o di una
+ *        registrazione, con l'hash della password (`hash_password`) al posto
+ *        della password.
+ *
+ * @return La lunghezza del payload copiato; 0 se il payload non contiene
+ *         un username seguito da una password, e non viene registrato nulla.
+ *
+ * L'hash è lo stesso per ogni richiesta con la stessa password, quindi il
+ * replay registra e autentica gli utenti come nella cattura, e le password
+ * sbagliate restano sbagliate.
+ */
+static uint32_t mask_credentials(const char* payload, uint32_t captured, char* out, size_t size) {
+    const char* user_end = memchr(payload, '\0', captured);
+    if (!user_end || user_end + 1 >= payload + captured) return 0;
+    size_t user_len = user_end - payload;
+    const char* pass = user_end + 1;
+    size_t pass_len = strnlen(pass, captured - user_len - 1);
+
+    char password[CAPTURE_CREDENTIALS_SIZE];
+    char hashed[64];
+    if (pass_len >= sizeof(password)) return 0;
+    memcpy(password, pass, pass_len);
+    password[pass_len] = '\0';
+    hash_password(password, hashed, sizeof(hashed));
+    size_t hashed_len = strlen(hashed);
+    if (user_len + hashed_len + 2 > size) return 0;
+
+    memcpy(out, payload, user_len + 1);
+    memcpy(out + user_len + 1, hashed, hashed_len + 1);
+    return (uint32_t)(user_len + hashed_len + 2);
+}
+
+/**
+ * @brief Registra una richiesta della connessione `conn`.
+ *
+ * @param payload I primi `captured` byte del payload (tutto, salvo i
+ *                messaggi lunghi: vedi `capture_format.h`).
+ */
+void capture_request(uint64_t conn, const packet_header* header, const void* payload, uint32_t captured) {
+    if (!capture_file) return;
+    if (header->type == C_REGISTER || header->type == C_LOGIN) {
+        char masked[CAPTURE_CREDENTIALS_SIZE];
+        uint32_t length = mask_credentials(payload, captured, masked, sizeof(masked));
+        capture_write(conn, header->type, length, masked, length);
+        return;
+    }
+    capture_write(conn, header->type, header->length, payload, captured);
+}
+
+void capture_connection_closed(uint64_t conn) {
+    if (!capture_file) return;
+    capture_write(conn, CAPTURE_CLOSE, 0, NULL, 0);
+}
+
+/**
+ * @brief Scrive su file i record ancora nel buffer, ad esempio prima di un hot restart.
+ */
+void capture_flush(void) {
+    if (!capture_file) return;
+    pthread_mutex_lock(&capture_m);
+    if (capture_file) fflush(capture_file);
+    pthread_mutex_unlock(&capture_m);
+}
+
+void capture_close(void) {
+    if (!capture_file) return;
+    pthread_mutex_lock(&capture_m);
+    fclose(capture_file);
+    capture_file = NULL;
+    pthread_mutex_unlock(&capture_m);
+}
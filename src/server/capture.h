@@ -0,0 +1,24 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../common/protocol.h"
+
+/**
+ * Cattura del traffico (`--capture FILE`): ogni richiesta decodificata viene
+ * accodata al file con ora di ricezione e connessione, nel formato di
+ * `common/capture_format.h`, per rieseguirla con `replay_executable`.
+ * Le password di registrazioni e login sono sostituite dal loro hash, lo
+ * stesso di `users.txt`: il replay resta coerente (chi si registra rientra
+ * con lo stesso valore) senza che il file contenga password in chiaro. Il
+ * file viene comunque creato con permessi 0600.
+ */
+int capture_open(const char* path, bool resume);
+bool capture_enabled(void);
+void capture_request(uint64_t conn, const packet_header* header, const void* payload, uint32_t captured);
+void capture_connection_closed(uint64_t conn);
+void capture_flush(void);
+void capture_close(void);
+
+#endif // CAPTURE_H
@@ -1,23 +1,855 @@
+#define _GNU_SOURCE
+
 #include "client_handler.h"
 #include <pthread.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdatomic.h>
 #include <signal.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h> 
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/socket.h>
 #include "../common/common.h"
 #include "../common/protocol.h" 
 #include "../common/net_utils.h"
 #include "user_auth.h"
 #include "message_store.h"
+#include "boards.h"
+#include "hot_restart.h"
+#include "idle_sessions.h"
+#include "stats.h"
+#include "rate_limit.h"
+#include "replication.h"
+#include "capture.h"
+#include "lock_prof.h"
 
-extern volatile sig_atomic_t active_client_count;
+extern atomic_int active_client_count;
 extern pthread_mutex_t client_m;
+extern pthread_cond_t client_cv;
+extern bool log_connections;
+
+/**
+ * Attesa in millisecondi della richiesta successiva prima di cedere la
+ * sessione a `idle_sessions`: un client che invia richieste una dopo l'altra
+ * resta allo stesso lavoratore. Una sessione in modalità push viene ceduta
+ * appena ha inviato gli eventi accodati.
+ */
+#define SESSION_LINGER_MS 20
+
+/**
+ * Tempo in millisecondi per cui un lavoratore serve una sessione di seguito
+ * quando altri task attendono nel pool: poi, tra una richiesta e l'altra, la
+ * rimette in coda nella classe della prossima richiesta. Un client che invia
+ * richieste senza sosta non tiene il lavoratore per sé.
+ */
+#define SESSION_SLICE_MS 5
+
+/** Durata in millisecondi di ogni `session_deadline`; 0 la disattiva. */
+static unsigned deadline_ms[DEADLINE_QUEUE + 1];
+
+/**
+ * @brief Imposta le scadenze delle connessioni, in secondi (0 = nessuna scadenza).
+ */
+void client_set_timeouts(unsigned idle_sec, unsigned request_sec, unsigned write_sec) {
+    deadline_ms[DEADLINE_IDLE] = idle_sec > UINT_MAX / 1000 ? UINT_MAX : idle_sec * 1000;
+    deadline_ms[DEADLINE_REQUEST] = request_sec > UINT_MAX / 1000 ? UINT_MAX : request_sec * 1000;
+    deadline_ms[DEADLINE_WRITE] = write_sec > UINT_MAX / 1000 ? UINT_MAX : write_sec * 1000;
+}
+
+/**
+ * @brief Imposta l'attesa massima, in millisecondi, di una connessione accettata
+ *        prima che un thread del pool la serva (0 = nessun limite).
+ */
+void client_set_queue_timeout(unsigned ms) {
+    deadline_ms[DEADLINE_QUEUE] = ms;
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Invia `BUSY` senza bloccare: se il buffer del socket è pieno il
+ *        client vede solo la chiusura della connessione.
+ */
+static void send_busy(int sock) {
+    packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = BUSY;
+    header.length = 0;
+    send(sock, &header, sizeof(header), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/**
+ * @brief Chiamata dal thread della ruota quando una scadenza della sessione è trascorsa.
+ *
+ * Non tocca la sessione oltre al socket: `shutdown` sblocca le `recv`/`send`
+ * in corso (anche quelle del ring io_uring), e il thread che serve la
+ * connessione la rilascia come per una disconnessione. La sessione non può
+ * essere liberata nel frattempo, perché `client_session_release` annulla il
+ * timer, e attende il lock della ruota, prima di chiudere il socket.
+ */
+static void session_expired(timer_entry* t) {
+    client_session* session = (client_session*)((char*)t - offsetof(client_session, timer));
+    if (t->tag == DEADLINE_QUEUE) {
+        // Nessun thread ha ancora letto dal socket: il client riceve BUSY
+        // come risposta alla sua prima richiesta.
+        send_busy(session->sock);
+    }
+    shutdown(session->sock, SHUT_RDWR);
+    switch (t->tag) {
+        case DEADLINE_IDLE:    stats_add(STAT_TIMEOUTS_IDLE, 1); break;
+        case DEADLINE_REQUEST: stats_add(STAT_TIMEOUTS_REQUEST, 1); break;
+        case DEADLINE_QUEUE:   stats_add(STAT_SHED_QUEUE_TIMEOUT, 1); break;
+        default:               stats_add(STAT_TIMEOUTS_WRITE, 1); break;
+    }
+    if (log_connections) {
+        static const char* const names[] = { "", "inattività", "richiesta", "invio", "attesa in coda" };
+        printf("Timeout di %s: chiudo la connessione.\n", names[t->tag]);
+    }
+}
+
+/**
+ * @brief Alloca una nuova sessione non autenticata per il socket `sock`, sulla bacheca predefinita.
+ *
+ * @return La sessione, o NULL se l'allocazione fallisce.
+ */
+client_session* client_session_create(int sock) {
+    client_session* session = calloc(1, sizeof(client_session));
+    if (!session) return NULL;
+    static atomic_uint next_session = 1;
+    session->id = ((uint64_t)getpid() << 32) | atomic_fetch_add(&next_session, 1);
+    session->sock = sock;
+    session->auth = false;
+    session->board = boards_default();
+    struct sockaddr_storage address;
+    socklen_t addrlen = sizeof(address);
+    if (getpeername(sock, (struct sockaddr*)&address, &addrlen) == 0) {
+        if (address.ss_family == AF_INET) {
+            session->peer_addr = ((struct sockaddr_in*)&address)->sin_addr.s_addr;
+        } else if (address.ss_family == AF_UNIX) {
+            struct ucred cred;
+            socklen_t credlen = sizeof(cred);
+            session->local = true;
+            if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) == 0) {
+                session->peer_pid = cred.pid;
+                session->peer_uid = cred.uid;
+                session->peer_gid = cred.gid;
+            }
+        }
+    }
+    timer_init(&session->timer, session_expired);
+    session->deadline = DEADLINE_NONE;
+    return session;
+}
+
+/**
+ * @brief Scrive in `buf` una descrizione del client per i log.
+ *
+ * `IP:porta` per le connessioni TCP, il processo e l'utente per quelle dal
+ * socket Unix.
+ */
+void client_session_describe(const client_session* session, char* buf, size_t len) {
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+    if (session->local) {
+        snprintf(buf, len, "locale (pid %ld, uid %ld)", (long)session->peer_pid, (long)session->peer_uid);
+    } else if (getpeername(session->sock, (struct sockaddr*)&address, &addrlen) == 0 && address.sin_family == AF_INET) {
+        snprintf(buf, len, "%s:%d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+    } else {
+        snprintf(buf, len, "sconosciuto");
+    }
+}
+
+/**
+ * @brief Crea il subscriber di una sessione ripresa in modalità push.
+ *
+ * Una sessione ricevuta da un hot restart ha `subscribed` ma non ancora un
+ * subscriber in questo processo; gli eventi del restart sono persi, quindi
+ * il primo pacchetto inviato è un `EVENT_RESYNC`.
+ */
+void client_session_resume_push(client_session* session) {
+    if (!session->subscribed || session->sub) return;
+    session->sub = subscriber_create(session->board, session->push_notify, session->push_ctx);
+    if (session->sub) {
+        subscriber_resync(session->sub);
+    } else {
+        session->subscribed = false;
+    }
+}
+
+/**
+ * @brief Arma la scadenza `deadline` della sessione, sostituendo la precedente.
+ *
+ * Una sessione in modalità push non ha scadenza di inattività: il client
+ * attende gli eventi senza inviare nulla.
+ */
+void client_session_deadline(client_session* session, session_deadline deadline) {
+    if (deadline == DEADLINE_IDLE && session->subscribed) {
+        deadline = DEADLINE_NONE;
+    }
+    if (deadline == DEADLINE_NONE || deadline_ms[deadline] == 0) {
+        if (session->deadline != DEADLINE_NONE) {
+            timer_cancel(&session->timer);
+            session->deadline = DEADLINE_NONE;
+        }
+        return;
+    }
+    timer_arm(&session->timer, deadline_ms[deadline], deadline);
+    session->deadline = deadline;
+}
+
+static void write_progress(void* ctx) {
+    client_session_deadline((client_session*)ctx, DEADLINE_WRITE);
+}
+
+/**
+ * @brief Attende la prossima richiesta del client, un evento push o una richiesta di hot restart.
+ *
+ * @param sock Il socket del client.
+ * @param event_fd L'eventfd del subscriber della sessione, o -1.
+ * @param timeout_ms Attesa massima, o -1 per attendere senza limite.
+ * @return 1 se il socket è leggibile, 2 se ci sono eventi push da inviare,
+ *         3 se l'attesa è scaduta, 0 se la sessione va parcheggiata per
+ *         l'handoff, -1 in caso di errore.
+ *
+ * Durante un drain la sessione viene parcheggiata anche se il client ha già
+ * inviato dati: non avendone ancora letto nessuno, la richiesta resta intatta
+ * nel buffer del socket e sarà servita dal nuovo processo.
+ */
+static int wait_for_request(int sock, int event_fd, int timeout_ms) {
+    struct pollfd pfd[3];
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = hot_restart_wake_fd();
+    pfd[1].events = POLLIN;
+    pfd[2].fd = event_fd;
+    pfd[2].events = POLLIN;
+
+    while (1) {
+        pfd[0].revents = 0;
+        pfd[1].revents = 0;
+        pfd[2].revents = 0;
+        int r = poll(pfd, 3, timeout_ms);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (hot_restart_draining()) return 0;
+        if (r == 0) return 3;
+        if (pfd[2].revents != 0) return 2;
+        if (pfd[0].revents != 0) return 1;
+    }
+}
+
+/**
+ * @brief Classe di limitazione di un comando, o -1 se il comando non è limitato.
+ */
+static int request_class(uint8_t type) {
+    switch (type) {
+        case C_REGISTER:
+        case C_LOGIN:
+            return RATE_CLASS_AUTH;
+        case C_GET_BOARD:
+            return RATE_CLASS_READ;
+        case C_POST_MESSAGE:
+        case C_DELETE_MESSAGE:
+        case C_CREATE_BOARD:
+        case C_POST_BATCH:
+        case C_DELETE_BATCH:
+            return RATE_CLASS_WRITE;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Verifica se la sessione può pubblicare un messaggio, prima di riceverne il corpo.
+ *
+ * @return true se il messaggio va ricevuto e pubblicato; altrimenti la
+ *         risposta (`READ_ONLY`, `RATE_LIMITED` o `UNAUTHORIZED`) è già in `out` e il
+ *         corpo va scartato.
+ *
+ * Per i messaggi lunghi i controlli di `handle_request` vengono fatti con
+ * il solo inizio del payload, così un client non autorizzato non fa
+ * allocare megabyte al server. Per lo stesso motivo la cattura del traffico
+ * ne registra solo l'oggetto (`subject`).
+ */
+bool client_post_admit(client_session* session, const packet_header* header, const char* subject, reply* out) {
+    capture_request(session->id, header, subject, (uint32_t)strlen(subject) + 1);
+    if (replication_is_replica()) {
+        reply_status(out, READ_ONLY);
+        return false;
+    }
+    if (!rate_limit_allow(RATE_CLASS_WRITE, session->auth ? session->curr_user : NULL, session->peer_addr)) {
+        stats_add(STAT_RATE_LIMITED, 1);
+        reply_status(out, RATE_LIMITED);
+        return false;
+    }
+    if (!session->auth) {
+        reply_status(out, UNAUTHORIZED);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Pubblica un messaggio ricevuto, cedendo `body` alla bacheca della sessione.
+ */
+void client_post_commit(client_session* session, const char* subject, char* body, reply* out) {
+    add_message_body(session->board, session->curr_user, subject, body);
+    reply_status(out, OK);
+}
 
+/**
+ * @brief Verifica se la sessione può eseguire un lotto, prima di riceverne il payload.
+ *
+ * @return true se il payload va ricevuto ed eseguito con `client_batch_commit`;
+ *         altrimenti la risposta è già in `out` e il payload va scartato.
+ *
+ * Come `client_post_admit`, serve ai lotti più lunghi di `CLIENT_MAX_PAYLOAD`:
+ * la memoria per il payload viene allocata solo per una sessione ammessa. Un
+ * lotto rifiutato viene registrato nella cattura senza payload. Un lotto
+ * conta come una sola richiesta per i limiti di frequenza.
+ */
+bool client_batch_admit(client_session* session, const packet_header* header, reply* out) {
+    if (replication_is_replica()) {
+        reply_status(out, READ_ONLY);
+    } else if (!rate_limit_allow(RATE_CLASS_WRITE, session->auth ? session->curr_user : NULL, session->peer_addr)) {
+        stats_add(STAT_RATE_LIMITED, 1);
+        reply_status(out, RATE_LIMITED);
+    } else if (!session->auth) {
+        reply_status(out, UNAUTHORIZED);
+    } else {
+        return true;
+    }
+    capture_request(session->id, header, NULL, 0);
+    return false;
+}
+
+/**
+ * @brief Esegue un `C_DELETE_BATCH`: payload di ID, risposta di stati.
+ */
+static void run_delete_batch(client_session* session, const char* payload, uint32_t length, reply* out) {
+    size_t n = length / sizeof(uint32_t);
+    if (length % sizeof(uint32_t) != 0 || n == 0 || n > BATCH_MAX_ITEMS) {
+        reply_status(out, ERROR);
+        return;
+    }
+    uint32_t* ids = malloc(n * (sizeof(uint32_t) + sizeof(int) + 1));
+    if (!ids) {
+        reply_status(out, ERROR);
+        return;
+    }
+    int* results = (int*)(ids + n);
+    uint8_t* statuses = (uint8_t*)(results + n);
+    memcpy(ids, payload, n * sizeof(uint32_t));
+
+    message_store_delete_batch(session->board, ids, n, session->curr_user, results);
+    for (size_t i = 0; i < n; i++) {
+        statuses[i] = results[i] == 0 ? OK : results[i] == -1 ? UNAUTHORIZED : NOT_FOUND;
+    }
+    reply_frame(out, OK, statuses, (uint32_t)n);
+    stats_add(STAT_BATCHES, 1);
+    stats_add(STAT_BATCH_ITEMS, n);
+    free(ids);
+}
+
+/**
+ * @brief Esegue un `C_POST_BATCH`: payload di record "oggetto\0corpo\0", risposta
+ *        con il primo ID e uno stato per record.
+ *
+ * Un payload che non si divide in record interi viene rifiutato per intero
+ * con `ERROR`; un record con il corpo vuoto ha stato `ERROR` (come
+ * `C_POST_MESSAGE`) ma consuma comunque il proprio ID.
+ */
+static void run_post_batch(client_session* session, const char* payload, uint32_t length, reply* out) {
+    const char* end = payload + length;
+    size_t n = 0;
+    for (const char* p = payload; p < end; n++) {
+        const char* subject_end = memchr(p, '\0', end - p);
+        const char* body_end = subject_end ? memchr(subject_end + 1, '\0', end - subject_end - 1) : NULL;
+        if (!body_end || n == BATCH_MAX_ITEMS) {
+            reply_status(out, ERROR);
+            return;
+        }
+        p = body_end + 1;
+    }
+    if (n == 0) {
+        reply_status(out, ERROR);
+        return;
+    }
+
+    const char** subjects = malloc(n * (2 * sizeof(char*) + sizeof(int) + 1));
+    if (!subjects) {
+        reply_status(out, ERROR);
+        return;
+    }
+    char** bodies = (char**)(subjects + n);
+    int* results = (int*)(bodies + n);
+    uint8_t* statuses = (uint8_t*)(results + n);
+    const char* p = payload;
+    for (size_t i = 0; i < n; i++) {
+        subjects[i] = p;
+        const char* body = p + strlen(p) + 1;
+        size_t body_len = strlen(body);
+        bodies[i] = body_len > 0 ? message_body_alloc(body_len) : NULL;
+        if (bodies[i]) memcpy(bodies[i], body, body_len);
+        p = body + body_len + 1;
+    }
+
+    uint32_t first_id = message_store_add_batch(session->board, session->curr_user, subjects, bodies, n, results);
+    for (size_t i = 0; i < n; i++) {
+        statuses[i] = results[i] == 0 ? OK : ERROR;
+    }
+    reply_frame_begin(out, OK, (uint32_t)(sizeof(first_id) + n));
+    reply_bytes(out, &first_id, sizeof(first_id));
+    reply_bytes(out, statuses, n);
+    stats_add(STAT_BATCHES, 1);
+    stats_add(STAT_BATCH_ITEMS, n);
+    free(subjects);
+}
+
+/**
+ * @brief Esegue un lotto ammesso da `client_batch_admit`, ricevuto per intero in `payload`.
+ */
+void client_batch_commit(client_session* session, const packet_header* header, const char* payload, reply* out) {
+    capture_request(session->id, header, payload, header->length);
+    if (header->type == C_POST_BATCH) {
+        run_post_batch(session, payload, header->length, out);
+    } else {
+        run_delete_batch(session, payload, header->length, out);
+    }
+}
+
+/**
+ * @brief Esegue una richiesta già ricevuta per intero.
+ *
+ * @param session La sessione del client (stato di autenticazione).
+ * @param header L'header della richiesta.
+ * @param buffer Il payload, lungo `header->length` byte e seguito da un `\0`.
+ * @param out La risposta in cui accodare i pacchetti da inviare.
+ *
+ * Utilizza uno `switch` sul `header.type` per determinare l'azione richiesta dal
+ * client: registrazione, login, invio/lettura/cancellazione messaggi, logout.
+ * Non esegue I/O sul socket: è condivisa tra il ciclo bloccante di
+ * `handle_client` e il backend io_uring. Prima di eseguirla verifica i limiti
+ * di frequenza della sua classe e, se superati, risponde `RATE_LIMITED`. Una
+ * replica rifiuta le scritture con `READ_ONLY`: vanno inviate al primario.
+ */
+void handle_request(client_session* session, const packet_header* header, char* buffer, reply* out) {
+    capture_request(session->id, header, buffer, header->length);
+    if (replication_is_replica() && (header->type == C_REGISTER || header->type == C_POST_MESSAGE ||
+                                     header->type == C_DELETE_MESSAGE || header->type == C_CREATE_BOARD ||
+                                     header->type == C_POST_BATCH || header->type == C_DELETE_BATCH)) {
+        reply_status(out, READ_ONLY);
+        return;
+    }
+    int cls = request_class(header->type);
+    if (cls >= 0 && !rate_limit_allow(cls, session->auth ? session->curr_user : NULL, session->peer_addr)) {
+        stats_add(STAT_RATE_LIMITED, 1);
+        reply_status(out, RATE_LIMITED);
+        return;
+    }
+
+    switch (header->type) {
+        case C_REGISTER: 
+        case C_LOGIN: {
+            // Estrae username e password dal payload.
+            // Il formato atteso è "username\0password\0".
+            char* user = buffer;
+            char* pass = (char*)memchr(buffer, '\0', header->length);
+
+            if (pass && (pass + 1 < buffer + header->length)) {
+                pass++; // Salta il terminatore nullo dell'username
+                if (header->type == C_REGISTER) {
+                    if (register_user(user, pass)) {
+                        reply_status(out, REG_SUCCESS);
+                    } else {
+                        reply_status(out, REG_USER_EXISTS);
+                    }
+                } else { // C_LOGIN
+                    if (authenticate_user(user, pass)) {
+                        session->auth = true;
+                        strncpy(session->curr_user, user, sizeof(session->curr_user) - 1);
+                        session->curr_user[sizeof(session->curr_user) - 1] = '\0';
+                        reply_status(out, AUTH_SUCCESS);
+                    } else {
+                        reply_status(out, AUTH_FAILURE);
+                    }
+                }
+            } else {
+                reply_status(out, ERROR);
+            }
+            break;
+        }
+
+        case C_GET_BOARD:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            // Un payload di 8 byte è la versione della bacheca in cache nel client.
+            if (header->length == sizeof(uint64_t)) {
+                uint64_t known_version;
+                memcpy(&known_version, buffer, sizeof(known_version));
+                get_board(session->board, out, &known_version);
+            } else {
+                get_board(session->board, out, NULL);
+            }
+            break;
+
+        case C_POST_MESSAGE:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            // Estrae oggetto e corpo dal payload.
+            // Il formato atteso è "oggetto\0corpo".
+            char* subject = buffer;
+            char* body = (char*)memchr(buffer, '\0', header->length);
+            if (body && (body + 1 < buffer + header->length)) {
+                body++;
+                size_t body_len = buffer + header->length - body;
+                char* copy = message_body_alloc(body_len);
+                if (!copy) {
+                    reply_status(out, ERROR);
+                    break;
+                }
+                memcpy(copy, body, body_len);
+                client_post_commit(session, subject, copy, out);
+            } else {
+                reply_status(out, ERROR);
+            }
+            break;
+
+        case C_DELETE_MESSAGE:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            if (header->length != sizeof(uint32_t)) {
+                reply_status(out, ERROR);
+                break;
+            }
+            uint32_t message_id;
+            memcpy(&message_id, buffer, sizeof(uint32_t));
+
+            int delete_res = delete_message(session->board, message_id, session->curr_user);
+            if (delete_res == 0) { // Successo
+                reply_status(out, OK);
+            } else if (delete_res == -1) { // Non autorizzato
+                reply_status(out, UNAUTHORIZED);
+            } else { // Non trovato o altro errore
+                reply_status(out, NOT_FOUND);
+            }
+            break;
+            
+        case C_POST_BATCH:
+        case C_DELETE_BATCH:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+            } else if (header->type == C_POST_BATCH) {
+                run_post_batch(session, buffer, header->length, out);
+            } else {
+                run_delete_batch(session, buffer, header->length, out);
+            }
+            break;
+
+        case C_STATS: {
+            char stats_buffer[4096];
+            size_t stats_len = stats_format(stats_buffer, sizeof(stats_buffer));
+            reply_frame(out, OK, stats_buffer, stats_len);
+            break;
+        }
+
+        case C_SUBSCRIBE:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            // Il subscriber viene creato prima di accodare l'OK: nessun
+            // evento successivo alla risposta va perso, e nessuno la precede.
+            if (!session->sub) {
+                session->sub = subscriber_create(session->board, session->push_notify, session->push_ctx);
+            }
+            session->subscribed = session->sub != NULL;
+            reply_status(out, session->subscribed ? OK : ERROR);
+            break;
+
+        case C_REPLICATE:
+            // Come C_SUBSCRIBE, ma senza login: l'accesso è deciso dal
+            // primario con --allow-replicas. Il subscriber esiste prima della
+            // copia, quindi nessuna modifica successiva va persa. Si replica
+            // solo la bacheca predefinita.
+            if (!replication_allowed()) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            session->board = boards_default();
+            if (session->sub) {
+                subscriber_set_board(session->sub, session->board);
+            }
+            if (!session->sub) {
+                session->sub = subscriber_create(session->board, session->push_notify, session->push_ctx);
+            }
+            session->subscribed = session->sub != NULL;
+            if (!session->subscribed) {
+                reply_status(out, ERROR);
+                break;
+            }
+            subscriber_set_replica(session->sub);
+            reply_status(out, OK);
+            replication_snapshot(out);
+            break;
+
+        case C_CREATE_BOARD:
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            if (header->length == 0 || buffer[header->length - 1] != '\0') {
+                reply_status(out, ERROR);
+                break;
+            }
+            switch (boards_create(buffer)) {
+                case 0:  reply_status(out, OK); break;
+                case -1: reply_status(out, BOARD_EXISTS); break;
+                default: reply_status(out, ERROR); break;
+            }
+            break;
+
+        case C_LIST_BOARDS: {
+            if (!session->auth) {
+                reply_status(out, UNAUTHORIZED);
+                break;
+            }
+            size_t list_len;
+            char* list = boards_list(&list_len);
+            if (!list) {
+                reply_status(out, ERROR);
+                break;
+            }
+            reply_frame(out, OK, list, (uint32_t)list_len);
+            free(list);
+            break;
+        }
+
+        case C_JOIN_BOARD: {
+            // Come la bacheca predefinita, anche le altre si possono
+            // scegliere prima del login: i comandi che le usano lo richiedono.
+            if (header->length == 0 || buffer[header->length - 1] != '\0') {
+                reply_status(out, ERROR);
+                break;
+            }
+            message_store* board = boards_open(buffer);
+            if (!board) {
+                reply_status(out, NOT_FOUND);
+                break;
+            }
+            session->board = board;
+            if (session->sub) {
+                subscriber_set_board(session->sub, board);
+            }
+            reply_status(out, OK);
+            break;
+        }
+
+        case C_UNSUBSCRIBE:
+            if (session->sub) {
+                subscriber_destroy(session->sub);
+                session->sub = NULL;
+            }
+            session->subscribed = false;
+            reply_status(out, OK);
+            break;
+
+        case C_LOGOUT:
+            if (session->sub) {
+                subscriber_destroy(session->sub);
+                session->sub = NULL;
+            }
+            session->subscribed = false;
+            session->auth = false;
+            memset(session->curr_user, 0, sizeof(session->curr_user));
+            reply_status(out, OK);
+            break;
+        
+        default:
+            reply_status(out, ERROR);
+            break;
+    }
+}
+
+/**
+ * @brief Chiude (o parcheggia per l'hot restart) una sessione e aggiorna il contatore dei client attivi.
+ *
+ * @param session La sessione, che viene liberata o ceduta a `hot_restart_park`.
+ * @param parked true se la sessione va passata al nuovo processo.
+ */
+void client_session_release(client_session* session, bool parked) {
+    timer_cancel(&session->timer);
+    session->deadline = DEADLINE_NONE;
+    if (session->sub) {
+        subscriber_destroy(session->sub);
+        session->sub = NULL;
+    }
+    if (parked) {
+        hot_restart_park(session);
+    } else {
+        capture_connection_closed(session->id);
+        close(session->sock);
+        free(session);
+    }
+
+    int count = atomic_fetch_sub(&active_client_count, 1) - 1;
+    if (hot_restart_draining()) {
+        // Il thread principale attende che i client attivi scendano a 0.
+        PROF_LOCK(&client_m, LOCK_CLIENTS);
+        pthread_cond_broadcast(&client_cv);
+        PROF_UNLOCK(&client_m);
+    }
+    if (!parked && log_connections) {
+        printf("Client disconnesso. Client attivi: %d\n", count);
+    }
+}
+
+/**
+ * @brief Sceglie la classe del task che servirà la sessione nel pool.
+ *
+ * Una sessione in modalità push, o la cui prima richiesta (letta con
+ * `MSG_PEEK`, senza attendere) è una lettura della bacheca, delle
+ * statistiche o una replica, va tra le letture; le altre, comprese quelle
+ * che non hanno ancora inviato nulla, sono interattive. Viene chiamata
+ * all'accept e a ogni ritorno della sessione da `idle_sessions`, quindi la
+ * classe segue la richiesta che ha risvegliato la sessione.
+ */
+task_class client_session_task_class(const client_session* session) {
+    if (session->subscribed) {
+        return TASK_BULK;
+    }
+    packet_header header;
+    ssize_t n = recv(session->sock, &header, sizeof(header), MSG_PEEK | MSG_DONTWAIT);
+    if (n != (ssize_t)sizeof(header)) {
+        return TASK_INTERACTIVE;
+    }
+    switch (header.type) {
+        case C_GET_BOARD:
+        case C_STATS:
+        case C_SUBSCRIBE:
+        case C_REPLICATE:
+        case C_LIST_BOARDS:
+            return TASK_BULK;
+        default:
+            return TASK_INTERACTIVE;
+    }
+}
+
+/**
+ * @brief Rifiuta una sessione che il pool non può accodare: invia `BUSY` e la chiude.
+ *
+ * @param session_ptr La sessione (`client_session*`), di cui diventa proprietaria.
+ *
+ * È la funzione di rifiuto dei pool del server (`thread_pool_set_limit`),
+ * chiamata quando la coda ha raggiunto il livello di guardia, e viene usata
+ * anche dal backend io_uring quando le connessioni sono esaurite.
+ */
+void client_session_reject(void* session_ptr) {
+    client_session* session = (client_session*)session_ptr;
+    send_busy(session->sock);
+    stats_add(STAT_SHED_QUEUE_FULL, 1);
+    if (log_connections) {
+        printf("Server occupato: rifiuto il client.\n");
+    }
+    client_session_release(session, false);
+}
+
+/**
+ * @brief Riceve ed esegue un `C_POST_MESSAGE` più lungo di `CLIENT_MAX_PAYLOAD`.
+ *
+ * @param buffer Buffer di `CLIENT_MAX_PAYLOAD` byte per l'inizio del payload.
+ * @return 0 se la risposta è in `out`, -1 se la connessione va chiusa.
+ *
+ * Legge l'oggetto con l'inizio del payload, poi riceve il corpo a pezzi
+ * direttamente nella memoria che la bacheca terrà, riarmando la scadenza
+ * della richiesta a ogni pezzo: un corpo di megabyte non passa da buffer
+ * intermedi. Se il messaggio non è ammesso il corpo viene letto e scartato.
+ */
+static int recv_large_post(client_session* session, const packet_header* header, char* buffer, reply* out) {
+    size_t head = CLIENT_MAX_PAYLOAD - 1;
+    if (recv_all(session->sock, buffer, head) != 0) return -1;
+    buffer[head] = '\0';
+    char* subject_end = memchr(buffer, '\0', head);
+    if (!subject_end) return -1;
+
+    size_t body_off = subject_end + 1 - buffer;
+    size_t body_len = header->length - body_off;
+    size_t have = head - body_off;
+    char* body = NULL;
+    if (client_post_admit(session, header, buffer, out)) {
+        body = message_body_alloc(body_len);
+        if (!body) reply_status(out, ERROR);
+    }
+    if (body) memcpy(body, subject_end + 1, have);
+
+    while (have < body_len) {
+        size_t n = body_len - have;
+        if (body && n > REPLY_CHUNK_SIZE) n = REPLY_CHUNK_SIZE;
+        if (!body && n > head) n = head;
+        client_session_deadline(session, DEADLINE_REQUEST);
+        if (recv_all(session->sock, body ? body + have : buffer, n) != 0) {
+            message_body_release(body);
+            return -1;
+        }
+        have += n;
+    }
+    if (body) client_post_commit(session, buffer, body, out);
+    return 0;
+}
+
+/**
+ * @brief Riceve ed esegue un lotto più lungo di `CLIENT_MAX_PAYLOAD` (fino a `BATCH_MAX_LENGTH`).
+ *
+ * Il payload viene ricevuto a pezzi in memoria allocata, riarmando la
+ * scadenza della richiesta a ogni pezzo; se il lotto non è ammesso viene
+ * letto nel buffer della connessione e scartato.
+ */
+static int recv_large_batch(client_session* session, const packet_header* header, char* buffer, reply* out) {
+    char* payload = NULL;
+    if (client_batch_admit(session, header, out)) {
+        payload = malloc(header->length + 1);
+        if (!payload) reply_status(out, ERROR);
+    }
+    size_t have = 0;
+    while (have < header->length) {
+        size_t n = header->length - have;
+        if (payload && n > REPLY_CHUNK_SIZE) n = REPLY_CHUNK_SIZE;
+        if (!payload && n > CLIENT_MAX_PAYLOAD) n = CLIENT_MAX_PAYLOAD;
+        client_session_deadline(session, DEADLINE_REQUEST);
+        if (recv_all(session->sock, payload ? payload + have : buffer, n) != 0) {
+            free(payload);
+            return -1;
+        }
+        have += n;
+    }
+    if (payload) {
+        payload[header->length] = '\0';
+        client_batch_commit(session, header, payload, out);
+        free(payload);
+    }
+    return 0;
+}
 
 /**
  * @brief Funzione eseguita da ogni thread per gestire un singolo client.
  * 
- * @param client_socket_ptr Puntatore al file descriptor del socket del client.
+ * @param session_ptr Puntatore alla `client_session` del client (viene liberata qui).
  * @return NULL
  * 
  * Questa è la funzione principale per l'interazione con un client. Opera in un ciclo,
@@ -27,25 +859,96 @@ extern pthread_mutex_t client_m;
  * 1. Attende la ricezione di un `packet_header` usando `recv_all` per garantire
  *    la lettura completa dell'header.
  * 2. Se l'header indica la presenza di un payload (`header.length > 0`), legge
- *    l'intero payload in un buffer.
- * 3. Utilizza uno `switch` sul `header.type` per determinare l'azione richiesta dal client.
- * 4. Gestisce la logica per ogni tipo di richiesta (registrazione, login, invio/lettura/cancellazione
- *    messaggi, logout), mantenendo lo stato di autenticazione del client.
- * 5. Invia risposte di stato appropriate al client.
+ *    l'intero payload in un buffer; un messaggio o un lotto più lungo del
+ *    buffer viene ricevuto da `recv_large_post` o `recv_large_batch`.
+ * 3. Esegue la richiesta con `handle_request` e invia la risposta accumulata.
+ *
+ * In modalità push (`C_SUBSCRIBE`) il ciclo attende anche l'eventfd del
+ * subscriber e invia gli eventi accodati; il client può continuare a inviare
+ * richieste, le cui risposte si alternano agli eventi.
+ *
+ * Ogni fase del ciclo arma la propria scadenza (`client_session_deadline`):
+ * un client inattivo, lento a inviare una richiesta o che smette di leggere
+ * le risposte non trattiene il thread del pool oltre il timeout configurato.
+ * Una sessione senza richieste da servire per `SESSION_LINGER_MS` (subito
+ * in modalità push, al più fino alla fine della sua parte di tempo se altri
+ * task attendono nel pool) viene ceduta a
+ * `idle_sessions`, che la rimette in coda nel pool alla prossima richiesta o
+ * al prossimo evento: il task termina senza rilasciarla. Allo stesso modo,
+ * dopo `SESSION_SLICE_MS` con altri task in attesa la sessione torna in coda
+ * tra una richiesta e l'altra.
  * 
  * La funzione termina quando `recv_all` fallisce (es. il client si disconnette),
  * chiude il socket, e decrementa il contatore globale dei client attivi in modo thread-safe.
+ * Se è in corso un hot restart, la sessione viene invece parcheggiata tra una
+ * richiesta e l'altra senza chiudere il socket, per essere passata al nuovo processo.
  */
-void* handle_client(void* client_socket_ptr) { 
-    int sock = *(int*)client_socket_ptr;
-    free(client_socket_ptr);
+void* handle_client(void* session_ptr) { 
+    client_session* session = (client_session*)session_ptr;
+    int sock = session->sock;
 
-    char buffer[2048] = {0};
+    char buffer[CLIENT_MAX_PAYLOAD] = {0};
     packet_header header;
-    bool auth = false;
-    char curr_user[MAX_USERNAME_LEN] = {0}; 
+    bool parked = false;
+    reply out;
+
+    session->push_notify = NULL;
+    session->push_ctx = NULL;
+    client_session_resume_push(session);
+    uint64_t slice_end = monotonic_ms() + SESSION_SLICE_MS;
+
+    while (1) {
+        client_session_deadline(session, DEADLINE_IDLE);
+        int linger = session->sub ? 0 : SESSION_LINGER_MS;
+        if (thread_pool_contended(session->pool)) {
+            uint64_t now = monotonic_ms();
+            if (now >= slice_end) {
+                // Da qui la sessione appartiene al lavoratore che la riprenderà;
+                // se la coda si è appena riempita il pool la chiude con BUSY.
+                add_task_class(session->pool, client_session_task_class(session), handle_client, session);
+                return NULL;
+            }
+            if (linger > (int)(slice_end - now)) linger = (int)(slice_end - now);
+        }
+        int event_fd = session->sub ? subscriber_fd(session->sub) : -1;
+        int ready = wait_for_request(sock, event_fd, linger);
+        if (ready == 3) {
+            if (idle_sessions_hold(session)) return NULL;
+            ready = wait_for_request(sock, event_fd, -1);
+        }
+        if (ready == 0) {
+            parked = true;
+            break;
+        }
+        if (ready == 2) {
+            client_session_deadline(session, DEADLINE_WRITE);
+            reply_init(&out, sock);
+            reply_on_progress(&out, write_progress, session);
+            subscriber_drain(session->sub, &out);
+            if (reply_flush(&out) < 0) break;
+            continue;
+        }
+        client_session_deadline(session, DEADLINE_REQUEST);
+        if (ready < 0 || recv_all(sock, &header, sizeof(header)) != 0) break;
+
+        bool large_post = header.type == C_POST_MESSAGE && header.length >= sizeof(buffer) &&
+                          header.length <= CLIENT_MAX_POST;
+        bool large_batch = (header.type == C_POST_BATCH || header.type == C_DELETE_BATCH) &&
+                           header.length >= sizeof(buffer) && header.length <= BATCH_MAX_LENGTH;
+        if (large_post || large_batch) {
+            reply_init(&out, sock);
+            reply_on_progress(&out, write_progress, session);
+            int received = large_post ? recv_large_post(session, &header, buffer, &out)
+                                      : recv_large_batch(session, &header, buffer, &out);
+            if (received != 0) {
+                reply_free_chunks(reply_take(&out));
+                break;
+            }
+            client_session_deadline(session, DEADLINE_WRITE);
+            if (reply_flush(&out) < 0) break;
+            continue;
+        }
 
-    while (recv_all(sock, &header, sizeof(header)) == 0) {
         memset(buffer, 0, sizeof(buffer));
         if (header.length > 0) {
             if (header.length >= sizeof(buffer)) {
@@ -56,104 +959,13 @@ void* handle_client(void* client_socket_ptr) {
             }
         }
 
-        switch (header.type) {
-            case C_REGISTER: 
-            case C_LOGIN: {
-                // Estrae username e password dal payload.
-                // Il formato atteso è "username\0password\0".
-                char* user = buffer;
-                char* pass = (char*)memchr(buffer, '\0', header.length);
-
-                if (pass && (pass + 1 < buffer + header.length)) {
-                    pass++; // Salta il terminatore nullo dell'username
-                    if (header.type == C_REGISTER) {
-                        if (register_user(user, pass)) {
-                            status(sock, REG_SUCCESS);
-                        } else {
-                            status(sock, REG_USER_EXISTS);
-                        }
-                    } else { // C_LOGIN
-                        if (authenticate_user(user, pass)) {
-                            auth = true;
-                            strncpy(curr_user, user, sizeof(curr_user) - 1);
-                            curr_user[sizeof(curr_user) - 1] = '\0';
-                            status(sock, AUTH_SUCCESS);
-                        } else {
-                            status(sock, AUTH_FAILURE);
-                        }
-                    }
-                } else {
-                    status(sock, ERROR);
-                }
-                break;
-            }
-
-            case C_GET_BOARD:
-                if (!auth) {
-                    status(sock, UNAUTHORIZED);
-                    break;
-                }
-                get_board(sock);
-                break;
-
-            case C_POST_MESSAGE:
-                if (!auth) {
-                    status(sock, UNAUTHORIZED);
-                    break;
-                }
-                // Estrae oggetto e corpo dal payload.
-                // Il formato atteso è "oggetto\0corpo".
-                char* subject = buffer;
-                char* body = (char*)memchr(buffer, '\0', header.length);
-                if (body && (body + 1 < buffer + header.length)) {
-                    body++;
-                    add_message(curr_user, subject, body);
-                    status(sock, OK);
-                } else {
-                    status(sock, ERROR);
-                }
-                break;
-
-            case C_DELETE_MESSAGE:
-                if (!auth) {
-                    status(sock, UNAUTHORIZED);
-                    break;
-                }
-                if (header.length != sizeof(uint32_t)) {
-                    status(sock, ERROR);
-                    break;
-                }
-                uint32_t message_id;
-                memcpy(&message_id, buffer, sizeof(uint32_t));
-
-                int delete_res = delete_message(message_id, curr_user);
-                if (delete_res == 0) { // Successo
-                    status(sock, OK);
-                } else if (delete_res == -1) { // Non autorizzato
-                    status(sock, UNAUTHORIZED);
-                } else { // Non trovato o altro errore
-                    status(sock, NOT_FOUND);
-                }
-                break;
-                
-            case C_LOGOUT:
-                auth = false;
-                memset(curr_user, 0, sizeof(curr_user));
-                status(sock, OK);
-                break;
-            
-            default:
-                status(sock, ERROR);
-                break;
-        }
+        client_session_deadline(session, DEADLINE_WRITE);
+        reply_init(&out, sock);
+        reply_on_progress(&out, write_progress, session);
+        handle_request(session, &header, buffer, &out);
+        if (reply_flush(&out) < 0) break;
     }
 
-    close(sock);
-    pthread_mutex_lock(&client_m);
-    active_client_count--;
-    int count = active_client_count;
-    pthread_mutex_unlock(&client_m);
-    printf("Client disconnesso. Client attivi: %d\n", count);
-    
+    client_session_release(session, parked);
     return NULL; 
-}
\ No newline at end of file
+}
@@ -1,6 +1,96 @@
 #ifndef CLIENT_HANDLER_H
 #define CLIENT_HANDLER_H
 
-void* handle_client(void* client_socket_ptr);
+#include <stdbool.h>
+#include "../common/common.h"
+#include "../common/protocol.h"
+#include "message_store.h"
+#include "reply.h"
+#include "subscriptions.h"
+#include "timer_wheel.h"
 
-#endif // CLIENT_HANDLER_H
\ No newline at end of file
+/** Dimensione massima (esclusa) del payload di una richiesta. */
+#define CLIENT_MAX_PAYLOAD 2048
+
+/**
+ * Dimensione massima del payload di un `C_POST_MESSAGE`. Oltre
+ * `CLIENT_MAX_PAYLOAD` il corpo viene ricevuto a pezzi direttamente nella
+ * sua memoria definitiva (`message_body_alloc`); l'oggetto deve comunque
+ * terminare entro i primi `CLIENT_MAX_PAYLOAD - 1` byte.
+ */
+#define CLIENT_MAX_POST (8 * 1024 * 1024)
+
+/**
+ * Scadenze di una connessione, tracciate da un solo timer per sessione:
+ * attesa della prossima richiesta, ricezione di una richiesta iniziata,
+ * invio della risposta (riarmata a ogni blocco inviato, quindi misura lo
+ * stallo e non la durata totale) e attesa di un thread del pool dopo
+ * l'accept. Alla scadenza il socket viene chiuso con `shutdown` e il backend
+ * rilascia la sessione come per una disconnessione; se la sessione era
+ * ancora in coda il client riceve prima `BUSY`.
+ */
+typedef enum {
+    DEADLINE_NONE,
+    DEADLINE_IDLE,
+    DEADLINE_REQUEST,
+    DEADLINE_WRITE,
+    DEADLINE_QUEUE
+} session_deadline;
+
+/**
+ * Stato di una connessione client. Viene allocato dal server all'accept (o
+ * ricevuto dal processo precedente durante un hot restart) e passato come
+ * argomento del task a `handle_client`, che ne diventa proprietario.
+ *
+ * `board` è la bacheca su cui lavora la connessione (`C_JOIN_BOARD`).
+ * `subscribed` è lo stato della modalità push e sopravvive a un hot restart;
+ * `sub` è il subscriber che la realizza nel processo corrente, creato con
+ * `push_notify`/`push_ctx` impostati dal backend che serve la connessione.
+ * `deadline` è la scadenza armata in `timer`, letta e scritta solo dal
+ * thread che serve la sessione (o, prima di accodarla, da quello di accept). `peer_addr` è l'indirizzo IPv4 del client
+ * (ordine di rete, 0 se sconosciuto), usato dai limiti per indirizzo.
+ * `local` indica una connessione dal socket Unix (`--unix`): `peer_pid`,
+ * `peer_uid` e `peer_gid` sono allora le credenziali del processo client
+ * (`SO_PEERCRED`), disponibili per le decisioni di accesso.
+ * `id` identifica la connessione nella cattura del traffico e sopravvive a
+ * un hot restart. `pool` è il pool del backend bloccante in cui la sessione
+ * torna dopo un'attesa fuori dal pool (`idle_sessions_hold`) o alla fine
+ * della sua parte di tempo.
+ */
+typedef struct client_session {
+    uint64_t id;
+    int sock;
+    uint32_t peer_addr;
+    bool local;
+    pid_t peer_pid;
+    uid_t peer_uid;
+    gid_t peer_gid;
+    bool auth;
+    char curr_user[MAX_USERNAME_LEN];
+    message_store* board;
+    bool subscribed;
+    subscriber* sub;
+    void (*push_notify)(void* ctx);
+    void* push_ctx;
+    timer_entry timer;
+    session_deadline deadline;
+    thread_pool* pool;
+} client_session;
+
+client_session* client_session_create(int sock);
+void client_session_describe(const client_session* session, char* buf, size_t len);
+void client_session_release(client_session* session, bool parked);
+void client_session_resume_push(client_session* session);
+void client_session_deadline(client_session* session, session_deadline deadline);
+void client_set_timeouts(unsigned idle_sec, unsigned request_sec, unsigned write_sec);
+void client_set_queue_timeout(unsigned ms);
+void client_session_reject(void* session_ptr);
+task_class client_session_task_class(const client_session* session);
+bool client_post_admit(client_session* session, const packet_header* header, const char* subject, reply* out);
+void client_post_commit(client_session* session, const char* subject, char* body, reply* out);
+bool client_batch_admit(client_session* session, const packet_header* header, reply* out);
+void client_batch_commit(client_session* session, const packet_header* header, const char* payload, reply* out);
+void handle_request(client_session* session, const packet_header* header, char* buffer, reply* out);
+void* handle_client(void* session_ptr);
+
+#endif // CLIENT_HANDLER_H
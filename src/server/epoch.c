@@ -0,0 +1,170 @@
+#include "epoch.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define EPOCH_MAX_THREADS 256
+#define EPOCH_RECLAIM_EVERY 64
+
+/**
+ * Lo slot di un thread lettore: l'epoca letta all'ingresso nella sezione in
+ * corso, 0 fuori da una sezione. Preso alla prima sezione del thread e
+ * restituito alla sua uscita (`slot_key`).
+ */
+typedef struct epoch_slot {
+    _Atomic uint64_t epoch;
+    atomic_bool used;
+} __attribute__((aligned(64))) epoch_slot;
+
+/** Un oggetto ritirato all'epoca `epoch`, in attesa di `release`. */
+typedef struct retired {
+    void (*release)(void* ptr);
+    void* ptr;
+    uint64_t epoch;
+} retired;
+
+static epoch_slot slots[EPOCH_MAX_THREADS];
+static _Atomic uint64_t global_epoch = 1;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static __thread epoch_slot* thread_slot = NULL;
+
+static pthread_mutex_t limbo_m = PTHREAD_MUTEX_INITIALIZER;
+static retired* limbo = NULL;
+static size_t limbo_len = 0;
+static size_t limbo_cap = 0;
+static size_t since_reclaim = 0;
+static _Atomic size_t limbo_pending = 0;
+
+static void slot_free(void* arg) {
+    epoch_slot* slot = (epoch_slot*)arg;
+    atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+    atomic_store_explicit(&slot->used, false, memory_order_release);
+}
+
+static void make_key(void) {
+    pthread_key_create(&slot_key, slot_free);
+}
+
+static epoch_slot* claim_slot(void) {
+    pthread_once(&key_once, make_key);
+    for (size_t i = 0; i < EPOCH_MAX_THREADS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&slots[i].used, &expected, true)) {
+            pthread_setspecific(slot_key, &slots[i]);
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Epoca più vecchia tra le sezioni in corso, UINT64_MAX se non ce ne sono.
+ *
+ * La barriera accoppia quella di `epoch_enter`: o lo scrittore vede lo slot
+ * del lettore, o il lettore vede la shard già senza l'oggetto ritirato.
+ */
+static uint64_t oldest_reader(void) {
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < EPOCH_MAX_THREADS; i++) {
+        uint64_t e = atomic_load_explicit(&slots[i].epoch, memory_order_acquire);
+        if (e != 0 && e < oldest) oldest = e;
+    }
+    return oldest;
+}
+
+/**
+ * @brief Rilascia gli oggetti ritirati prima dell'inizio di ogni sezione in corso.
+ *
+ * Va chiamata con `limbo_m` acquisito; `release` non deve ritirare altro.
+ */
+static void reclaim_locked(uint64_t oldest) {
+    size_t kept = 0;
+    for (size_t i = 0; i < limbo_len; i++) {
+        if (limbo[i].epoch < oldest) {
+            limbo[i].release(limbo[i].ptr);
+        } else {
+            limbo[kept++] = limbo[i];
+        }
+    }
+    limbo_len = kept;
+    since_reclaim = 0;
+    atomic_store_explicit(&limbo_pending, kept, memory_order_relaxed);
+}
+
+/**
+ * @brief Apre una sezione di lettura.
+ *
+ * @return true se la sezione è aperta; false se tutti gli slot sono in uso,
+ *         e il chiamante deve leggere sotto il lock.
+ */
+bool epoch_enter(void) {
+    if (!thread_slot) {
+        thread_slot = claim_slot();
+        if (!thread_slot) return false;
+    }
+    atomic_store_explicit(&thread_slot->epoch, atomic_load(&global_epoch), memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    return true;
+}
+
+/**
+ * @brief Chiude la sezione aperta da `epoch_enter`.
+ *
+ * Se ci sono oggetti in attesa prova a rilasciarli, senza attendere un altro
+ * thread che lo stia già facendo: una lettura lunga non li trattiene oltre
+ * la propria fine anche se non arrivano altri ritiri.
+ */
+void epoch_exit(void) {
+    atomic_store_explicit(&thread_slot->epoch, 0, memory_order_release);
+    if (atomic_load_explicit(&limbo_pending, memory_order_relaxed) == 0) return;
+    if (pthread_mutex_trylock(&limbo_m) != 0) return;
+    reclaim_locked(oldest_reader());
+    pthread_mutex_unlock(&limbo_m);
+}
+
+/**
+ * @brief Chiama `release(ptr)` quando nessuna sezione iniziata prima è ancora in corso.
+ *
+ * Va chiamata dopo aver tolto `ptr` dalla struttura letta senza lock. Se
+ * manca memoria per la lista d'attesa, attende la fine delle sezioni in
+ * corso e rilascia subito.
+ */
+void epoch_retire(void (*release)(void* ptr), void* ptr) {
+    uint64_t epoch = atomic_fetch_add(&global_epoch, 1);
+    pthread_mutex_lock(&limbo_m);
+    if (limbo_len == limbo_cap) {
+        size_t cap = limbo_cap ? limbo_cap * 2 : 256;
+        retired* grown = realloc(limbo, cap * sizeof(retired));
+        if (!grown) {
+            pthread_mutex_unlock(&limbo_m);
+            while (oldest_reader() <= epoch) sched_yield();
+            release(ptr);
+            return;
+        }
+        limbo = grown;
+        limbo_cap = cap;
+    }
+    limbo[limbo_len++] = (retired){release, ptr, epoch};
+    atomic_store_explicit(&limbo_pending, limbo_len, memory_order_relaxed);
+    if (++since_reclaim >= EPOCH_RECLAIM_EVERY) {
+        reclaim_locked(oldest_reader());
+    }
+    pthread_mutex_unlock(&limbo_m);
+}
+
+/**
+ * @brief Rilascia tutti gli oggetti in attesa. Va chiamata quando non ci sono più lettori.
+ */
+void epoch_shutdown(void) {
+    pthread_mutex_lock(&limbo_m);
+    reclaim_locked(UINT64_MAX);
+    free(limbo);
+    limbo = NULL;
+    limbo_cap = 0;
+    pthread_mutex_unlock(&limbo_m);
+}
@@ -0,0 +1,20 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+
+/**
+ * Rilascio differito per epoche, per i lettori senza lock delle shard. Un
+ * lettore racchiude la lettura tra `epoch_enter` ed `epoch_exit`; uno
+ * scrittore che toglie un oggetto ancora raggiungibile da una lettura in
+ * corso lo passa a `epoch_retire` invece di liberarlo, e `release` viene
+ * chiamata solo quando tutte le sezioni iniziate prima del ritiro sono
+ * terminate. Le sezioni non si annidano e non devono bloccarsi su un lock
+ * tenuto da chi ritira.
+ */
+bool epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(void (*release)(void* ptr), void* ptr);
+void epoch_shutdown(void);
+
+#endif // EPOCH_H
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+
+#include "hot_restart.h"
+#include "boards.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define HANDOFF_MAGIC   0x42484452u // "BHDR"
+#define HANDOFF_VERSION 5
+#define HANDOFF_ADOPTED 'A'
+#define HANDOFF_SPAWN_TIMEOUT_MS 5000
+#define HANDOFF_ADOPT_TIMEOUT_MS 60000
+
+/** Primo messaggio del nuovo processo: dichiara il formato di handoff che capisce. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} handoff_ready;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_boards;
+    uint32_t n_sessions;
+} handoff_header;
+
+typedef struct {
+    uint64_t id;
+    uint8_t auth;
+    uint8_t subscribed;
+    char curr_user[MAX_USERNAME_LEN];
+    char board[MAX_BOARD_NAME_LEN];
+} handoff_session;
+
+static char exec_path[PATH_MAX];
+static char** child_argv = NULL;
+static int child_argc = 0;
+static pid_t child_pid = -1;
+
+static int signal_pipe[2] = {-1, -1};
+static int wake_pipe[2] = {-1, -1};
+static volatile sig_atomic_t draining = 0;
+
+static pthread_mutex_t parked_m = PTHREAD_MUTEX_INITIALIZER;
+static client_session** parked = NULL;
+static size_t parked_count = 0;
+static size_t parked_capacity = 0;
+
+/**
+ * @brief Prepara il meccanismo di hot restart.
+ *
+ * @param argc Numero di argomenti della riga di comando.
+ * @param argv Argomenti della riga di comando del processo corrente.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ *
+ * Memorizza il percorso assoluto dell'eseguibile e una copia degli argomenti
+ * (senza un eventuale `--handoff-fd`), così che il nuovo binario venga avviato
+ * con la stessa configurazione. Il percorso viene risolto all'avvio perché un
+ * deploy sostituisce il file su disco: `/proc/self/exe` punterebbe ancora al
+ * vecchio inode ed è usato solo come ripiego.
+ * Crea inoltre due pipe: una per il segnale di restart (scritta dall'handler
+ * di SIGUSR2) e una di "risveglio" su cui i thread lavoratori fanno poll.
+ */
+int hot_restart_init(int argc, char* argv[]) {
+    if (argc < 1 || realpath(argv[0], exec_path) == NULL || strchr(argv[0], '/') == NULL) {
+        strncpy(exec_path, "/proc/self/exe", sizeof(exec_path) - 1);
+    }
+
+    child_argv = calloc(argc + 3, sizeof(char*));
+    if (!child_argv) return -1;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--handoff-fd") == 0) {
+            i++;
+            continue;
+        }
+        if (strncmp(argv[i], "--handoff-fd=", 13) == 0) continue;
+        child_argv[child_argc++] = argv[i];
+    }
+
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0 || pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        perror("Errore nella creazione delle pipe di hot restart");
+        return -1;
+    }
+    return 0;
+}
+
+int hot_restart_signal_fd(void) {
+    return signal_pipe[0];
+}
+
+/**
+ * @brief Notifica al thread principale una richiesta di hot restart.
+ *
+ * Pensata per essere chiamata dall'handler di SIGUSR2: usa solo `write`,
+ * che è async-signal-safe.
+ */
+void hot_restart_signal(void) {
+    int saved_errno = errno;
+    char c = 1;
+    if (write(signal_pipe[1], &c, 1) < 0) {
+        // Pipe piena: una richiesta è già in attesa.
+    }
+    errno = saved_errno;
+}
+
+int hot_restart_wake_fd(void) {
+    return wake_pipe[0];
+}
+
+bool hot_restart_draining(void) {
+    return draining != 0;
+}
+
+/**
+ * @brief Parcheggia una sessione inattiva in attesa di essere passata al nuovo processo.
+ *
+ * @param session La sessione da parcheggiare; il modulo ne diventa proprietario.
+ *
+ * Chiamata da `handle_client` tra una richiesta e l'altra quando è in corso un
+ * drain. Il socket resta aperto: eventuali byte già inviati dal client restano
+ * nel buffer del kernel e verranno letti dal nuovo processo.
+ */
+void hot_restart_park(client_session* session) {
+    pthread_mutex_lock(&parked_m);
+    if (parked_count == parked_capacity) {
+        size_t new_capacity = (parked_capacity == 0) ? 16 : parked_capacity * 2;
+        client_session** new_parked = realloc(parked, new_capacity * sizeof(client_session*));
+        if (!new_parked) {
+            pthread_mutex_unlock(&parked_m);
+            perror("Realloc fallita, la sessione viene chiusa");
+            close(session->sock);
+            free(session);
+            return;
+        }
+        parked = new_parked;
+        parked_capacity = new_capacity;
+    }
+    parked[parked_count++] = session;
+    pthread_mutex_unlock(&parked_m);
+}
+
+/** Termina il nuovo processo di un restart annullato, se è ancora in vita. */
+static void stop_child(void) {
+    if (child_pid <= 0) return;
+    kill(child_pid, SIGKILL);
+    waitpid(child_pid, NULL, 0);
+    child_pid = -1;
+}
+
+/** Attende fino a `timeout_ms` che sul canale ci sia un messaggio da leggere. */
+static int wait_message(int channel, int timeout_ms) {
+    struct pollfd pfd = { .fd = channel, .events = POLLIN, .revents = 0 };
+    int r;
+    do {
+        r = poll(&pfd, 1, timeout_ms);
+    } while (r < 0 && errno == EINTR);
+    return r > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Avvia il nuovo eseguibile e attende che sia pronto a ricevere lo stato.
+ *
+ * @return Il lato locale del canale di handoff, o -1 se l'avvio fallisce.
+ *
+ * Il canale è una coppia di socket Unix `SOCK_SEQPACKET`, che preserva i
+ * confini dei messaggi e permette di trasferire file descriptor con
+ * `SCM_RIGHTS`. Solo il lato del figlio perde il flag `FD_CLOEXEC`, così il
+ * nuovo processo non eredita nessun altro socket del vecchio.
+ * Il figlio conferma di essere partito inviando il proprio magic e la propria
+ * versione di handoff: se non risponde entro `HANDOFF_SPAWN_TIMEOUT_MS` (es.
+ * il nuovo binario è rotto) o parla una versione diversa, viene terminato e il
+ * restart è annullato prima del drain, senza che i client se ne accorgano.
+ */
+int hot_restart_spawn(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("Errore nella creazione del canale di handoff");
+        return -1;
+    }
+
+    char fd_arg[16];
+    snprintf(fd_arg, sizeof(fd_arg), "%d", sv[1]);
+    child_argv[child_argc] = "--handoff-fd";
+    child_argv[child_argc + 1] = fd_arg;
+    child_argv[child_argc + 2] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Fork fallita");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        fcntl(sv[1], F_SETFD, 0);
+        execv(exec_path, child_argv);
+        _exit(127);
+    }
+    close(sv[1]);
+
+    child_pid = pid;
+
+    handoff_ready ready;
+    if (wait_message(sv[0], HANDOFF_SPAWN_TIMEOUT_MS) < 0 || recv(sv[0], &ready, sizeof(ready), 0) != sizeof(ready)) {
+        fprintf(stderr, "Il nuovo eseguibile (%s) non ha risposto all'handoff\n", exec_path);
+        stop_child();
+        close(sv[0]);
+        return -1;
+    }
+    if (ready.magic != HANDOFF_MAGIC || ready.version != HANDOFF_VERSION) {
+        fprintf(stderr, "Il nuovo eseguibile (%s) usa la versione di handoff %u invece di %u\n", exec_path,
+                ready.magic == HANDOFF_MAGIC ? ready.version : 0, HANDOFF_VERSION);
+        stop_child();
+        close(sv[0]);
+        return -1;
+    }
+    return sv[0];
+}
+
+/**
+ * @brief Chiede a tutti i thread lavoratori di parcheggiare le proprie sessioni.
+ *
+ * La pipe di risveglio non viene mai svuotata durante il drain: essendo il
+ * poll level-triggered, ogni lavoratore (anche quelli che prenderanno in
+ * carico sessioni ancora in coda) la vedrà leggibile.
+ */
+void hot_restart_begin_drain(void) {
+    draining = 1;
+    char c = 1;
+    if (write(wake_pipe[1], &c, 1) < 0) {
+        perror("Errore nella scrittura sulla pipe di risveglio");
+    }
+}
+
+static int send_with_fds(int channel, const void* data, size_t len, const int* fds, int nfds) {
+    struct iovec iov = { .iov_base = (void*)data, .iov_len = len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HOT_RESTART_MAX_LISTENERS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return (sent == (ssize_t)len) ? 0 : -1;
+}
+
+static int recv_with_fds(int channel, void* data, size_t len, int* fds, int max_fds) {
+    struct iovec iov = { .iov_base = data, .iov_len = len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HOT_RESTART_MAX_LISTENERS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t received;
+    do {
+        received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received != (ssize_t)len) return -1;
+
+    int nfds = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int* received_fds = (int*)CMSG_DATA(cmsg);
+        for (int i = 0; i < count; i++) {
+            if (nfds < max_fds) {
+                fds[nfds++] = received_fds[i];
+            } else {
+                close(received_fds[i]);
+            }
+        }
+    }
+    return nfds;
+}
+
+/**
+ * @brief Trasferisce lo stato del server al nuovo processo.
+ *
+ * @param channel Il canale restituito da `hot_restart_spawn`.
+ * @param state I socket in ascolto e il prossimo ID di ogni bacheca aperta.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ *
+ * Invia prima un header con i socket in ascolto allegati, poi un messaggio
+ * per ogni bacheca e uno per ogni sessione parcheggiata, con il relativo
+ * socket, lo stato di autenticazione e la bacheca su cui si trova.
+ * Le sessioni restano comunque parcheggiate, con i socket aperti: il vecchio
+ * processo le abbandona solo dopo la conferma di `hot_restart_wait_adopted`,
+ * altrimenti le riprende con `hot_restart_abort`.
+ */
+int hot_restart_send(int channel, const handoff_state* state) {
+    pthread_mutex_lock(&parked_m);
+
+    handoff_header header;
+    header.magic = HANDOFF_MAGIC;
+    header.version = HANDOFF_VERSION;
+    header.n_boards = state->n_boards;
+    header.n_sessions = parked_count;
+
+    if (send_with_fds(channel, &header, sizeof(header), state->listen_fds, state->n_listen) < 0) {
+        pthread_mutex_unlock(&parked_m);
+        return -1;
+    }
+    for (uint32_t i = 0; i < state->n_boards; i++) {
+        if (send_with_fds(channel, &state->boards[i], sizeof(handoff_board), NULL, 0) < 0) {
+            pthread_mutex_unlock(&parked_m);
+            return -1;
+        }
+    }
+
+    for (size_t i = 0; i < parked_count; i++) {
+        handoff_session record;
+        memset(&record, 0, sizeof(record));
+        record.id = parked[i]->id;
+        record.auth = parked[i]->auth ? 1 : 0;
+        record.subscribed = parked[i]->subscribed ? 1 : 0;
+        memcpy(record.curr_user, parked[i]->curr_user, sizeof(record.curr_user));
+        strncpy(record.board, message_store_name(parked[i]->board), sizeof(record.board) - 1);
+        if (send_with_fds(channel, &record, sizeof(record), &parked[i]->sock, 1) < 0) {
+            pthread_mutex_unlock(&parked_m);
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&parked_m);
+    return 0;
+}
+
+/**
+ * @brief Attende che il nuovo processo confermi di aver preso in carico lo stato.
+ *
+ * @param channel Il canale restituito da `hot_restart_spawn`.
+ * @return 0 se il nuovo processo ha confermato, -1 altrimenti.
+ *
+ * Il nuovo processo conferma solo dopo aver caricato le bacheche, avviato i
+ * propri thread e ricevuto tutte le sessioni. Se la conferma non arriva entro
+ * `HANDOFF_ADOPT_TIMEOUT_MS` o il canale si chiude (il nuovo processo è
+ * terminato), il nuovo processo viene terminato: le sessioni parcheggiate
+ * non sono mai servite da due processi.
+ */
+int hot_restart_wait_adopted(int channel) {
+    char ack = 0;
+    if (wait_message(channel, HANDOFF_ADOPT_TIMEOUT_MS) < 0 || recv(channel, &ack, 1, 0) != 1 ||
+        ack != HANDOFF_ADOPTED) {
+        stop_child();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Annulla un drain in corso e restituisce le sessioni parcheggiate.
+ *
+ * @param resume Funzione chiamata per ogni sessione parcheggiata (di norma la
+ *               rimette in coda nel thread pool).
+ *
+ * Il nuovo processo, se ancora in vita, viene terminato prima di riprendere le
+ * sessioni, così i socket che gli erano già stati passati non restano aperti
+ * in due processi.
+ */
+void hot_restart_abort(void (*resume)(client_session* session)) {
+    stop_child();
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {
+    }
+    draining = 0;
+
+    pthread_mutex_lock(&parked_m);
+    size_t count = parked_count;
+    client_session** sessions = parked;
+    parked = NULL;
+    parked_count = 0;
+    parked_capacity = 0;
+    pthread_mutex_unlock(&parked_m);
+
+    for (size_t i = 0; i < count; i++) {
+        resume(sessions[i]);
+    }
+    free(sessions);
+}
+
+/**
+ * @brief Lato del nuovo processo: conferma al vecchio di essere pronto.
+ *
+ * Insieme alla conferma invia la propria versione di handoff, così il vecchio
+ * processo annulla il restart prima del drain se i formati non coincidono.
+ */
+int hot_restart_announce(int channel) {
+    handoff_ready ready = { HANDOFF_MAGIC, HANDOFF_VERSION };
+    return (send(channel, &ready, sizeof(ready), MSG_NOSIGNAL) == sizeof(ready)) ? 0 : -1;
+}
+
+/**
+ * @brief Lato del nuovo processo: conferma di aver preso in carico tutto lo stato.
+ *
+ * Da chiamare dopo aver ricevuto l'ultima sessione: da qui in poi il vecchio
+ * processo termina e il nuovo non può più tirarsi indietro.
+ */
+int hot_restart_confirm(int channel) {
+    char ack = HANDOFF_ADOPTED;
+    return (send(channel, &ack, 1, MSG_NOSIGNAL) == 1) ? 0 : -1;
+}
+
+/**
+ * @brief Lato del nuovo processo: riceve l'header e i socket in ascolto.
+ *
+ * @param channel Il file descriptor ereditato tramite `--handoff-fd`.
+ * @param state Struttura di output.
+ * @return 0 in caso di successo, -1 in caso di errore o di versione incompatibile.
+ *
+ * Si blocca finché il vecchio processo non ha completato il drain e salvato i
+ * messaggi su file, quindi il caricamento della bacheca va fatto dopo.
+ */
+int hot_restart_receive_state(int channel, handoff_state* state) {
+    handoff_header header;
+    int n = recv_with_fds(channel, &header, sizeof(header), state->listen_fds, HOT_RESTART_MAX_LISTENERS);
+    if (n < 0) return -1;
+    if (header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION || n == 0) {
+        for (int i = 0; i < n; i++) close(state->listen_fds[i]);
+        return -1;
+    }
+    state->n_listen = n;
+    state->boards = NULL;
+    state->n_boards = header.n_boards;
+    state->n_sessions = header.n_sessions;
+    return 0;
+}
+
+/**
+ * @brief Lato del nuovo processo: riceve il nome e il prossimo ID di una bacheca aperta.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int hot_restart_receive_board(int channel, handoff_board* board) {
+    if (recv_with_fds(channel, board, sizeof(*board), NULL, 0) != 0) return -1;
+    board->name[sizeof(board->name) - 1] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Lato del nuovo processo: riceve una sessione client.
+ *
+ * @return La sessione ricostruita, o NULL in caso di errore.
+ *
+ * Se la bacheca della sessione non esiste più, la sessione torna sulla
+ * bacheca predefinita.
+ */
+client_session* hot_restart_receive_session(int channel) {
+    handoff_session record;
+    int fd = -1;
+    if (recv_with_fds(channel, &record, sizeof(record), &fd, 1) != 1) return NULL;
+
+    client_session* session = client_session_create(fd);
+    if (!session) {
+        close(fd);
+        return NULL;
+    }
+    session->id = record.id;
+    session->auth = record.auth != 0;
+    session->subscribed = record.subscribed != 0;
+    memcpy(session->curr_user, record.curr_user, sizeof(session->curr_user));
+    session->curr_user[sizeof(session->curr_user) - 1] = '\0';
+    record.board[sizeof(record.board) - 1] = '\0';
+    message_store* board = boards_open(record.board);
+    if (board) session->board = board;
+    return session;
+}
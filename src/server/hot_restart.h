@@ -0,0 +1,49 @@
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "client_handler.h"
+
+#define HOT_RESTART_MAX_LISTENERS 64
+
+/** Una bacheca aperta e il suo prossimo ID, da ripristinare nel nuovo processo. */
+typedef struct handoff_board {
+    char name[MAX_BOARD_NAME_LEN];
+    uint32_t next_id;
+} handoff_board;
+
+/**
+ * Stato trasferito al nuovo processo. In ricezione `boards` non viene
+ * usato: le `n_boards` bacheche si leggono con `hot_restart_receive_board`,
+ * prima delle sessioni.
+ */
+typedef struct handoff_state {
+    int listen_fds[HOT_RESTART_MAX_LISTENERS];
+    int n_listen;
+    const handoff_board* boards;
+    uint32_t n_boards;
+    uint32_t n_sessions;
+} handoff_state;
+
+int hot_restart_init(int argc, char* argv[]);
+int hot_restart_signal_fd(void);
+void hot_restart_signal(void);
+int hot_restart_wake_fd(void);
+bool hot_restart_draining(void);
+void hot_restart_park(client_session* session);
+
+int hot_restart_spawn(void);
+void hot_restart_begin_drain(void);
+int hot_restart_send(int channel, const handoff_state* state);
+int hot_restart_wait_adopted(int channel);
+void hot_restart_abort(void (*resume)(client_session* session));
+
+int hot_restart_announce(int channel);
+int hot_restart_confirm(int channel);
+int hot_restart_receive_state(int channel, handoff_state* state);
+int hot_restart_receive_board(int channel, handoff_board* board);
+client_session* hot_restart_receive_session(int channel);
+
+#endif // HOT_RESTART_H
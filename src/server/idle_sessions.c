@@ -0,0 +1,185 @@
+#include "idle_sessions.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "hot_restart.h"
+#include "thread_pool.h"
+
+#define IDLE_EVENTS 64
+
+/** Una sessione in attesa, nella lista `held` finché non viene risvegliata. */
+typedef struct held_session {
+    struct held_session* prev;
+    struct held_session* next;
+    client_session* session;
+    bool woken;
+} held_session;
+
+static int epoll_fd = -1;
+static pthread_t idle_thread;
+static pthread_mutex_t held_m = PTHREAD_MUTEX_INITIALIZER;
+static held_session* held = NULL;
+// Vero durante un drain: le sessioni sono state parcheggiate e le nuove
+// restano al lavoratore, che le parcheggia da sé.
+static bool closed = false;
+
+static void unlink_held(held_session* h) {
+    if (h->prev) h->prev->next = h->next;
+    else held = h->next;
+    if (h->next) h->next->prev = h->prev;
+}
+
+/** Toglie da epoll i file descriptor di una sessione risvegliata o parcheggiata. */
+static void forget(held_session* h) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, h->session->sock, NULL);
+    if (h->session->sub) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, subscriber_fd(h->session->sub), NULL);
+    }
+}
+
+/**
+ * @brief Ciclo del thread di attesa.
+ *
+ * Gli eventi di un giro vengono prima raccolti sotto `held_m` (una sessione
+ * con socket ed eventfd pronti insieme compare due volte, ma viene
+ * risvegliata una sola) e solo dopo le sessioni tornano nel pool: da lì in
+ * poi un lavoratore può liberarle.
+ * La pipe di risveglio dell'hot restart ha `data.ptr` NULL: durante un drain
+ * tutte le sessioni in attesa vengono parcheggiate e la pipe, che resta
+ * leggibile fino alla fine del drain, esce dall'insieme di epoll.
+ */
+static void* idle_loop(void* arg) {
+    (void)arg;
+    struct epoll_event events[IDLE_EVENTS];
+    while (1) {
+        int n = epoll_wait(epoll_fd, events, IDLE_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) perror("Epoll fallita");
+            continue;
+        }
+
+        held_session* woken = NULL;
+        held_session* parked = NULL;
+        bool drain = false;
+        pthread_mutex_lock(&held_m);
+        for (int i = 0; i < n; i++) {
+            held_session* h = (held_session*)events[i].data.ptr;
+            if (!h) {
+                drain = true;
+                continue;
+            }
+            if (h->woken) continue;
+            h->woken = true;
+            unlink_held(h);
+            h->next = woken;
+            woken = h;
+        }
+        if (drain && hot_restart_draining() && !closed) {
+            closed = true;
+            parked = held;
+            held = NULL;
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, hot_restart_wake_fd(), NULL);
+        }
+        pthread_mutex_unlock(&held_m);
+
+        while (woken) {
+            held_session* h = woken;
+            woken = h->next;
+            forget(h);
+            client_session* session = h->session;
+            free(h);
+            // Classe scelta di nuovo dalla richiesta appena arrivata; se la
+            // coda è piena il pool chiude la sessione con BUSY.
+            add_task_class(session->pool, client_session_task_class(session), handle_client, session);
+        }
+        while (parked) {
+            held_session* h = parked;
+            parked = h->next;
+            forget(h);
+            client_session_release(h->session, true);
+            free(h);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Avvia il thread di attesa delle sessioni inattive.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore: le sessioni restano
+ *         allora ai lavoratori per tutta la connessione.
+ */
+int idle_sessions_start(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("Impossibile creare l'istanza epoll delle sessioni inattive");
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, hot_restart_wake_fd(), &ev) < 0 ||
+        pthread_create(&idle_thread, NULL, idle_loop, NULL) != 0) {
+        perror("Impossibile avviare il thread delle sessioni inattive");
+        close(epoll_fd);
+        epoll_fd = -1;
+        return -1;
+    }
+    pthread_detach(idle_thread);
+    return 0;
+}
+
+/**
+ * @brief Cede una sessione senza richieste in corso al thread di attesa.
+ *
+ * @return true se la sessione è stata presa in carico: il chiamante non deve
+ *         più toccarla, perché può essere già tornata nel pool. false se il
+ *         thread non è attivo, è in corso un drain o manca memoria: la
+ *         sessione resta al chiamante.
+ *
+ * La sessione continua a contare tra i client attivi e mantiene la propria
+ * scadenza: allo scadere `shutdown` rende leggibile il socket e un
+ * lavoratore la chiude come per una disconnessione.
+ */
+bool idle_sessions_hold(client_session* session) {
+    if (epoll_fd < 0) return false;
+    held_session* h = calloc(1, sizeof(held_session));
+    if (!h) return false;
+    h->session = session;
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = h };
+    pthread_mutex_lock(&held_m);
+    // La registrazione avviene sotto `held_m`, così un drain non può
+    // parcheggiare la sessione prima che sia entrata in epoll.
+    bool ok = !closed && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, session->sock, &ev) == 0;
+    if (ok && session->sub && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, subscriber_fd(session->sub), &ev) < 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->sock, NULL);
+        ok = false;
+    }
+    if (ok) {
+        h->next = held;
+        if (held) held->prev = h;
+        held = h;
+    }
+    pthread_mutex_unlock(&held_m);
+    if (!ok) free(h);
+    return ok;
+}
+
+/**
+ * @brief Riapre l'attesa dopo un hot restart annullato.
+ *
+ * Va chiamata dopo `hot_restart_abort`, quando la pipe di risveglio è di
+ * nuovo vuota.
+ */
+void idle_sessions_reopen(void) {
+    if (epoll_fd < 0) return;
+    pthread_mutex_lock(&held_m);
+    if (closed) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, hot_restart_wake_fd(), &ev);
+        closed = false;
+    }
+    pthread_mutex_unlock(&held_m);
+}
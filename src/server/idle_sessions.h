@@ -0,0 +1,19 @@
+#ifndef IDLE_SESSIONS_H
+#define IDLE_SESSIONS_H
+
+#include <stdbool.h>
+#include "client_handler.h"
+
+/**
+ * Attesa delle sessioni inattive del backend bloccante fuori dal thread pool.
+ * Un lavoratore che non ha richieste da servire cede la sessione a un unico
+ * thread con `epoll`, che la rimette in coda nel pool della sessione quando
+ * il socket o l'eventfd del subscriber diventano leggibili. I client in
+ * modalità push, le repliche e le connessioni ferme non occupano quindi un
+ * lavoratore per tutta la durata della connessione.
+ */
+int idle_sessions_start(void);
+bool idle_sessions_hold(client_session* session);
+void idle_sessions_reopen(void);
+
+#endif // IDLE_SESSIONS_H
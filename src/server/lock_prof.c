@@ -0,0 +1,247 @@
+#include "lock_prof.h"
+
+#ifdef LOCK_PROFILE
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOCK_PROF_BUCKETS 40
+#define LOCK_PROF_SITES 128
+#define LOCK_PROF_TOP_SITES 5
+#define LOCK_PROF_MAX_HELD 64
+
+static const char* const class_names[LOCK_CLASS_COUNT] = {
+    [LOCK_SHARD]      = "shard",
+    [LOCK_USERS]      = "users",
+    [LOCK_CLIENTS]    = "clients",
+    [LOCK_POOL_QUEUE] = "pool_queue",
+};
+
+/** Un punto di chiamata di `PROF_LOCK`, identificato dalla stringa "file:riga". */
+typedef struct lock_site {
+    _Atomic(const char*) site;
+    atomic_uint_fast64_t acquired;
+    atomic_uint_fast64_t contended;
+    atomic_uint_fast64_t wait_ns;
+} lock_site;
+
+/**
+ * Contatori di una classe di lock. Gli istogrammi hanno bucket in potenze
+ * di 2: il bucket `k` conta le durate in [2^(k-1), 2^k) nanosecondi.
+ */
+typedef struct lock_stats {
+    atomic_uint_fast64_t acquired;
+    atomic_uint_fast64_t contended;
+    atomic_uint_fast64_t wait_ns;
+    atomic_uint_fast64_t hold_ns;
+    atomic_uint_fast64_t wait_hist[LOCK_PROF_BUCKETS];
+    atomic_uint_fast64_t hold_hist[LOCK_PROF_BUCKETS];
+    lock_site sites[LOCK_PROF_SITES];
+    atomic_uint_fast64_t sites_dropped;
+} lock_stats;
+
+/** Un lock tenuto dal thread, con l'ora di acquisizione per misurarne la tenuta. */
+typedef struct held_lock {
+    pthread_mutex_t* mutex;
+    lock_class cls;
+    uint64_t since_ns;
+} held_lock;
+
+static lock_stats stats[LOCK_CLASS_COUNT];
+static _Thread_local held_lock held[LOCK_PROF_MAX_HELD];
+static _Thread_local size_t n_held = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static unsigned bucket_of(uint64_t ns) {
+    unsigned k = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    return k < LOCK_PROF_BUCKETS ? k : LOCK_PROF_BUCKETS - 1;
+}
+
+/**
+ * @brief Il contatore del punto di chiamata `site`, inserito alla prima acquisizione.
+ *
+ * La tabella è ad indirizzamento aperto sul puntatore della stringa; se è
+ * piena il punto viene contato solo nei totali della classe.
+ */
+static lock_site* site_of(lock_stats* s, const char* site) {
+    size_t h = ((uintptr_t)site >> 3) % LOCK_PROF_SITES;
+    for (size_t i = 0; i < LOCK_PROF_SITES; i++) {
+        lock_site* slot = &s->sites[(h + i) % LOCK_PROF_SITES];
+        const char* current = atomic_load_explicit(&slot->site, memory_order_acquire);
+        if (current == site) return slot;
+        if (current == NULL) {
+            if (atomic_compare_exchange_strong(&slot->site, &current, site) || current == site) {
+                return slot;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&s->sites_dropped, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static void held_push(pthread_mutex_t* m, lock_class cls) {
+    if (n_held < LOCK_PROF_MAX_HELD) {
+        held[n_held++] = (held_lock){ m, cls, now_ns() };
+    }
+}
+
+/**
+ * @brief Acquisisce `m`, misurando l'eventuale attesa.
+ *
+ * Un `trylock` riuscito non è conteso e non legge l'orologio per l'attesa;
+ * altrimenti l'attesa va dal fallimento del `trylock` all'acquisizione.
+ */
+void lock_prof_lock(pthread_mutex_t* m, lock_class cls, const char* site) {
+    lock_stats* s = &stats[cls];
+    lock_site* ls = site_of(s, site);
+    uint64_t wait = 0;
+    bool contended = pthread_mutex_trylock(m) != 0;
+    if (contended) {
+        uint64_t start = now_ns();
+        pthread_mutex_lock(m);
+        wait = now_ns() - start;
+    }
+    held_push(m, cls);
+
+    atomic_fetch_add_explicit(&s->acquired, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->wait_hist[bucket_of(wait)], 1, memory_order_relaxed);
+    if (ls) atomic_fetch_add_explicit(&ls->acquired, 1, memory_order_relaxed);
+    if (contended) {
+        atomic_fetch_add_explicit(&s->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->wait_ns, wait, memory_order_relaxed);
+        if (ls) {
+            atomic_fetch_add_explicit(&ls->contended, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&ls->wait_ns, wait, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Chiude la tenuta di `m` da parte del thread, se era registrata.
+ */
+static void held_pop(pthread_mutex_t* m) {
+    for (size_t i = n_held; i > 0; i--) {
+        if (held[i - 1].mutex != m) continue;
+        uint64_t hold = now_ns() - held[i - 1].since_ns;
+        lock_stats* s = &stats[held[i - 1].cls];
+        atomic_fetch_add_explicit(&s->hold_ns, hold, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->hold_hist[bucket_of(hold)], 1, memory_order_relaxed);
+        held[i - 1] = held[--n_held];
+        return;
+    }
+}
+
+void lock_prof_unlock(pthread_mutex_t* m) {
+    held_pop(m);
+    pthread_mutex_unlock(m);
+}
+
+/**
+ * @brief `pthread_cond_wait` su un lock profilato: l'attesa sulla condizione
+ *        non conta come tenuta, che riparte al risveglio.
+ */
+void lock_prof_cond_wait(pthread_cond_t* cv, pthread_mutex_t* m) {
+    lock_class cls = LOCK_CLASS_COUNT;
+    for (size_t i = n_held; i > 0; i--) {
+        if (held[i - 1].mutex == m) {
+            cls = held[i - 1].cls;
+            break;
+        }
+    }
+    held_pop(m);
+    pthread_cond_wait(cv, m);
+    if (cls != LOCK_CLASS_COUNT) held_push(m, cls);
+}
+
+/**
+ * @brief Il limite superiore, in ns, del bucket che contiene il percentile `pct`.
+ */
+static uint64_t hist_percentile(atomic_uint_fast64_t* hist, unsigned pct) {
+    uint64_t total = 0;
+    for (unsigned k = 0; k < LOCK_PROF_BUCKETS; k++) total += atomic_load(&hist[k]);
+    if (total == 0) return 0;
+    uint64_t target = (total * pct + 99) / 100, seen = 0;
+    for (unsigned k = 0; k < LOCK_PROF_BUCKETS; k++) {
+        seen += atomic_load(&hist[k]);
+        if (seen >= target) return 1ull << k;
+    }
+    return 1ull << (LOCK_PROF_BUCKETS - 1);
+}
+
+/**
+ * @brief Formatta i totali di ogni classe come righe "lock_<classe>_<contatore> valore", come `stats_format`.
+ */
+size_t lock_prof_format(char* buf, size_t size) {
+    size_t len = 0;
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (int c = 0; c < LOCK_CLASS_COUNT; c++) {
+        lock_stats* s = &stats[c];
+        int written = snprintf(buf + len, size - len,
+                               "lock_%s_acquired %" PRIu64 "\nlock_%s_contended %" PRIu64 "\n"
+                               "lock_%s_wait_us %" PRIu64 "\nlock_%s_hold_us %" PRIu64 "\n",
+                               class_names[c], (uint64_t)atomic_load(&s->acquired),
+                               class_names[c], (uint64_t)atomic_load(&s->contended),
+                               class_names[c], (uint64_t)atomic_load(&s->wait_ns) / 1000,
+                               class_names[c], (uint64_t)atomic_load(&s->hold_ns) / 1000);
+        if (written < 0 || (size_t)written >= size - len) {
+            return size - 1;
+        }
+        len += written;
+    }
+    return len;
+}
+
+static int compare_site_wait(const void* a, const void* b) {
+    uint64_t w_a = atomic_load(&(*(lock_site* const*)a)->wait_ns);
+    uint64_t w_b = atomic_load(&(*(lock_site* const*)b)->wait_ns);
+    return (w_a < w_b) - (w_a > w_b);
+}
+
+/**
+ * @brief Stampa il resoconto completo: per ogni classe acquisizioni, contesa,
+ *        percentili di attesa e tenuta, e i punti di chiamata con più attesa.
+ */
+void lock_prof_report(FILE* out) {
+    fprintf(out, "Profilo dei lock:\n");
+    for (int c = 0; c < LOCK_CLASS_COUNT; c++) {
+        lock_stats* s = &stats[c];
+        uint64_t acquired = atomic_load(&s->acquired);
+        if (acquired == 0) continue;
+        uint64_t contended = atomic_load(&s->contended);
+        fprintf(out, "  %s: %" PRIu64 " acquisizioni, %" PRIu64 " contese (%.1f%%), attesa %" PRIu64
+                     " us, tenuta %" PRIu64 " us\n",
+                class_names[c], acquired, contended, 100.0 * contended / acquired,
+                (uint64_t)atomic_load(&s->wait_ns) / 1000, (uint64_t)atomic_load(&s->hold_ns) / 1000);
+        fprintf(out, "    attesa ns  p50 <%" PRIu64 " p99 <%" PRIu64 " max <%" PRIu64 "\n",
+                hist_percentile(s->wait_hist, 50), hist_percentile(s->wait_hist, 99),
+                hist_percentile(s->wait_hist, 100));
+        fprintf(out, "    tenuta ns  p50 <%" PRIu64 " p99 <%" PRIu64 " max <%" PRIu64 "\n",
+                hist_percentile(s->hold_hist, 50), hist_percentile(s->hold_hist, 99),
+                hist_percentile(s->hold_hist, 100));
+
+        lock_site* sites[LOCK_PROF_SITES];
+        size_t n = 0;
+        for (size_t i = 0; i < LOCK_PROF_SITES; i++) {
+            if (atomic_load(&s->sites[i].site)) sites[n++] = &s->sites[i];
+        }
+        qsort(sites, n, sizeof(lock_site*), compare_site_wait);
+        for (size_t i = 0; i < n && i < LOCK_PROF_TOP_SITES; i++) {
+            fprintf(out, "    %-36s %10" PRIu64 " acquisizioni %8" PRIu64 " contese, attesa %" PRIu64 " us\n",
+                    atomic_load(&sites[i]->site), (uint64_t)atomic_load(&sites[i]->acquired),
+                    (uint64_t)atomic_load(&sites[i]->contended), (uint64_t)atomic_load(&sites[i]->wait_ns) / 1000);
+        }
+    }
+}
+
+#endif // LOCK_PROFILE
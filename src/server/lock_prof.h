@@ -0,0 +1,44 @@
+#ifndef LOCK_PROF_H
+#define LOCK_PROF_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Profilo della contesa dei lock principali del server, compilato solo con
+ * `make LOCK_PROFILE=1` (`-DLOCK_PROFILE`). Per ogni classe di lock conta le
+ * acquisizioni e quelle contese, misura attesa e tenuta (totali e
+ * istogrammi) e tiene i punti di chiamata con più attesa. I totali escono in
+ * `C_STATS`, il resoconto completo allo shutdown.
+ *
+ * Senza il flag le macro sono le chiamate pthread dirette, senza alcun costo.
+ */
+typedef enum {
+    LOCK_SHARD,      // MessageShard.mutex, tutte le shard di tutte le bacheche
+    LOCK_USERS,      // user_mutex
+    LOCK_CLIENTS,    // client_m
+    LOCK_POOL_QUEUE, // client_queue.mutex di tutti i thread pool
+    LOCK_CLASS_COUNT
+} lock_class;
+
+#define LOCK_PROF_STR(x) #x
+#define LOCK_PROF_SITE(line) __FILE__ ":" LOCK_PROF_STR(line)
+
+#ifdef LOCK_PROFILE
+void lock_prof_lock(pthread_mutex_t* m, lock_class cls, const char* site);
+void lock_prof_unlock(pthread_mutex_t* m);
+void lock_prof_cond_wait(pthread_cond_t* cv, pthread_mutex_t* m);
+size_t lock_prof_format(char* buf, size_t size);
+void lock_prof_report(FILE* out);
+
+#define PROF_LOCK(m, cls) lock_prof_lock((m), (cls), LOCK_PROF_SITE(__LINE__))
+#define PROF_UNLOCK(m) lock_prof_unlock(m)
+#define PROF_COND_WAIT(cv, m) lock_prof_cond_wait((cv), (m))
+#else
+#define PROF_LOCK(m, cls) pthread_mutex_lock(m)
+#define PROF_UNLOCK(m) pthread_mutex_unlock(m)
+#define PROF_COND_WAIT(cv, m) pthread_cond_wait((cv), (m))
+#endif
+
+#endif // LOCK_PROF_H
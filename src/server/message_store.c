@@ -1,4 +1,4 @@
-#define _XOPEN_SOURCE 700
+#define _GNU_SOURCE
 
 #include "message_store.h"
 #include "../common/net_utils.h"
@@ -11,388 +11,2871 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "stats.h"
+#include "lock_prof.h"
+#include "epoch.h"
 
+#define PARALLEL_LOAD_MIN_BYTES (1 << 20)
+
+#ifndef MESSAGE_SHARDS
+#define MESSAGE_SHARDS 16
+#endif
+
+#define TIMESTAMP_FORMAT "%a %b %d %H:%M:%S %Y"
+#define MAX_STORE_OBSERVERS 8
+
+/**
+ * Un messaggio della bacheca. `body` punta ai dati di un `message_body`:
+ * le copie della bacheca in invio e gli eventi push ne tengono un
+ * riferimento invece di duplicarlo, e il corpo viene liberato dall'ultimo
+ * `message_body_release`.
+ *
+ * Un messaggio nel livello freddo ha `body` NULL: il corpo è lungo
+ * `cold_len` byte a partire da `cold_offset` nel file freddo della bacheca
+ * (vedi `tier_pass` e `load_spill`), e in memoria resta solo questo record.
+ */
 typedef struct {
     uint32_t id;
-    char author[MAX_USERNAME_LEN];
-    char subject[MAX_SUBJECT_LEN];
-    char* body;
-    char* timestamp;
-} Message;
+    uint32_t cold_len;
+    uint64_t cold_offset;
+    time_t created;
+    char author[MAX_USERNAME_LEN];
+    char subject[MAX_SUBJECT_LEN];
+    char* body;
+    char* timestamp;
+} Message;
+
+/**
+ * Corpo di un messaggio con conteggio dei riferimenti. `data` è terminato da
+ * `\0` e lungo `len` byte; chi lo riceve o lo invia conosce la lunghezza
+ * senza `strlen`, anche per corpi di diversi megabyte.
+ */
+typedef struct message_body {
+    atomic_uint refs;
+    uint32_t len;
+    char data[];
+} message_body;
+
+/**
+ * Il file del livello freddo di una bacheca. La bacheca ne tiene un
+ * riferimento finché è il file corrente; una lettura che deve inviare corpi
+ * espulsi ne prende uno per ogni messaggio copiato, così una compattazione
+ * (`cold_compact`) può sostituire il file senza chiuderlo sotto l'invio.
+ */
+typedef struct cold_file {
+    atomic_uint refs;
+    int fd;
+} cold_file;
+
+/** Messaggi per segmento di una shard: una potenza di 2, per indicizzare con shift e maschera. */
+#define SHARD_SEGMENT_SHIFT 8
+#define SHARD_SEGMENT_MESSAGES ((size_t)1 << SHARD_SEGMENT_SHIFT)
+
+/**
+ * L'indice dei segmenti di una shard. Quando si riempie viene sostituito da
+ * uno di capacità doppia, che copia solo i puntatori ai segmenti; il vecchio
+ * resta in `retired` fino allo shutdown, perché un lettore senza lock può
+ * ancora percorrerlo.
+ */
+typedef struct shard_directory {
+    struct shard_directory* retired;
+    size_t capacity;
+    Message* segments[];
+} shard_directory;
+
+/**
+ * Una partizione della bacheca. Il messaggio con ID `id` vive nella shard
+ * `id % MESSAGE_SHARDS`; ogni shard ha i propri messaggi e il proprio mutex,
+ * così scritture su shard diverse non si serializzano. L'allineamento evita
+ * che i mutex di shard vicine condividano una linea di cache.
+ *
+ * I messaggi stanno in segmenti di `SHARD_SEGMENT_MESSAGES` record, allocati
+ * una volta e mai spostati: crescere costa l'allocazione di un segmento, non
+ * la copia di tutta la shard, e l'indirizzo di un record resta valido finché
+ * una cancellazione non lo sovrascrive. I record sono ordinati per (data,
+ * ID), l'ordine in cui la bacheca viene inviata (`shard_insert`): una lettura
+ * riprende da dove era arrivata con una ricerca binaria. Le scritture avvengono sotto
+ * `mutex`; un inserimento in coda scrive il record e poi pubblica `size` con una
+ * store release, così un lettore che legge `size` con acquire vede completi
+ * tutti i record fino a lì. Cancellazioni, sostituzioni e inserimenti fuori
+ * ordine, che riscrivono record già pubblicati, incrementano `rewrites` prima e dopo (vedi
+ * `shard_rewrite_begin`): un lettore senza lock confronta il valore prima e
+ * dopo la lettura e, se è cambiato, ripete sotto il lock. Corpi e timestamp
+ * di record tolti o riscritti vengono rilasciati con `epoch_retire`, così un
+ * lettore può ancora usarli dopo la convalida, fino alla fine della propria
+ * sezione (`epoch_enter`).
+ */
+typedef struct MESSAGE_SHARD {
+    _Atomic(shard_directory*) directory;
+    _Atomic size_t size;
+    _Atomic unsigned rewrites;
+    size_t n_segments;
+    pthread_mutex_t mutex;
+} __attribute__((aligned(64))) MessageShard;
+
+/**
+ * Una bacheca: shard, ID, file e salvataggi sono propri di ogni istanza, così
+ * il traffico su una bacheca non contende lock né salvataggi con le altre.
+ *
+ * `version` cambia a ogni inserimento o cancellazione; parte da un valore
+ * casuale all'apertura, così una versione vista da un client prima di un
+ * riavvio non coincide con una del nuovo processo. `snapshot_io_m` è tenuto
+ * per tutta la durata di un salvataggio su file della bacheca. Le istanze
+ * aperte formano una lista (`next`) percorsa dal thread dei salvataggi e
+ * liberata solo allo shutdown.
+ *
+ * `expiry_version` e `expiry_due` sono usati solo dal thread della
+ * conservazione (`message_store_expire`): la versione dell'ultimo controllo
+ * dei limiti di numero, e l'ora (locale, come `Message.created`) in cui il
+ * messaggio più vecchio supererà l'età massima.
+ *
+ * `cold` è il file del livello freddo, creato dal thread del livello freddo
+ * alla prima espulsione (NULL fino ad allora) e scritto solo da lui, in coda
+ * a `cold_end`, come `tier_due`; lo leggono con `pread` gli invii della
+ * bacheca e i salvataggi, solo per messaggi già espulsi. `cold_dead` conta i
+ * byte del file di messaggi cancellati o sostituiti; quando superano metà
+ * del file il thread lo compatta (`cold_compact`) e sostituisce `cold` con
+ * tutte le shard bloccate.
+ */
+struct message_store {
+    MessageShard shards[MESSAGE_SHARDS];
+    _Atomic uint32_t next_id;
+    _Atomic uint64_t version;
+    _Atomic unsigned mutations_since_snapshot;
+    uint64_t expiry_version;
+    time_t expiry_due;
+    _Atomic(cold_file*) cold;
+    uint64_t cold_end;
+    _Atomic uint64_t cold_dead;
+    time_t tier_due;
+    pthread_mutex_t snapshot_io_m;
+    char* filename;
+    char name[MAX_BOARD_NAME_LEN];
+    struct message_store* next;
+};
+
+static thread_pool* load_pool = NULL;
+static pthread_mutex_t stores_m = PTHREAD_MUTEX_INITIALIZER;
+static message_store* stores = NULL;
+
+static pthread_t snapshot_tid;
+static pthread_mutex_t snapshot_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t snapshot_cv = PTHREAD_COND_INITIALIZER;
+static bool snapshot_running = false;
+static bool snapshot_stop = false;
+static bool snapshot_requested = false;
+static unsigned snapshot_interval = 0;
+static unsigned snapshot_every = 0;
+
+static pthread_t tier_tid;
+static pthread_mutex_t tier_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tier_cv = PTHREAD_COND_INITIALIZER;
+static bool tier_running = false;
+static bool tier_stop = false;
+static unsigned tier_cold_after = 0;
+static size_t tier_hot_budget = 0;
+static _Atomic size_t hot_bytes = 0;
+static _Atomic uint64_t cold_bytes = 0;
+
+static struct {
+    store_observer fn;
+    void* ctx;
+} observers[MAX_STORE_OBSERVERS];
+static int n_observers = 0;
+
+static void note_mutations(message_store* store, size_t n);
+static void cold_release(cold_file* cold);
+static void request_snapshot(void);
+static void stop_snapshots(void);
+static void stop_tiering(void);
+
+/**
+ * @brief Registra un osservatore delle modifiche alla bacheca.
+ *
+ * @return 0 in caso di successo, -1 se sono già registrati `MAX_STORE_OBSERVERS` osservatori.
+ *
+ * Va chiamata all'avvio, prima che i thread lavoratori modifichino la bacheca.
+ * L'osservatore viene chiamato con il lock della shard del messaggio: vede le
+ * modifiche di uno stesso ID nell'ordine in cui sono avvenute, ma non deve
+ * bloccarsi né chiamare funzioni di questo modulo.
+ */
+int message_store_add_observer(store_observer observer, void* ctx) {
+    if (n_observers >= MAX_STORE_OBSERVERS) return -1;
+    observers[n_observers].fn = observer;
+    observers[n_observers].ctx = ctx;
+    n_observers++;
+    return 0;
+}
+
+static void notify_observers(const message_store* store, store_event_type type, const Message* msg) {
+    if (n_observers == 0) return;
+    store_event event = {
+        .store = store,
+        .type = type,
+        .id = msg->id,
+        .created = msg->created,
+        .author = msg->author,
+        .subject = msg->subject,
+        .body = msg->body,
+        .timestamp = msg->timestamp,
+    };
+    for (int i = 0; i < n_observers; i++) {
+        observers[i].fn(&event, observers[i].ctx);
+    }
+}
+
+static inline message_body* body_header(const char* body) {
+    return (message_body*)(body - offsetof(message_body, data));
+}
+
+/**
+ * @brief Alloca un corpo di `len` byte (più il terminatore) con un riferimento.
+ *
+ * @return Il puntatore ai dati, da riempire dal chiamante, o NULL.
+ *
+ * Chi riceve un messaggio scrive il corpo direttamente qui e lo cede alla
+ * bacheca con `add_message_body`, senza copie intermedie.
+ */
+char* message_body_alloc(size_t len) {
+    if (len > UINT32_MAX - sizeof(message_body) - 1) return NULL;
+    message_body* b = malloc(sizeof(message_body) + len + 1);
+    if (!b) return NULL;
+    atomic_init(&b->refs, 1);
+    b->len = (uint32_t)len;
+    b->data[len] = '\0';
+    return b->data;
+}
+
+/**
+ * @brief Ridimensiona un corpo non ancora condiviso (o ne alloca uno se `body` è NULL).
+ */
+static char* body_resize(char* body, size_t len) {
+    message_body* b = realloc(body ? body_header(body) : NULL, sizeof(message_body) + len + 1);
+    if (!b) return NULL;
+    if (!body) atomic_init(&b->refs, 1);
+    b->len = (uint32_t)len;
+    b->data[len] = '\0';
+    return b->data;
+}
+
+void message_body_acquire(const char* body) {
+    atomic_fetch_add_explicit(&body_header(body)->refs, 1, memory_order_relaxed);
+}
+
+void message_body_release(const char* body) {
+    if (!body) return;
+    message_body* b = body_header(body);
+    if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) {
+        free(b);
+    }
+}
+
+size_t message_body_len(const char* body) {
+    return body_header(body)->len;
+}
+
+static void body_reply_release(const char* body) {
+    message_body_release(body);
+}
+
+/**
+ * @brief Accoda un corpo a `out` inviandolo dalla memoria della bacheca.
+ *
+ * I corpi lunghi restano riferiti fino all'invio (`reply_ref`); quelli brevi
+ * vengono copiati nel blocco della risposta.
+ */
+void message_body_reply(reply* out, const char* body) {
+    size_t len = message_body_len(body);
+    if (len < REPLY_REF_MIN) {
+        reply_bytes(out, body, len);
+        return;
+    }
+    message_body_acquire(body);
+    reply_ref(out, body, len, body_reply_release);
+}
+
+static inline MessageShard* shard_for(message_store* store, uint32_t id) {
+    return &store->shards[id % MESSAGE_SHARDS];
+}
+
+/**
+ * @brief Acquisisce i lock di tutte le shard, sempre in ordine di indice per evitare deadlock.
+ */
+static void lock_all_shards(message_store* store) {
+    for (size_t i = 0; i < MESSAGE_SHARDS; i++) {
+        PROF_LOCK(&store->shards[i].mutex, LOCK_SHARD);
+    }
+}
+
+static void unlock_all_shards(message_store* store) {
+    for (size_t i = MESSAGE_SHARDS; i > 0; i--) {
+        PROF_UNLOCK(&store->shards[i - 1].mutex);
+    }
+}
+
+/**
+ * @brief Converte un timestamp in formato `ctime` in `time_t`.
+ *
+ * Viene calcolato una sola volta, all'inserimento o al caricamento, e
+ * memorizzato in `Message.created` per ordinare la bacheca senza riparsare.
+ * Serve solo per l'ordinamento, quindi i campi vengono interpretati con
+ * `timegm`: è monotono nell'ora locale scritta nel timestamp e, a differenza di
+ * `mktime`, non consulta il fuso orario a ogni chiamata.
+ * Il formato fisso di `ctime` ("Sat Sep 20 15:06:06 2025") viene letto a mano,
+ * perché `strptime` con i nomi di mese dipendenti dal locale domina il tempo di
+ * caricamento di file grandi; `strptime` resta come ripiego.
+ */
+static time_t parse_timestamp(const char* timestamp) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    struct tm tm = {0};
+    if (!timestamp) return 0;
+
+    const char* t = timestamp;
+    if (strlen(t) >= 24 && t[3] == ' ' && t[7] == ' ' && t[10] == ' ' && t[13] == ':' && t[16] == ':' && t[19] == ' ') {
+        for (int m = 0; m < 12; m++) {
+            if (memcmp(t + 4, months + 3 * m, 3) == 0) {
+                tm.tm_mon = m;
+                tm.tm_mday = (t[8] == ' ' ? 0 : t[8] - '0') * 10 + (t[9] - '0');
+                tm.tm_hour = (t[11] - '0') * 10 + (t[12] - '0');
+                tm.tm_min = (t[14] - '0') * 10 + (t[15] - '0');
+                tm.tm_sec = (t[17] - '0') * 10 + (t[18] - '0');
+                tm.tm_year = atoi(t + 20) - 1900;
+                return timegm(&tm);
+            }
+        }
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(timestamp, TIMESTAMP_FORMAT, &tm)) {
+        return timegm(&tm);
+    }
+    return 0;
+}
+
+/**
+ * @brief Il record in posizione `i` della shard.
+ *
+ * Sotto il lock vale per ogni `i < size`; senza lock, per ogni `i` sotto un
+ * valore di `size` letto con acquire.
+ */
+static inline Message* shard_at(MessageShard* shard, size_t i) {
+    shard_directory* directory = atomic_load_explicit(&shard->directory, memory_order_acquire);
+    return &directory->segments[i >> SHARD_SEGMENT_SHIFT][i & (SHARD_SEGMENT_MESSAGES - 1)];
+}
+
+/**
+ * @brief Pubblica `size` record della shard ai lettori senza lock.
+ *
+ * Va chiamata con il lock della shard acquisito, dopo aver scritto i record.
+ */
+static inline void shard_publish(MessageShard* shard, size_t size) {
+    atomic_store_explicit(&shard->size, size, memory_order_release);
+}
+
+/**
+ * @brief Segnala ai lettori senza lock l'inizio di una riscrittura di record pubblicati.
+ *
+ * Va chiamata con il lock della shard acquisito, seguita da
+ * `shard_rewrite_end` prima di rilasciarlo. Durante la riscrittura
+ * `rewrites` è dispari.
+ */
+static inline void shard_rewrite_begin(MessageShard* shard) {
+    atomic_fetch_add_explicit(&shard->rewrites, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void shard_rewrite_end(MessageShard* shard) {
+    atomic_fetch_add_explicit(&shard->rewrites, 1, memory_order_release);
+}
+
+/**
+ * @brief Garantisce spazio per altri `extra` messaggi nella shard, allocando i segmenti mancanti.
+ *
+ * I segmenti esistenti non vengono mai spostati; se l'indice dei segmenti è
+ * pieno ne viene pubblicato uno di capacità doppia, e il vecchio ritirato.
+ * Va chiamata con il lock della shard acquisito.
+ */
+static bool shard_reserve(MessageShard* shard, size_t extra) {
+    size_t needed = (shard->size + extra + SHARD_SEGMENT_MESSAGES - 1) >> SHARD_SEGMENT_SHIFT;
+    shard_directory* directory = atomic_load_explicit(&shard->directory, memory_order_relaxed);
+    while (shard->n_segments < needed) {
+        if (!directory || shard->n_segments == directory->capacity) {
+            size_t new_capacity = directory ? directory->capacity * 2 : 4;
+            while (new_capacity < needed) new_capacity *= 2;
+            shard_directory* grown = malloc(sizeof(shard_directory) + new_capacity * sizeof(Message*));
+            if (!grown) {
+                perror("Malloc fallita");
+                return false;
+            }
+            grown->retired = directory;
+            grown->capacity = new_capacity;
+            if (directory) {
+                memcpy(grown->segments, directory->segments, shard->n_segments * sizeof(Message*));
+            }
+            atomic_store_explicit(&shard->directory, grown, memory_order_release);
+            directory = grown;
+        }
+        Message* segment = malloc(SHARD_SEGMENT_MESSAGES * sizeof(Message));
+        if (!segment) {
+            perror("Malloc fallita");
+            return false;
+        }
+        directory->segments[shard->n_segments++] = segment;
+    }
+    return true;
+}
+
+/**
+ * @brief Ordine della bacheca: per data (`Message.created`) e, a parità di data, per ID.
+ */
+static int compare_message_time(const void* a, const void* b) {
+    const Message* msg_a = (const Message*)a;
+    const Message* msg_b = (const Message*)b;
+    if (msg_a->created != msg_b->created) {
+        return (msg_a->created > msg_b->created) ? 1 : -1;
+    }
+    return (msg_a->id > msg_b->id) - (msg_a->id < msg_b->id);
+}
+
+/**
+ * @brief Sposta `n` record dalla posizione `from` alla posizione `to`.
+ *
+ * Copia un tratto contiguo alla volta, senza mai superare la fine di un
+ * segmento: verso l'inizio della shard partendo dal primo record, verso la
+ * fine partendo dall'ultimo, così i tratti sovrapposti non si sovrascrivono.
+ * Va chiamata con il lock della shard acquisito, dentro una riscrittura
+ * (`shard_rewrite_begin`); la destinazione deve essere già riservata.
+ */
+static void shard_move(MessageShard* shard, size_t to, size_t from, size_t n) {
+    if (to > from) {
+        while (n > 0) {
+            size_t to_room = ((to + n - 1) & (SHARD_SEGMENT_MESSAGES - 1)) + 1;
+            size_t from_room = ((from + n - 1) & (SHARD_SEGMENT_MESSAGES - 1)) + 1;
+            size_t run = n < to_room ? n : to_room;
+            if (run > from_room) run = from_room;
+            n -= run;
+            memmove(shard_at(shard, to + n), shard_at(shard, from + n), run * sizeof(Message));
+        }
+        return;
+    }
+    while (n > 0) {
+        size_t to_room = SHARD_SEGMENT_MESSAGES - (to & (SHARD_SEGMENT_MESSAGES - 1));
+        size_t from_room = SHARD_SEGMENT_MESSAGES - (from & (SHARD_SEGMENT_MESSAGES - 1));
+        size_t run = n < to_room ? n : to_room;
+        if (run > from_room) run = from_room;
+        memmove(shard_at(shard, to), shard_at(shard, from), run * sizeof(Message));
+        to += run;
+        from += run;
+        n -= run;
+    }
+}
+
+/**
+ * @brief Inserisce un messaggio nella shard, al suo posto nell'ordine per (data, ID), e lo pubblica.
+ *
+ * Quasi sempre il messaggio è il più recente e va in coda, senza toccare i
+ * record già pubblicati. Altrimenti (l'orologio è tornato indietro, o il
+ * messaggio arriva dal primario) i record successivi vengono spostati di un
+ * posto dentro una riscrittura. Va chiamata con il lock della shard acquisito.
+ */
+static bool shard_insert(MessageShard* shard, const Message* msg) {
+    if (!shard_reserve(shard, 1)) return false;
+    size_t size = shard->size;
+    size_t pos = size;
+    while (pos > 0 && compare_message_time(shard_at(shard, pos - 1), msg) > 0) pos--;
+    if (pos < size) {
+        shard_rewrite_begin(shard);
+        shard_move(shard, pos + 1, pos, size - pos);
+        *shard_at(shard, pos) = *msg;
+        shard_publish(shard, size + 1);
+        shard_rewrite_end(shard);
+    } else {
+        *shard_at(shard, size) = *msg;
+        shard_publish(shard, size + 1);
+    }
+    if (msg->body) {
+        atomic_fetch_add_explicit(&hot_bytes, message_body_len(msg->body), memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * @brief Sostituisce il record in posizione `i` con `msg`, spostandolo al suo posto nell'ordine.
+ *
+ * @return Il record, nella nuova posizione.
+ *
+ * Va chiamata con il lock della shard acquisito, dentro una riscrittura.
+ */
+static Message* shard_replace(MessageShard* shard, size_t i, const Message* msg) {
+    size_t pos = i;
+    while (pos > 0 && compare_message_time(shard_at(shard, pos - 1), msg) > 0) pos--;
+    while (pos + 1 < shard->size && compare_message_time(shard_at(shard, pos + 1), msg) < 0) pos++;
+    if (pos < i) {
+        shard_move(shard, pos + 1, pos, i - pos);
+    } else if (pos > i) {
+        shard_move(shard, i, i + 1, pos - i);
+    }
+    *shard_at(shard, pos) = *msg;
+    return shard_at(shard, pos);
+}
+
+/**
+ * @brief Libera segmenti e indici, attuali e ritirati, di una shard.
+ *
+ * Va chiamata allo shutdown, quando nessun lettore può più percorrerli.
+ */
+static void shard_free(MessageShard* shard) {
+    shard_directory* directory = atomic_load_explicit(&shard->directory, memory_order_relaxed);
+    for (size_t i = 0; directory && i < shard->n_segments; i++) {
+        free(directory->segments[i]);
+    }
+    while (directory) {
+        shard_directory* retired = directory->retired;
+        free(directory);
+        directory = retired;
+    }
+    atomic_store_explicit(&shard->directory, NULL, memory_order_relaxed);
+    shard->n_segments = 0;
+    shard_publish(shard, 0);
+}
+
+static void retired_body_release(void* body) {
+    message_body_release((const char*)body);
+}
+
+/**
+ * @brief Rilascia corpo e timestamp di un messaggio tolto dalla sua shard.
+ *
+ * Un lettore senza lock può averne appena copiato il record: il riferimento
+ * della shard al corpo e il timestamp vengono rilasciati con `epoch_retire`.
+ * Il corpo di un messaggio espulso resta nel file freddo fino alla prossima
+ * compattazione, e conta in `cold_dead`.
+ */
+static void message_release(message_store* store, Message* msg) {
+    if (msg->body) {
+        atomic_fetch_sub_explicit(&hot_bytes, message_body_len(msg->body), memory_order_relaxed);
+        epoch_retire(retired_body_release, (void*)msg->body);
+    } else {
+        atomic_fetch_add_explicit(&store->cold_dead, msg->cold_len, memory_order_relaxed);
+    }
+    if (msg->timestamp) {
+        epoch_retire(free, msg->timestamp);
+    }
+}
+
+/**
+ * @brief Imposta il pool usato per caricare in parallelo i file delle bacheche.
+ */
+void message_store_init(thread_pool* pool) {
+    load_pool = pool;
+}
+
+/**
+ * @brief Crea una bacheca e la carica da `file`.
+ *
+ * @param name Il nome della bacheca (troncato a `MAX_BOARD_NAME_LEN - 1`).
+ * @param file Il file della bacheca, o NULL per una bacheca solo in memoria
+ *             (una replica, che la riceve dal primario): niente caricamento
+ *             né salvataggi.
+ * @return La bacheca, o NULL se manca memoria o se il file non può essere
+ *         caricato per intero: una bacheca caricata a metà non viene mai
+ *         aperta, perché il suo salvataggio perderebbe il resto del file.
+ *
+ * La bacheca resta aperta fino a `message_store_shutdown`.
+ */
+message_store* message_store_open(const char* name, const char* file) {
+    message_store* store;
+    if (posix_memalign((void**)&store, _Alignof(MessageShard), sizeof(message_store)) != 0) {
+        return NULL;
+    }
+    memset(store, 0, sizeof(message_store));
+    store->filename = file ? strdup(file) : NULL;
+    if (file && !store->filename) {
+        free(store);
+        return NULL;
+    }
+    strncpy(store->name, name, sizeof(store->name) - 1);
+    for (size_t i = 0; i < MESSAGE_SHARDS; i++) {
+        pthread_mutex_init(&store->shards[i].mutex, NULL);
+    }
+    pthread_mutex_init(&store->snapshot_io_m, NULL);
+    atomic_store(&store->next_id, 1);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t seed = ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec) ^ ((uint64_t)getpid() << 32) ^ (uintptr_t)store;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    atomic_store(&store->version, seed ^ (seed >> 31));
+    if (load_messages(store) < 0) {
+        fprintf(stderr, "Impossibile caricare la bacheca %s da %s\n", store->name, store->filename);
+        for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+            shard_free(&store->shards[s]);
+            pthread_mutex_destroy(&store->shards[s].mutex);
+        }
+        pthread_mutex_destroy(&store->snapshot_io_m);
+        free(store->filename);
+        free(store);
+        return NULL;
+    }
+    store->expiry_version = atomic_load(&store->version) - 1;
+
+    pthread_mutex_lock(&stores_m);
+    store->next = stores;
+    stores = store;
+    pthread_mutex_unlock(&stores_m);
+    return store;
+}
+
+const char* message_store_name(const message_store* store) {
+    return store->name;
+}
+
+/**
+ * @brief Restituisce la versione corrente della bacheca.
+ *
+ * La versione viene incrementata dopo che la modifica è visibile: una copia
+ * della bacheca fatta dopo averla letta contiene almeno tutte le modifiche
+ * che la versione include, mai meno.
+ */
+uint64_t message_store_version(message_store* store) {
+    return atomic_load(&store->version);
+}
+
+/**
+ * @brief Ferma i salvataggi, salva ogni bacheca aperta e ne libera la memoria.
+ */
+void message_store_shutdown() {
+    stop_tiering();
+    stop_snapshots();
+    pthread_mutex_lock(&stores_m);
+    message_store* store = stores;
+    stores = NULL;
+    pthread_mutex_unlock(&stores_m);
+
+    while (store) {
+        message_store* next = store->next;
+        pthread_mutex_lock(&store->snapshot_io_m);
+        lock_all_shards(store);
+        save_messages(store);
+        for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+            MessageShard* shard = &store->shards[s];
+            for (size_t i = 0; i < shard->size; i++) {
+                message_release(store, shard_at(shard, i));
+            }
+            shard_free(shard);
+        }
+        cold_file* cold = atomic_load_explicit(&store->cold, memory_order_relaxed);
+        if (cold) {
+            atomic_fetch_sub_explicit(&cold_bytes, store->cold_end, memory_order_relaxed);
+            cold_release(cold);
+        }
+        free(store->filename);
+        unlock_all_shards(store);
+        pthread_mutex_unlock(&store->snapshot_io_m);
+        for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+            pthread_mutex_destroy(&store->shards[s].mutex);
+        }
+        pthread_mutex_destroy(&store->snapshot_io_m);
+        free(store);
+        store = next;
+    }
+    epoch_shutdown();
+}
+
+/**
+ * @brief Salva su file ogni bacheca aperta, senza liberare lo stato in memoria.
+ *
+ * Usata dall'hot restart: il nuovo processo ricarica le bacheche dai file,
+ * mentre il vecchio deve poter riprendere a servire se l'handoff fallisce.
+ * Attende l'eventuale salvataggio in background in corso, così un file non
+ * può essere sostituito da un figlio dopo questa scrittura.
+ */
+void message_store_save() {
+    pthread_mutex_lock(&stores_m);
+    message_store* store = stores;
+    pthread_mutex_unlock(&stores_m);
+
+    for (; store; store = store->next) {
+        pthread_mutex_lock(&store->snapshot_io_m);
+        lock_all_shards(store);
+        if (save_messages(store) == 0) {
+            atomic_store(&store->mutations_since_snapshot, 0);
+        }
+        unlock_all_shards(store);
+        pthread_mutex_unlock(&store->snapshot_io_m);
+    }
+}
+
+/**
+ * @brief Chiama `fn` per ogni bacheca aperta.
+ */
+void message_store_for_each(void (*fn)(message_store* store, void* ctx), void* ctx) {
+    pthread_mutex_lock(&stores_m);
+    message_store* store = stores;
+    pthread_mutex_unlock(&stores_m);
+    for (; store; store = store->next) {
+        fn(store, ctx);
+    }
+}
+
+/**
+ * @brief Restituisce il prossimo ID che verrà assegnato a un messaggio.
+ *
+ * `load_messages` ricalcola `next_id` dal massimo ID presente su file, che può
+ * essere minore se gli ultimi messaggi sono stati cancellati: durante l'hot
+ * restart il valore viene quindi passato esplicitamente per non riusare ID.
+ */
+uint32_t message_store_next_id(message_store* store) {
+    return atomic_load(&store->next_id);
+}
+
+void message_store_set_next_id(message_store* store, uint32_t next_id) {
+    uint32_t current = atomic_load(&store->next_id);
+    while (next_id > current && !atomic_compare_exchange_weak(&store->next_id, &current, next_id)) {
+    }
+}
+
+/**
+ * @brief Aggiunge un nuovo messaggio alla bacheca, copiandone il corpo.
+ */
+void add_message(message_store* store, const char* author, const char* subject, const char* body) {
+    size_t len = strlen(body);
+    char* copy = message_body_alloc(len);
+    if (!copy) return;
+    memcpy(copy, body, len);
+    add_message_body(store, author, subject, copy);
+}
+
+/**
+ * @brief Aggiunge un nuovo messaggio alla bacheca.
+ * 
+ * @param author L'autore del messaggio.
+ * @param subject L'oggetto del messaggio.
+ * @param body Il corpo, allocato con `message_body_alloc`: la bacheca ne
+ *             diventa proprietaria (anche in caso di errore).
+ * 
+ * La funzione è thread-safe:
+ * 1. Prepara il messaggio (timestamp) senza tenere alcun lock; il corpo è
+ *    già nella sua memoria definitiva.
+ * 2. Assegna un ID univoco con un incremento atomico di `next_id`.
+ * 3. Acquisisce il lock della sola shard a cui appartiene l'ID e vi inserisce il
+ *    messaggio, raddoppiandone la capacità se è piena.
+ * 4. Rilascia il lock.
+ * Scritture concorrenti finiscono quasi sempre su shard diverse e procedono in parallelo.
+ */
+void add_message_body(message_store* store, const char* author, const char* subject, char* body) {
+    // Un `\0` dentro il corpo lo termina, come per il resto del server.
+    body_header(body)->len = (uint32_t)strnlen(body, message_body_len(body));
+
+    time_t ora = time(NULL);
+    char stringa_ora[32];
+    if (ora == (time_t)-1 || ctime_r(&ora, stringa_ora) == NULL) {
+        message_body_release(body);
+        return;
+    }
+    stringa_ora[strcspn(stringa_ora, "\r\n")] = 0;
+
+    Message msg;
+    memset(&msg, 0, sizeof(Message));
+
+    strncpy(msg.author, author, sizeof(msg.author) - 1);
+    msg.author[sizeof(msg.author) - 1] = '\0';
+    strncpy(msg.subject, subject, sizeof(msg.subject) - 1);
+    msg.subject[sizeof(msg.subject) - 1] = '\0';
+    msg.body = body;
+    msg.timestamp = strdup(stringa_ora);
+    msg.created = parse_timestamp(stringa_ora);
+
+    if (!msg.timestamp) {
+        message_body_release(msg.body);
+        return;
+    }
+
+    msg.id = atomic_fetch_add(&store->next_id, 1);
+    MessageShard* shard = shard_for(store, msg.id);
+
+    PROF_LOCK(&shard->mutex, LOCK_SHARD);
+    bool inserted = shard_insert(shard, &msg);
+    if (inserted) {
+        notify_observers(store, STORE_EVENT_ADDED, &msg);
+    }
+    PROF_UNLOCK(&shard->mutex);
+
+    if (!inserted) {
+        message_body_release(msg.body);
+        free(msg.timestamp);
+        return;
+    }
+    note_mutations(store, 1);
+}
+
+/**
+ * @brief Cancella un messaggio dalla bacheca.
+ * 
+ * @param message_id L'ID del messaggio da cancellare.
+ * @param current_user L'utente che richiede la cancellazione, o NULL per
+ *                     cancellare senza controllo (replica che applica il primario).
+ * @return 0 in caso di successo, -1 se l'utente non è autorizzato, -2 se il messaggio non è stato trovato.
+ * 
+ * La funzione, in modo thread-safe e tenendo il lock della sola shard dell'ID:
+ * 1. Cerca il messaggio con l'ID specificato.
+ * 2. Verifica che `current_user` sia l'autore del messaggio.
+ * 3. Se autorizzato, rimuove il messaggio dalla shard compattando gli elementi successivi.
+ *    Questa operazione è O(N / MESSAGE_SHARDS).
+ * 4. Rilascia il corpo (liberato quando nessun invio in corso lo usa più) e il timestamp.
+ */
+int delete_message(message_store* store, uint32_t message_id, const char* current_user) {
+    MessageShard* shard = shard_for(store, message_id);
+    PROF_LOCK(&shard->mutex, LOCK_SHARD);
+    int found_index = -1;
+    for (size_t i = 0; i < shard->size; i++) {
+        if (shard_at(shard, i)->id == message_id) {
+            // Controllo di autorizzazione: solo l'autore può cancellare.
+            if (current_user && strcmp(shard_at(shard, i)->author, current_user) != 0) {
+                PROF_UNLOCK(&shard->mutex);
+                return -1; // Non autorizzato
+            }
+            found_index = i;
+            break;
+        }
+    }
+
+    if (found_index == -1) {
+        PROF_UNLOCK(&shard->mutex);
+        return -2; // Non trovato
+    }
+
+    notify_observers(store, STORE_EVENT_DELETED, shard_at(shard, found_index));
+    message_release(store, shard_at(shard, found_index));
+    
+    // Compatta la shard per rimuovere il messaggio.
+    size_t size = shard->size;
+    shard_rewrite_begin(shard);
+    shard_move(shard, (size_t)found_index, (size_t)found_index + 1, size - (size_t)found_index - 1);
+    shard_publish(shard, size - 1);
+    shard_rewrite_end(shard);
+    PROF_UNLOCK(&shard->mutex);
+    note_mutations(store, 1);
+    return 0; // Successo
+}
+
+/**
+ * @brief Aggiunge più messaggi dello stesso autore come un'unica modifica della bacheca.
+ *
+ * @param subjects Gli oggetti degli `n` messaggi.
+ * @param bodies I corpi, allocati con `message_body_alloc`: la bacheca ne
+ *               diventa proprietaria. Un corpo NULL indica un elemento non
+ *               valido, che consuma il proprio ID senza essere inserito.
+ * @param results Per ogni elemento, 0 se inserito, -1 altrimenti.
+ * @return L'ID del primo elemento: l'elemento `i` ha ID primo + `i`.
+ *
+ * Gli `n` ID vengono riservati con un solo incremento atomico e i messaggi
+ * hanno tutti lo stesso timestamp. Gli ID consecutivi si distribuiscono a
+ * rotazione sulle shard: ogni shard coinvolta viene bloccata una sola volta,
+ * in ordine di indice, e cresce al più una volta per tutti i suoi elementi.
+ * Gli osservatori ricevono un evento per messaggio, ma la bacheca cambia
+ * versione una sola volta e le modifiche contano in blocco per i salvataggi.
+ */
+uint32_t message_store_add_batch(message_store* store, const char* author, const char* const* subjects,
+                                 char* const* bodies, size_t n, int* results) {
+    time_t ora = time(NULL);
+    char stringa_ora[32];
+    bool has_time = ora != (time_t)-1 && ctime_r(&ora, stringa_ora) != NULL;
+    if (has_time) stringa_ora[strcspn(stringa_ora, "\r\n")] = 0;
+    time_t created = has_time ? parse_timestamp(stringa_ora) : 0;
+
+    uint32_t first_id = atomic_fetch_add(&store->next_id, (uint32_t)n);
+    Message* msgs = has_time ? calloc(n, sizeof(Message)) : NULL;
+    size_t per_shard[MESSAGE_SHARDS] = {0};
+    for (size_t i = 0; i < n; i++) {
+        results[i] = -1;
+        char* body = bodies[i];
+        if (!body) continue;
+        if (!msgs) {
+            message_body_release(body);
+            continue;
+        }
+        Message* msg = &msgs[i];
+        body_header(body)->len = (uint32_t)strnlen(body, message_body_len(body));
+        msg->id = first_id + (uint32_t)i;
+        strncpy(msg->author, author, sizeof(msg->author) - 1);
+        strncpy(msg->subject, subjects[i], sizeof(msg->subject) - 1);
+        msg->created = created;
+        msg->timestamp = strdup(stringa_ora);
+        if (!msg->timestamp) {
+            message_body_release(body);
+            continue;
+        }
+        msg->body = body;
+        per_shard[msg->id % MESSAGE_SHARDS]++;
+    }
+    if (!msgs) return first_id;
+
+    size_t inserted = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        if (per_shard[s] == 0) continue;
+        MessageShard* shard = &store->shards[s];
+        // Il primo elemento con ID nella shard `s`, poi uno ogni MESSAGE_SHARDS.
+        size_t start = (s + MESSAGE_SHARDS - first_id % MESSAGE_SHARDS) % MESSAGE_SHARDS;
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        if (shard_reserve(shard, per_shard[s])) {
+            for (size_t i = start; i < n; i += MESSAGE_SHARDS) {
+                if (!msgs[i].body) continue;
+                shard_insert(shard, &msgs[i]);
+                notify_observers(store, STORE_EVENT_ADDED, &msgs[i]);
+                results[i] = 0;
+                inserted++;
+            }
+        }
+        PROF_UNLOCK(&shard->mutex);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (results[i] != 0 && msgs[i].body) {
+            message_body_release(msgs[i].body);
+            free(msgs[i].timestamp);
+        }
+    }
+    free(msgs);
+    note_mutations(store, inserted);
+    return first_id;
+}
+
+/** Un ID di `message_store_delete_batch` e la sua posizione nella richiesta. */
+typedef struct delete_entry {
+    uint32_t id;
+    uint32_t index;
+} delete_entry;
+
+/** Per shard, poi per ID, poi per posizione. */
+static int compare_delete_entry(const void* a, const void* b) {
+    const delete_entry* x = (const delete_entry*)a;
+    const delete_entry* y = (const delete_entry*)b;
+    if (x->id % MESSAGE_SHARDS != y->id % MESSAGE_SHARDS) {
+        return x->id % MESSAGE_SHARDS > y->id % MESSAGE_SHARDS ? 1 : -1;
+    }
+    if (x->id != y->id) return x->id > y->id ? 1 : -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * @brief Prima voce di `entries` (ordinate per ID) con ID `id`, o NULL.
+ */
+static delete_entry* find_delete_entry(delete_entry* entries, size_t n, uint32_t id) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < n && entries[lo].id == id ? &entries[lo] : NULL;
+}
+
+/**
+ * @brief Cancella più messaggi come un'unica modifica della bacheca.
+ *
+ * @param current_user L'utente che richiede le cancellazioni, come per `delete_message`.
+ * @param results Per ogni ID, come `delete_message`: 0, -1 se l'utente non è
+ *                autorizzato, -2 se il messaggio non è stato trovato.
+ * @return Il numero di messaggi cancellati.
+ *
+ * Gli ID vengono ordinati per shard; ogni shard coinvolta viene bloccata una
+ * sola volta e percorsa una sola volta, cercando ogni suo messaggio tra gli
+ * ID richiesti con una ricerca binaria e compattandola durante la stessa
+ * passata. Un ID ripetuto viene cancellato una volta sola: le ripetizioni
+ * risultano non trovate.
+ */
+size_t message_store_delete_batch(message_store* store, const uint32_t* ids, size_t n, const char* current_user,
+                                  int* results) {
+    delete_entry* entries = malloc(n * sizeof(delete_entry));
+    if (!entries) {
+        size_t removed = 0;
+        for (size_t i = 0; i < n; i++) {
+            results[i] = delete_message(store, ids[i], current_user);
+            if (results[i] == 0) removed++;
+        }
+        return removed;
+    }
+    for (size_t i = 0; i < n; i++) {
+        entries[i].id = ids[i];
+        entries[i].index = (uint32_t)i;
+        results[i] = -2;
+    }
+    qsort(entries, n, sizeof(delete_entry), compare_delete_entry);
+
+    size_t removed = 0;
+    for (size_t start = 0; start < n;) {
+        size_t end = start + 1;
+        while (end < n && entries[end].id % MESSAGE_SHARDS == entries[start].id % MESSAGE_SHARDS) end++;
+        MessageShard* shard = shard_for(store, entries[start].id);
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        shard_rewrite_begin(shard);
+        size_t kept = 0;
+        for (size_t i = 0; i < shard->size; i++) {
+            Message* msg = shard_at(shard, i);
+            delete_entry* e = find_delete_entry(entries + start, end - start, msg->id);
+            if (e && current_user && strcmp(msg->author, current_user) != 0) {
+                for (; e < entries + end && e->id == msg->id; e++) {
+                    results[e->index] = -1;
+                }
+            } else if (e) {
+                notify_observers(store, STORE_EVENT_DELETED, msg);
+                message_release(store, msg);
+                results[e->index] = 0;
+                removed++;
+                continue;
+            }
+            *shard_at(shard, kept++) = *msg;
+        }
+        shard_publish(shard, kept);
+        shard_rewrite_end(shard);
+        PROF_UNLOCK(&shard->mutex);
+        start = end;
+    }
+    free(entries);
+    note_mutations(store, removed);
+    return removed;
+}
+
+/**
+ * @brief Inserisce un messaggio ricevuto dal primario, con il suo ID e il suo timestamp.
+ *
+ * @param body Il corpo, allocato con `message_body_alloc`: la bacheca ne
+ *             diventa proprietaria (anche se il messaggio viene ignorato).
+ * @return 0 se inserito, 1 se era già presente identico, -1 in caso di errore.
+ *
+ * Una replica riceve la copia della bacheca mentre il flusso delle modifiche
+ * è già attivo, quindi può vedere due volte lo stesso inserimento: un
+ * duplicato identico viene ignorato, e l'applicazione è idempotente. Un
+ * messaggio diverso con lo stesso ID sostituisce quello presente.
+ */
+int message_store_insert(message_store* store, uint32_t id, const char* author, const char* subject, char* body, const char* timestamp) {
+    body_header(body)->len = (uint32_t)strnlen(body, message_body_len(body));
+
+    Message msg;
+    memset(&msg, 0, sizeof(Message));
+    msg.id = id;
+    strncpy(msg.author, author, sizeof(msg.author) - 1);
+    strncpy(msg.subject, subject, sizeof(msg.subject) - 1);
+    msg.body = body;
+    msg.timestamp = strdup(timestamp);
+    if (!msg.timestamp) {
+        message_body_release(body);
+        return -1;
+    }
+    msg.created = parse_timestamp(timestamp);
+    message_store_set_next_id(store, id + 1);
+
+    MessageShard* shard = shard_for(store, id);
+    PROF_LOCK(&shard->mutex, LOCK_SHARD);
+    int res = 0;
+    Message* existing = NULL;
+    size_t existing_index = 0;
+    for (size_t i = 0; i < shard->size; i++) {
+        if (shard_at(shard, i)->id == id) {
+            existing = shard_at(shard, i);
+            existing_index = i;
+            break;
+        }
+    }
+    if (existing && existing->body && existing->timestamp && strcmp(existing->timestamp, msg.timestamp) == 0 &&
+        strcmp(existing->author, msg.author) == 0 && strcmp(existing->subject, msg.subject) == 0 &&
+        message_body_len(existing->body) == message_body_len(body) &&
+        memcmp(existing->body, body, message_body_len(body)) == 0) {
+        res = 1;
+    } else if (existing) {
+        // Stesso ID ma contenuto diverso: il primario è ripartito da un file
+        // senza gli ultimi messaggi e ha riusato l'ID. Vale la sua versione.
+        notify_observers(store, STORE_EVENT_DELETED, existing);
+        message_release(store, existing);
+        shard_rewrite_begin(shard);
+        existing = shard_replace(shard, existing_index, &msg);
+        shard_rewrite_end(shard);
+        atomic_fetch_add_explicit(&hot_bytes, message_body_len(msg.body), memory_order_relaxed);
+        notify_observers(store, STORE_EVENT_ADDED, existing);
+    } else if (shard_insert(shard, &msg)) {
+        notify_observers(store, STORE_EVENT_ADDED, &msg);
+    } else {
+        res = -1;
+    }
+    PROF_UNLOCK(&shard->mutex);
+
+    if (res != 0) {
+        message_body_release(msg.body);
+        free(msg.timestamp);
+        return res;
+    }
+    note_mutations(store, 1);
+    return 0;
+}
+
+static int compare_id(const void* a, const void* b) {
+    uint32_t id_a = *(const uint32_t*)a;
+    uint32_t id_b = *(const uint32_t*)b;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/**
+ * @brief Cancella i messaggi il cui ID non è in `ids` (ordinato in modo crescente).
+ *
+ * Chiamata da una replica alla fine della copia della bacheca: i messaggi
+ * rimasti da una connessione precedente e cancellati nel frattempo sul
+ * primario spariscono, con un evento per ciascuno.
+ */
+void message_store_retain(message_store* store, const uint32_t* ids, size_t n_ids) {
+    size_t removed = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        MessageShard* shard = &store->shards[s];
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        shard_rewrite_begin(shard);
+        size_t kept = 0;
+        for (size_t i = 0; i < shard->size; i++) {
+            Message* msg = shard_at(shard, i);
+            if (n_ids > 0 && bsearch(&msg->id, ids, n_ids, sizeof(uint32_t), compare_id)) {
+                *shard_at(shard, kept++) = *msg;
+                continue;
+            }
+            notify_observers(store, STORE_EVENT_DELETED, msg);
+            message_release(store, msg);
+            removed++;
+        }
+        shard_publish(shard, kept);
+        shard_rewrite_end(shard);
+        PROF_UNLOCK(&shard->mutex);
+    }
+    note_mutations(store, removed);
+}
+
+/** Un messaggio candidato alla scadenza: la copia dei soli campi che servono ai limiti. */
+typedef struct expiry_entry {
+    uint32_t id;
+    bool expired;
+    time_t created;
+    uint64_t author_hash;
+} expiry_entry;
+
+/**
+ * @brief Hash FNV-1a dell'autore, letto al più per la lunghezza del campo.
+ *
+ * Il limite serve alla copia senza lock, che può leggere un campo riscritto
+ * a metà (e poi scartarlo).
+ */
+static uint64_t author_hash(const char* author) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < MAX_USERNAME_LEN && author[i]; i++) {
+        h = (h ^ (uint8_t)author[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Copia ID, data e hash dell'autore di al più `capacity` messaggi della shard.
+ *
+ * @param locked Se il chiamante tiene il lock della shard. Senza lock la
+ *               copia percorre i record pubblicati fino a `size` (letto con
+ *               acquire) e viene scartata se nel frattempo una cancellazione
+ *               o una sostituzione ha riscritto dei record.
+ * @return Il numero di elementi copiati, o `SIZE_MAX` se la copia senza lock
+ *         va ripetuta sotto il lock.
+ */
+static size_t expiry_copy_shard(MessageShard* shard, expiry_entry* entries, size_t capacity, bool by_author,
+                                bool locked) {
+    unsigned rewrites = atomic_load_explicit(&shard->rewrites, memory_order_acquire);
+    if (!locked && (rewrites & 1)) return SIZE_MAX;
+    size_t size = atomic_load_explicit(&shard->size, memory_order_acquire);
+    size_t n = 0;
+    for (size_t i = 0; i < size && n < capacity; i++) {
+        const Message* msg = shard_at(shard, i);
+        entries[n].id = msg->id;
+        entries[n].expired = false;
+        entries[n].created = msg->created;
+        entries[n].author_hash = by_author ? author_hash(msg->author) : 0;
+        n++;
+    }
+    if (!locked) {
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shard->rewrites, memory_order_relaxed) != rewrites) return SIZE_MAX;
+    }
+    return n;
+}
+
+static int compare_shard_id(const void* a, const void* b) {
+    uint32_t id_a = *(const uint32_t*)a;
+    uint32_t id_b = *(const uint32_t*)b;
+    if (id_a % MESSAGE_SHARDS != id_b % MESSAGE_SHARDS) {
+        return id_a % MESSAGE_SHARDS > id_b % MESSAGE_SHARDS ? 1 : -1;
+    }
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/** Dal più recente al più vecchio. */
+static int compare_expiry_newest(const void* a, const void* b) {
+    const expiry_entry* x = (const expiry_entry*)a;
+    const expiry_entry* y = (const expiry_entry*)b;
+    if (x->created != y->created) return x->created < y->created ? 1 : -1;
+    return (x->id < y->id) - (x->id > y->id);
+}
+
+/** Per autore, e per ogni autore dal più recente al più vecchio. */
+static int compare_expiry_author(const void* a, const void* b) {
+    const expiry_entry* x = (const expiry_entry*)a;
+    const expiry_entry* y = (const expiry_entry*)b;
+    if (x->author_hash != y->author_hash) return x->author_hash > y->author_hash ? 1 : -1;
+    return compare_expiry_newest(a, b);
+}
+
+/**
+ * @brief L'ora corrente nella stessa scala di `Message.created`.
+ *
+ * `parse_timestamp` interpreta con `timegm` un timestamp scritto in ora
+ * locale, quindi anche l'ora corrente va espressa così per confrontarle.
+ */
+static time_t local_now(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+    if (!localtime_r(&now, &tm)) return now;
+    return timegm(&tm);
+}
+
+/**
+ * @brief Rimuove da una shard al più `batch` dei messaggi con ID in `ids` (ordinato).
+ *
+ * @return Il numero di messaggi rimossi.
+ *
+ * Il lock della shard è tenuto per una sola passata, che si ferma appena
+ * rimossi `batch` messaggi: i messaggi scaduti sono i più vecchi, quasi
+ * sempre in testa alla shard, e la parte restante viene spostata un
+ * segmento alla volta.
+ */
+static size_t shard_remove_batch(message_store* store, MessageShard* shard, const uint32_t* ids, size_t n_ids,
+                                 size_t batch) {
+    size_t removed = 0;
+    PROF_LOCK(&shard->mutex, LOCK_SHARD);
+    shard_rewrite_begin(shard);
+    size_t size = shard->size;
+    size_t kept = 0;
+    size_t i = 0;
+    for (; i < size && removed < batch; i++) {
+        Message* msg = shard_at(shard, i);
+        if (bsearch(&msg->id, ids, n_ids, sizeof(uint32_t), compare_id)) {
+            notify_observers(store, STORE_EVENT_DELETED, msg);
+            message_release(store, msg);
+            removed++;
+        } else {
+            *shard_at(shard, kept++) = *msg;
+        }
+    }
+    if (removed > 0) {
+        shard_move(shard, kept, i, size - i);
+        shard_publish(shard, size - removed);
+    }
+    shard_rewrite_end(shard);
+    PROF_UNLOCK(&shard->mutex);
+    return removed;
+}
+
+/**
+ * @brief Applica i limiti di conservazione alla bacheca, cancellando i messaggi che li superano.
+ *
+ * @param policy I limiti; un campo a 0 non limita.
+ * @param batch Numero massimo di messaggi rimossi per ogni acquisizione del lock di una shard.
+ * @return Il numero di messaggi cancellati.
+ *
+ * Chiamata periodicamente dal thread della conservazione, mai in parallelo
+ * con sé stessa sulla stessa bacheca. I messaggi vengono prima copiati (ID,
+ * data, hash dell'autore) senza il lock delle shard, che viene preso solo
+ * se una cancellazione riscrive la shard durante la copia; i limiti
+ * si calcolano sulla copia senza lock, e le cancellazioni avvengono a blocchi
+ * di `batch` messaggi per shard. La copia si fa solo se serve: i limiti di
+ * numero cambiano esito solo se la bacheca ha una nuova versione, quello di
+ * età solo quando il messaggio più vecchio lo raggiunge.
+ *
+ * Ogni cancellazione è notificata agli osservatori come `C_DELETE_MESSAGE`
+ * (subscriber, repliche) e conta come modifica per i salvataggi; a fine
+ * passata viene richiesto un salvataggio, così il file segue le scadenze. Un
+ * messaggio scaduto ma ancora nel file dopo un crash torna in memoria al
+ * caricamento e viene cancellato di nuovo alla passata successiva.
+ */
+size_t message_store_expire(message_store* store, const retention_policy* policy, size_t batch) {
+    time_t now = local_now();
+    uint64_t version = atomic_load(&store->version);
+    bool count_limits = policy->max_messages > 0 || policy->max_per_author > 0;
+    bool count_due = count_limits && version != store->expiry_version;
+    bool age_due = policy->max_age_sec > 0 && now >= store->expiry_due;
+    if (!count_due && !age_due) return 0;
+    store->expiry_version = version;
+
+    // Un margine per i messaggi aggiunti durante la copia; quelli oltre
+    // cambiano la versione e vengono considerati alla passata successiva.
+    size_t total = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        total += atomic_load_explicit(&store->shards[s].size, memory_order_acquire);
+    }
+    size_t capacity = total + 64;
+    expiry_entry* entries = malloc(capacity * sizeof(expiry_entry));
+    if (!entries) return 0;
+    size_t n = 0;
+    bool by_author = policy->max_per_author > 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        MessageShard* shard = &store->shards[s];
+        size_t copied = expiry_copy_shard(shard, entries + n, capacity - n, by_author, false);
+        if (copied == SIZE_MAX) {
+            PROF_LOCK(&shard->mutex, LOCK_SHARD);
+            copied = expiry_copy_shard(shard, entries + n, capacity - n, by_author, true);
+            PROF_UNLOCK(&shard->mutex);
+        }
+        n += copied;
+    }
+
+    // Un timestamp illeggibile (created == 0) non fa scadere il messaggio per età.
+    time_t cutoff = (time_t)(now - (time_t)policy->max_age_sec);
+    size_t n_expired = 0;
+    if (policy->max_age_sec > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (entries[i].created != 0 && entries[i].created < cutoff) {
+                entries[i].expired = true;
+                n_expired++;
+            }
+        }
+    }
+    if (policy->max_per_author > 0 && n > policy->max_per_author) {
+        qsort(entries, n, sizeof(expiry_entry), compare_expiry_author);
+        size_t run = 0;
+        for (size_t i = 0; i < n; i++) {
+            run = (i > 0 && entries[i].author_hash == entries[i - 1].author_hash) ? run + 1 : 1;
+            if (run > policy->max_per_author && !entries[i].expired) {
+                entries[i].expired = true;
+                n_expired++;
+            }
+        }
+    }
+    if (policy->max_messages > 0 && n - n_expired > policy->max_messages) {
+        qsort(entries, n, sizeof(expiry_entry), compare_expiry_newest);
+        size_t alive = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (entries[i].expired) continue;
+            if (++alive > policy->max_messages) {
+                entries[i].expired = true;
+                n_expired++;
+            }
+        }
+    }
+
+    // Il prossimo controllo di età serve quando il più vecchio dei rimasti scade.
+    time_t oldest = 0;
+    uint32_t* ids = n_expired > 0 ? malloc(n_expired * sizeof(uint32_t)) : NULL;
+    size_t n_ids = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (entries[i].expired) {
+            if (ids) ids[n_ids++] = entries[i].id;
+        } else if (entries[i].created != 0 && (oldest == 0 || entries[i].created < oldest)) {
+            oldest = entries[i].created;
+        }
+    }
+    free(entries);
+    store->expiry_due = oldest != 0 ? oldest + (time_t)policy->max_age_sec + 1 : now + (time_t)policy->max_age_sec;
+    if (n_expired > 0 && !ids) {
+        // Senza memoria per gli ID si riprova alla prossima passata.
+        store->expiry_version = version - 1;
+        store->expiry_due = 0;
+        return 0;
+    }
+
+    // Ordinati per shard e, in ogni shard, per ID (per la ricerca binaria).
+    qsort(ids, n_ids, sizeof(uint32_t), compare_shard_id);
+    size_t removed = 0;
+    for (size_t start = 0; start < n_ids;) {
+        size_t end = start + 1;
+        while (end < n_ids && ids[end] % MESSAGE_SHARDS == ids[start] % MESSAGE_SHARDS) end++;
+        MessageShard* shard = shard_for(store, ids[start]);
+        size_t done;
+        do {
+            done = shard_remove_batch(store, shard, ids + start, end - start, batch);
+            removed += done;
+        } while (done == batch);
+        start = end;
+    }
+    free(ids);
+
+    note_mutations(store, removed);
+    if (removed > 0) {
+        request_snapshot();
+    }
+    return removed;
+}
+
+/** Byte letti dal file freddo per volta, per inviare o salvare un corpo espulso. */
+#define COLD_PIECE (64 * 1024)
+
+static void cold_acquire(cold_file* cold) {
+    atomic_fetch_add_explicit(&cold->refs, 1, memory_order_relaxed);
+}
+
+static void cold_release(cold_file* cold) {
+    if (atomic_fetch_sub_explicit(&cold->refs, 1, memory_order_acq_rel) == 1) {
+        close(cold->fd);
+        free(cold);
+    }
+}
+
+static void retired_cold_release(void* cold) {
+    cold_release((cold_file*)cold);
+}
+
+/**
+ * @brief Copia su `file` il corpo di un messaggio espulso, a blocchi, senza caricarlo in memoria.
+ *
+ * Va chiamata con tutte le shard bloccate, così `cold` e gli offset dei
+ * messaggi non cambiano durante la copia.
+ *
+ * @param last Riceve l'ultimo byte del corpo.
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+static int cold_copy(const message_store* store, const Message* msg, FILE* file, char* last) {
+    char buffer[COLD_PIECE];
+    cold_file* cold = atomic_load_explicit(&store->cold, memory_order_relaxed);
+    uint64_t done = 0;
+    while (done < msg->cold_len) {
+        size_t want = msg->cold_len - done < sizeof(buffer) ? (size_t)(msg->cold_len - done) : sizeof(buffer);
+        ssize_t r = pread(cold->fd, buffer, want, (off_t)(msg->cold_offset + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        if (fwrite(buffer, 1, (size_t)r, file) != (size_t)r) return -1;
+        *last = buffer[r - 1];
+        done += (uint64_t)r;
+    }
+    return 0;
+}
+
+/** Messaggi copiati da una shard a ogni passo di una lettura della bacheca. */
+#define BOARD_WINDOW 16
+
+/** Byte di pacchetti, circa, accodati da un passo di una lettura della bacheca. */
+#define BOARD_STEP_BYTES (4 * REPLY_CHUNK_SIZE)
+
+/**
+ * Un messaggio copiato da una lettura della bacheca. Il corpo è riferito
+ * (`message_body_acquire`); quello di un messaggio espulso resta nel file
+ * freddo, di cui `cold` tiene un riferimento, e viene letto a pezzi durante
+ * l'invio. Il timestamp è copiato in `timestamp`, o in una copia allocata se
+ * non ci sta, e `msg.timestamp` punta alla copia.
+ */
+typedef struct board_item {
+    Message msg;
+    cold_file* cold;
+    char timestamp[32];
+} board_item;
+
+/**
+ * La finestra di una shard in una lettura della bacheca: i suoi prossimi
+ * messaggi in ordine di data, `items[next]` il primo non ancora inviato.
+ * Quando è esaurita viene riempita di nuovo ripartendo dopo l'ultimo
+ * messaggio copiato (`last`, di cui contano solo data e ID).
+ */
+typedef struct board_window {
+    board_item items[BOARD_WINDOW];
+    size_t size;
+    size_t next;
+    bool started;
+    Message last;
+} board_window;
+
+/**
+ * Una lettura della bacheca in corso, prodotta a passi (`reply_stream`):
+ * fonde a k vie le finestre delle shard con un min-heap. Alla fine accoda
+ * `END_BOARD` (con `version` se `versioned`) oppure, per la copia di una
+ * replica, chiama `finish`. `sending` indica che il pacchetto del messaggio
+ * in cima allo heap è iniziato e, per un corpo espulso, ne sono stati
+ * accodati `cold_sent` byte: il corpo può occupare più passi.
+ */
+typedef struct board_cursor {
+    reply_source source;
+    message_store* store;
+    bool started;
+    bool versioned;
+    uint64_t version;
+    void (*finish)(reply* out, bool complete);
+    bool sending;
+    uint64_t cold_sent;
+    char last_printed_date[32];
+    board_window* heap[MESSAGE_SHARDS];
+    size_t heap_size;
+    board_window windows[MESSAGE_SHARDS];
+} board_cursor;
+
+static void item_release(board_item* item) {
+    message_body_release(item->msg.body);
+    if (item->cold) {
+        cold_release(item->cold);
+    }
+    if (item->msg.timestamp != item->timestamp) {
+        free(item->msg.timestamp);
+    }
+}
+
+/**
+ * @brief Rende proprio di `item` il record copiato in `item->msg`: copia il timestamp e riferisce il corpo.
+ *
+ * @param cold Il file freddo da cui leggere il corpo, se il messaggio è espulso.
+ * @return 0, o -1 se manca memoria per un timestamp lungo (il corpo non è
+ *         allora riferito).
+ */
+static int item_take(board_item* item, cold_file* cold) {
+    const char* timestamp = item->msg.timestamp;
+    item->cold = NULL;
+    if (timestamp && strlen(timestamp) < sizeof(item->timestamp)) {
+        strcpy(item->timestamp, timestamp);
+        item->msg.timestamp = item->timestamp;
+    } else if (timestamp) {
+        item->msg.timestamp = strdup(timestamp);
+        if (!item->msg.timestamp) return -1;
+    }
+    if (item->msg.body) {
+        message_body_acquire(item->msg.body);
+    } else if (cold) {
+        cold_acquire(cold);
+        item->cold = cold;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prima posizione della shard dopo (data, ID) di `after`, con una ricerca binaria.
+ */
+static size_t shard_seek(MessageShard* shard, size_t size, const Message* after) {
+    size_t lo = 0;
+    size_t hi = size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (compare_message_time(shard_at(shard, mid), after) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Copia senza lock nella finestra i prossimi record della shard.
+ *
+ * @return 1 se la copia è valida, 0 se una riscrittura l'ha attraversata (o
+ *         non c'è uno slot per la sezione) e va ripetuta sotto il lock, -1 se
+ *         manca memoria.
+ *
+ * I record vengono prima copiati così come sono, senza seguire i puntatori:
+ * durante una riscrittura possono essere a metà. Solo dopo che `rewrites`
+ * ha confermato la copia vengono letti timestamp e corpi, che restano
+ * allocati fino a `epoch_exit` anche se nel frattempo il messaggio viene
+ * cancellato o espulso. Il file freddo è letto dentro la copia: una
+ * compattazione lo sostituisce dentro una riscrittura di ogni shard, quindi
+ * una copia convalidata ha offset e file coerenti.
+ */
+static int window_copy_unlocked(message_store* store, MessageShard* shard, board_window* w) {
+    if (!epoch_enter()) return 0;
+    unsigned rewrites = atomic_load_explicit(&shard->rewrites, memory_order_acquire);
+    int res = (rewrites & 1) ? 0 : 1;
+    cold_file* cold = NULL;
+    if (res == 1) {
+        size_t size = atomic_load_explicit(&shard->size, memory_order_acquire);
+        size_t i = w->started ? shard_seek(shard, size, &w->last) : 0;
+        for (; i < size && w->size < BOARD_WINDOW; i++) {
+            w->items[w->size++].msg = *shard_at(shard, i);
+        }
+        cold = atomic_load_explicit(&store->cold, memory_order_acquire);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shard->rewrites, memory_order_relaxed) != rewrites) res = 0;
+    }
+    size_t taken = 0;
+    while (res == 1 && taken < w->size) {
+        if (item_take(&w->items[taken], cold) < 0) {
+            res = -1;
+        } else {
+            taken++;
+        }
+    }
+    epoch_exit();
+    if (res != 1) w->size = taken;
+    return res;
+}
+
+/**
+ * @brief Riempie la finestra con i prossimi messaggi della shard.
+ *
+ * @return 0 in caso di successo (una finestra vuota indica la shard finita),
+ *         -1 se manca memoria.
+ *
+ * Di solito la copia avviene senza lock (`window_copy_unlocked`); se una
+ * riscrittura la attraversa viene ripetuta con il lock della shard, tenuto
+ * solo per la ricerca e la copia di al più `BOARD_WINDOW` record. I corpi
+ * dei messaggi espulsi non vengono letti qui ma durante l'invio.
+ */
+static int window_fill(message_store* store, MessageShard* shard, board_window* w) {
+    w->size = 0;
+    w->next = 0;
+    int copied = window_copy_unlocked(store, shard, w);
+    int res = copied < 0 ? -1 : 0;
+    if (copied == 0) {
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        cold_file* cold = atomic_load_explicit(&store->cold, memory_order_relaxed);
+        size_t i = w->started ? shard_seek(shard, shard->size, &w->last) : 0;
+        for (; i < shard->size && w->size < BOARD_WINDOW; i++) {
+            w->items[w->size].msg = *shard_at(shard, i);
+            if (item_take(&w->items[w->size], cold) < 0) {
+                res = -1;
+                break;
+            }
+            w->size++;
+        }
+        PROF_UNLOCK(&shard->mutex);
+    }
+
+    if (w->size > 0) {
+        w->last.created = w->items[w->size - 1].msg.created;
+        w->last.id = w->items[w->size - 1].msg.id;
+        w->started = true;
+    }
+    return res;
+}
+
+/**
+ * @brief Ripristina la proprietà di min-heap (per data) a partire dal nodo `i`.
+ */
+static void heap_sift_down(board_window** heap, size_t heap_size, size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < heap_size && compare_message_time(&heap[left]->items[heap[left]->next].msg,
+                                                     &heap[smallest]->items[heap[smallest]->next].msg) < 0) {
+            smallest = left;
+        }
+        if (right < heap_size && compare_message_time(&heap[right]->items[heap[right]->next].msg,
+                                                      &heap[smallest]->items[heap[smallest]->next].msg) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) return;
+        board_window* temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+/** Lunghezza del corpo di un messaggio, in memoria o nel file freddo. */
+static size_t item_body_len(const Message* msg) {
+    return msg->body ? message_body_len(msg->body) : msg->cold_len;
+}
+
+/**
+ * @brief Accoda il corpo di un messaggio espulso, letto dal file freddo a pezzi di `COLD_PIECE` byte.
+ *
+ * @param sent I byte del corpo già accodati; viene aggiornato.
+ * @param budget Byte dopo cui fermarsi: un corpo di diversi megabyte occupa
+ *               più passi della lettura, senza essere mai tutto in memoria.
+ * @return I byte accodati.
+ *
+ * Se la lettura fallisce la risposta viene segnata come fallita: il
+ * pacchetto è già iniziato e la connessione va chiusa.
+ */
+static size_t cold_reply(reply* out, const board_item* item, uint64_t* sent, size_t budget) {
+    char piece[COLD_PIECE];
+    size_t queued = 0;
+    while (*sent < item->msg.cold_len && queued < budget && !out->failed) {
+        uint64_t left = item->msg.cold_len - *sent;
+        size_t want = left < sizeof(piece) ? (size_t)left : sizeof(piece);
+        ssize_t r = pread(item->cold->fd, piece, want, (off_t)(item->msg.cold_offset + *sent));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            perror("Errore nella lettura del livello freddo");
+            out->failed = true;
+            break;
+        }
+        reply_bytes(out, piece, (size_t)r);
+        *sent += (uint64_t)r;
+        queued += (size_t)r;
+    }
+    return queued;
+}
+
+/** Compone in `tail` la coda del payload di un messaggio della bacheca: "\n(hh:mm:ss)\n\n". */
+static size_t board_message_tail(const Message* current_msg, char* tail) {
+    size_t tail_len = 0;
+    tail[tail_len++] = '\n';
+    if (current_msg->timestamp != NULL && strlen(current_msg->timestamp) >= 19) {
+        tail[tail_len++] = '(';
+        memcpy(tail + tail_len, current_msg->timestamp + 11, 8);
+        tail_len += 8;
+        tail[tail_len++] = ')';
+        tail[tail_len++] = '\n';
+    }
+    tail[tail_len++] = '\n';
+    return tail_len;
+}
+
+/**
+ * @brief Inizia il pacchetto `OK` di un messaggio della bacheca, fino al corpo compreso se è in memoria.
+ *
+ * @return I byte di payload accodati.
+ *
+ * Il payload è "[id] autore: oggetto\ncorpo\n(hh:mm:ss)\n\n". Intestazione e
+ * coda sono composte a mano in piccoli buffer; il corpo viene accodato dalla
+ * memoria della bacheca (`message_body_reply`), senza passare da un buffer
+ * intermedio né essere troncato. Il corpo di un messaggio espulso
+ * (`cold_reply`) e la coda (`send_board_tail`) li accoda il chiamante.
+ */
+static size_t send_board_head(reply* out, const Message* current_msg, char* last_printed_date) {
+    char current_message_date[32];
+
+    if (current_msg->timestamp != NULL && strlen(current_msg->timestamp) >= 24) {
+        snprintf(current_message_date, sizeof(current_message_date),
+                 "%.3s %.2s, %.4s",
+                 current_msg->timestamp + 4,
+                 current_msg->timestamp + 8,
+                 current_msg->timestamp + 20);
+    } else {
+        strcpy(current_message_date, "Data Sconosciuta");
+    }
+
+    if (strcmp(last_printed_date, current_message_date) != 0) {
+        char date_header[100];
+        int header_len = snprintf(date_header, sizeof(date_header), "\n--- %s ---\n\n", current_message_date);
+        reply_frame(out, OK, date_header, header_len);
+        strcpy(last_printed_date, current_message_date);
+    }
+
+    char head[16 + MAX_USERNAME_LEN + MAX_SUBJECT_LEN];
+    char digits[10];
+    size_t n_digits = 0;
+    uint32_t id = current_msg->id;
+    do {
+        digits[n_digits++] = (char)('0' + id % 10);
+        id /= 10;
+    } while (id > 0);
+    size_t head_len = 0;
+    head[head_len++] = '[';
+    while (n_digits > 0) head[head_len++] = digits[--n_digits];
+    head[head_len++] = ']';
+    head[head_len++] = ' ';
+    size_t author_len = strlen(current_msg->author);
+    memcpy(head + head_len, current_msg->author, author_len);
+    head_len += author_len;
+    head[head_len++] = ':';
+    head[head_len++] = ' ';
+    size_t subject_len = strlen(current_msg->subject);
+    memcpy(head + head_len, current_msg->subject, subject_len);
+    head_len += subject_len;
+    head[head_len++] = '\n';
+
+    char tail[16];
+    size_t tail_len = board_message_tail(current_msg, tail);
+    reply_frame_begin(out, OK, (uint32_t)(head_len + item_body_len(current_msg) + tail_len));
+    reply_bytes(out, head, head_len);
+    if (!current_msg->body) return head_len;
+    message_body_reply(out, current_msg->body);
+    return head_len + message_body_len(current_msg->body);
+}
+
+static size_t send_board_tail(reply* out, const Message* current_msg) {
+    char tail[16];
+    size_t tail_len = board_message_tail(current_msg, tail);
+    reply_bytes(out, tail, tail_len);
+    return tail_len;
+}
+
+/**
+ * @brief Inizia il pacchetto `EVENT_ADDED` di un messaggio, per la copia di una replica.
+ *
+ * @return I byte di payload accodati.
+ *
+ * Il pacchetto ha il formato degli eventi push ("id autore\0oggetto\0corpo\0
+ * timestamp\0"), così la replica applica copia e flusso delle modifiche allo
+ * stesso modo. Come per `send_board_head`, corpo espulso e coda
+ * (`send_export_tail`) li accoda il chiamante.
+ */
+static size_t send_export_head(reply* out, const Message* msg) {
+    const char* timestamp = msg->timestamp ? msg->timestamp : "";
+    size_t author_len = strlen(msg->author);
+    size_t subject_len = strlen(msg->subject);
+    size_t length = sizeof(msg->id) + author_len + 1 + subject_len + 1 +
+                    item_body_len(msg) + 1 + strlen(timestamp) + 1;
+
+    reply_frame_begin(out, EVENT_ADDED, (uint32_t)length);
+    reply_bytes(out, &msg->id, sizeof(msg->id));
+    reply_bytes(out, msg->author, author_len + 1);
+    reply_bytes(out, msg->subject, subject_len + 1);
+    size_t queued = sizeof(msg->id) + author_len + 1 + subject_len + 1;
+    if (!msg->body) return queued;
+    message_body_reply(out, msg->body);
+    return queued + message_body_len(msg->body);
+}
+
+static size_t send_export_tail(reply* out, const Message* msg) {
+    const char* timestamp = msg->timestamp ? msg->timestamp : "";
+    size_t timestamp_len = strlen(timestamp);
+    reply_bytes(out, "", 1);
+    reply_bytes(out, timestamp, timestamp_len + 1);
+    return 1 + timestamp_len + 1;
+}
+
+/**
+ * @brief Chiude la lettura: `END_BOARD` o, con `complete` falso, `ERROR`
+ *        (per una replica, `finish`).
+ */
+static void board_finish(board_cursor* cursor, reply* out, bool complete) {
+    if (cursor->finish) {
+        cursor->finish(out, complete);
+    } else if (!complete) {
+        reply_status(out, ERROR);
+    } else if (cursor->versioned) {
+        reply_frame(out, END_BOARD, &cursor->version, sizeof(cursor->version));
+    } else {
+        reply_status(out, END_BOARD);
+    }
+}
+
+/**
+ * @brief Un passo della lettura: accoda circa `BOARD_STEP_BYTES` byte di messaggi in ordine di data.
+ *
+ * Il primo passo riempie le finestre di tutte le shard e costruisce lo heap;
+ * ogni finestra esaurita viene riempita di nuovo appena serve. Se una
+ * finestra non può essere riempita la lettura termina con `ERROR`: una
+ * bacheca parziale chiusa da `END_BOARD` sembrerebbe completa al client.
+ * Il corpo di un messaggio espulso viene letto dal file freddo durante
+ * l'invio e può continuare nei passi successivi (`cold_reply`).
+ */
+static bool board_next(reply_source* source, reply* out) {
+    board_cursor* cursor = (board_cursor*)source;
+    message_store* store = cursor->store;
+    if (!cursor->started) {
+        cursor->started = true;
+        for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+            if (window_fill(store, &store->shards[s], &cursor->windows[s]) < 0) {
+                board_finish(cursor, out, false);
+                return false;
+            }
+            if (cursor->windows[s].size > 0) {
+                cursor->heap[cursor->heap_size++] = &cursor->windows[s];
+            }
+        }
+        for (size_t i = cursor->heap_size / 2; i > 0; i--) {
+            heap_sift_down(cursor->heap, cursor->heap_size, i - 1);
+        }
+    }
+
+    size_t step = 0;
+    while (cursor->heap_size > 0 && step < BOARD_STEP_BYTES && !out->failed) {
+        board_window* top = cursor->heap[0];
+        board_item* item = &top->items[top->next];
+        if (!cursor->sending) {
+            cursor->sending = true;
+            cursor->cold_sent = 0;
+            step += cursor->finish ? send_export_head(out, &item->msg)
+                                   : send_board_head(out, &item->msg, cursor->last_printed_date);
+            if (item->cold) stats_add(STAT_TIER_COLD_READS, 1);
+        }
+        if (item->cold) {
+            step += cold_reply(out, item, &cursor->cold_sent, step < BOARD_STEP_BYTES ? BOARD_STEP_BYTES - step : 0);
+            if (cursor->cold_sent < item->msg.cold_len) continue;
+        }
+        step += cursor->finish ? send_export_tail(out, &item->msg) : send_board_tail(out, &item->msg);
+        cursor->sending = false;
+        item_release(item);
+        top->next++;
+        if (top->next == top->size) {
+            if (window_fill(store, &store->shards[top - cursor->windows], top) < 0) {
+                board_finish(cursor, out, false);
+                return false;
+            }
+            if (top->size == 0) {
+                cursor->heap[0] = cursor->heap[--cursor->heap_size];
+            }
+        }
+        heap_sift_down(cursor->heap, cursor->heap_size, 0);
+    }
+    if (cursor->heap_size > 0) return true;
+    board_finish(cursor, out, true);
+    return false;
+}
+
+static void board_free(reply_source* source) {
+    board_cursor* cursor = (board_cursor*)source;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        board_window* w = &cursor->windows[s];
+        for (size_t i = w->next; i < w->size; i++) {
+            item_release(&w->items[i]);
+        }
+    }
+    free(cursor);
+}
+
+static board_cursor* board_cursor_create(message_store* store) {
+    board_cursor* cursor = calloc(1, sizeof(board_cursor));
+    if (!cursor) return NULL;
+    cursor->source.next = board_next;
+    cursor->source.free = board_free;
+    cursor->store = store;
+    return cursor;
+}
+
+/**
+ * @brief Invia l'intera bacheca, ordinata per data, a un client.
+ *
+ * @param out La risposta in cui accodare i pacchetti della bacheca.
+ * @param known_version La versione che il client ha già, o NULL se il client
+ *                      non usa le versioni.
+ *
+ * Se la bacheca è ancora alla versione `known_version` risponde solo
+ * `NOT_MODIFIED`. Altrimenti la invia, e con `known_version` il pacchetto
+ * `END_BOARD` finale porta la versione (uint64) letta prima della lettura.
+ * Se la lettura di una shard fallisce la bacheca termina con `ERROR` invece
+ * di `END_BOARD`.
+ *
+ * La bacheca viene prodotta a passi da un cursore (`reply_stream`), così la
+ * memoria di una lettura non cresce con la bacheca:
+ * 1. Per ogni shard, ordinata per data, copia una finestra di al più
+ *    `BOARD_WINDOW` messaggi tenendone il lock solo per la copia
+ *    (`window_fill`); i corpi sono riferiti, non copiati.
+ * 2. Esegue una fusione a k vie delle finestre con un min-heap, ottenendo i
+ *    messaggi in ordine di data (a parità di data, di ID); una finestra
+ *    esaurita riparte nella sua shard dopo l'ultimo messaggio copiato.
+ * 3. Accoda ogni messaggio come un pacchetto separato in `out`, con il corpo
+ *    preso dalla memoria della bacheca o letto a pezzi dal file freddo. Per migliorare la leggibilità,
+ *    raggruppa i messaggi per giorno, stampando un'intestazione di data solo
+ *    quando la data cambia.
+ * 4. Alla fine, invia un pacchetto `END_BOARD` per segnalare la fine della trasmissione.
+ *
+ * Un messaggio aggiunto o cancellato durante la lettura può comparire o no,
+ * come per una copia fatta shard per shard. L'invio avviene senza alcun
+ * lock: un client lento non blocca le scritture.
+ */
+void get_board(message_store* store, reply* out, const uint64_t* known_version) {
+    uint64_t version = message_store_version(store);
+    if (known_version && *known_version == version) {
+        stats_add(STAT_BOARD_NOT_MODIFIED, 1);
+        reply_status(out, NOT_MODIFIED);
+        return;
+    }
+
+    board_cursor* cursor = board_cursor_create(store);
+    if (!cursor) {
+        reply_status(out, ERROR);
+        return;
+    }
+    cursor->versioned = known_version != NULL;
+    cursor->version = version;
+    reply_stream(out, &cursor->source);
+}
+
+/**
+ * @brief Accoda l'intera bacheca come pacchetti `EVENT_ADDED`, per una replica.
+ *
+ * @param finish Chiamata alla fine della copia per accodarne la chiusura,
+ *               con `complete` falso se manca memoria: la replica non deve
+ *               allora usare la copia parziale, che le farebbe cancellare i
+ *               messaggi mancanti. Se un corpo non può essere letto dal
+ *               file freddo la connessione viene chiusa a metà pacchetto.
+ *
+ * Come `get_board`, produce la copia a passi senza tenere lock durante l'invio.
+ */
+void message_store_export(message_store* store, reply* out, void (*finish)(reply* out, bool complete)) {
+    board_cursor* cursor = board_cursor_create(store);
+    if (!cursor) {
+        finish(out, false);
+        return;
+    }
+    cursor->finish = finish;
+    reply_stream(out, &cursor->source);
+}
+
+static int compare_message_ptr_id(const void* a, const void* b) {
+    uint32_t id_a = (*(Message* const*)a)->id;
+    uint32_t id_b = (*(Message* const*)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/**
+ * @brief Salva tutti i messaggi in memoria su un file di testo.
+ * 
+ * Il formato di salvataggio è strutturato per essere facilmente parsabile:
+ * ID: <id>
+ * Author: <autore>
+ * Timestamp: <timestamp>
+ * Subject: <oggetto>
+ * Body:
+ * <corpo del messaggio, può essere multi-riga>
+ * ===END===
+ * 
+ * Va chiamata con i lock di tutte le shard acquisiti, oppure da un processo
+ * figlio creato con `fork` mentre erano acquisiti (vedi `background_snapshot`).
+ * I messaggi vengono scritti in ordine di ID, indipendentemente dalla shard.
+ *
+ * Il file non viene mai troncato: i dati sono scritti in `<file>.tmp`,
+ * sincronizzati su disco con `fsync` e poi sostituiti all'originale con
+ * `rename`, che è atomica. Un crash a metà salvataggio lascia intatto il file
+ * precedente.
+ *
+ * @return 0 in caso di successo, -1 in caso di errore.
+ */
+int save_messages(message_store* store) {
+    if (!store->filename) return 0;
+    size_t total = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        total += store->shards[s].size;
+    }
+    Message** ordered = malloc((total > 0 ? total : 1) * sizeof(Message*));
+    if (!ordered) {
+        perror("Errore di memoria nel salvataggio dei messaggi");
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        for (size_t i = 0; i < store->shards[s].size; i++) {
+            ordered[n++] = shard_at(&store->shards[s], i);
+        }
+    }
+    qsort(ordered, total, sizeof(Message*), compare_message_ptr_id);
+
+    char tmp_filename[PATH_MAX];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", store->filename);
+
+    FILE* file = fopen(tmp_filename, "we");
+    if (!file) {
+        perror("Errore nell'apertura del file per il salvataggio dei messaggi");
+        free(ordered);
+        return -1;
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        Message* msg = ordered[i];
+        fprintf(file, "ID: %u\n", msg->id);
+        fprintf(file, "Author: %s\n", msg->author);
+        if (msg->timestamp) {
+            fprintf(file, "Timestamp: %s\n", msg->timestamp);
+        }
+        fprintf(file, "Subject: %s\n", msg->subject);
+        fprintf(file, "Body:\n");
+        if (!msg->body) {
+            char last = '\n';
+            if (cold_copy(store, msg, file, &last) < 0) {
+                perror("Errore nella lettura del livello freddo");
+                fclose(file);
+                unlink(tmp_filename);
+                free(ordered);
+                return -1;
+            }
+            if (last != '\n') {
+                fputc('\n', file);
+            }
+        }
+        size_t body_len = msg->body ? message_body_len(msg->body) : 0;
+        if (body_len > 0) {
+            fwrite(msg->body, 1, body_len, file);
+            if (msg->body[body_len - 1] != '\n') {
+                fputc('\n', file);
+            }
+        }
+
+        fprintf(file, "===END===\n");
+    }
+    free(ordered);
+
+    bool ok = (fflush(file) == 0 && fsync(fileno(file)) == 0);
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_filename, store->filename) != 0) {
+        perror("Errore nel salvataggio dei messaggi");
+        unlink(tmp_filename);
+        return -1;
+    }
+
+    // Rende persistente anche la rename, sincronizzando la directory.
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s", store->filename);
+    char* slash = strrchr(dir_path, '/');
+    if (slash) {
+        *slash = '\0';
+    } else {
+        strcpy(dir_path, ".");
+    }
+    int dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+static uint64_t elapsed_us(const struct timespec* start, const struct timespec* end) {
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000u + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+/**
+ * @brief Esegue un salvataggio in background tramite `fork`.
+ *
+ * Il thread chiamante acquisisce i lock di tutte le shard, così lo stato è
+ * consistente, esegue `fork` e li rilascia subito: il figlio ha una copia
+ * copy-on-write della bacheca e la scrive su file con `save_messages` mentre il
+ * padre continua a servire i client. La pausa misurata per il padre è il solo
+ * tempo di acquisizione dei lock più la `fork` (la copia delle tabelle delle
+ * pagine), non la scrittura del file.
+ * Al termine il figlio viene atteso con `waitpid`; in caso di errore le
+ * modifiche non salvate vengono ricontate per ritentare al prossimo giro.
+ */
+static void background_snapshot(message_store* store) {
+    struct timespec t_start, t_resumed, t_done;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    lock_all_shards(store);
+    unsigned pending = atomic_exchange(&store->mutations_since_snapshot, 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(save_messages(store) == 0 ? 0 : 1);
+    }
+    unlock_all_shards(store);
+
+    clock_gettime(CLOCK_MONOTONIC, &t_resumed);
+    uint64_t pause_us = elapsed_us(&t_start, &t_resumed);
+
+    if (pid < 0) {
+        perror("Fork fallita per il salvataggio in background");
+        atomic_fetch_add(&store->mutations_since_snapshot, pending);
+        stats_add(STAT_SNAPSHOT_FAILURES, 1);
+        return;
+    }
+
+    int wstatus = 0;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_done);
+    uint64_t write_ms = elapsed_us(&t_start, &t_done) / 1000;
+
+    stats_set(STAT_SNAPSHOT_PAUSE_LAST_US, pause_us);
+    stats_max(STAT_SNAPSHOT_PAUSE_MAX_US, pause_us);
+    stats_add(STAT_SNAPSHOT_PAUSE_TOTAL_US, pause_us);
+
+    if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0) {
+        stats_add(STAT_SNAPSHOTS, 1);
+        stats_set(STAT_SNAPSHOT_WRITE_LAST_MS, write_ms);
+        printf("Salvataggio in background completato: %u modifiche, pausa %" PRIu64 " us, scrittura %" PRIu64 " ms\n",
+               pending, pause_us, write_ms);
+    } else {
+        atomic_fetch_add(&store->mutations_since_snapshot, pending);
+        stats_add(STAT_SNAPSHOT_FAILURES, 1);
+        fprintf(stderr, "Salvataggio in background fallito\n");
+    }
+}
+
+/**
+ * @brief Thread che esegue i salvataggi periodici di tutte le bacheche.
+ *
+ * Si risveglia ogni `snapshot_interval` secondi o quando `note_mutation` segnala
+ * che una bacheca ha raggiunto `snapshot_every` modifiche, e salva solo le
+ * bacheche cambiate dall'ultimo salvataggio. Tiene lo `snapshot_io_m` di una
+ * bacheca per tutta la durata del suo salvataggio, così `message_store_save` e
+ * lo shutdown non scrivono il file mentre un figlio lo sta ancora scrivendo. `snapshot_m`
+ * protegge solo i flag e viene rilasciato durante il salvataggio, così
+ * `note_mutation` non blocca mai un writer.
+ */
+static void* snapshot_thread(void* arg) {
+    (void)arg;
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&snapshot_m);
+    while (!snapshot_stop) {
+        if (snapshot_interval > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += snapshot_interval;
+            while (!snapshot_stop && !snapshot_requested) {
+                if (pthread_cond_timedwait(&snapshot_cv, &snapshot_m, &deadline) == ETIMEDOUT) break;
+            }
+        } else {
+            while (!snapshot_stop && !snapshot_requested) {
+                pthread_cond_wait(&snapshot_cv, &snapshot_m);
+            }
+        }
+        snapshot_requested = false;
+        if (snapshot_stop) break;
+        pthread_mutex_unlock(&snapshot_m);
+
+        pthread_mutex_lock(&stores_m);
+        message_store* store = stores;
+        pthread_mutex_unlock(&stores_m);
+        for (; store; store = store->next) {
+            pthread_mutex_lock(&store->snapshot_io_m);
+            if (store->filename && atomic_load(&store->mutations_since_snapshot) > 0) {
+                background_snapshot(store);
+            }
+            pthread_mutex_unlock(&store->snapshot_io_m);
+        }
+
+        pthread_mutex_lock(&snapshot_m);
+    }
+    pthread_mutex_unlock(&snapshot_m);
+    return NULL;
+}
+
+/**
+ * @brief Registra `n` modifiche alla bacheca (una nuova versione) e, ogni `snapshot_every` modifiche, richiede un salvataggio.
+ *
+ * Solo la chiamata che supera la soglia prende `snapshot_m` (per un istante),
+ * quindi il costo per le altre è un incremento atomico. Un lotto di modifiche
+ * (`message_store_add_batch`, le scadenze) conta per intero verso la soglia
+ * ma produce una sola versione e al più un salvataggio.
+ */
+static void note_mutations(message_store* store, size_t n) {
+    if (n == 0) return;
+    atomic_fetch_add(&store->version, 1);
+    unsigned count = atomic_fetch_add(&store->mutations_since_snapshot, (unsigned)n) + (unsigned)n;
+    if (snapshot_every > 0 && count / snapshot_every != (count - (unsigned)n) / snapshot_every) {
+        request_snapshot();
+    }
+}
+
+/**
+ * @brief Sveglia il thread dei salvataggi, se attivo, per salvare subito le bacheche modificate.
+ */
+static void request_snapshot(void) {
+    if (!snapshot_running) return;
+    pthread_mutex_lock(&snapshot_m);
+    snapshot_requested = true;
+    pthread_cond_signal(&snapshot_cv);
+    pthread_mutex_unlock(&snapshot_m);
+}
+
+/**
+ * @brief Avvia i salvataggi in background.
+ *
+ * @param interval_sec Intervallo massimo tra due salvataggi, in secondi (0 = nessun timer).
+ * @param every_mutations Numero di modifiche dopo cui salvare (0 = nessuna soglia).
+ */
+void message_store_start_snapshots(unsigned interval_sec, unsigned every_mutations) {
+    if (interval_sec == 0 && every_mutations == 0) return;
+    snapshot_interval = interval_sec;
+    snapshot_every = every_mutations;
+    snapshot_stop = false;
+    if (pthread_create(&snapshot_tid, NULL, snapshot_thread, NULL) != 0) {
+        perror("Impossibile avviare il thread di salvataggio");
+        return;
+    }
+    snapshot_running = true;
+}
+
+static void stop_snapshots(void) {
+    if (!snapshot_running) return;
+    pthread_mutex_lock(&snapshot_m);
+    snapshot_stop = true;
+    pthread_cond_signal(&snapshot_cv);
+    pthread_mutex_unlock(&snapshot_m);
+    pthread_join(snapshot_tid, NULL);
+    snapshot_running = false;
+}
+
+#define TIER_INTERVAL_MS 1000
+#define TIER_BATCH 256
+
+typedef struct tier_candidate {
+    size_t index;
+    uint32_t id;
+    const char* body;
+    uint64_t offset;
+} tier_candidate;
 
-typedef struct MESSAGE_ARRAY{
-    Message* messages;
-    size_t size;
-    size_t capacity;
-    uint32_t next_id;
-    pthread_mutex_t mutex;
-} MessageArray;
+typedef struct tier_entry {
+    time_t created;
+    uint32_t id;
+    size_t len;
+} tier_entry;
+
+/** Il limite di un giro: si espellono i messaggi con (data, ID) fino a (`created`, `id`) compreso. */
+typedef struct tier_cutoff {
+    time_t created;
+    uint32_t id;
+} tier_cutoff;
 
-MessageArray message_array;
-char* filename;
+static bool tier_before(time_t created, uint32_t id, tier_cutoff cutoff) {
+    return created < cutoff.created || (created == cutoff.created && id <= cutoff.id);
+}
 
-void load_messages();
-void save_messages();
+/**
+ * @brief Crea un file freddo vuoto per una bacheca.
+ *
+ * Il file `<file>.cold` viene ricreato vuoto e subito scollegato: vive solo
+ * finché è aperto, quindi non resta nulla da ripulire dopo un crash, e in un
+ * hot restart i due processi hanno ciascuno il proprio.
+ *
+ * @return Il file, con il riferimento del chiamante, o NULL in caso di errore.
+ */
+static cold_file* cold_create(const message_store* store) {
+    cold_file* cold = malloc(sizeof(cold_file));
+    if (!cold) return NULL;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.cold", store->filename);
+    unlink(path);
+    cold->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (cold->fd < 0) {
+        perror("Impossibile creare il file del livello freddo");
+        free(cold);
+        return NULL;
+    }
+    unlink(path);
+    atomic_init(&cold->refs, 1);
+    return cold;
+}
 
-void message_store_init(const char* file) {
-    filename = strdup(file);
-    message_array.messages = NULL;
-    message_array.size = 0;
-    message_array.capacity = 0;
-    message_array.next_id = 1;
-    pthread_mutex_init(&message_array.mutex, NULL);
-    load_messages();
+static int cold_open(message_store* store) {
+    cold_file* cold = cold_create(store);
+    if (!cold) return -1;
+    store->cold_end = 0;
+    atomic_store_explicit(&store->cold, cold, memory_order_release);
+    return 0;
 }
 
-void message_store_shutdown() {
-    pthread_mutex_lock(&message_array.mutex);
-    save_messages();
-    for (size_t i = 0; i < message_array.size; i++) {
-        free(message_array.messages[i].body);
-        free(message_array.messages[i].timestamp);
+static int cold_write(const cold_file* cold, uint64_t offset, const char* data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = pwrite(cold->fd, data + done, len - done, (off_t)(offset + done));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        done += (size_t)w;
     }
-    free(message_array.messages);
-    free(filename);
-    pthread_mutex_unlock(&message_array.mutex);
-    pthread_mutex_destroy(&message_array.mutex);
+    return 0;
 }
 
 /**
- * @brief Aggiunge un nuovo messaggio all'array dei messaggi.
- * 
- * @param author L'autore del messaggio.
- * @param subject L'oggetto del messaggio.
- * @param body Il corpo del messaggio.
- * 
- * La funzione è thread-safe grazie all'uso di un mutex.
- * 1. Acquisisce il lock sull'array dei messaggi.
- * 2. Se l'array è pieno, ne raddoppia la capacità.
- * 3. Crea un nuovo messaggio, assegnandogli un ID univoco e un timestamp corrente.
- * 4. Copia i dati (autore, oggetto, corpo) nel nuovo messaggio.
- * 5. Incrementa la dimensione dell'array.
- * 6. Rilascia il lock.
- */
-void add_message(const char* author, const char* subject, const char* body) {
-    pthread_mutex_lock(&message_array.mutex);
-    if (message_array.size == message_array.capacity) {
-        size_t new_capacity = (message_array.capacity == 0) ? 10 : message_array.capacity * 2;
-        Message* new_messages = realloc(message_array.messages, new_capacity * sizeof(Message));
-        if (!new_messages) {
-            perror("Realloc fallita");
-            pthread_mutex_unlock(&message_array.mutex);
-            return;
-        }
-        message_array.messages = new_messages;
-        message_array.capacity = new_capacity;
-    }
+ * @brief Sposta nel livello freddo i corpi dei messaggi di una shard fino a `cutoff`.
+ *
+ * Procede a blocchi di `TIER_BATCH` messaggi: sotto il lock della shard
+ * sceglie i candidati e ne trattiene i corpi, senza lock li accoda al file
+ * freddo, e sotto il lock di nuovo sostituisce ogni corpo con la sua
+ * posizione nel file, solo se il messaggio è ancora lì con lo stesso corpo
+ * (nel frattempo può essere stato cancellato o spostato da una cancellazione).
+ *
+ * @param oldest_hot Aggiornata con la data più vecchia tra i corpi rimasti in memoria.
+ * @return Il numero di corpi espulsi.
+ */
+static size_t tier_evict_shard(message_store* store, MessageShard* shard, tier_cutoff cutoff, time_t* oldest_hot) {
+    tier_candidate batch[TIER_BATCH];
+    size_t evicted = 0;
+    size_t pos = 0;
+    while (1) {
+        size_t n = 0;
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        for (; pos < shard->size && n < TIER_BATCH; pos++) {
+            Message* msg = shard_at(shard, pos);
+            if (!msg->body || message_body_len(msg->body) == 0) continue;
+            if (!tier_before(msg->created, msg->id, cutoff)) {
+                if (msg->created < *oldest_hot) *oldest_hot = msg->created;
+                continue;
+            }
+            message_body_acquire(msg->body);
+            batch[n++] = (tier_candidate){pos, msg->id, msg->body, 0};
+        }
+        PROF_UNLOCK(&shard->mutex);
+        if (n == 0) break;
 
-    time_t ora = time(NULL);
-    if (ora == (time_t)-1) {
-        pthread_mutex_unlock(&message_array.mutex);
-        return;
-    }
+        size_t written = 0;
+        if (atomic_load_explicit(&store->cold, memory_order_relaxed) || cold_open(store) == 0) {
+            cold_file* cold = atomic_load_explicit(&store->cold, memory_order_relaxed);
+            for (; written < n; written++) {
+                size_t len = message_body_len(batch[written].body);
+                if (cold_write(cold, store->cold_end, batch[written].body, len) < 0) {
+                    perror("Errore nella scrittura del livello freddo");
+                    break;
+                }
+                batch[written].offset = store->cold_end;
+                store->cold_end += len;
+                atomic_fetch_add_explicit(&cold_bytes, len, memory_order_relaxed);
+            }
+        }
 
-    char* stringa_ora = ctime(&ora);
-    if (stringa_ora == NULL) {
-        pthread_mutex_unlock(&message_array.mutex);
-        return;
-    }
-    stringa_ora[strcspn(stringa_ora, "\r\n")] = 0;
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        shard_rewrite_begin(shard);
+        for (size_t i = 0; i < written; i++) {
+            Message* msg = batch[i].index < shard->size ? shard_at(shard, batch[i].index) : NULL;
+            if (!msg || msg->id != batch[i].id || msg->body != batch[i].body) {
+                // Scritto nel file ma non più riferito: byte morti fino alla compattazione.
+                atomic_fetch_add_explicit(&store->cold_dead, message_body_len(batch[i].body), memory_order_relaxed);
+                continue;
+            }
+            size_t len = message_body_len(msg->body);
+            msg->cold_offset = batch[i].offset;
+            msg->cold_len = (uint32_t)len;
+            msg->body = NULL;
+            atomic_fetch_sub_explicit(&hot_bytes, len, memory_order_relaxed);
+            epoch_retire(retired_body_release, (void*)batch[i].body);
+            evicted++;
+        }
+        shard_rewrite_end(shard);
+        PROF_UNLOCK(&shard->mutex);
 
-    Message* msg = &message_array.messages[message_array.size];
-    memset(msg, 0, sizeof(Message));
-
-    msg->id = message_array.next_id++;
-    strncpy(msg->author, author, sizeof(msg->author) - 1);
-    msg->author[sizeof(msg->author) - 1] = '\0';
-    strncpy(msg->subject, subject, sizeof(msg->subject) - 1);
-    msg->subject[sizeof(msg->subject) - 1] = '\0';
-    msg->body = strdup(body);
-    msg->timestamp = strdup(stringa_ora);
-
-    if (!msg->body || !msg->timestamp) {
-        free(msg->body);
-        free(msg->timestamp);
-        pthread_mutex_unlock(&message_array.mutex);
-        return;
+        for (size_t i = 0; i < n; i++) {
+            message_body_release(batch[i].body);
+        }
+        if (written < n) break;
     }
+    return evicted;
+}
+
+/** Byte morti del file freddo oltre cui, se sono almeno metà del file, viene compattato. */
+#define COLD_COMPACT_MIN (16 * 1024 * 1024)
+
+/** Un corpo ancora riferito nel file freddo, durante una compattazione. */
+typedef struct cold_live {
+    uint32_t id;
+    uint32_t len;
+    uint64_t offset;
+    uint64_t new_offset;
+} cold_live;
 
-    message_array.size++;
-    pthread_mutex_unlock(&message_array.mutex);
+static int compare_cold_offset(const void* a, const void* b) {
+    const cold_live* l_a = (const cold_live*)a;
+    const cold_live* l_b = (const cold_live*)b;
+    return (l_a->offset > l_b->offset) - (l_a->offset < l_b->offset);
+}
+
+static int compare_cold_id(const void* a, const void* b) {
+    const cold_live* l_a = (const cold_live*)a;
+    const cold_live* l_b = (const cold_live*)b;
+    if (l_a->id != l_b->id) {
+        return (l_a->id > l_b->id) ? 1 : -1;
+    }
+    return compare_cold_offset(a, b);
 }
 
 /**
- * @brief Cancella un messaggio dall'array.
- * 
- * @param message_id L'ID del messaggio da cancellare.
- * @param current_user L'utente che richiede la cancellazione.
- * @return 0 in caso di successo, -1 se l'utente non è autorizzato, -2 se il messaggio non è stato trovato.
- * 
- * La funzione, in modo thread-safe:
- * 1. Cerca il messaggio con l'ID specificato.
- * 2. Verifica che `current_user` sia l'autore del messaggio.
- * 3. Se autorizzato, rimuove il messaggio dall'array compattando gli elementi successivi.
- *    Questa operazione è O(N) dove N è il numero di messaggi dopo quello cancellato.
- * 4. Libera la memoria allocata per il corpo e il timestamp del messaggio.
+ * @brief Riscrive il file freddo di una bacheca con i soli corpi ancora riferiti.
+ *
+ * Sotto il lock di ogni shard raccoglie posizione e lunghezza dei corpi
+ * espulsi, poi senza lock li copia in un nuovo file nell'ordine in cui
+ * stanno nel vecchio. Infine, con tutte le shard bloccate e dentro una
+ * riscrittura di ognuna, aggiorna gli offset e sostituisce `cold`: un
+ * lettore senza lock vede o i vecchi offset con il vecchio file o i nuovi
+ * con il nuovo. Il riferimento della bacheca al vecchio file viene
+ * rilasciato con `epoch_retire`, e il file resta aperto finché l'ultima
+ * lettura che ne ha copiato un messaggio non ha finito di inviarlo.
+ *
+ * Solo il thread del livello freddo espelle, quindi durante la copia non
+ * nascono nuovi corpi freddi; quelli cancellati nel frattempo restano come
+ * byte morti nel nuovo file.
+ *
+ * @return I byte recuperati.
  */
-int delete_message(uint32_t message_id, const char* current_user) {
-    pthread_mutex_lock(&message_array.mutex);
-    int found_index = -1;
-    for (size_t i = 0; i < message_array.size; i++) {
-        if (message_array.messages[i].id == message_id) {
-            // Controllo di autorizzazione: solo l'autore può cancellare.
-            if (strcmp(message_array.messages[i].author, current_user) != 0) {
-                pthread_mutex_unlock(&message_array.mutex);
-                return -1; // Non autorizzato
+static uint64_t cold_compact(message_store* store) {
+    cold_file* old = atomic_load_explicit(&store->cold, memory_order_relaxed);
+    uint64_t dead = atomic_load_explicit(&store->cold_dead, memory_order_relaxed);
+    if (!old || dead < COLD_COMPACT_MIN || dead < store->cold_end / 2) return 0;
+
+    cold_live* live = NULL;
+    size_t n = 0;
+    size_t capacity = 0;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        MessageShard* shard = &store->shards[s];
+        PROF_LOCK(&shard->mutex, LOCK_SHARD);
+        for (size_t i = 0; i < shard->size; i++) {
+            const Message* msg = shard_at(shard, i);
+            if (msg->body || msg->cold_len == 0) continue;
+            if (n == capacity) {
+                size_t new_capacity = capacity ? capacity * 2 : 1024;
+                cold_live* grown = realloc(live, new_capacity * sizeof(cold_live));
+                if (!grown) {
+                    PROF_UNLOCK(&shard->mutex);
+                    free(live);
+                    return 0;
+                }
+                live = grown;
+                capacity = new_capacity;
             }
-            found_index = i;
-            break;
+            live[n++] = (cold_live){msg->id, msg->cold_len, msg->cold_offset, 0};
         }
+        PROF_UNLOCK(&shard->mutex);
     }
 
-    if (found_index == -1) {
-        pthread_mutex_unlock(&message_array.mutex);
-        return -2; // Non trovato
+    qsort(live, n, sizeof(cold_live), compare_cold_offset);
+    cold_file* cold = cold_create(store);
+    char buffer[COLD_PIECE];
+    uint64_t end = 0;
+    for (size_t i = 0; cold && i < n; i++) {
+        live[i].new_offset = end;
+        uint64_t done = 0;
+        while (done < live[i].len) {
+            size_t want = live[i].len - done < sizeof(buffer) ? (size_t)(live[i].len - done) : sizeof(buffer);
+            ssize_t r = pread(old->fd, buffer, want, (off_t)(live[i].offset + done));
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0 || cold_write(cold, end, buffer, (size_t)r) < 0) {
+                perror("Errore nella compattazione del livello freddo");
+                cold_release(cold);
+                cold = NULL;
+                break;
+            }
+            done += (uint64_t)r;
+            end += (uint64_t)r;
+        }
     }
-
-    free(message_array.messages[found_index].body);
-    free(message_array.messages[found_index].timestamp);
-    
-    // Compatta l'array per rimuovere il messaggio.
-    for (size_t i = found_index; i < message_array.size - 1; i++) {
-        message_array.messages[i] = message_array.messages[i + 1];
+    if (!cold) {
+        free(live);
+        return 0;
     }
-    message_array.size--;
-    pthread_mutex_unlock(&message_array.mutex);
-    return 0; // Successo
-}
 
-/**
- * @brief Invia l'intera bacheca, ordinata per data, a un client.
- * 
- * @param sock Il socket del client a cui inviare la bacheca.
- * 
- * Questa funzione è una delle più complesse:
- * 1. Acquisisce il lock per garantire una visione consistente della bacheca.
- * 2. Se non ci sono messaggi, invia un pacchetto `END_BOARD` e termina.
- * 3. Crea un array di puntatori ai messaggi per poterli ordinare senza spostare
- *    i dati originali.
- * 4. Esegue un **Bubble Sort** sull'array di puntatori basandosi sul timestamp.
- *    `strptime` e `mktime` sono usati per convertire le stringhe di timestamp in `time_t`
- *    comparabili.
- * 5. Itera sui messaggi ordinati e li formatta in un buffer. Per migliorare la
- *    leggibilità, raggruppa i messaggi per giorno, stampando un'intestazione di data
- *    solo quando la data cambia.
- * 6. Invia ogni messaggio formattato come un pacchetto separato al client.
- * 7. Alla fine, invia un pacchetto `END_BOARD` per segnalare la fine della trasmissione.
- */
-void get_board(int sock) {
-    pthread_mutex_lock(&message_array.mutex);
-
-    if (message_array.size == 0) {
-        status(sock, END_BOARD);
-        pthread_mutex_unlock(&message_array.mutex);
-        return;
+    qsort(live, n, sizeof(cold_live), compare_cold_id);
+    uint64_t kept = 0;
+    lock_all_shards(store);
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        shard_rewrite_begin(&store->shards[s]);
     }
-    
-    Message** sorted_messages = malloc(message_array.size * sizeof(Message*));
-    if (!sorted_messages) {
-        status(sock, END_BOARD);
-        pthread_mutex_unlock(&message_array.mutex);
-        return;
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        MessageShard* shard = &store->shards[s];
+        for (size_t i = 0; i < shard->size; i++) {
+            Message* msg = shard_at(shard, i);
+            if (msg->body || msg->cold_len == 0) continue;
+            cold_live key = {msg->id, msg->cold_len, msg->cold_offset, 0};
+            cold_live* found = bsearch(&key, live, n, sizeof(cold_live), compare_cold_id);
+            if (!found) continue;
+            msg->cold_offset = found->new_offset;
+            kept += found->len;
+        }
     }
-    for (size_t i = 0; i < message_array.size; i++) {
-        sorted_messages[i] = &message_array.messages[i];
+    uint64_t reclaimed = store->cold_end - end;
+    store->cold_end = end;
+    atomic_store_explicit(&store->cold_dead, end - kept, memory_order_relaxed);
+    atomic_store_explicit(&store->cold, cold, memory_order_release);
+    for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+        shard_rewrite_end(&store->shards[s]);
     }
-    
-    for (size_t i = 0; i < message_array.size - 1; i++) {
-        for (size_t j = 0; j < message_array.size - i - 1; j++) {
-            struct tm tm_a = {0}, tm_b = {0};
-            time_t time_a = 0, time_b = 0;
+    unlock_all_shards(store);
 
-            if (sorted_messages[j]->timestamp && strptime(sorted_messages[j]->timestamp, "%a %b %d %H:%M:%S %Y", &tm_a)) {
-                time_a = mktime(&tm_a);
-            }
-            if (sorted_messages[j + 1]->timestamp && strptime(sorted_messages[j + 1]->timestamp, "%a %b %d %H:%M:%S %Y", &tm_b)) {
-                time_b = mktime(&tm_b);
-            }
+    epoch_retire(retired_cold_release, old);
+    atomic_fetch_sub_explicit(&cold_bytes, reclaimed, memory_order_relaxed);
+    stats_add(STAT_TIER_COMPACTIONS, 1);
+    free(live);
+    return reclaimed;
+}
+
+static int compare_tier_entry(const void* a, const void* b) {
+    const tier_entry* e_a = (const tier_entry*)a;
+    const tier_entry* e_b = (const tier_entry*)b;
+    if (e_a->created != e_b->created) {
+        return (e_a->created > e_b->created) ? 1 : -1;
+    }
+    return (e_a->id > e_b->id) - (e_a->id < e_b->id);
+}
+
+/** Messaggi campionati da ogni shard per stimare il limite del budget. */
+#define TIER_SAMPLES 64
 
-            if (time_a > time_b) {
-                Message* temp = sorted_messages[j];
-                sorted_messages[j] = sorted_messages[j + 1];
-                sorted_messages[j + 1] = temp;
+/**
+ * @brief Il limite entro cui espellere i corpi per scendere a `target` byte in memoria.
+ *
+ * Non raccoglie tutti i corpi in memoria: divide ogni shard delle bacheche
+ * su file in al più `TIER_SAMPLES` tratti consecutivi e ne prende l'ultimo
+ * messaggio, che vale la lunghezza del proprio corpo (0 se espulso) per i
+ * messaggi del tratto. Le shard sono ordinate per data, quindi i campioni,
+ * ordinati dal più vecchio (a parità di data, per ID), approssimano i corpi
+ * in ordine di età; le stime vengono riportate a `hot_bytes` e il limite è
+ * il campione a cui la somma copre l'eccesso. Il costo dipende dal numero di
+ * shard, non di messaggi; se la stima è corta, il giro successivo espelle il
+ * resto.
+ *
+ * @return Il limite, con `created` -1 se manca memoria.
+ */
+static tier_cutoff tier_budget_cutoff(size_t target) {
+    size_t hot = atomic_load_explicit(&hot_bytes, memory_order_relaxed);
+
+    pthread_mutex_lock(&stores_m);
+    message_store* first = stores;
+    pthread_mutex_unlock(&stores_m);
+    size_t capacity = 0;
+    for (message_store* store = first; store; store = store->next) {
+        if (store->filename) capacity += MESSAGE_SHARDS * TIER_SAMPLES;
+    }
+    tier_entry* entries = capacity > 0 ? malloc(capacity * sizeof(tier_entry)) : NULL;
+    if (!entries) return (tier_cutoff){-1, 0};
+
+    size_t n = 0;
+    uint64_t estimated = 0;
+    for (message_store* store = first; store; store = store->next) {
+        if (!store->filename) continue;
+        for (size_t s = 0; s < MESSAGE_SHARDS && n + TIER_SAMPLES <= capacity; s++) {
+            MessageShard* shard = &store->shards[s];
+            PROF_LOCK(&shard->mutex, LOCK_SHARD);
+            size_t size = shard->size;
+            size_t samples = size < TIER_SAMPLES ? size : TIER_SAMPLES;
+            for (size_t j = 0; j < samples; j++) {
+                size_t from = j * size / samples;
+                size_t to = (j + 1) * size / samples;
+                const Message* msg = shard_at(shard, to - 1);
+                size_t len = msg->body ? message_body_len(msg->body) * (to - from) : 0;
+                entries[n++] = (tier_entry){msg->created, msg->id, len};
+                estimated += len;
             }
+            PROF_UNLOCK(&shard->mutex);
         }
     }
 
-    char message_buffer[4096];
-    char last_printed_date[32] = {0};
-
-    for (size_t i = 0; i < message_array.size; ++i) {
-        Message* current_msg = sorted_messages[i];
-        
-        char current_message_date[32];
-        
-        if (current_msg->timestamp != NULL && strlen(current_msg->timestamp) >= 24) {
-            snprintf(current_message_date, sizeof(current_message_date),
-                     "%.3s %.2s, %.4s",
-                     current_msg->timestamp + 4,
-                     current_msg->timestamp + 8, 
-                     current_msg->timestamp + 20);
-        } else {
-            strcpy(current_message_date, "Data Sconosciuta");
-        }
-        
-        if (strcmp(last_printed_date, current_message_date) != 0) {
-            char date_header[100];
-            int header_len = snprintf(date_header, sizeof(date_header), "\n--- %s ---\n\n", current_message_date);
-            response(sock, OK, date_header, header_len);
-            strcpy(last_printed_date, current_message_date);
-        }
-
-        int written = 0;
-        if (current_msg->timestamp != NULL && strlen(current_msg->timestamp) >= 19) {
-            written = snprintf(message_buffer, sizeof(message_buffer),
-                               "[%u] %s: %s\n%s\n(%.8s)\n\n",
-                               current_msg->id, current_msg->author, current_msg->subject,
-                               current_msg->body, current_msg->timestamp + 11);
-        } else {
-            written = snprintf(message_buffer, sizeof(message_buffer),
-                               "[%u] %s: %s\n%s\n\n",
-                               current_msg->id, current_msg->author, current_msg->subject,
-                               current_msg->body);
+    qsort(entries, n, sizeof(tier_entry), compare_tier_entry);
+    tier_cutoff cutoff = {-1, 0};
+    if (hot > target && estimated == 0 && n > 0) {
+        // Nessun campione ha il corpo in memoria: i pochi rimasti sono sparsi
+        // tra messaggi espulsi, e si espellono fino al campione più recente.
+        cutoff = (tier_cutoff){entries[n - 1].created, entries[n - 1].id};
+    } else if (hot > target) {
+        uint64_t excess = (uint64_t)((unsigned __int128)(hot - target) * estimated / hot);
+        uint64_t freed = 0;
+        for (size_t i = 0; i < n && freed < excess; i++) {
+            freed += entries[i].len;
+            cutoff = (tier_cutoff){entries[i].created, entries[i].id};
         }
-        response(sock, OK, message_buffer, written);
     }
-    
-    free(sorted_messages);
-    status(sock, END_BOARD);
-    pthread_mutex_unlock(&message_array.mutex);
+    free(entries);
+    return cutoff;
 }
 
 /**
- * @brief Salva tutti i messaggi in memoria su un file di testo.
- * 
- * Il formato di salvataggio è strutturato per essere facilmente parsabile:
- * ID: <id>
- * Author: <autore>
- * Timestamp: <timestamp>
- * Subject: <oggetto>
- * Body:
- * <corpo del messaggio, può essere multi-riga>
- * ===END===
- * 
- * Questa funzione viene chiamata durante lo shutdown del server per garantire la persistenza.
+ * @brief Un giro del livello freddo su tutte le bacheche su file.
+ *
+ * Espelle i corpi più vecchi di `tier_cold_after` secondi e, se i corpi in
+ * memoria superano `tier_hot_budget`, i più vecchi fino a scendere al 90%
+ * del budget, così il giro successivo non riparte subito. Senza budget
+ * superato, una bacheca viene esaminata solo quando il suo corpo in memoria
+ * più vecchio ha raggiunto l'età (`tier_due`). Alla fine compatta i file
+ * freddi con troppi byte morti (`cold_compact`).
  */
-void save_messages() {
-    FILE* file = fopen(filename, "w");
-    if (!file) {
-        perror("Errore nell'apertura del file per il salvataggio dei messaggi");
-        return;
+static void tier_pass(void) {
+    time_t now = local_now();
+    tier_cutoff age_cutoff = {tier_cold_after > 0 ? now - (time_t)tier_cold_after : -1, UINT32_MAX};
+    tier_cutoff budget_cutoff = {-1, 0};
+    if (tier_hot_budget > 0 && atomic_load_explicit(&hot_bytes, memory_order_relaxed) > tier_hot_budget) {
+        budget_cutoff = tier_budget_cutoff(tier_hot_budget / 10 * 9);
     }
+    tier_cutoff cutoff = tier_before(budget_cutoff.created, budget_cutoff.id, age_cutoff) ? age_cutoff : budget_cutoff;
 
-    for (size_t i = 0; i < message_array.size; i++) {
-        Message* msg = &message_array.messages[i];
-        fprintf(file, "ID: %u\n", msg->id);
-        fprintf(file, "Author: %s\n", msg->author);
-        if (msg->timestamp) {
-            fprintf(file, "Timestamp: %s\n", msg->timestamp);
-        }
-        fprintf(file, "Subject: %s\n", msg->subject);
-        fprintf(file, "Body:\n");
-        if (msg->body && msg->body[0] != '\0') {
-            size_t body_len = strlen(msg->body);
-            if (msg->body[body_len - 1] == '\n') {
-                fprintf(file, "%s", msg->body);
-            } else {
-                fprintf(file, "%s\n", msg->body);
-            }
+    pthread_mutex_lock(&stores_m);
+    message_store* first = stores;
+    pthread_mutex_unlock(&stores_m);
+    size_t evicted = 0;
+    for (message_store* store = first; store && cutoff.created >= 0; store = store->next) {
+        if (!store->filename) continue;
+        if (budget_cutoff.created < 0 && now < store->tier_due) continue;
+        time_t oldest_hot = (time_t)INT64_MAX;
+        for (size_t s = 0; s < MESSAGE_SHARDS; s++) {
+            evicted += tier_evict_shard(store, &store->shards[s], cutoff, &oldest_hot);
         }
+        store->tier_due = tier_cold_after > 0 && oldest_hot != (time_t)INT64_MAX
+                              ? oldest_hot + (time_t)tier_cold_after + 1
+                              : (time_t)INT64_MAX;
+    }
+    for (message_store* store = first; store; store = store->next) {
+        if (store->filename) cold_compact(store);
+    }
+    stats_add(STAT_TIER_EVICTED, evicted);
+    stats_set(STAT_TIER_HOT_BYTES, atomic_load_explicit(&hot_bytes, memory_order_relaxed));
+    stats_set(STAT_TIER_COLD_BYTES, atomic_load_explicit(&cold_bytes, memory_order_relaxed));
+}
 
-        fprintf(file, "===END===\n");
+static void* tier_thread(void* arg) {
+    (void)arg;
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&tier_m);
+    while (!tier_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += TIER_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (TIER_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!tier_stop) {
+            if (pthread_cond_timedwait(&tier_cv, &tier_m, &deadline) == ETIMEDOUT) break;
+        }
+        if (tier_stop) break;
+        pthread_mutex_unlock(&tier_m);
+        tier_pass();
+        pthread_mutex_lock(&tier_m);
     }
-    fclose(file);
+    pthread_mutex_unlock(&tier_m);
+    return NULL;
 }
 
 /**
- * @brief Carica i messaggi da un file di testo in memoria all'avvio del server.
- * 
- * La funzione è uno state machine che parsa il file `messages.txt`.
- * 1. Legge il file riga per riga.
- * 2. Usa `sscanf` e `strncmp` per identificare i campi (ID, Author, etc.).
- * 3. Quando incontra "Body:", entra in una modalità speciale (`in_body = true`)
- *    in cui accumula tutte le righe successive in un buffer dinamico fino a
- *    quando non incontra il delimitatore "===END===".
- * 4. Una volta letto un messaggio completo, lo aggiunge all'array `message_array`.
- * 5. Tiene traccia dell'ID più alto per impostare correttamente `next_id`.
+ * @brief Imposta i limiti del livello freddo: i corpi dei messaggi vecchi o
+ *        in eccesso stanno su disco, e in memoria restano i soli metadati.
+ *
+ * Va chiamata prima di caricare le bacheche, perché `load_messages` sposta
+ * già nel file freddo i corpi oltre i limiti invece di leggerli in memoria.
+ *
+ * @param cold_after_sec Età oltre cui un corpo viene espulso (0 = nessuna).
+ * @param hot_budget_bytes Byte massimi di corpi in memoria (0 = nessun limite).
  */
-void load_messages() {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+void message_store_set_tiering(unsigned cold_after_sec, size_t hot_budget_bytes) {
+    tier_cold_after = cold_after_sec;
+    tier_hot_budget = hot_budget_bytes;
+}
+
+/**
+ * @brief Avvia il thread che mantiene i limiti di `message_store_set_tiering`
+ *        mentre nuovi messaggi arrivano e invecchiano.
+ */
+void message_store_start_tiering(void) {
+    if (tier_cold_after == 0 && tier_hot_budget == 0) return;
+    tier_stop = false;
+    if (pthread_create(&tier_tid, NULL, tier_thread, NULL) != 0) {
+        perror("Impossibile avviare il thread del livello freddo");
         return;
     }
+    tier_running = true;
+}
+
+static void stop_tiering(void) {
+    if (!tier_running) return;
+    pthread_mutex_lock(&tier_m);
+    tier_stop = true;
+    pthread_cond_signal(&tier_cv);
+    pthread_mutex_unlock(&tier_m);
+    pthread_join(tier_tid, NULL);
+    tier_running = false;
+}
+
+typedef struct load_latch {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    size_t remaining;
+} load_latch;
+
+typedef struct load_chunk {
+    const char* base;       // Inizio del file mappato
+    const char* start;
+    const char* end;
+    Message* messages;
+    size_t size;
+    size_t capacity;
+    size_t head;            // Prossimo messaggio da fondere
+    uint32_t max_id;
+    bool spill;             // Corpi lasciati nel file mappato (vedi `load_spill`)
+    bool failed;
+    load_latch* latch;
+} load_chunk;
+
+typedef struct load_task {
+    load_chunk* chunk;
+} load_task;
+
+static bool chunk_append(load_chunk* chunk, const Message* msg) {
+    if (chunk->size == chunk->capacity) {
+        size_t new_capacity = (chunk->capacity == 0) ? 64 : chunk->capacity * 2;
+        Message* new_messages = realloc(chunk->messages, new_capacity * sizeof(Message));
+        if (!new_messages) return false;
+        chunk->messages = new_messages;
+        chunk->capacity = new_capacity;
+    }
+    chunk->messages[chunk->size++] = *msg;
+    return true;
+}
+
+static int compare_message_id(const void* a, const void* b) {
+    uint32_t id_a = ((const Message*)a)->id;
+    uint32_t id_b = ((const Message*)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
 
+/**
+ * @brief Parsa i record compresi in `[chunk->start, chunk->end)`.
+ *
+ * @param chunk Il blocco da parsare; i messaggi letti finiscono in `chunk->messages`.
+ *
+ * È la stessa macchina a stati del caricamento sequenziale, ma lavora sulla
+ * memoria mappata invece che con `fgets`: le righe di intestazione vengono
+ * copiate in un buffer locale per poterle passare a `sscanf`, mentre le righe
+ * del corpo vengono copiate direttamente nel buffer del corpo.
+ * Con `chunk->spill` il corpo non viene copiato: il messaggio ne ricorda
+ * posizione (rispetto a `chunk->base`) e lunghezza in `cold_offset` e
+ * `cold_len`, e lo legge o lo sposta nel file freddo `load_spill`.
+ * Alla fine i messaggi del blocco vengono ordinati per ID, se necessario.
+ */
+static void parse_chunk(load_chunk* chunk) {
     Message current_msg;
     char line[4096];
     bool in_body = false;
-    uint32_t max_id = 0;
     char* body_buffer = NULL;
     size_t body_capacity = 0;
     size_t body_len = 0;
+    const char* body_start = NULL;
+    const char* p = chunk->start;
 
     memset(&current_msg, 0, sizeof(Message));
 
-    while (fgets(line, sizeof(line), file)) {
+    while (p < chunk->end) {
+        const char* nl = memchr(p, '\n', chunk->end - p);
+        const char* line_end = nl ? nl + 1 : chunk->end;
+        size_t line_len = line_end - p;
+
         if (in_body) {
-            if (strcmp(line, "===END===\n") == 0) {
-                if (message_array.size == message_array.capacity) {
-                    size_t new_capacity = (message_array.capacity == 0) ? 10 : message_array.capacity * 2;
-                    Message* new_messages = realloc(message_array.messages, new_capacity * sizeof(Message));
-                    if (!new_messages) { 
-                        free(body_buffer); 
-                        free(current_msg.timestamp);
-                        fclose(file); 
-                        return; 
-                    }
-                    message_array.messages = new_messages;
-                    message_array.capacity = new_capacity;
+            if (line_len == 10 && memcmp(p, "===END===\n", 10) == 0) {
+                if (chunk->spill) {
+                    current_msg.cold_offset = (uint64_t)(body_start - chunk->base);
+                    current_msg.cold_len = (uint32_t)(p - body_start);
+                } else {
+                    current_msg.body = body_buffer ? body_resize(body_buffer, body_len) : message_body_alloc(0);
+                    if (!current_msg.body) message_body_release(body_buffer);
+                }
+                current_msg.created = parse_timestamp(current_msg.timestamp);
+                if ((!chunk->spill && !current_msg.body) || !chunk_append(chunk, &current_msg)) {
+                    message_body_release(current_msg.body);
+                    free(current_msg.timestamp);
+                    chunk->failed = true;
+                    return;
                 }
-                
-                current_msg.body = body_buffer ? body_buffer : strdup("");
-                
-                message_array.messages[message_array.size] = current_msg;
-                message_array.size++;
 
                 body_buffer = NULL;
                 body_capacity = 0;
                 body_len = 0;
                 in_body = false;
-                
-                memset(&current_msg, 0, sizeof(Message));
 
-            } else {
-                size_t line_len = strlen(line);
+                memset(&current_msg, 0, sizeof(Message));
+            } else if (!chunk->spill) {
                 if (body_len + line_len + 1 > body_capacity) {
                     body_capacity = (body_len + line_len + 1) * 2;
-                    char* new_body_buffer = realloc(body_buffer, body_capacity);
-                    if (!new_body_buffer) { 
-                        free(body_buffer); 
+                    char* new_body_buffer = body_resize(body_buffer, body_capacity);
+                    if (!new_body_buffer) {
+                        message_body_release(body_buffer);
                         free(current_msg.timestamp);
-                        fclose(file); 
-                        return; 
+                        chunk->failed = true;
+                        return;
                     }
                     body_buffer = new_body_buffer;
                 }
-                memcpy(body_buffer + body_len, line, line_len);
+                memcpy(body_buffer + body_len, p, line_len);
                 body_len += line_len;
                 body_buffer[body_len] = '\0';
             }
         } else {
+            size_t copy_len = (line_len < sizeof(line)) ? line_len : sizeof(line) - 1;
+            memcpy(line, p, copy_len);
+            line[copy_len] = '\0';
             line[strcspn(line, "\r\n")] = 0;
-            
+
             if (sscanf(line, "ID: %u", &current_msg.id) == 1) {
-                if (current_msg.id > max_id) {
-                    max_id = current_msg.id;
+                if (current_msg.id > chunk->max_id) {
+                    chunk->max_id = current_msg.id;
                 }
             } else if (sscanf(line, "Author: %49s", current_msg.author) == 1) {
             } else if (strncmp(line, "Timestamp: ", 11) == 0) {
@@ -403,12 +2886,365 @@ void load_messages() {
                 current_msg.subject[sizeof(current_msg.subject) - 1] = '\0';
             } else if (strcmp(line, "Body:") == 0) {
                 in_body = true;
+                body_start = line_end;
             }
         }
+        p = line_end;
     }
-    
-    free(body_buffer); 
+
+    message_body_release(body_buffer);
     free(current_msg.timestamp);
-    fclose(file);
-    message_array.next_id = max_id + 1;
-}
\ No newline at end of file
+
+    for (size_t i = 1; i < chunk->size; i++) {
+        if (chunk->messages[i - 1].id > chunk->messages[i].id) {
+            qsort(chunk->messages, chunk->size, sizeof(Message), compare_message_id);
+            break;
+        }
+    }
+}
+
+static void* parse_chunk_task(void* arg) {
+    load_chunk* chunk = ((load_task*)arg)->chunk;
+    free(arg);
+
+    parse_chunk(chunk);
+
+    pthread_mutex_lock(&chunk->latch->mutex);
+    if (--chunk->latch->remaining == 0) {
+        pthread_cond_signal(&chunk->latch->cond);
+    }
+    pthread_mutex_unlock(&chunk->latch->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Trova il primo confine di record (subito dopo una riga "===END===") a partire da `from`.
+ */
+static const char* next_record_boundary(const char* data, const char* from, const char* end) {
+    static const char marker[] = "\n===END===\n";
+    const size_t marker_len = sizeof(marker) - 1;
+
+    if (from <= data) return data;
+    const char* found = memmem(from - 1, end - (from - 1), marker, marker_len);
+    return found ? found + marker_len : end;
+}
+
+static void free_chunks(load_chunk* chunks, size_t n_chunks) {
+    for (size_t c = 0; c < n_chunks; c++) {
+        for (size_t i = 0; i < chunks[c].size; i++) {
+            message_body_release(chunks[c].messages[i].body);
+            free(chunks[c].messages[i].timestamp);
+        }
+        free(chunks[c].messages);
+    }
+}
+
+/**
+ * @brief Ripristina la proprietà di min-heap (per ID del prossimo messaggio) a partire dal nodo `i`.
+ */
+static void chunk_sift_down(load_chunk** heap, size_t heap_size, size_t i) {
+    while (1) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < heap_size &&
+            heap[left]->messages[heap[left]->head].id < heap[smallest]->messages[heap[smallest]->head].id) {
+            smallest = left;
+        }
+        if (right < heap_size &&
+            heap[right]->messages[heap[right]->head].id < heap[smallest]->messages[heap[smallest]->head].id) {
+            smallest = right;
+        }
+        if (smallest == i) return;
+        load_chunk* temp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = temp;
+        i = smallest;
+    }
+}
+
+/**
+ * @brief Dà il corpo ai messaggi parsati con `spill`, ancora nel file mappato `data`.
+ *
+ * `messages` è ordinato per data. Dal più recente restano in memoria i corpi
+ * che non hanno l'età `tier_cold_after` finché, con quelli già in memoria,
+ * stanno nel 90% di `tier_hot_budget` (l'obiettivo di `tier_pass`); quelli
+ * più vecchi vengono scritti dal file mappato direttamente nel file freddo
+ * della bacheca, senza passare dalla memoria. I corpi vuoti restano in
+ * memoria, come in `tier_evict_shard`. Se il file freddo non si può
+ * scrivere, i corpi rimanenti vengono copiati in memoria e li espellerà il
+ * thread del livello freddo.
+ *
+ * @return 0, o -1 se manca memoria: il file freddo viene chiuso e i messaggi
+ *         ancora senza corpo restano con `body` NULL.
+ */
+static int load_spill(message_store* store, Message* messages, size_t total, const char* data) {
+    time_t age_limit = local_now() - (time_t)tier_cold_after;
+    size_t limit = tier_hot_budget > 0 ? tier_hot_budget / 10 * 9 : SIZE_MAX;
+    size_t hot = atomic_load_explicit(&hot_bytes, memory_order_relaxed);
+    // I messaggi prima di `split` vanno nel file freddo.
+    size_t split = total;
+    while (split > 0) {
+        const Message* msg = &messages[split - 1];
+        if (msg->cold_len > 0) {
+            if (tier_cold_after > 0 && msg->created <= age_limit) break;
+            if (hot > limit || msg->cold_len > limit - hot) break;
+            hot += msg->cold_len;
+        }
+        split--;
+    }
+
+    bool writable = split > 0 && (atomic_load_explicit(&store->cold, memory_order_relaxed) || cold_open(store) == 0);
+    cold_file* cold = atomic_load_explicit(&store->cold, memory_order_relaxed);
+    size_t spilled = 0;
+    for (size_t i = 0; i < total; i++) {
+        Message* msg = &messages[i];
+        const char* body = data + msg->cold_offset;
+        size_t len = msg->cold_len;
+        if (i < split && len > 0 && writable) {
+            if (cold_write(cold, store->cold_end, body, len) == 0) {
+                msg->cold_offset = store->cold_end;
+                store->cold_end += len;
+                atomic_fetch_add_explicit(&cold_bytes, len, memory_order_relaxed);
+                spilled++;
+                continue;
+            }
+            perror("Errore nella scrittura del livello freddo");
+            writable = false;
+        }
+        msg->body = message_body_alloc(len);
+        if (!msg->body) {
+            if (cold) {
+                atomic_fetch_sub_explicit(&cold_bytes, store->cold_end, memory_order_relaxed);
+                atomic_store_explicit(&store->cold, NULL, memory_order_relaxed);
+                store->cold_end = 0;
+                cold_release(cold);
+            }
+            return -1;
+        }
+        memcpy(msg->body, body, len);
+        msg->cold_offset = 0;
+        msg->cold_len = 0;
+    }
+    stats_add(STAT_TIER_EVICTED, spilled);
+    return 0;
+}
+
+/**
+ * @brief Carica i messaggi da un file di testo in memoria all'avvio del server.
+ * 
+ * Il parsing vero e proprio è in `parse_chunk`, una macchina a stati che:
+ * 1. Legge il file riga per riga.
+ * 2. Usa `sscanf` e `strncmp` per identificare i campi (ID, Author, etc.).
+ * 3. Quando incontra "Body:", entra in una modalità speciale (`in_body = true`)
+ *    in cui accumula tutte le righe successive in un buffer dinamico fino a
+ *    quando non incontra il delimitatore "===END===".
+ * 4. Tiene traccia dell'ID più alto per impostare correttamente `next_id`.
+ *
+ * Per sfruttare tutti i core su file grandi, il file viene mappato in memoria e
+ * diviso in tanti blocchi quanti sono i thread del pool (più il thread
+ * chiamante), tagliando sempre subito dopo una riga "===END===" così che
+ * nessun record venga spezzato. I blocchi vengono parsati in parallelo dai
+ * thread lavoratori in array separati, poi fusi in ordine di ID con un
+ * min-heap delle teste dei blocchi, ordinati per
+ * data e distribuiti nelle shard, che restano così ordinate per data come
+ * richiede `shard_insert`. Sotto `PARALLEL_LOAD_MIN_BYTES` il file è parsato in un unico blocco
+ * dal thread chiamante.
+ *
+ * Con il livello freddo attivo (`message_store_set_tiering`) i blocchi non
+ * copiano i corpi: il file resta mappato fino alla fine e `load_spill`
+ * copia in memoria solo i corpi entro i limiti, scrivendo gli altri nel file
+ * freddo. Così la memoria occupata all'avvio, e in un hot restart, resta
+ * quella del budget invece di quella dell'intero file.
+ *
+ * @return 0 se il file è stato caricato per intero (o non esiste ancora), -1
+ *         se non è stato possibile leggerlo tutto. In quel caso la bacheca
+ *         resta vuota e non va usata: il primo salvataggio sostituirebbe il
+ *         file con la sola parte caricata.
+ */
+int load_messages(message_store* store) {
+    if (!store->filename) return 0;
+    int fd = open(store->filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return 0;
+        perror("Errore nell'apertura del file dei messaggi");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Errore nella lettura del file dei messaggi");
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t file_size = st.st_size;
+
+    char* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Errore nella mappatura del file dei messaggi");
+        return -1;
+    }
+    madvise(data, file_size, MADV_SEQUENTIAL);
+
+    bool spill = tier_cold_after > 0 || tier_hot_budget > 0;
+    size_t n_chunks = 1;
+    if (load_pool != NULL && file_size >= PARALLEL_LOAD_MIN_BYTES) {
+        n_chunks = thread_pool_size(load_pool) + 1;
+    }
+
+    load_chunk* chunks = calloc(n_chunks, sizeof(load_chunk));
+    if (!chunks) {
+        munmap(data, file_size);
+        fprintf(stderr, "Errore di memoria durante il caricamento dei messaggi\n");
+        return -1;
+    }
+
+    load_latch latch;
+    pthread_mutex_init(&latch.mutex, NULL);
+    pthread_cond_init(&latch.cond, NULL);
+    latch.remaining = 0;
+
+    const char* end = data + file_size;
+    const char* start = data;
+    for (size_t c = 0; c < n_chunks; c++) {
+        const char* chunk_end = (c == n_chunks - 1) ? end
+            : next_record_boundary(data, data + file_size * (c + 1) / n_chunks, end);
+        if (chunk_end < start) chunk_end = start;
+        chunks[c].base = data;
+        chunks[c].start = start;
+        chunks[c].end = chunk_end;
+        chunks[c].spill = spill;
+        chunks[c].latch = &latch;
+        start = chunk_end;
+    }
+
+    // Il primo blocco viene parsato dal thread chiamante; gli altri dal pool.
+    // Se un task non può essere accodato viene parsato anch'esso qui.
+    for (size_t c = 1; c < n_chunks; c++) {
+        load_task* task = malloc(sizeof(load_task));
+        if (task) {
+            task->chunk = &chunks[c];
+            pthread_mutex_lock(&latch.mutex);
+            latch.remaining++;
+            pthread_mutex_unlock(&latch.mutex);
+            if (add_task_class(load_pool, TASK_BACKGROUND, parse_chunk_task, task) == 0) continue;
+            pthread_mutex_lock(&latch.mutex);
+            latch.remaining--;
+            pthread_mutex_unlock(&latch.mutex);
+        }
+        parse_chunk(&chunks[c]);
+    }
+    parse_chunk(&chunks[0]);
+
+    pthread_mutex_lock(&latch.mutex);
+    while (latch.remaining > 0) {
+        pthread_cond_wait(&latch.cond, &latch.mutex);
+    }
+    pthread_mutex_unlock(&latch.mutex);
+    pthread_mutex_destroy(&latch.mutex);
+    pthread_cond_destroy(&latch.cond);
+    if (!spill) munmap(data, file_size);
+
+    size_t total = 0;
+    uint32_t max_id = 0;
+    bool failed = false;
+    for (size_t c = 0; c < n_chunks; c++) {
+        total += chunks[c].size;
+        if (chunks[c].max_id > max_id) max_id = chunks[c].max_id;
+        failed = failed || chunks[c].failed;
+    }
+
+    Message* merged = (total > 0 && !failed) ? malloc(total * sizeof(Message)) : NULL;
+    if (failed || (total > 0 && !merged)) {
+        fprintf(stderr, "Errore di memoria durante il caricamento dei messaggi\n");
+        if (spill) munmap(data, file_size);
+        free_chunks(chunks, n_chunks);
+        free(chunks);
+        return -1;
+    }
+
+    // Fusione a k vie dei blocchi, già ordinati per ID: O(log k) per messaggio.
+    load_chunk** heap = calloc(n_chunks, sizeof(load_chunk*));
+    if (!heap) {
+        fprintf(stderr, "Errore di memoria durante il caricamento dei messaggi\n");
+        if (spill) munmap(data, file_size);
+        free(merged);
+        free_chunks(chunks, n_chunks);
+        free(chunks);
+        return -1;
+    }
+    size_t heap_size = 0;
+    for (size_t c = 0; c < n_chunks; c++) {
+        if (chunks[c].size > 0) heap[heap_size++] = &chunks[c];
+    }
+    for (size_t i = heap_size / 2; i > 0; i--) {
+        chunk_sift_down(heap, heap_size, i - 1);
+    }
+    for (size_t out = 0; out < total; out++) {
+        load_chunk* top = heap[0];
+        merged[out] = top->messages[top->head++];
+        if (top->head == top->size) {
+            heap[0] = heap[--heap_size];
+        }
+        chunk_sift_down(heap, heap_size, 0);
+    }
+    free(heap);
+    for (size_t c = 0; c < n_chunks; c++) {
+        free(chunks[c].messages);
+    }
+    free(chunks);
+
+    size_t shard_sizes[MESSAGE_SHARDS] = {0};
+    for (size_t i = 0; i < total; i++) {
+        shard_sizes[merged[i].id % MESSAGE_SHARDS]++;
+    }
+    bool reserved = true;
+    for (size_t s = 0; s < MESSAGE_SHARDS && reserved; s++) {
+        reserved = shard_sizes[s] == 0 || shard_reserve(&store->shards[s], shard_sizes[s]);
+    }
+    if (!reserved) {
+        fprintf(stderr, "Errore di memoria durante il caricamento dei messaggi\n");
+        if (spill) munmap(data, file_size);
+        for (size_t i = 0; i < total; i++) {
+            message_body_release(merged[i].body);
+            free(merged[i].timestamp);
+        }
+        free(merged);
+        return -1;
+    }
+    // Le shard sono ordinate per data: un file salvato in ordine di ID lo è
+    // quasi sempre già, altrimenti si ordina una volta qui invece di spostare
+    // record a ogni inserimento.
+    for (size_t i = 1; i < total; i++) {
+        if (compare_message_time(&merged[i - 1], &merged[i]) > 0) {
+            qsort(merged, total, sizeof(Message), compare_message_time);
+            break;
+        }
+    }
+    if (spill) {
+        int spilled = load_spill(store, merged, total, data);
+        munmap(data, file_size);
+        if (spilled < 0) {
+            fprintf(stderr, "Errore di memoria durante il caricamento dei messaggi\n");
+            for (size_t i = 0; i < total; i++) {
+                message_body_release(merged[i].body);
+                free(merged[i].timestamp);
+            }
+            free(merged);
+            return -1;
+        }
+    }
+    // Lo spazio è già riservato e i messaggi arrivano in ordine: vanno tutti
+    // in coda e gli inserimenti non possono fallire.
+    for (size_t i = 0; i < total; i++) {
+        shard_insert(shard_for(store, merged[i].id), &merged[i]);
+    }
+    free(merged);
+    message_store_set_next_id(store, max_id + 1);
+    return 0;
+}
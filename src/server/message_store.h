@@ -4,13 +4,75 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "../common/common.h"
+#include "thread_pool.h"
+#include "reply.h"
 
-void message_store_init(const char* filename);
+/** Una bacheca, con le proprie shard, il proprio file e i propri salvataggi. */
+typedef struct message_store message_store;
+
+typedef enum {
+    STORE_EVENT_ADDED,
+    STORE_EVENT_DELETED
+} store_event_type;
+
+/**
+ * Una modifica della bacheca, notificata agli osservatori registrati con
+ * `message_store_add_observer`. I puntatori restano validi solo per la durata
+ * della notifica; `body` è un corpo con conteggio dei riferimenti, che
+ * l'osservatore può trattenere con `message_body_acquire`.
+ */
+typedef struct store_event {
+    const message_store* store;
+    store_event_type type;
+    uint32_t id;
+    time_t created;
+    const char* author;
+    const char* subject;
+    const char* body;
+    const char* timestamp;
+} store_event;
+
+typedef void (*store_observer)(const store_event* event, void* ctx);
+
+/** Limiti di conservazione dei messaggi di una bacheca; 0 = nessun limite. */
+typedef struct retention_policy {
+    unsigned max_age_sec;       // Età massima di un messaggio
+    size_t max_messages;        // Messaggi nella bacheca, i più vecchi scadono per primi
+    size_t max_per_author;      // Messaggi di ogni autore nella bacheca
+} retention_policy;
+
+int message_store_add_observer(store_observer observer, void* ctx);
+void message_store_init(thread_pool* pool);
+message_store* message_store_open(const char* name, const char* file);
+const char* message_store_name(const message_store* store);
 void message_store_shutdown();
-void add_message(const char* author, const char* subject, const char* body);
-int delete_message(uint32_t message_id, const char* current_user);
-void get_board(int sock);
-void save_messages();
-void load_messages();
+void message_store_save();
+void message_store_for_each(void (*fn)(message_store* store, void* ctx), void* ctx);
+uint32_t message_store_next_id(message_store* store);
+void message_store_set_next_id(message_store* store, uint32_t next_id);
+char* message_body_alloc(size_t len);
+void message_body_acquire(const char* body);
+void message_body_release(const char* body);
+size_t message_body_len(const char* body);
+void message_body_reply(reply* out, const char* body);
+void add_message(message_store* store, const char* author, const char* subject, const char* body);
+void add_message_body(message_store* store, const char* author, const char* subject, char* body);
+int delete_message(message_store* store, uint32_t message_id, const char* current_user);
+uint32_t message_store_add_batch(message_store* store, const char* author, const char* const* subjects,
+                                 char* const* bodies, size_t n, int* results);
+size_t message_store_delete_batch(message_store* store, const uint32_t* ids, size_t n, const char* current_user,
+                                  int* results);
+int message_store_insert(message_store* store, uint32_t id, const char* author, const char* subject,
+                         char* body, const char* timestamp);
+void message_store_retain(message_store* store, const uint32_t* ids, size_t n_ids);
+size_t message_store_expire(message_store* store, const retention_policy* policy, size_t batch);
+void message_store_export(message_store* store, reply* out, void (*finish)(reply* out, bool complete));
+uint64_t message_store_version(message_store* store);
+void get_board(message_store* store, reply* out, const uint64_t* known_version);
+int save_messages(message_store* store);
+void message_store_start_snapshots(unsigned interval_sec, unsigned every_mutations);
+void message_store_set_tiering(unsigned cold_after_sec, size_t hot_budget_bytes);
+void message_store_start_tiering(void);
+int load_messages(message_store* store);
 
 #endif // MESSAGE_STORE_H
\ No newline at end of file
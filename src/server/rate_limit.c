@@ -0,0 +1,172 @@
+#include "rate_limit.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RATE_STRIPES 64
+#define RATE_STRIPE_SLOTS 128
+#define RATE_PROBE 8
+#define RATE_ADDR_FACTOR 4
+#define RATE_MAX_PER_SEC 100000
+
+/**
+ * Un token bucket. `key` è un hash a 64 bit di classe, tipo di chiave
+ * (utente o indirizzo) e identità, 0 se lo slot è libero; i token sono in
+ * millesimi e vengono ricaricati pigramente in base ai millisecondi trascorsi
+ * da `stamp_ms`. 16 byte per bucket, quattro per linea di cache.
+ */
+typedef struct rate_bucket {
+    uint64_t key;
+    uint32_t stamp_ms;
+    int32_t tokens;
+} rate_bucket;
+
+/**
+ * Una partizione della tabella dei bucket, con il proprio mutex: richieste
+ * di utenti diversi cadono quasi sempre su stripe diverse. La tabella ha
+ * dimensione fissa; quando le `RATE_PROBE` posizioni di una chiave sono
+ * occupate viene riusato il bucket inattivo da più tempo, che tanto sarebbe
+ * già tornato pieno.
+ */
+typedef struct rate_stripe {
+    pthread_mutex_t mutex;
+    rate_bucket slots[RATE_STRIPE_SLOTS];
+} __attribute__((aligned(64))) rate_stripe;
+
+typedef struct rate_limit {
+    uint32_t per_sec;   // 0 = classe senza limite
+    uint32_t burst;
+} rate_limit;
+
+static rate_stripe stripes[RATE_STRIPES];
+static rate_limit limits[RATE_CLASS_COUNT];
+static const char* const class_names[RATE_CLASS_COUNT] = {
+    [RATE_CLASS_AUTH]  = "auth",
+    [RATE_CLASS_READ]  = "read",
+    [RATE_CLASS_WRITE] = "write",
+};
+
+void rate_limit_init(void) {
+    for (int i = 0; i < RATE_STRIPES; i++) {
+        pthread_mutex_init(&stripes[i].mutex, NULL);
+    }
+}
+
+/**
+ * @brief Imposta il limite di una classe da una stringa `classe=richieste_al_secondo[:burst]`.
+ *
+ * @return 0 in caso di successo, -1 se la stringa non è valida.
+ *
+ * Senza burst il bucket contiene due secondi di richieste. Il limite vale per
+ * ogni utente; quello per indirizzo è `RATE_ADDR_FACTOR` volte più largo,
+ * perché dietro un indirizzo (NAT) possono esserci più utenti.
+ */
+int rate_limit_parse(const char* spec) {
+    const char* eq = strchr(spec, '=');
+    if (!eq) return -1;
+    for (int i = 0; i < RATE_CLASS_COUNT; i++) {
+        if (strlen(class_names[i]) != (size_t)(eq - spec) || strncmp(spec, class_names[i], eq - spec) != 0) {
+            continue;
+        }
+        char* end;
+        unsigned long per_sec = strtoul(eq + 1, &end, 10);
+        unsigned long burst = per_sec * 2;
+        if (*end == ':') burst = strtoul(end + 1, &end, 10);
+        if (*end != '\0' || per_sec > RATE_MAX_PER_SEC || burst > 2 * RATE_MAX_PER_SEC || (per_sec > 0 && burst == 0)) {
+            return -1;
+        }
+        limits[i].per_sec = (uint32_t)per_sec;
+        limits[i].burst = (uint32_t)burst;
+        return 0;
+    }
+    return -1;
+}
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static uint64_t hash_key(rate_class cls, char kind, const void* data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = (h ^ (uint8_t)cls) * 0x100000001b3ULL;
+    h = (h ^ (uint8_t)kind) * 0x100000001b3ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ ((const uint8_t*)data)[i]) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+/**
+ * @brief Preleva un token dal bucket `key`.
+ *
+ * @param per_sec Ricarica in token al secondo.
+ * @param burst Capacità del bucket in token.
+ * @return true se il token era disponibile.
+ */
+static bool take_token(uint64_t key, uint32_t per_sec, uint32_t burst) {
+    rate_stripe* stripe = &stripes[key % RATE_STRIPES];
+    unsigned start = (unsigned)(key / RATE_STRIPES) % RATE_STRIPE_SLOTS;
+    uint32_t now = now_ms();
+    int64_t capacity = (int64_t)burst * 1000;
+    bool allowed;
+
+    pthread_mutex_lock(&stripe->mutex);
+    rate_bucket* bucket = NULL;
+    rate_bucket* free_slot = NULL;
+    rate_bucket* oldest = NULL;
+    for (unsigned i = 0; i < RATE_PROBE && !bucket; i++) {
+        rate_bucket* b = &stripe->slots[(start + i) % RATE_STRIPE_SLOTS];
+        if (b->key == key) {
+            bucket = b;
+        } else if (b->key == 0) {
+            if (!free_slot) free_slot = b;
+        } else if (!oldest || (uint32_t)(now - b->stamp_ms) > (uint32_t)(now - oldest->stamp_ms)) {
+            oldest = b;
+        }
+    }
+    if (!bucket) {
+        bucket = free_slot ? free_slot : oldest;
+        bucket->key = key;
+        bucket->stamp_ms = now;
+        bucket->tokens = (int32_t)capacity;
+    }
+
+    int64_t tokens = bucket->tokens + (int64_t)(uint32_t)(now - bucket->stamp_ms) * per_sec;
+    if (tokens > capacity) tokens = capacity;
+    bucket->stamp_ms = now;
+    allowed = tokens >= 1000;
+    if (allowed) tokens -= 1000;
+    bucket->tokens = (int32_t)tokens;
+    pthread_mutex_unlock(&stripe->mutex);
+    return allowed;
+}
+
+/**
+ * @brief Verifica se una richiesta della classe `cls` rientra nei limiti.
+ *
+ * @param user L'utente autenticato, o NULL.
+ * @param addr L'indirizzo IPv4 del client (ordine di rete), o 0 se sconosciuto.
+ * @return true se la richiesta può essere eseguita.
+ *
+ * Una richiesta consuma un token sia dal bucket dell'utente sia da quello
+ * dell'indirizzo; basta che uno dei due sia vuoto per rifiutarla.
+ */
+bool rate_limit_allow(rate_class cls, const char* user, uint32_t addr) {
+    const rate_limit* limit = &limits[cls];
+    if (limit->per_sec == 0) return true;
+
+    bool allowed = true;
+    if (user) {
+        allowed = take_token(hash_key(cls, 'u', user, strlen(user)), limit->per_sec, limit->burst);
+    }
+    if (addr != 0 && allowed) {
+        allowed = take_token(hash_key(cls, 'a', &addr, sizeof(addr)),
+                             limit->per_sec * RATE_ADDR_FACTOR, limit->burst * RATE_ADDR_FACTOR);
+    }
+    return allowed;
+}
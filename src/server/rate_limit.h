@@ -0,0 +1,19 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Classi di comandi con limiti indipendenti. */
+typedef enum {
+    RATE_CLASS_AUTH,    // C_REGISTER, C_LOGIN
+    RATE_CLASS_READ,    // C_GET_BOARD
+    RATE_CLASS_WRITE,   // C_POST_MESSAGE, C_DELETE_MESSAGE
+    RATE_CLASS_COUNT
+} rate_class;
+
+void rate_limit_init(void);
+int rate_limit_parse(const char* spec);
+bool rate_limit_allow(rate_class cls, const char* user, uint32_t addr);
+
+#endif // RATE_LIMIT_H
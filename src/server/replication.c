@@ -0,0 +1,345 @@
+#include "replication.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "../common/protocol.h"
+#include "../lib/bacheca.h"
+#include "boards.h"
+#include "message_store.h"
+#include "subscriptions.h"
+#include "stats.h"
+
+#define HEARTBEAT_INTERVAL_MS 1000
+#define REPLICA_TIMEOUT_MS 5000
+#define REPLICA_BACKOFF_MIN_MS 100
+#define REPLICA_BACKOFF_MAX_MS 5000
+
+static bool allowed = false;
+static bool replica_mode = false;
+static char primary_ip[64];
+static int primary_port;
+
+static pthread_t heartbeat_tid;
+static pthread_t replica_tid;
+static bool heartbeat_running = false;
+static bool replica_running = false;
+static pthread_mutex_t stop_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cv = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+static int replica_sock = -1;       // Socket verso il primario, per `replication_stop`
+
+/**
+ * Stato della connessione di una replica al primario. Finché `synced` è
+ * falso si sta ricevendo la copia della bacheca, e gli ID ricevuti vengono
+ * raccolti in `ids` per `message_store_retain`.
+ */
+typedef struct replica_state {
+    bool synced;
+    bool failed;
+    uint32_t* ids;
+    size_t n_ids;
+    size_t cap_ids;
+    uint64_t last_contact_ms;
+} replica_state;
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Attende `ms` millisecondi o la richiesta di arresto.
+ *
+ * @return true se è stato richiesto l'arresto.
+ */
+static bool wait_stop(unsigned ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&stop_m);
+    while (!stopping && pthread_cond_timedwait(&stop_cv, &stop_m, &deadline) != ETIMEDOUT) {
+    }
+    bool stop = stopping;
+    pthread_mutex_unlock(&stop_m);
+    return stop;
+}
+
+static bool should_stop(void) {
+    pthread_mutex_lock(&stop_m);
+    bool stop = stopping;
+    pthread_mutex_unlock(&stop_m);
+    return stop;
+}
+
+/**
+ * @brief Compone il payload di un `EVENT_HEARTBEAT`: prossimo ID e ora corrente in ms.
+ */
+static void heartbeat_payload(char payload[sizeof(uint32_t) + sizeof(uint64_t)]) {
+    uint32_t next_id = message_store_next_id(boards_default());
+    uint64_t now = wall_ms();
+    memcpy(payload, &next_id, sizeof(next_id));
+    memcpy(payload + sizeof(next_id), &now, sizeof(now));
+}
+
+static void* heartbeat_thread(void* arg) {
+    (void)arg;
+    char payload[sizeof(uint32_t) + sizeof(uint64_t)];
+    while (!wait_stop(HEARTBEAT_INTERVAL_MS)) {
+        heartbeat_payload(payload);
+        subscriptions_heartbeat(payload, sizeof(payload));
+    }
+    return NULL;
+}
+
+/**
+ * @brief Abilita `C_REPLICATE` e avvia il thread dei battiti verso le repliche.
+ *
+ * @return 0 in caso di successo, -1 se il thread non può essere avviato.
+ */
+int replication_allow(void) {
+    if (pthread_create(&heartbeat_tid, NULL, heartbeat_thread, NULL) != 0) {
+        perror("Impossibile avviare il thread dei battiti di replica");
+        return -1;
+    }
+    heartbeat_running = true;
+    allowed = true;
+    return 0;
+}
+
+bool replication_allowed(void) {
+    return allowed;
+}
+
+/** Chiude la copia per una replica: il primo battito, o `EVENT_RESYNC` se è incompleta. */
+static void snapshot_finish(reply* out, bool complete) {
+    if (!complete) {
+        reply_status(out, EVENT_RESYNC);
+        return;
+    }
+    char payload[sizeof(uint32_t) + sizeof(uint64_t)];
+    heartbeat_payload(payload);
+    reply_frame(out, EVENT_HEARTBEAT, payload, sizeof(payload));
+}
+
+/**
+ * @brief Accoda la risposta a `C_REPLICATE`, dopo l'`OK`: la copia della bacheca e il primo battito.
+ *
+ * Il subscriber della sessione esiste già, quindi ogni modifica successiva
+ * alla copia arriva nel flusso; quelle concorrenti possono arrivare due
+ * volte, e la replica le applica in modo idempotente. La copia viene
+ * prodotta a passi mentre viene inviata; se non può essere completata
+ * termina con `EVENT_RESYNC`, e la replica si riconnette.
+ */
+void replication_snapshot(reply* out) {
+    message_store_export(boards_default(), out, snapshot_finish);
+}
+
+/**
+ * @brief Imposta il primario da replicare da una stringa `IP:PORTA`.
+ *
+ * @return 0 in caso di successo, -1 se la stringa non è valida.
+ */
+int replication_parse_primary(const char* spec) {
+    const char* colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(primary_ip)) return -1;
+    char* end;
+    long port = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) return -1;
+    memcpy(primary_ip, spec, colon - spec);
+    primary_ip[colon - spec] = '\0';
+    primary_port = (int)port;
+    replica_mode = true;
+    return 0;
+}
+
+bool replication_is_replica(void) {
+    return replica_mode;
+}
+
+static int compare_id(const void* a, const void* b) {
+    uint32_t id_a = *(const uint32_t*)a;
+    uint32_t id_b = *(const uint32_t*)b;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+static void remember_id(replica_state* st, uint32_t id) {
+    if (st->n_ids == st->cap_ids) {
+        size_t cap = st->cap_ids ? st->cap_ids * 2 : 1024;
+        uint32_t* ids = realloc(st->ids, cap * sizeof(uint32_t));
+        if (!ids) {
+            st->failed = true;
+            return;
+        }
+        st->ids = ids;
+        st->cap_ids = cap;
+    }
+    st->ids[st->n_ids++] = id;
+}
+
+/**
+ * @brief Applica alla bacheca locale un pacchetto ricevuto dal primario (callback di libbacheca).
+ *
+ * Il primo `EVENT_HEARTBEAT` chiude la copia della bacheca: i messaggi
+ * locali che non ne fanno parte vengono cancellati. Ogni battito aggiorna il
+ * ritardo, misurato con l'orologio di sistema dei due processi (sulla stessa
+ * macchina è esatto, altrimenti include lo scarto tra gli orologi).
+ */
+static void on_primary_event(bacheca* b, const bacheca_event* event, void* ctx) {
+    (void)b;
+    replica_state* st = (replica_state*)ctx;
+    st->last_contact_ms = wall_ms();
+    switch (event->type) {
+        case EVENT_ADDED: {
+            char* body = message_body_alloc(event->body_length);
+            if (!body) {
+                st->failed = true;
+                return;
+            }
+            memcpy(body, event->body, event->body_length);
+            if (message_store_insert(boards_default(), event->id, event->author, event->subject, body, event->timestamp) < 0) {
+                st->failed = true;
+                return;
+            }
+            if (!st->synced) {
+                remember_id(st, event->id);
+            } else {
+                stats_add(STAT_REPLICATION_APPLIED, 1);
+            }
+            break;
+        }
+        case EVENT_DELETED:
+            delete_message(boards_default(), event->id, NULL);
+            if (st->synced) stats_add(STAT_REPLICATION_APPLIED, 1);
+            break;
+        case EVENT_HEARTBEAT:
+            if (!st->synced) {
+                qsort(st->ids, st->n_ids, sizeof(uint32_t), compare_id);
+                message_store_retain(boards_default(), st->ids, st->n_ids);
+                free(st->ids);
+                st->ids = NULL;
+                st->n_ids = st->cap_ids = 0;
+                st->synced = true;
+                stats_add(STAT_REPLICATION_SYNCS, 1);
+                stats_set(STAT_REPLICATION_CONNECTED, 1);
+            }
+            message_store_set_next_id(boards_default(), event->id);
+            stats_set(STAT_REPLICATION_LAG_MS,
+                      st->last_contact_ms > event->time_ms ? st->last_contact_ms - event->time_ms : 0);
+            break;
+        case EVENT_RESYNC:
+            // Il primario ha perso eventi per questa replica: serve una nuova copia.
+            st->failed = true;
+            break;
+    }
+}
+
+/**
+ * @brief Segue il primario: connessione, copia della bacheca e flusso delle modifiche.
+ *
+ * Se la connessione cade, il primario tace per `REPLICA_TIMEOUT_MS` o chiede
+ * un resync, la replica si riconnette con un ritardo crescente e riceve una
+ * nuova copia; nel frattempo continua a servire la bacheca che ha.
+ */
+static void* replica_thread(void* arg) {
+    (void)arg;
+    unsigned backoff_ms = REPLICA_BACKOFF_MIN_MS;
+    bool logged_failure = false;
+    while (!should_stop()) {
+        bacheca* b = bacheca_connect(primary_ip, primary_port);
+        if (!b) {
+            if (!logged_failure) {
+                fprintf(stderr, "Replica: impossibile connettersi al primario %s:%d: %s\n",
+                        primary_ip, primary_port, strerror(errno));
+                logged_failure = true;
+            }
+            if (wait_stop(backoff_ms)) break;
+            backoff_ms = backoff_ms * 2 > REPLICA_BACKOFF_MAX_MS ? REPLICA_BACKOFF_MAX_MS : backoff_ms * 2;
+            continue;
+        }
+        pthread_mutex_lock(&stop_m);
+        replica_sock = bacheca_fd(b);
+        if (stopping) shutdown(replica_sock, SHUT_RDWR);
+        pthread_mutex_unlock(&stop_m);
+
+        replica_state st;
+        memset(&st, 0, sizeof(st));
+        st.last_contact_ms = wall_ms();
+        bacheca_on_event(b, on_primary_event, &st);
+        int status = bacheca_replicate(b);
+        if (status == OK) {
+            printf("Replica: connessa al primario %s:%d\n", primary_ip, primary_port);
+            logged_failure = false;
+            backoff_ms = REPLICA_BACKOFF_MIN_MS;
+            while (!st.failed && !should_stop()) {
+                if (bacheca_run(b, HEARTBEAT_INTERVAL_MS) < 0) break;
+                if (wall_ms() - st.last_contact_ms > REPLICA_TIMEOUT_MS) break;
+            }
+            if (!should_stop()) {
+                printf("Replica: connessione al primario persa, nuova sincronizzazione...\n");
+            }
+        } else if (status == BACHECA_IO_ERROR) {
+            fprintf(stderr, "Replica: connessione al primario %s:%d chiusa\n", primary_ip, primary_port);
+        } else {
+            fprintf(stderr, "Replica: il primario rifiuta la replica (codice %d), è avviato con --allow-replicas?\n",
+                    status);
+        }
+        stats_set(STAT_REPLICATION_CONNECTED, 0);
+
+        pthread_mutex_lock(&stop_m);
+        replica_sock = -1;
+        pthread_mutex_unlock(&stop_m);
+        bacheca_close(b);
+        free(st.ids);
+        if (wait_stop(backoff_ms)) break;
+        backoff_ms = backoff_ms * 2 > REPLICA_BACKOFF_MAX_MS ? REPLICA_BACKOFF_MAX_MS : backoff_ms * 2;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Avvia il thread che riceve la bacheca dal primario impostato con `replication_parse_primary`.
+ *
+ * @return 0 in caso di successo, -1 se il thread non può essere avviato.
+ */
+int replication_start_replica(void) {
+    if (pthread_create(&replica_tid, NULL, replica_thread, NULL) != 0) {
+        perror("Impossibile avviare il thread di replica");
+        return -1;
+    }
+    replica_running = true;
+    return 0;
+}
+
+/**
+ * @brief Ferma i thread di replica; va chiamata prima di `message_store_shutdown`.
+ *
+ * Il socket verso il primario viene chiuso con `shutdown`, così un'attesa
+ * in corso termina subito.
+ */
+void replication_stop(void) {
+    pthread_mutex_lock(&stop_m);
+    stopping = true;
+    if (replica_sock >= 0) shutdown(replica_sock, SHUT_RDWR);
+    pthread_cond_broadcast(&stop_cv);
+    pthread_mutex_unlock(&stop_m);
+
+    if (heartbeat_running) {
+        pthread_join(heartbeat_tid, NULL);
+        heartbeat_running = false;
+    }
+    if (replica_running) {
+        pthread_join(replica_tid, NULL);
+        replica_running = false;
+    }
+}
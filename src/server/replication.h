@@ -0,0 +1,29 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stdbool.h>
+#include "reply.h"
+
+/**
+ * Replica della bacheca predefinita per scalare le letture.
+ *
+ * Un primario avviato con `--allow-replicas` accetta `C_REPLICATE`: la
+ * connessione diventa un subscriber (`subscriber_set_replica`) e riceve la
+ * copia della bacheca come pacchetti `EVENT_ADDED`, un `EVENT_HEARTBEAT` che
+ * ne segna la fine, e poi il flusso delle modifiche. Ogni secondo il
+ * primario accoda un nuovo `EVENT_HEARTBEAT` a tutte le repliche.
+ *
+ * Una replica (`--replica-of IP:PORTA`) ha solo la bacheca predefinita, in memoria,
+ * la riceve da un thread dedicato che si riconnette da solo, serve le letture
+ * localmente e rifiuta le scritture con `READ_ONLY`. Il ritardo rispetto al
+ * primario è la statistica `replication_lag_ms`.
+ */
+int replication_allow(void);
+bool replication_allowed(void);
+void replication_snapshot(reply* out);
+int replication_parse_primary(const char* spec);
+int replication_start_replica(void);
+bool replication_is_replica(void);
+void replication_stop(void);
+
+#endif // REPLICATION_H
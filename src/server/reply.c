@@ -0,0 +1,254 @@
+#include "reply.h"
+#include <stdlib.h>
+#include <string.h>
+#include "../common/protocol.h"
+#include "../common/net_utils.h"
+
+void reply_init(reply* out, int sock) {
+    out->sock = sock;
+    out->head = NULL;
+    out->tail = NULL;
+    out->failed = false;
+    out->progress = NULL;
+    out->progress_ctx = NULL;
+    out->source = NULL;
+}
+
+void reply_on_progress(reply* out, void (*progress)(void* ctx), void* ctx) {
+    out->progress = progress;
+    out->progress_ctx = ctx;
+}
+
+void reply_free_chunks(reply_chunk* chunk) {
+    while (chunk) {
+        reply_chunk* next = chunk->next;
+        if (chunk->ref && chunk->release) {
+            chunk->release(chunk->ref);
+        }
+        free(chunk);
+        chunk = next;
+    }
+}
+
+/**
+ * @brief Stacca dalla risposta la lista dei blocchi accumulati.
+ *
+ * @return Il primo blocco (il chiamante ne diventa proprietario), o NULL.
+ */
+reply_chunk* reply_take(reply* out) {
+    reply_chunk* head = out->head;
+    out->head = NULL;
+    out->tail = NULL;
+    return head;
+}
+
+/**
+ * @brief Sposta in coda a `out` tutti i blocchi di `from`, senza copiarli.
+ */
+void reply_append(reply* out, reply* from) {
+    reply_chunk* head = reply_take(from);
+    if (!head) return;
+    reply_chunk* tail = head;
+    while (tail->next) tail = tail->next;
+    if (out->tail) {
+        out->tail->next = head;
+    } else {
+        out->head = head;
+    }
+    out->tail = tail;
+}
+
+/**
+ * @brief Accoda a `out` una risposta prodotta a passi da `source`, che ne diventa proprietaria.
+ *
+ * In modalità bloccante i passi vengono prodotti e inviati subito, uno dopo
+ * l'altro, e la memoria usata resta quella di un passo. Con `sock < 0` la
+ * sorgente resta in `out`: chi invia la prende con `reply_take_source` e
+ * produce ogni passo quando il precedente è stato inviato. Dopo una
+ * sorgente non va accodato altro nella stessa risposta.
+ */
+void reply_stream(reply* out, reply_source* source) {
+    if (out->sock < 0 && !out->failed && !out->source) {
+        out->source = source;
+        return;
+    }
+    while (!out->failed && source->next(source, out)) {
+    }
+    source->free(source);
+}
+
+/**
+ * @brief Stacca dalla risposta la sorgente accodata con `reply_stream`.
+ *
+ * @return La sorgente (il chiamante ne diventa proprietario), o NULL.
+ */
+reply_source* reply_take_source(reply* out) {
+    reply_source* source = out->source;
+    out->source = NULL;
+    return source;
+}
+
+/**
+ * @brief Invia e libera tutti i blocchi accumulati.
+ *
+ * @return 0 in caso di successo, -1 se un invio (anche precedente) è fallito.
+ *
+ * Dopo un errore i pacchetti successivi vengono scartati: il client si è
+ * disconnesso e se ne accorgerà il ciclo di lettura.
+ */
+int reply_flush(reply* out) {
+    reply_chunk* chunk = reply_take(out);
+    for (reply_chunk* c = chunk; c && !out->failed && out->sock >= 0; c = c->next) {
+        if (out->progress) out->progress(out->progress_ctx);
+        if (send_all(out->sock, reply_chunk_bytes(c), c->len) < 0) {
+            out->failed = true;
+        }
+    }
+    reply_free_chunks(chunk);
+    return out->failed ? -1 : 0;
+}
+
+/**
+ * @brief Restituisce un blocco con almeno `need` byte liberi in coda alla risposta.
+ *
+ * In modalità bloccante il blocco pieno viene prima inviato, così la memoria
+ * usata resta limitata a un blocco anche per bacheche molto grandi.
+ */
+static reply_chunk* reserve(reply* out, size_t need) {
+    if (out->tail && out->tail->cap - out->tail->len >= need) {
+        return out->tail;
+    }
+    if (out->sock >= 0 && out->head) {
+        reply_flush(out);
+    }
+    size_t cap = need > REPLY_CHUNK_SIZE ? need : REPLY_CHUNK_SIZE;
+    reply_chunk* chunk = malloc(sizeof(reply_chunk) + cap);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->len = 0;
+    chunk->cap = cap;
+    chunk->ref = NULL;
+    chunk->release = NULL;
+    if (out->tail) {
+        out->tail->next = chunk;
+    } else {
+        out->head = chunk;
+    }
+    out->tail = chunk;
+    return chunk;
+}
+
+/**
+ * @brief Aggiunge alla risposta un pacchetto completo (header + payload).
+ *
+ * Il formato sul filo è identico a quello di `response`.
+ */
+void reply_frame(reply* out, uint8_t type, const void* data, uint32_t length) {
+    if (out->failed) return;
+    if (data == NULL) length = 0;
+
+    reply_chunk* chunk = reserve(out, sizeof(packet_header) + length);
+    if (!chunk) {
+        out->failed = true;
+        return;
+    }
+    packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.length = length;
+    memcpy(chunk->data + chunk->len, &header, sizeof(header));
+    chunk->len += sizeof(header);
+    if (length > 0) {
+        memcpy(chunk->data + chunk->len, data, length);
+        chunk->len += length;
+    }
+}
+
+void reply_status(reply* out, uint8_t status) {
+    reply_frame(out, status, NULL, 0);
+}
+
+/**
+ * @brief Inizia un pacchetto di `length` byte, da completare con `reply_bytes`/`reply_ref`.
+ */
+void reply_frame_begin(reply* out, uint8_t type, uint32_t length) {
+    if (out->failed) return;
+    packet_header header;
+    memset(&header, 0, sizeof(header));
+    header.type = type;
+    header.length = length;
+    reply_bytes(out, &header, sizeof(header));
+}
+
+/**
+ * @brief Copia `length` byte in coda alla risposta, anche a cavallo di più blocchi.
+ */
+void reply_bytes(reply* out, const void* data, size_t length) {
+    const char* p = (const char*)data;
+    while (length > 0 && !out->failed) {
+        reply_chunk* chunk = out->tail;
+        if (!chunk || chunk->len == chunk->cap) {
+            chunk = reserve(out, length < REPLY_CHUNK_SIZE ? length : REPLY_CHUNK_SIZE);
+            if (!chunk) {
+                out->failed = true;
+                return;
+            }
+        }
+        size_t n = chunk->cap - chunk->len;
+        if (n > length) n = length;
+        memcpy(chunk->data + chunk->len, p, n);
+        chunk->len += n;
+        p += n;
+        length -= n;
+    }
+}
+
+/**
+ * @brief Accoda `length` byte di memoria esterna senza copiarli.
+ *
+ * @param release Rilascia il riferimento a `data` che il chiamante cede alla
+ *                risposta; viene chiamata quando i byte sono stati inviati
+ *                (o scartati).
+ *
+ * Sotto `REPLY_REF_MIN` byte i dati vengono copiati: un blocco dedicato
+ * costerebbe più della copia. In modalità bloccante i blocchi precedenti e
+ * poi `data`, a pezzi di `REPLY_CHUNK_SIZE`, vengono inviati subito, così la memoria della connessione resta
+ * limitata a un blocco anche con corpi di diversi megabyte.
+ */
+void reply_ref(reply* out, const char* data, size_t length, void (*release)(const char* ref)) {
+    if (out->failed || length < REPLY_REF_MIN) {
+        reply_bytes(out, data, length);
+        release(data);
+        return;
+    }
+    if (out->sock >= 0) {
+        reply_flush(out);
+        for (size_t off = 0; off < length && !out->failed; off += REPLY_CHUNK_SIZE) {
+            size_t n = length - off < REPLY_CHUNK_SIZE ? length - off : REPLY_CHUNK_SIZE;
+            if (out->progress) out->progress(out->progress_ctx);
+            if (send_all(out->sock, data + off, n) < 0) {
+                out->failed = true;
+            }
+        }
+        release(data);
+        return;
+    }
+
+    reply_chunk* chunk = malloc(sizeof(reply_chunk));
+    if (!chunk) {
+        out->failed = true;
+        release(data);
+        return;
+    }
+    chunk->next = NULL;
+    chunk->len = length;
+    chunk->cap = length;
+    chunk->ref = data;
+    chunk->release = release;
+    if (out->tail) {
+        out->tail->next = chunk;
+    } else {
+        out->head = chunk;
+    }
+    out->tail = chunk;
+}
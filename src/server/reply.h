@@ -0,0 +1,84 @@
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLY_CHUNK_SIZE (64 * 1024)
+
+/** Sotto questa soglia `reply_ref` copia i byte invece di riferirli. */
+#define REPLY_REF_MIN 4096
+
+/**
+ * Blocco di byte di risposta già serializzati (header + payload dei pacchetti).
+ * I blocchi di una risposta formano una lista nell'ordine di invio.
+ *
+ * Un blocco con `ref` non ha dati propri: i suoi `len` byte sono memoria
+ * esterna (il corpo di un messaggio nella bacheca), di cui il blocco tiene un
+ * riferimento rilasciato con `release` quando il blocco viene liberato.
+ */
+typedef struct reply_chunk {
+    struct reply_chunk* next;
+    size_t len;
+    size_t cap;
+    const char* ref;
+    void (*release)(const char* ref);
+    char data[];
+} reply_chunk;
+
+static inline const char* reply_chunk_bytes(const reply_chunk* chunk) {
+    return chunk->ref ? chunk->ref : chunk->data;
+}
+
+/**
+ * Destinazione delle risposte di una richiesta.
+ *
+ * Con `sock >= 0` i pacchetti vengono accumulati e inviati con `send_all` ogni
+ * volta che un blocco si riempie, e alla fine con `reply_flush`: una bacheca
+ * di migliaia di messaggi costa poche `send` invece di due per messaggio.
+ * Con `sock < 0` i blocchi restano in memoria e vengono presi con
+ * `reply_take` da chi li invia in modo asincrono (backend io_uring).
+ * Un pacchetto può essere composto a pezzi con `reply_frame_begin` seguita da
+ * `reply_bytes`/`reply_ref` per esattamente la lunghezza dichiarata.
+ * In modalità bloccante `progress`, se impostata, viene chiamata prima di
+ * ogni blocco inviato (per riarmare la scadenza di invio della connessione).
+ * `source` è la risposta a passi accodata con `reply_stream` e non ancora
+ * prodotta (solo con `sock < 0`).
+ */
+typedef struct reply {
+    int sock;
+    reply_chunk* head;
+    reply_chunk* tail;
+    bool failed;
+    void (*progress)(void* ctx);
+    void* progress_ctx;
+    struct reply_source* source;
+} reply;
+
+/**
+ * Una risposta prodotta a passi, per non tenerla mai tutta in memoria (la
+ * bacheca, la copia per una replica). `next` accoda in `out` il passo
+ * successivo e restituisce false quando la risposta è completa; `free`
+ * libera la sorgente, anche se non è arrivata alla fine.
+ */
+typedef struct reply_source {
+    bool (*next)(struct reply_source* source, reply* out);
+    void (*free)(struct reply_source* source);
+} reply_source;
+
+void reply_init(reply* out, int sock);
+void reply_on_progress(reply* out, void (*progress)(void* ctx), void* ctx);
+void reply_frame(reply* out, uint8_t type, const void* data, uint32_t length);
+void reply_status(reply* out, uint8_t status);
+void reply_frame_begin(reply* out, uint8_t type, uint32_t length);
+void reply_bytes(reply* out, const void* data, size_t length);
+void reply_ref(reply* out, const char* data, size_t length, void (*release)(const char* ref));
+void reply_append(reply* out, reply* from);
+void reply_stream(reply* out, reply_source* source);
+reply_source* reply_take_source(reply* out);
+int reply_flush(reply* out);
+reply_chunk* reply_take(reply* out);
+void reply_free_chunks(reply_chunk* chunk);
+
+#endif // REPLY_H
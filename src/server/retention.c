@@ -0,0 +1,140 @@
+#include "retention.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "message_store.h"
+#include "stats.h"
+
+#define RETENTION_SWEEP_INTERVAL_MS 1000
+#define RETENTION_BATCH 256
+
+static retention_policy policy;
+static pthread_t sweeper_tid;
+static bool sweeper_running = false;
+static pthread_mutex_t stop_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cv = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+
+/**
+ * @brief Imposta un limite da una stringa `age=DURATA`, `max=N` o `per-author=N`.
+ *
+ * @return 0 in caso di successo, -1 se la stringa non è valida.
+ *
+ * La durata è in secondi, oppure in minuti, ore o giorni con il suffisso
+ * `m`, `h` o `d` (`age=30d`). Un valore 0 toglie il limite.
+ */
+int retention_parse(const char* spec) {
+    const char* eq = strchr(spec, '=');
+    if (!eq || eq[1] == '\0') return -1;
+    char* end;
+    unsigned long value = strtoul(eq + 1, &end, 10);
+    size_t key_len = (size_t)(eq - spec);
+
+    if (key_len == 3 && strncmp(spec, "age", 3) == 0) {
+        unsigned long unit = 1;
+        if (*end == 'm') unit = 60;
+        else if (*end == 'h') unit = 3600;
+        else if (*end == 'd') unit = 86400;
+        if (unit != 1 || *end == 's') end++;
+        if (*end != '\0' || value > 100UL * 365 * 86400 / unit) return -1;
+        policy.max_age_sec = (unsigned)(value * unit);
+        return 0;
+    }
+    if (*end != '\0') return -1;
+    if (key_len == 3 && strncmp(spec, "max", 3) == 0) {
+        policy.max_messages = value;
+        return 0;
+    }
+    if (key_len == 10 && strncmp(spec, "per-author", 10) == 0) {
+        policy.max_per_author = value;
+        return 0;
+    }
+    return -1;
+}
+
+bool retention_enabled(void) {
+    return policy.max_age_sec > 0 || policy.max_messages > 0 || policy.max_per_author > 0;
+}
+
+/**
+ * @brief Attende `ms` millisecondi o la richiesta di arresto.
+ *
+ * @return true se è stato richiesto l'arresto.
+ */
+static bool wait_stop(unsigned ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&stop_m);
+    while (!stopping && pthread_cond_timedwait(&stop_cv, &stop_m, &deadline) != ETIMEDOUT) {
+    }
+    bool stop = stopping;
+    pthread_mutex_unlock(&stop_m);
+    return stop;
+}
+
+static void sweep_store(message_store* store, void* ctx) {
+    size_t* removed = (size_t*)ctx;
+    *removed += message_store_expire(store, &policy, RETENTION_BATCH);
+}
+
+/**
+ * @brief Ogni `RETENTION_SWEEP_INTERVAL_MS` applica i limiti a tutte le bacheche aperte.
+ */
+static void* sweeper_thread(void* arg) {
+    (void)arg;
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (!wait_stop(RETENTION_SWEEP_INTERVAL_MS)) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        size_t removed = 0;
+        message_store_for_each(sweep_store, &removed);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (removed > 0) {
+            stats_add(STAT_RETENTION_EXPIRED, removed);
+            stats_set(STAT_RETENTION_SWEEP_LAST_US,
+                      (uint64_t)(end.tv_sec - start.tv_sec) * 1000000u + (end.tv_nsec - start.tv_nsec) / 1000);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Avvia il thread della conservazione.
+ *
+ * @return 0 in caso di successo, -1 se il thread non può essere avviato.
+ */
+int retention_start(void) {
+    if (pthread_create(&sweeper_tid, NULL, sweeper_thread, NULL) != 0) {
+        perror("Impossibile avviare il thread di conservazione");
+        return -1;
+    }
+    sweeper_running = true;
+    return 0;
+}
+
+/**
+ * @brief Ferma il thread della conservazione; va chiamata prima di `message_store_shutdown`.
+ */
+void retention_stop(void) {
+    pthread_mutex_lock(&stop_m);
+    stopping = true;
+    pthread_cond_broadcast(&stop_cv);
+    pthread_mutex_unlock(&stop_m);
+    if (sweeper_running) {
+        pthread_join(sweeper_tid, NULL);
+        sweeper_running = false;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <stdbool.h>
+
+/**
+ * Conservazione dei messaggi: età massima e numero massimo di messaggi, per
+ * bacheca e per autore, impostati con `--retention` e applicati a ogni
+ * bacheca aperta da un thread in background (`message_store_expire`).
+ * Una replica non lo avvia: riceve le cancellazioni dal primario.
+ */
+int retention_parse(const char* spec);
+bool retention_enabled(void);
+int retention_start(void);
+void retention_stop(void);
+
+#endif // RETENTION_H
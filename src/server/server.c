@@ -1,85 +1,241 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <signal.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <errno.h>
-#include <stdlib.h> 
-#include <unistd.h> 
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "../common/common.h"
 #include "thread_pool.h"
 #include "client_handler.h"
 #include "message_store.h"
-#include "user_auth.h" 
+#include "boards.h"
+#include "user_auth.h"
+#include "hot_restart.h"
+#include "idle_sessions.h"
+#include "stats.h"
+#include "uring_server.h"
+#include "subscriptions.h"
+#include "timer_wheel.h"
+#include "rate_limit.h"
+#include "replication.h"
+#include "retention.h"
+#include "capture.h"
+#include "lock_prof.h"
 
 #define PORT 8080
 #define MAX_CLIENTS 10
 #define THREAD_POOL_SIZE 4
+#define SNAPSHOT_INTERVAL_SEC 60
+#define SNAPSHOT_EVERY_MUTATIONS 1000
+#define IDLE_TIMEOUT_SEC 300
+#define REQUEST_TIMEOUT_SEC 10
+#define WRITE_TIMEOUT_SEC 30
+#define MAX_QUEUED_CLIENTS 1024
+#define QUEUE_TIMEOUT_MS 2000
+
+/**
+ * Un socket in ascolto con il proprio thread di accept e il proprio pool.
+ * In modalità normale c'è un solo gruppo con un pool condiviso; con
+ * `--reuseport` ce n'è uno per core: i listener `SO_REUSEPORT` condividono la
+ * porta, il kernel distribuisce le connessioni tra di loro e ogni connessione
+ * viene servita dai thread vincolati al core che l'ha accettata.
+ * Con `--io-uring` il thread del gruppo esegue il ciclo del ring `uring`
+ * invece del ciclo di accept, e serve da solo tutte le connessioni del gruppo.
+ * Con `--unix` l'ultimo gruppo (`local`) ascolta sul socket Unix, con un pool
+ * non vincolato: i client sulla stessa macchina non passano dallo stack TCP.
+ */
+typedef struct listener_group {
+    int listen_fd;
+    bool local;
+    int cpu;
+    thread_pool* pool;
+    uring_server* uring;
+    pthread_t acceptor;
+} listener_group;
 
-sig_atomic_t active_client_count = 0;
+atomic_int active_client_count = 0;
 pthread_mutex_t client_m;
+pthread_cond_t client_cv;
+bool log_connections = true;
+
+static int listen_port = PORT;
+static char unix_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static bool unix_owned = false;
+static listener_group groups[HOT_RESTART_MAX_LISTENERS];
+static int n_groups = 0;
+static int paused_acceptors = 0;
+static atomic_uint next_group = 0;
+// Vero nel nuovo processo finché non ha confermato l'handoff: fino ad allora
+// file e socket Unix appartengono ancora al vecchio processo.
+static bool handoff_pending = false;
 
 
 void cleanup(void);
 
 
 void handle_sigint(int signo) {
-    (void)signo; 
+    (void)signo;
     printf("\nRicevuto il segnale SIGINT, controllo se è possibile chiudere il server...\n");
 
-    pthread_mutex_lock(&client_m);
-    int count = active_client_count; 
-    pthread_mutex_unlock(&client_m);
+    int count = atomic_load(&active_client_count);
 
     if(count > 0) {
         printf("Attesa di %d client attivi che completano...\n", count);
     } else {
         printf("Nessun client attivo, avvio chiusura server.\n");
-        exit(0); 
+        exit(0);
     }
 }
 
+void handle_sigusr2(int signo) {
+    (void)signo;
+    hot_restart_signal();
+}
 
+/**
+ * @brief Affida una sessione a un gruppo, aggiornando il contatore dei client attivi.
+ *
+ * Usata sia per le sessioni ricevute da un processo precedente sia per quelle
+ * riprese dopo un hot restart annullato; i gruppi vengono scelti a rotazione.
+ */
+static void enqueue_session(client_session* session) {
+    listener_group* group = &groups[atomic_fetch_add(&next_group, 1) % (unsigned)n_groups];
+    atomic_fetch_add(&active_client_count, 1);
+    if (group->uring) {
+        uring_server_adopt(group->uring, session);
+    } else {
+        // Se la coda è piena il pool chiude la sessione con BUSY.
+        session->pool = group->pool;
+        add_task_class(group->pool, client_session_task_class(session), handle_client, session);
+    }
+}
 
-int main() {
-    sigset_t signal_mask;
+/**
+ * @brief Sospende il thread di accept corrente per la durata di un drain.
+ *
+ * Il thread principale attende che tutti gli acceptor siano sospesi prima di
+ * contare i client attivi, così nessuna connessione viene accettata dopo che
+ * il conteggio è arrivato a 0.
+ */
+static void pause_acceptor(void) {
+    PROF_LOCK(&client_m, LOCK_CLIENTS);
+    paused_acceptors++;
+    pthread_cond_broadcast(&client_cv);
+    while (hot_restart_draining()) {
+        PROF_COND_WAIT(&client_cv, &client_m);
+    }
+    paused_acceptors--;
+    PROF_UNLOCK(&client_m);
+}
 
-    sigfillset(&signal_mask);
-    sigdelset(&signal_mask, SIGINT);
-    if (pthread_sigmask(SIG_BLOCK, &signal_mask, NULL) != 0) {
-        perror("Errore nell'impostare la maschera dei segnali");
-        exit(EXIT_FAILURE);
+/** Le bacheche aperte, raccolte per l'handoff da `collect_board`. */
+typedef struct board_list {
+    handoff_board* items;
+    uint32_t count;
+    uint32_t capacity;
+} board_list;
+
+static void collect_board(message_store* store, void* ctx) {
+    board_list* list = (board_list*)ctx;
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 16;
+        handoff_board* items = realloc(list->items, capacity * sizeof(handoff_board));
+        if (!items) return;
+        list->items = items;
+        list->capacity = capacity;
     }
-    struct sigaction sa;
-    sa.sa_handler = handle_sigint;
-    sigfillset(&sa.sa_mask); 
-    sa.sa_flags = 0;
-    if (sigaction(SIGINT, &sa, NULL) == -1) {
-        perror("Errore nell'impostare l'handler per SIGINT");
-        exit(EXIT_FAILURE);
+    handoff_board* board = &list->items[list->count++];
+    memset(board, 0, sizeof(*board));
+    strncpy(board->name, message_store_name(store), sizeof(board->name) - 1);
+    board->next_id = message_store_next_id(store);
+}
+
+/**
+ * @brief Esegue un hot restart passando listener, sessioni e bacheca al nuovo binario.
+ *
+ * 1. Avvia il nuovo eseguibile e attende che confermi di essere partito; se
+ *    fallisce, il restart viene annullato senza toccare i client.
+ * 2. Avvia il drain: gli acceptor si sospendono e ogni lavoratore, alla fine
+ *    della richiesta in corso, parcheggia la propria sessione. Si attende che i
+ *    client attivi scendano a 0.
+ * 3. Salva la bacheca su file e passa al nuovo processo i socket in ascolto,
+ *    il prossimo ID e le sessioni parcheggiate.
+ * 4. Attende che il nuovo processo confermi di aver preso in carico tutto;
+ *    senza conferma lo termina e riprende le sessioni parcheggiate.
+ * 5. Termina con `_exit`, così `cleanup` non sovrascrive il file che ora
+ *    appartiene al nuovo processo.
+ *
+ * I socket in ascolto non vengono mai chiusi: le connessioni che arrivano
+ * durante il restart attendono nella coda di `listen` e vengono accettate dal
+ * nuovo processo, quindi nessun client riceve un rifiuto.
+ */
+static void perform_hot_restart(void) {
+    printf("\nRichiesto hot restart, avvio del nuovo eseguibile...\n");
+    int channel = hot_restart_spawn();
+    if (channel < 0) {
+        printf("Hot restart annullato, il server continua a funzionare.\n");
+        return;
     }
 
-    // Registra la funzione di cleanup per essere eseguita all'uscita.
-    atexit(cleanup);
+    hot_restart_begin_drain();
+    PROF_LOCK(&client_m, LOCK_CLIENTS);
+    while (paused_acceptors < n_groups || atomic_load(&active_client_count) > 0) {
+        PROF_COND_WAIT(&client_cv, &client_m);
+    }
+    PROF_UNLOCK(&client_m);
 
-    // Crea la directory 'data' se non esiste.
-    if (mkdir("data", 0755) == -1) {
-        if (errno != EEXIST) {
-            perror("Impossibile creare la directory 'data'");
-            exit(EXIT_FAILURE);
-        }
+    message_store_save();
+    // Il nuovo processo continua il file di cattura dopo questi record.
+    capture_flush();
+
+    handoff_state state;
+    for (int i = 0; i < n_groups; i++) {
+        state.listen_fds[i] = groups[i].listen_fd;
     }
+    state.n_listen = n_groups;
+    board_list boards = { NULL, 0, 0 };
+    message_store_for_each(collect_board, &boards);
+    state.boards = boards.items;
+    state.n_boards = boards.count;
 
-    pthread_mutex_init(&user_mutex, NULL); 
-    pthread_mutex_init(&client_m, NULL);
+    int sent = hot_restart_send(channel, &state);
+    free(boards.items);
+    if (sent < 0 || hot_restart_wait_adopted(channel) < 0) {
+        fprintf(stderr, "Handoff fallito, ripresa delle sessioni\n");
+        close(channel);
+        hot_restart_abort(enqueue_session);
+        idle_sessions_reopen();
+        PROF_LOCK(&client_m, LOCK_CLIENTS);
+        pthread_cond_broadcast(&client_cv);
+        PROF_UNLOCK(&client_m);
+        return;
+    }
+
+    close(channel);
+    printf("Handoff completato, il nuovo processo ha preso in carico i client.\n");
+    fflush(stdout);
+    _exit(0);
+}
 
-    int server_fd, new_socket;
+static int create_listener(bool reuseport) {
+    int server_fd;
     struct sockaddr_in address;
     int opt = 1;
-    socklen_t addrlen = sizeof(address); 
 
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
         perror("Socket fallita");
         exit(EXIT_FAILURE);
     }
@@ -89,10 +245,15 @@ int main() {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt SO_REUSEPORT");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
 
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    address.sin_port = htons(listen_port);
 
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("Bind fallita");
@@ -105,48 +266,567 @@ int main() {
         close(server_fd);
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
 
-    printf("Server in ascolto sulla porta %d\n", PORT);
+/**
+ * @brief Crea il socket Unix in ascolto sul percorso `unix_path`.
+ *
+ * Un socket rimasto da un server terminato senza cleanup viene rimosso se
+ * nessuno vi accetta più connessioni; se invece un altro server è in
+ * ascolto sullo stesso percorso, l'avvio fallisce come per una porta occupata.
+ */
+static int create_unix_listener(void) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, unix_path, sizeof(address.sun_path));
 
-    message_store_init("data/messages.txt");
-    thread_pool* pool = thread_pool_create(THREAD_POOL_SIZE);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (server_fd < 0) {
+        perror("Socket Unix fallita");
+        exit(EXIT_FAILURE);
+    }
+
+    int bound = bind(server_fd, (struct sockaddr*)&address, sizeof(address));
+    if (bound < 0 && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = probe >= 0 && connect(probe, (struct sockaddr*)&address, sizeof(address)) < 0 &&
+                     errno == ECONNREFUSED;
+        if (probe >= 0) close(probe);
+        if (stale && unlink(unix_path) == 0) {
+            bound = bind(server_fd, (struct sockaddr*)&address, sizeof(address));
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    if (bound < 0) {
+        perror("Bind del socket Unix fallita");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+
+    if (listen(server_fd, MAX_CLIENTS) < 0) {
+        perror("Listen fallita");
+        close(server_fd);
+        unlink(unix_path);
+        exit(EXIT_FAILURE);
+    }
+    return server_fd;
+}
+
+/**
+ * @brief Ciclo di accept di un gruppo.
+ *
+ * @param arg Puntatore al `listener_group`.
+ *
+ * Attende con `poll` sia il socket in ascolto sia la pipe di risveglio
+ * dell'hot restart; durante un drain si sospende con `pause_acceptor`.
+ * Il socket in ascolto è non bloccante: se la connessione viene presa da un
+ * altro acceptor, `accept4` restituisce `EAGAIN` invece di bloccare.
+ */
+static void* accept_loop(void* arg) {
+    listener_group* group = (listener_group*)arg;
+    if (group->uring) {
+        uring_server_run(group->uring, pause_acceptor);
+        return NULL;
+    }
+
+    struct pollfd pfd[2];
+    pfd[0].fd = group->listen_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = hot_restart_wake_fd();
+    pfd[1].events = POLLIN;
 
     while (1) {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen)) < 0) {
+        if (hot_restart_draining()) {
+            pause_acceptor();
+            continue;
+        }
+
+        pfd[0].revents = 0;
+        pfd[1].revents = 0;
+        if (poll(pfd, 2, -1) < 0) {
             if (errno == EINTR) continue;
-            perror("Accept fallita");
+            perror("Poll fallita");
             continue;
         }
+        if (!(pfd[0].revents & POLLIN)) continue;
 
-        pthread_mutex_lock(&client_m);
-        active_client_count++;
-        printf("\nNuovo client connesso: %s:%d. Client attivi: %d\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port), active_client_count);
-        pthread_mutex_unlock(&client_m);
+        int new_socket = accept4(group->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+            perror("Accept fallita");
+            continue;
+        }
 
-        int* pclient = malloc(sizeof(int));
-        if (!pclient) {
-            perror("malloc fallita");
+        int count = atomic_fetch_add(&active_client_count, 1) + 1;
+        client_session* session = client_session_create(new_socket);
+        if (!session) {
+            perror("Impossibile affidare il client al pool");
             close(new_socket);
-            pthread_mutex_lock(&client_m);
-            active_client_count--;
-            pthread_mutex_unlock(&client_m);
+            atomic_fetch_sub(&active_client_count, 1);
             continue;
         }
-        *pclient = new_socket;
+        if (log_connections) {
+            char peer[64];
+            client_session_describe(session, peer, sizeof(peer));
+            printf("\nNuovo client connesso: %s. Client attivi: %d\n", peer, count);
+        }
+        // La scadenza va armata prima di accodare: da lì in poi la sessione
+        // appartiene al thread che la serve. Se il pool la rifiuta, la
+        // sessione è già stata chiusa con BUSY da `client_session_reject`.
+        client_session_deadline(session, DEADLINE_QUEUE);
+        session->pool = group->pool;
+        add_task_class(group->pool, client_session_task_class(session), handle_client, session);
+    }
+    return NULL;
+}
+
 
-        add_task(pool, handle_client, pclient);
+int main(int argc, char* argv[]) {
+    int handoff_fd = -1;
+    unsigned snapshot_interval = SNAPSHOT_INTERVAL_SEC;
+    unsigned snapshot_every = SNAPSHOT_EVERY_MUTATIONS;
+    bool reuseport = false;
+    bool io_uring = false;
+    long n_listeners = 0;
+    long n_threads = 0;
+    unsigned idle_timeout = IDLE_TIMEOUT_SEC;
+    unsigned request_timeout = REQUEST_TIMEOUT_SEC;
+    unsigned write_timeout = WRITE_TIMEOUT_SEC;
+    bool allow_replicas = false;
+    unsigned cold_after = 0;
+    unsigned long hot_budget_mb = 0;
+    const char* capture_path = NULL;
+    bool tcp = true;
+    unsigned long max_queued = MAX_QUEUED_CLIENTS;
+    unsigned queue_timeout = QUEUE_TIMEOUT_MS;
+    static const struct option long_options[] = {
+        {"handoff-fd", required_argument, NULL, 'H'},
+        {"snapshot-interval", required_argument, NULL, 'i'},
+        {"snapshot-every", required_argument, NULL, 'e'},
+        {"reuseport", no_argument, NULL, 'r'},
+        {"listeners", required_argument, NULL, 'l'},
+        {"threads", required_argument, NULL, 't'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"io-uring", no_argument, NULL, 'u'},
+        {"idle-timeout", required_argument, NULL, 'I'},
+        {"request-timeout", required_argument, NULL, 'R'},
+        {"write-timeout", required_argument, NULL, 'W'},
+        {"rate-limit", required_argument, NULL, 'L'},
+        {"port", required_argument, NULL, 'p'},
+        {"allow-replicas", no_argument, NULL, 'A'},
+        {"replica-of", required_argument, NULL, 'P'},
+        {"retention", required_argument, NULL, 'K'},
+        {"cold-after", required_argument, NULL, 'C'},
+        {"hot-budget", required_argument, NULL, 'B'},
+        {"capture", required_argument, NULL, 'c'},
+        {"unix", required_argument, NULL, 'U'},
+        {"no-tcp", no_argument, NULL, 'N'},
+        {"max-queue", required_argument, NULL, 'Q'},
+        {"queue-timeout", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt_c;
+    while ((opt_c = getopt_long(argc, argv, "t:q", long_options, NULL)) != -1) {
+        switch (opt_c) {
+            case 'H':
+                handoff_fd = atoi(optarg);
+                break;
+            case 'i':
+                snapshot_interval = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                snapshot_every = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                reuseport = true;
+                break;
+            case 'l':
+                n_listeners = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                n_threads = strtol(optarg, NULL, 10);
+                break;
+            case 'q':
+                log_connections = false;
+                break;
+            case 'u':
+                io_uring = true;
+                break;
+            case 'I':
+                idle_timeout = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'R':
+                request_timeout = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'W':
+                write_timeout = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'L':
+                // Ripetibile, una classe per volta: --rate-limit read=20:40
+                if (rate_limit_parse(optarg) < 0) {
+                    fprintf(stderr, "Limite non valido: %s (atteso auth|read|write=N[:BURST])\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                listen_port = atoi(optarg);
+                if (listen_port <= 0 || listen_port > 65535) {
+                    fprintf(stderr, "Porta non valida: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'A':
+                allow_replicas = true;
+                break;
+            case 'P':
+                if (replication_parse_primary(optarg) < 0) {
+                    fprintf(stderr, "Primario non valido: %s (atteso IP:PORTA)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'K':
+                // Ripetibile: --retention age=30d --retention per-author=100
+                if (retention_parse(optarg) < 0) {
+                    fprintf(stderr, "Limite di conservazione non valido: %s (atteso age=N[s|m|h|d], max=N o per-author=N)\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'C':
+                cold_after = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'B':
+                hot_budget_mb = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                capture_path = optarg;
+                break;
+            case 'U':
+                if (optarg[0] == '\0' || strlen(optarg) >= sizeof(unix_path)) {
+                    fprintf(stderr, "Percorso del socket Unix non valido: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                strcpy(unix_path, optarg);
+                break;
+            case 'N':
+                tcp = false;
+                break;
+            case 'Q':
+                max_queued = strtoul(optarg, NULL, 10);
+                break;
+            case 'T':
+                queue_timeout = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Uso: %s [--port N] [--snapshot-interval SEC] [--snapshot-every N] "
+                                "[--reuseport [--listeners N]] [--io-uring] [--idle-timeout SEC] "
+                                "[--request-timeout SEC] [--write-timeout SEC] "
+                                "[--rate-limit auth|read|write=N[:BURST]]... "
+                                "[--allow-replicas] [--replica-of IP:PORTA] "
+                                "[--retention age=N[s|m|h|d]|max=N|per-author=N]... "
+                                "[--cold-after SEC] [--hot-budget MB] [--capture FILE] "
+                                "[--unix PERCORSO [--no-tcp]] [--max-queue N] [--queue-timeout MS] "
+                                "[-t N] [-q]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (!tcp && unix_path[0] == '\0') {
+        fprintf(stderr, "--no-tcp richiede --unix PERCORSO\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sigset_t signal_mask;
+
+    sigfillset(&signal_mask);
+    sigdelset(&signal_mask, SIGINT);
+    sigdelset(&signal_mask, SIGUSR2);
+    if (pthread_sigmask(SIG_BLOCK, &signal_mask, NULL) != 0) {
+        perror("Errore nell'impostare la maschera dei segnali");
+        exit(EXIT_FAILURE);
+    }
+    struct sigaction sa;
+    sa.sa_handler = handle_sigint;
+    sigfillset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    if (sigaction(SIGINT, &sa, NULL) == -1) {
+        perror("Errore nell'impostare l'handler per SIGINT");
+        exit(EXIT_FAILURE);
+    }
+    sa.sa_handler = handle_sigusr2;
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR2, &sa, NULL) == -1) {
+        perror("Errore nell'impostare l'handler per SIGUSR2");
+        exit(EXIT_FAILURE);
+    }
+
+    if (hot_restart_init(argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    handoff_pending = handoff_fd >= 0;
+    if (capture_path && capture_open(capture_path, handoff_fd >= 0) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Registra la funzione di cleanup per essere eseguita all'uscita.
+    atexit(cleanup);
+
+    // Crea la directory 'data' se non esiste.
+    if (mkdir("data", 0755) == -1) {
+        if (errno != EEXIST) {
+            perror("Impossibile creare la directory 'data'");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_init(&user_mutex, NULL);
+    pthread_mutex_init(&client_m, NULL);
+    pthread_cond_init(&client_cv, NULL);
+    subscriptions_init();
+    rate_limit_init();
+
+    // Le scadenze delle connessioni (0 = disattivata) sono gestite da un
+    // unico thread con una ruota di timer, condiviso da tutti i backend.
+    client_set_timeouts(idle_timeout, request_timeout, write_timeout);
+    client_set_queue_timeout(queue_timeout);
+    if (timer_wheel_start() < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+
+    handoff_state handoff;
+    int n_tcp = 0;
+    if (handoff_fd >= 0) {
+        // Avviato da un hot restart: il vecchio processo ci passa i listener
+        // solo dopo aver salvato la bacheca. Si creano tanti gruppi quanti
+        // sono i listener ricevuti.
+        if (hot_restart_announce(handoff_fd) < 0 || hot_restart_receive_state(handoff_fd, &handoff) < 0) {
+            fprintf(stderr, "Errore nella ricezione dello stato dal processo precedente\n");
+            exit(EXIT_FAILURE);
+        }
+        // Il socket Unix si riconosce dal proprio indirizzo, che ne dà anche
+        // il percorso da rimuovere alla chiusura.
+        n_groups = handoff.n_listen;
+        for (int i = 0; i < n_groups; i++) {
+            groups[i].listen_fd = handoff.listen_fds[i];
+            fcntl(groups[i].listen_fd, F_SETFL, fcntl(groups[i].listen_fd, F_GETFL) | O_NONBLOCK);
+            struct sockaddr_un address;
+            socklen_t addrlen = sizeof(address);
+            if (getsockname(groups[i].listen_fd, (struct sockaddr*)&address, &addrlen) == 0 &&
+                address.sun_family == AF_UNIX) {
+                groups[i].local = true;
+                size_t path_len = addrlen > offsetof(struct sockaddr_un, sun_path)
+                                      ? addrlen - offsetof(struct sockaddr_un, sun_path) : 0;
+                if (path_len > sizeof(unix_path) - 1) path_len = sizeof(unix_path) - 1;
+                memcpy(unix_path, address.sun_path, path_len);
+                unix_path[path_len] = '\0';
+                unix_owned = true;
+            } else {
+                n_tcp++;
+            }
+        }
+        reuseport = n_tcp > 1;
+    } else {
+        int max_tcp = HOT_RESTART_MAX_LISTENERS - (unix_path[0] ? 1 : 0);
+        n_tcp = !tcp ? 0 : reuseport ? (int)(n_listeners > 0 ? n_listeners : n_cpus) : 1;
+        if (n_tcp > max_tcp) n_tcp = max_tcp;
+        for (int i = 0; i < n_tcp; i++) {
+            groups[i].listen_fd = create_listener(reuseport);
+        }
+        n_groups = n_tcp;
+        if (unix_path[0]) {
+            groups[n_groups].listen_fd = create_unix_listener();
+            groups[n_groups].local = true;
+            unix_owned = true;
+            n_groups++;
+        }
+    }
+
+    // Un solo pool condiviso con almeno un thread per core, oppure con
+    // --reuseport un pool per gruppo TCP vincolato al core del gruppo (e uno
+    // non vincolato per il socket Unix).
+    thread_pool* shared_pool = NULL;
+    for (int i = 0; i < n_groups; i++) {
+        if (reuseport && !groups[i].local) {
+            groups[i].cpu = (int)(i % n_cpus);
+            groups[i].pool = thread_pool_create_pinned(n_threads > 0 ? (size_t)n_threads : THREAD_POOL_SIZE, groups[i].cpu);
+        } else {
+            size_t pool_size = (n_cpus > THREAD_POOL_SIZE) ? (size_t)n_cpus : THREAD_POOL_SIZE;
+            groups[i].cpu = -1;
+            if (!shared_pool) shared_pool = thread_pool_create(n_threads > 0 ? (size_t)n_threads : pool_size);
+            groups[i].pool = shared_pool;
+        }
+        if (!groups[i].pool) {
+            fprintf(stderr, "Impossibile creare il thread pool\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Con --io-uring ogni gruppo prova a creare il proprio ring; se il kernel
+    // non lo supporta, tutti i gruppi restano sul backend bloccante.
+    for (int i = 0; io_uring && i < n_groups; i++) {
+        groups[i].uring = uring_server_create(groups[i].listen_fd, groups[i].pool);
+        if (!groups[i].uring) {
+            printf("io_uring non disponibile, uso il backend bloccante.\n");
+            for (int j = 0; j < i; j++) {
+                uring_server_destroy(groups[j].uring);
+                groups[j].uring = NULL;
+            }
+            io_uring = false;
+        }
+    }
+    // Nel backend bloccante le sessioni senza richieste attendono fuori dal
+    // pool; se il thread non parte restano ai lavoratori come prima.
+    if (!io_uring) {
+        idle_sessions_start();
+    }
+
+    char local_desc[sizeof(unix_path) + 32] = "";
+    if (unix_path[0]) {
+        snprintf(local_desc, sizeof(local_desc), "%s socket Unix %s", n_tcp > 0 ? " e sul" : " sul", unix_path);
+    }
+    if (n_tcp == 0) {
+        printf("Server%s in ascolto%s\n", handoff_fd >= 0 ? " avviato tramite hot restart," : "", local_desc);
+    } else if (handoff_fd >= 0) {
+        printf("Server avviato tramite hot restart, in ascolto sulla porta %d (%d listener)%s\n",
+               listen_port, n_tcp, local_desc);
+    } else if (reuseport) {
+        printf("Server in ascolto sulla porta %d con %d listener SO_REUSEPORT%s\n", listen_port, n_tcp, local_desc);
+    } else {
+        printf("Server in ascolto sulla porta %d%s\n", listen_port, local_desc);
+    }
+
+    // Il caricamento usa un pool non vincolato, così il parsing si distribuisce
+    // su tutti i core anche quando i pool dei gruppi sono vincolati.
+    thread_pool* load_pool = reuseport ? thread_pool_create((size_t)n_cpus) : groups[0].pool;
+    // I corpi vecchi o oltre il budget passano nel file freddo di ogni
+    // bacheca, già durante il caricamento; una replica non ha file e li
+    // tiene tutti in memoria.
+    if (!replication_is_replica()) {
+        message_store_set_tiering(cold_after, (size_t)hot_budget_mb * 1024 * 1024);
+    }
+    // Una replica riceve la bacheca predefinita dal primario e non la salva
+    // su file, così può girare nella stessa directory del primario (i cui
+    // utenti usa per il login).
+    boards_init(load_pool, !replication_is_replica());
+    if (reuseport && load_pool) {
+        pool_destroy(load_pool);
+    }
+    // Solo dopo il caricamento, che accoda i propri task: oltre il livello di
+    // guardia le nuove connessioni ricevono BUSY invece di attendere un
+    // thread senza limite (0 = coda illimitata).
+    for (int i = 0; i < n_groups; i++) {
+        thread_pool_set_limit(groups[i].pool, (size_t)max_queued, client_session_reject);
+    }
+    message_store_start_snapshots(snapshot_interval, snapshot_every);
+    message_store_start_tiering();
+    if ((allow_replicas && replication_allow() < 0) ||
+        (replication_is_replica() && replication_start_replica() < 0) ||
+        (retention_enabled() && !replication_is_replica() && retention_start() < 0)) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (handoff_fd >= 0) {
+        for (uint32_t i = 0; i < handoff.n_boards; i++) {
+            handoff_board board;
+            if (hot_restart_receive_board(handoff_fd, &board) < 0) {
+                fprintf(stderr, "Errore nella ricezione delle bacheche dal processo precedente\n");
+                exit(EXIT_FAILURE);
+            }
+            message_store* store = boards_open(board.name);
+            if (store) message_store_set_next_id(store, board.next_id);
+        }
+        // Le sessioni si servono solo dopo la conferma: se l'handoff fallisce
+        // a metà, il vecchio processo le riprende tutte intatte.
+        client_session** sessions = calloc(handoff.n_sessions ? handoff.n_sessions : 1, sizeof(client_session*));
+        if (!sessions) {
+            perror("Calloc fallita");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < handoff.n_sessions; i++) {
+            sessions[i] = hot_restart_receive_session(handoff_fd);
+            if (!sessions[i]) {
+                fprintf(stderr, "Errore nella ricezione di una sessione dal processo precedente\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (hot_restart_confirm(handoff_fd) < 0) {
+            fprintf(stderr, "Errore nella conferma dell'handoff al processo precedente\n");
+            exit(EXIT_FAILURE);
+        }
+        handoff_pending = false;
+        for (uint32_t i = 0; i < handoff.n_sessions; i++) {
+            enqueue_session(sessions[i]);
+        }
+        free(sessions);
+        close(handoff_fd);
+        printf("Ricevute %u sessioni dal processo precedente.\n", handoff.n_sessions);
+    }
+
+    for (int i = 0; i < n_groups; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (groups[i].cpu >= 0) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(groups[i].cpu, &cpuset);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+        }
+        if (pthread_create(&groups[i].acceptor, &attr, accept_loop, &groups[i]) != 0) {
+            perror("Impossibile avviare il thread di accept");
+            exit(EXIT_FAILURE);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // Il thread principale gestisce solo le richieste di hot restart.
+    struct pollfd pfd;
+    pfd.fd = hot_restart_signal_fd();
+    pfd.events = POLLIN;
+    while (1) {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("Poll fallita");
+            continue;
+        }
+        if (pfd.revents & POLLIN) {
+            char buf[16];
+            while (read(pfd.fd, buf, sizeof(buf)) > 0) {
+            }
+            perform_hot_restart();
+        }
     }
 
- 
-    pool_destroy(pool);
-    close(server_fd);
     return 0;
 }
 
 
 void cleanup(void) {
+    if (handoff_pending) {
+        // Handoff non confermato: il vecchio processo riprende le sessioni e
+        // continua a usare i propri file, che non vanno toccati.
+        return;
+    }
     printf("\nEseguo cleanup e spengo il server...\n");
+    replication_stop();
+    retention_stop();
     message_store_shutdown();
+    capture_close();
+    if (unix_owned) {
+        unlink(unix_path);
+    }
+    char stats_buffer[4096];
+    stats_format(stats_buffer, sizeof(stats_buffer));
+    printf("Statistiche finali:\n%s", stats_buffer);
+#ifdef LOCK_PROFILE
+    lock_prof_report(stdout);
+#endif
     pthread_mutex_destroy(&user_mutex);
     pthread_mutex_destroy(&client_m);
-}
\ No newline at end of file
+    pthread_cond_destroy(&client_cv);
+}
@@ -0,0 +1,90 @@
+#include "stats.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "lock_prof.h"
+
+static _Atomic uint64_t counters[STAT_COUNT];
+
+static const char* const stat_names[STAT_COUNT] = {
+    [STAT_SNAPSHOTS]               = "snapshots",
+    [STAT_SNAPSHOT_FAILURES]       = "snapshot_failures",
+    [STAT_SNAPSHOT_PAUSE_LAST_US]  = "snapshot_pause_last_us",
+    [STAT_SNAPSHOT_PAUSE_MAX_US]   = "snapshot_pause_max_us",
+    [STAT_SNAPSHOT_PAUSE_TOTAL_US] = "snapshot_pause_total_us",
+    [STAT_SNAPSHOT_WRITE_LAST_MS]  = "snapshot_write_last_ms",
+    [STAT_SUBSCRIBERS]             = "subscribers",
+    [STAT_PUSH_EVENTS]             = "push_events",
+    [STAT_PUSH_RESYNCS]            = "push_resyncs",
+    [STAT_TIMEOUTS_IDLE]           = "timeouts_idle",
+    [STAT_TIMEOUTS_REQUEST]        = "timeouts_request",
+    [STAT_TIMEOUTS_WRITE]          = "timeouts_write",
+    [STAT_RATE_LIMITED]            = "rate_limited",
+    [STAT_BOARD_NOT_MODIFIED]      = "board_not_modified",
+    [STAT_REPLICAS]                = "replicas",
+    [STAT_REPLICATION_CONNECTED]   = "replication_connected",
+    [STAT_REPLICATION_SYNCS]       = "replication_syncs",
+    [STAT_REPLICATION_APPLIED]     = "replication_applied",
+    [STAT_REPLICATION_LAG_MS]      = "replication_lag_ms",
+    [STAT_RETENTION_EXPIRED]       = "retention_expired",
+    [STAT_RETENTION_SWEEP_LAST_US] = "retention_sweep_last_us",
+    [STAT_TIER_HOT_BYTES]          = "tier_hot_bytes",
+    [STAT_TIER_COLD_BYTES]         = "tier_cold_bytes",
+    [STAT_TIER_EVICTED]            = "tier_evicted",
+    [STAT_TIER_COLD_READS]         = "tier_cold_reads",
+    [STAT_TIER_COMPACTIONS]        = "tier_compactions",
+    [STAT_BATCHES]                 = "batches",
+    [STAT_BATCH_ITEMS]             = "batch_items",
+    [STAT_SHED_QUEUE_FULL]         = "shed_queue_full",
+    [STAT_SHED_QUEUE_TIMEOUT]      = "shed_queue_timeout",
+};
+
+void stats_add(stat_id id, uint64_t value) {
+    atomic_fetch_add_explicit(&counters[id], value, memory_order_relaxed);
+}
+
+void stats_set(stat_id id, uint64_t value) {
+    atomic_store_explicit(&counters[id], value, memory_order_relaxed);
+}
+
+/**
+ * @brief Aggiorna il contatore `id` se `value` è maggiore del valore corrente.
+ */
+void stats_max(stat_id id, uint64_t value) {
+    uint64_t current = atomic_load_explicit(&counters[id], memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(&counters[id], &current, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t stats_get(stat_id id) {
+    return atomic_load_explicit(&counters[id], memory_order_relaxed);
+}
+
+/**
+ * @brief Formatta tutti i contatori come testo "nome valore", uno per riga.
+ *
+ * @param buf Il buffer di destinazione.
+ * @param size La dimensione del buffer.
+ * @return Il numero di byte scritti (senza terminatore).
+ *
+ * È il payload della risposta a `C_STATS` e viene stampato anche allo shutdown.
+ */
+size_t stats_format(char* buf, size_t size) {
+    size_t len = 0;
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (int i = 0; i < STAT_COUNT; i++) {
+        int written = snprintf(buf + len, size - len, "%s %" PRIu64 "\n", stat_names[i], stats_get(i));
+        if (written < 0 || (size_t)written >= size - len) {
+            len = size - 1;
+            break;
+        }
+        len += written;
+    }
+#ifdef LOCK_PROFILE
+    len += lock_prof_format(buf + len, size - len);
+#endif
+    return len;
+}
@@ -0,0 +1,47 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    STAT_SNAPSHOTS,
+    STAT_SNAPSHOT_FAILURES,
+    STAT_SNAPSHOT_PAUSE_LAST_US,
+    STAT_SNAPSHOT_PAUSE_MAX_US,
+    STAT_SNAPSHOT_PAUSE_TOTAL_US,
+    STAT_SNAPSHOT_WRITE_LAST_MS,
+    STAT_SUBSCRIBERS,
+    STAT_PUSH_EVENTS,
+    STAT_PUSH_RESYNCS,
+    STAT_TIMEOUTS_IDLE,
+    STAT_TIMEOUTS_REQUEST,
+    STAT_TIMEOUTS_WRITE,
+    STAT_RATE_LIMITED,
+    STAT_BOARD_NOT_MODIFIED,
+    STAT_REPLICAS,
+    STAT_REPLICATION_CONNECTED,
+    STAT_REPLICATION_SYNCS,
+    STAT_REPLICATION_APPLIED,
+    STAT_REPLICATION_LAG_MS,
+    STAT_RETENTION_EXPIRED,
+    STAT_RETENTION_SWEEP_LAST_US,
+    STAT_TIER_HOT_BYTES,
+    STAT_TIER_COLD_BYTES,
+    STAT_TIER_EVICTED,
+    STAT_TIER_COLD_READS,
+    STAT_TIER_COMPACTIONS,
+    STAT_BATCHES,
+    STAT_BATCH_ITEMS,
+    STAT_SHED_QUEUE_FULL,
+    STAT_SHED_QUEUE_TIMEOUT,
+    STAT_COUNT
+} stat_id;
+
+void stats_add(stat_id id, uint64_t value);
+void stats_set(stat_id id, uint64_t value);
+void stats_max(stat_id id, uint64_t value);
+uint64_t stats_get(stat_id id);
+size_t stats_format(char* buf, size_t size);
+
+#endif // STATS_H
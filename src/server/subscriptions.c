@@ -0,0 +1,298 @@
+#include "subscriptions.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "../common/protocol.h"
+#include "message_store.h"
+#include "stats.h"
+
+#define SUBSCRIBER_MAX_QUEUE (256 * 1024)
+#define REPLICA_MAX_QUEUE (64 * 1024 * 1024)
+
+/**
+ * Una connessione in modalità push sulla bacheca `board`, di cui riceve
+ * le sole modifiche. Gli eventi vengono serializzati come
+ * pacchetti completi in `queue`, limitata a `SUBSCRIBER_MAX_QUEUE` byte.
+ *
+ * Quando la coda passa da vuota a non vuota viene chiamata `notify` (o, se
+ * assente, viene scritto `event_fd`), così il backend che serve la
+ * connessione sa che c'è qualcosa da inviare. Chi pubblica non attende mai il
+ * client: se la coda è piena viene svuotata e sostituita da un unico
+ * `EVENT_RESYNC`, che chiede al client di rileggere la bacheca.
+ *
+ * Una replica (`subscriber_set_replica`) ha una coda più ampia, perché un
+ * `EVENT_RESYNC` le costa una nuova copia dell'intera bacheca, e riceve anche
+ * gli `EVENT_HEARTBEAT` con cui misura il proprio ritardo.
+ */
+struct subscriber {
+    struct subscriber* prev;
+    struct subscriber* next;
+    const message_store* board;
+    reply queue;
+    size_t queued;
+    size_t max_queue;
+    bool overflow;
+    bool replica;
+    void (*notify)(void* ctx);
+    void* ctx;
+    int event_fd;
+};
+
+static pthread_mutex_t hub_m = PTHREAD_MUTEX_INITIALIZER;
+static subscriber* subscribers = NULL;
+static atomic_uint n_subscribers = 0;
+
+static void wake(subscriber* sub) {
+    if (sub->notify) {
+        sub->notify(sub->ctx);
+    } else {
+        uint64_t one = 1;
+        if (write(sub->event_fd, &one, sizeof(one)) < 0) {
+            perror("write eventfd");
+        }
+    }
+}
+
+/**
+ * @brief Accoda un pacchetto ai subscriber di `board` (chiamata con `hub_m`).
+ *
+ * Il payload è `head`, seguito dal corpo di un messaggio (se `body` non è
+ * NULL) e da `tail`: il corpo viene riferito nella coda di ogni subscriber
+ * (con `replicas_only`, delle sole repliche, e con `board` NULL, di tutte le
+ * bacheche) invece di esservi copiato. Un evento più grande di `SUBSCRIBER_MAX_QUEUE`
+ * viene comunque accettato in una coda vuota, altrimenti un messaggio molto
+ * lungo produrrebbe solo `EVENT_RESYNC`.
+ */
+static void publish(const message_store* board, uint8_t type, const char* head, uint32_t head_len,
+                    const char* body, const char* tail, uint32_t tail_len, bool replicas_only) {
+    uint64_t delivered = 0;
+    size_t body_len = body ? message_body_len(body) : 0;
+    size_t length = head_len + body_len + tail_len;
+    for (subscriber* sub = subscribers; sub; sub = sub->next) {
+        if (sub->overflow || (replicas_only && !sub->replica) || (board && sub->board != board)) continue;
+        bool was_empty = sub->queued == 0;
+        if (!was_empty && sub->queued + sizeof(packet_header) + length > sub->max_queue) {
+            reply_free_chunks(reply_take(&sub->queue));
+            sub->queued = 0;
+            sub->overflow = true;
+            stats_add(STAT_PUSH_RESYNCS, 1);
+        } else {
+            reply_frame_begin(&sub->queue, type, (uint32_t)length);
+            reply_bytes(&sub->queue, head, head_len);
+            if (body) message_body_reply(&sub->queue, body);
+            reply_bytes(&sub->queue, tail, tail_len);
+            sub->queued += sizeof(packet_header) + length;
+            delivered++;
+        }
+        if (was_empty) {
+            wake(sub);
+        }
+    }
+    if (!replicas_only) stats_add(STAT_PUSH_EVENTS, delivered);
+}
+
+/**
+ * @brief Osservatore della bacheca: trasforma ogni modifica in un evento push.
+ *
+ * I campi brevi dell'evento vengono serializzati una sola volta, fuori da
+ * `hub_m`; il corpo viene accodato per riferimento a ogni subscriber.
+ */
+static void on_store_event(const store_event* event, void* ctx) {
+    (void)ctx;
+    if (atomic_load(&n_subscribers) == 0) return;
+
+    if (event->type == STORE_EVENT_DELETED) {
+        pthread_mutex_lock(&hub_m);
+        publish(event->store, EVENT_DELETED, (const char*)&event->id, sizeof(event->id), NULL, NULL, 0, false);
+        pthread_mutex_unlock(&hub_m);
+        return;
+    }
+
+    // id, autore\0, oggetto\0 | corpo | \0, timestamp\0
+    char head[sizeof(event->id) + MAX_USERNAME_LEN + MAX_SUBJECT_LEN];
+    char tail[1 + 32];
+    const char* timestamp = event->timestamp ? event->timestamp : "";
+    size_t author_len = strnlen(event->author, MAX_USERNAME_LEN - 1);
+    size_t subject_len = strnlen(event->subject, MAX_SUBJECT_LEN - 1);
+    size_t timestamp_len = strnlen(timestamp, sizeof(tail) - 2);
+
+    uint32_t head_len = 0;
+    memcpy(head, &event->id, sizeof(event->id));
+    head_len += sizeof(event->id);
+    memcpy(head + head_len, event->author, author_len);
+    head_len += author_len;
+    head[head_len++] = '\0';
+    memcpy(head + head_len, event->subject, subject_len);
+    head_len += subject_len;
+    head[head_len++] = '\0';
+
+    uint32_t tail_len = 0;
+    tail[tail_len++] = '\0';
+    memcpy(tail + tail_len, timestamp, timestamp_len);
+    tail_len += timestamp_len;
+    tail[tail_len++] = '\0';
+
+    pthread_mutex_lock(&hub_m);
+    publish(event->store, EVENT_ADDED, head, head_len, event->body, tail, tail_len, false);
+    pthread_mutex_unlock(&hub_m);
+}
+
+void subscriptions_init(void) {
+    message_store_add_observer(on_store_event, NULL);
+}
+
+/**
+ * @brief Registra un nuovo subscriber.
+ *
+ * @param board La bacheca di cui ricevere le modifiche.
+ * @param notify Chiamata quando arrivano eventi in una coda vuota, con
+ *               `hub_m` e il lock di una shard della bacheca: deve solo
+ *               segnalare, senza bloccarsi. Se NULL, il subscriber crea un
+ *               eventfd da attendere con `poll` (vedi `subscriber_fd`).
+ * @param ctx Argomento passato a `notify`.
+ * @return Il subscriber, o NULL in caso di errore.
+ */
+subscriber* subscriber_create(const message_store* board, void (*notify)(void* ctx), void* ctx) {
+    subscriber* sub = calloc(1, sizeof(subscriber));
+    if (!sub) return NULL;
+    sub->board = board;
+    reply_init(&sub->queue, -1);
+    sub->max_queue = SUBSCRIBER_MAX_QUEUE;
+    sub->notify = notify;
+    sub->ctx = ctx;
+    sub->event_fd = -1;
+    if (!notify) {
+        sub->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (sub->event_fd < 0) {
+            perror("eventfd");
+            free(sub);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_lock(&hub_m);
+    sub->next = subscribers;
+    if (subscribers) subscribers->prev = sub;
+    subscribers = sub;
+    unsigned count = atomic_fetch_add(&n_subscribers, 1) + 1;
+    pthread_mutex_unlock(&hub_m);
+    stats_set(STAT_SUBSCRIBERS, count);
+    return sub;
+}
+
+/**
+ * @brief Rimuove un subscriber; al ritorno `notify` non verrà più chiamata.
+ */
+void subscriber_destroy(subscriber* sub) {
+    pthread_mutex_lock(&hub_m);
+    if (sub->prev) sub->prev->next = sub->next;
+    else subscribers = sub->next;
+    if (sub->next) sub->next->prev = sub->prev;
+    if (sub->replica) stats_add(STAT_REPLICAS, (uint64_t)-1);
+    unsigned count = atomic_fetch_sub(&n_subscribers, 1) - 1;
+    pthread_mutex_unlock(&hub_m);
+    stats_set(STAT_SUBSCRIBERS, count);
+
+    reply_free_chunks(reply_take(&sub->queue));
+    if (sub->event_fd >= 0) close(sub->event_fd);
+    free(sub);
+}
+
+/**
+ * @brief Sposta il subscriber su un'altra bacheca.
+ *
+ * Gli eventi già in coda della bacheca precedente vengono scartati e
+ * sostituiti da un `EVENT_RESYNC`, che chiede al client di leggere la nuova.
+ */
+void subscriber_set_board(subscriber* sub, const message_store* board) {
+    pthread_mutex_lock(&hub_m);
+    if (sub->board != board) {
+        bool was_empty = sub->queued == 0 && !sub->overflow;
+        sub->board = board;
+        reply_free_chunks(reply_take(&sub->queue));
+        sub->queued = 0;
+        sub->overflow = true;
+        if (was_empty) {
+            wake(sub);
+        }
+    }
+    pthread_mutex_unlock(&hub_m);
+}
+
+/**
+ * @brief Segna il subscriber come replica (coda ampia ed `EVENT_HEARTBEAT`).
+ */
+void subscriber_set_replica(subscriber* sub) {
+    pthread_mutex_lock(&hub_m);
+    if (!sub->replica) {
+        sub->replica = true;
+        sub->max_queue = REPLICA_MAX_QUEUE;
+        stats_add(STAT_REPLICAS, 1);
+    }
+    pthread_mutex_unlock(&hub_m);
+}
+
+/**
+ * @brief Accoda un `EVENT_HEARTBEAT` con `payload` a tutte le repliche.
+ *
+ * Il battito segue nella coda le modifiche pubblicate prima di lui: quando la
+ * replica lo riceve le ha già applicate, e la differenza tra il suo orologio
+ * e l'ora nel payload è il ritardo della replica.
+ */
+void subscriptions_heartbeat(const void* payload, uint32_t length) {
+    pthread_mutex_lock(&hub_m);
+    publish(NULL, EVENT_HEARTBEAT, payload, length, NULL, NULL, 0, true);
+    pthread_mutex_unlock(&hub_m);
+}
+
+int subscriber_fd(subscriber* sub) {
+    return sub->event_fd;
+}
+
+/**
+ * @brief Forza un `EVENT_RESYNC`, ad esempio per una sessione ripresa dopo un
+ *        hot restart che può aver perso eventi.
+ */
+void subscriber_resync(subscriber* sub) {
+    pthread_mutex_lock(&hub_m);
+    bool was_empty = sub->queued == 0 && !sub->overflow;
+    reply_free_chunks(reply_take(&sub->queue));
+    sub->queued = 0;
+    sub->overflow = true;
+    if (was_empty) {
+        wake(sub);
+    }
+    pthread_mutex_unlock(&hub_m);
+}
+
+/**
+ * @brief Sposta in `out` gli eventi in coda.
+ *
+ * @return true se è stato aggiunto almeno un pacchetto.
+ */
+bool subscriber_drain(subscriber* sub, reply* out) {
+    pthread_mutex_lock(&hub_m);
+    if (sub->event_fd >= 0) {
+        // Azzera la notifica; EAGAIN se non ce n'era nessuna.
+        uint64_t value;
+        ssize_t r = read(sub->event_fd, &value, sizeof(value));
+        (void)r;
+    }
+    bool added = false;
+    if (sub->overflow) {
+        reply_status(out, EVENT_RESYNC);
+        sub->overflow = false;
+        added = true;
+    } else if (sub->queued > 0) {
+        reply_append(out, &sub->queue);
+        added = true;
+    }
+    sub->queued = 0;
+    pthread_mutex_unlock(&hub_m);
+    return added;
+}
@@ -0,0 +1,21 @@
+#ifndef SUBSCRIPTIONS_H
+#define SUBSCRIPTIONS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "message_store.h"
+#include "reply.h"
+
+typedef struct subscriber subscriber;
+
+void subscriptions_init(void);
+subscriber* subscriber_create(const message_store* board, void (*notify)(void* ctx), void* ctx);
+void subscriber_destroy(subscriber* sub);
+int subscriber_fd(subscriber* sub);
+void subscriber_resync(subscriber* sub);
+void subscriber_set_board(subscriber* sub, const message_store* board);
+void subscriber_set_replica(subscriber* sub);
+void subscriptions_heartbeat(const void* payload, uint32_t length);
+bool subscriber_drain(subscriber* sub, reply* out);
+
+#endif // SUBSCRIPTIONS_H
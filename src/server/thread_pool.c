@@ -1,20 +1,52 @@
+#define _GNU_SOURCE
+
 #include "thread_pool.h"
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h> 
+#include <time.h>
+#include "lock_prof.h"
+
+/**
+ * Attesa oltre la quale il primo task di una coda passa davanti ai pesi:
+ * nessuna classe resta ferma per più di tanto, anche sotto carico continuo
+ * delle classi più pesanti.
+ */
+#define TASK_STARVATION_MS 200
+
+/**
+ * Task estratti da ogni coda per giro, in ordine di classe: sotto carico su
+ * tutte le code, ogni 12 task 8 sono interattivi, 3 letture e 1 di
+ * manutenzione, e una coda vuota cede il proprio turno alle altre.
+ */
+static const unsigned lane_weight[TASK_CLASSES] = {
+    [TASK_INTERACTIVE] = 8,
+    [TASK_BULK]        = 3,
+    [TASK_BACKGROUND]  = 1
+};
 
 typedef struct client
 {
     struct client* next;
     void* (*function)(void*);
     void* arg;
+    void (*reject)(void* arg);  // NULL: la funzione di rifiuto del pool
+    uint64_t enqueued_ms;
 } client;
 
-typedef struct client_queue{
+/** Coda FIFO dei task di una classe, con i turni rimasti nel giro corrente. */
+typedef struct task_lane {
     client* head;
     client* tail;
+    unsigned credit;
+} task_lane;
+
+typedef struct client_queue{
+    task_lane lanes[TASK_CLASSES];
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 } client_queue;
@@ -24,9 +56,67 @@ typedef struct thread_pool
     int num_threads;
     pthread_t* threads;
     client_queue client_queue;
+    size_t queued;
+    size_t max_queued;
+    void (*reject)(void* arg);
     int close_requested;
 } thread_pool;
 
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Sceglie la coda da cui estrarre il prossimo task, con il lock della
+ *        coda acquisito e almeno un task accodato.
+ *
+ * Se il primo task di qualche coda attende da più di `TASK_STARVATION_MS`
+ * viene servito il più vecchio di questi; altrimenti la prima coda non vuota
+ * che ha ancora turni nel giro (`lane_weight`). Quando le code non vuote
+ * hanno esaurito i turni, inizia un nuovo giro.
+ */
+static int next_lane(client_queue* queue) {
+    uint64_t now = monotonic_ms();
+    int oldest = -1;
+    for (int i = 0; i < TASK_CLASSES; i++) {
+        client* head = queue->lanes[i].head;
+        if (head && now - head->enqueued_ms >= TASK_STARVATION_MS &&
+            (oldest < 0 || head->enqueued_ms < queue->lanes[oldest].head->enqueued_ms)) {
+            oldest = i;
+        }
+    }
+    if (oldest >= 0) return oldest;
+
+    while (1) {
+        for (int i = 0; i < TASK_CLASSES; i++) {
+            if (queue->lanes[i].head && queue->lanes[i].credit > 0) {
+                queue->lanes[i].credit--;
+                return i;
+            }
+        }
+        for (int i = 0; i < TASK_CLASSES; i++) {
+            queue->lanes[i].credit = lane_weight[i];
+        }
+    }
+}
+
+/**
+ * @brief Restituisce al chiamante un task non accodato: lo passa alla funzione
+ *        di rifiuto del task, altrimenti a quella del pool o, se nessuna delle
+ *        due è impostata, ne libera l'argomento.
+ */
+static void reject_task(thread_pool* pool, void (*reject)(void* arg), void* arg) {
+    if (reject) {
+        reject(arg);
+    } else if (pool && pool->reject) {
+        pool->reject(arg);
+    } else {
+        free(arg);
+    }
+}
+
 
 /**
  * @brief Funzione eseguita da ogni thread lavoratore del pool.
@@ -41,7 +131,8 @@ typedef struct thread_pool
  *    non contiene un task o non viene richiesta la chiusura del pool. L'attesa
  *    rilascia atomicamente il mutex e lo riacquisisce al risveglio.
  * 4. Se viene richiesta la chiusura e la coda è vuota, il thread esce dal ciclo.
- * 5. Estrae un task (un client) dalla testa della coda.
+ * 5. Sceglie la classe da servire (`next_lane`) ed estrae un task dalla testa
+ *    della sua coda.
  * 6. Rilascia il lock sulla coda.
  * 7. Esegue la funzione associata al task (es. `handle_client`).
  * 8. Libera la memoria allocata per la struttura del task.
@@ -49,22 +140,24 @@ typedef struct thread_pool
 void* client_handler(void* arg) {
     thread_pool* pool = (thread_pool*)arg;
     while (1) {
-        pthread_mutex_lock(&pool->client_queue.mutex);
-        while (pool->client_queue.head == NULL && !pool->close_requested) {
-            pthread_cond_wait(&pool->client_queue.cond, &pool->client_queue.mutex);
+        PROF_LOCK(&pool->client_queue.mutex, LOCK_POOL_QUEUE);
+        while (pool->queued == 0 && !pool->close_requested) {
+            PROF_COND_WAIT(&pool->client_queue.cond, &pool->client_queue.mutex);
         }
 
-        if (pool->close_requested && pool->client_queue.head == NULL) {
-            pthread_mutex_unlock(&pool->client_queue.mutex);
+        if (pool->close_requested && pool->queued == 0) {
+            PROF_UNLOCK(&pool->client_queue.mutex);
             break;
         }
 
-        client* client = pool->client_queue.head;
-        pool->client_queue.head = client->next;
-        if (pool->client_queue.head == NULL) {
-            pool->client_queue.tail = NULL;
+        task_lane* lane = &pool->client_queue.lanes[next_lane(&pool->client_queue)];
+        client* client = lane->head;
+        lane->head = client->next;
+        if (lane->head == NULL) {
+            lane->tail = NULL;
         }
-        pthread_mutex_unlock(&pool->client_queue.mutex);
+        pool->queued--;
+        PROF_UNLOCK(&pool->client_queue.mutex);
 
         client->function(client->arg);
 
@@ -78,20 +171,39 @@ void* client_handler(void* arg) {
  * 
  * @param num_threads Il numero di thread da creare nel pool.
  * @return Un puntatore al `thread_pool` creato, o NULL in caso di errore.
+ */
+thread_pool* thread_pool_create(size_t num_threads) {
+    return thread_pool_create_pinned(num_threads, -1);
+}
+
+/**
+ * @brief Crea un thread pool i cui lavoratori sono vincolati a una CPU.
+ * 
+ * @param num_threads Il numero di thread da creare nel pool.
+ * @param cpu La CPU su cui eseguire i lavoratori, o -1 per nessun vincolo.
+ * @return Un puntatore al `thread_pool` creato, o NULL in caso di errore.
  * 
  * La funzione alloca la memoria per la struttura del pool, inizializza la coda
  * dei task (con il suo mutex e la variabile di condizione), e crea i thread
  * lavoratori, ognuno dei quali eseguirà la funzione `client_handler`.
+ * Con `cpu >= 0` i thread vengono creati già vincolati alla CPU indicata, così
+ * coda, lavoratori e dati delle connessioni restano nella cache di quel core.
  */
-thread_pool* thread_pool_create(size_t num_threads) {
+thread_pool* thread_pool_create_pinned(size_t num_threads, int cpu) {
     thread_pool* pool = malloc(sizeof(thread_pool));
     if (!pool) return NULL;
 
     pool->num_threads = num_threads;
+    pool->queued = 0;
+    pool->max_queued = 0;
+    pool->reject = NULL;
     pool->close_requested = 0;
     
-    pool->client_queue.head = NULL;
-    pool->client_queue.tail = NULL;
+    for (int i = 0; i < TASK_CLASSES; i++) {
+        pool->client_queue.lanes[i].head = NULL;
+        pool->client_queue.lanes[i].tail = NULL;
+        pool->client_queue.lanes[i].credit = lane_weight[i];
+    }
     pthread_mutex_init(&pool->client_queue.mutex, NULL);
     pthread_cond_init(&pool->client_queue.cond, NULL);
 
@@ -101,55 +213,147 @@ thread_pool* thread_pool_create(size_t num_threads) {
         return NULL;
     }
 
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+    }
     for (size_t i = 0; i < num_threads; i++) {
-        pthread_create(&pool->threads[i], NULL, client_handler, (void*)pool);
+        pthread_create(&pool->threads[i], &attr, client_handler, (void*)pool);
     }
+    pthread_attr_destroy(&attr);
     return pool;
 }
 
 /**
- * @brief Aggiunge un nuovo task alla coda del thread pool.
+ * @brief Limita la coda del pool e imposta la funzione che riceve i task rifiutati.
+ *
+ * @param pool Il thread pool.
+ * @param max_queued Il numero massimo di task in attesa di un lavoratore
+ *                   (0 = nessun limite).
+ * @param reject La funzione a cui passare l'argomento di un task non accodato
+ *               (coda piena, pool in chiusura, memoria esaurita o task ancora
+ *               in coda alla distruzione del pool); NULL lo libera con `free`.
+ *
+ * Va chiamata prima di accodare i task. Il limite è il livello di guardia
+ * della coda: oltre, `add_task` rifiuta subito invece di far crescere la
+ * lista, e il chiamante può rispondere al client che il server è occupato.
+ */
+void thread_pool_set_limit(thread_pool* pool, size_t max_queued, void (*reject)(void* arg)) {
+    PROF_LOCK(&pool->client_queue.mutex, LOCK_POOL_QUEUE);
+    pool->max_queued = max_queued;
+    pool->reject = reject;
+    PROF_UNLOCK(&pool->client_queue.mutex);
+}
+
+/**
+ * @brief Aggiunge un nuovo task interattivo alla coda del thread pool.
+ *
+ * Equivale ad `add_task_class` con `TASK_INTERACTIVE`.
+ */
+int add_task(thread_pool* pool, void* (*function)(void*), void* arg) {
+    return add_task_class(pool, TASK_INTERACTIVE, function, arg);
+}
+
+/**
+ * @brief Aggiunge un nuovo task alla coda della sua classe.
  * 
  * @param pool Il thread pool a cui aggiungere il task.
+ * @param cls La classe del task, che ne sceglie la coda.
  * @param function La funzione che il thread deve eseguire.
  * @param arg L'argomento da passare alla funzione.
+ * @return 0 se il task è stato accodato, -1 altrimenti (in tal caso `arg` è
+ *         già stato passato alla funzione di rifiuto o liberato, ed `errno` è
+ *         `EBUSY` se la coda era piena).
  * 
  * La funzione, in modo thread-safe:
- * 1. Alloca un nuovo nodo `client` per rappresentare il task.
+ * 1. Alloca un nuovo nodo `client` per rappresentare il task, con l'istante
+ *    in cui viene accodato.
  * 2. Acquisisce il lock sulla coda.
- * 3. Aggiunge il nuovo task in coda (FIFO).
- * 4. Segnala (`pthread_cond_signal`) a uno dei thread in attesa che c'è un
+ * 3. Se le code hanno raggiunto in tutto il limite di `thread_pool_set_limit`,
+ *    rifiuta il task.
+ * 4. Aggiunge il nuovo task in fondo alla coda della sua classe (FIFO).
+ * 5. Segnala (`pthread_cond_signal`) a uno dei thread in attesa che c'è un
  *    nuovo task disponibile.
- * 5. Rilascia il lock.
+ * 6. Rilascia il lock.
  */
-void add_task(thread_pool* pool, void* (*function)(void*), void* arg) {
-    if (!pool || pool->close_requested) {
+int add_task_class(thread_pool* pool, task_class cls, void* (*function)(void*), void* arg) {
+    return add_task_reject(pool, cls, function, arg, NULL);
+}
 
-        free(arg);
-        return;
+/**
+ * @brief Come `add_task_class`, ma un task rifiutato va a `reject` invece che
+ *        alla funzione di rifiuto del pool.
+ *
+ * Serve ai task il cui argomento non è una sessione, accodati in un pool
+ * limitato con `thread_pool_set_limit`. Con `reject` NULL equivale ad
+ * `add_task_class`.
+ */
+int add_task_reject(thread_pool* pool, task_class cls, void* (*function)(void*), void* arg,
+                    void (*reject)(void* arg)) {
+    if (!pool || pool->close_requested) {
+        reject_task(pool, reject, arg);
+        return -1;
     }
 
     client* new_client = malloc(sizeof(client));
     if (!new_client) {
         perror("Errore nell'allocazione della memoria per il nuovo client");
-        free(arg);
-        return; 
+        reject_task(pool, reject, arg);
+        return -1; 
     }
 
     new_client->function = function;
     new_client->arg = arg;
+    new_client->reject = reject;
     new_client->next = NULL;
+    new_client->enqueued_ms = monotonic_ms();
 
-    pthread_mutex_lock(&pool->client_queue.mutex);
-    if (pool->client_queue.tail == NULL) {
-        pool->client_queue.head = new_client;
-        pool->client_queue.tail = new_client;
+    PROF_LOCK(&pool->client_queue.mutex, LOCK_POOL_QUEUE);
+    if (pool->max_queued > 0 && pool->queued >= pool->max_queued) {
+        PROF_UNLOCK(&pool->client_queue.mutex);
+        free(new_client);
+        reject_task(pool, reject, arg);
+        errno = EBUSY;
+        return -1;
+    }
+    task_lane* lane = &pool->client_queue.lanes[cls];
+    if (lane->tail == NULL) {
+        lane->head = new_client;
+        lane->tail = new_client;
     } else {
-        pool->client_queue.tail->next = new_client;
-        pool->client_queue.tail = new_client;
+        lane->tail->next = new_client;
+        lane->tail = new_client;
     }
+    pool->queued++;
     pthread_cond_signal(&pool->client_queue.cond);
-    pthread_mutex_unlock(&pool->client_queue.mutex);
+    PROF_UNLOCK(&pool->client_queue.mutex);
+    return 0;
+}
+
+/**
+ * @brief Restituisce il numero di thread lavoratori del pool.
+ */
+size_t thread_pool_size(thread_pool* pool) {
+    return pool ? (size_t)pool->num_threads : 0;
+}
+
+/**
+ * @brief Indica se ci sono task in attesa di un lavoratore e la coda può
+ *        accoglierne un altro.
+ *
+ * Un task che ha usato la propria parte di tempo la cede solo in questo
+ * caso: senza attese non serve, e con la coda piena verrebbe rifiutato.
+ */
+bool thread_pool_contended(thread_pool* pool) {
+    if (!pool) return false;
+    PROF_LOCK(&pool->client_queue.mutex, LOCK_POOL_QUEUE);
+    bool contended = pool->queued > 0 && (pool->max_queued == 0 || pool->queued < pool->max_queued);
+    PROF_UNLOCK(&pool->client_queue.mutex);
+    return contended;
 }
 
 /**
@@ -163,26 +367,28 @@ void add_task(thread_pool* pool, void* (*function)(void*), void* arg) {
  *    informandoli della richiesta di chiusura.
  * 3. Rilascia il lock.
  * 4. Usa `pthread_join` per attendere la terminazione di ogni thread lavoratore.
- * 5. Libera la memoria di eventuali task rimasti nella coda (anche se in una
- *    chiusura normale la coda dovrebbe essere vuota).
+ * 5. Rifiuta eventuali task rimasti nella coda (anche se in una chiusura
+ *    normale la coda dovrebbe essere vuota), liberandone la memoria.
  * 6. Distrugge il mutex e la variabile di condizione.
  * 7. Libera la memoria allocata per l'array di thread e per la struttura del pool.
  */
 void pool_destroy(thread_pool* pool) {
-    pthread_mutex_lock(&pool->client_queue.mutex);
+    PROF_LOCK(&pool->client_queue.mutex, LOCK_POOL_QUEUE);
     pool->close_requested = 1;
     pthread_cond_broadcast(&pool->client_queue.cond);
-    pthread_mutex_unlock(&pool->client_queue.mutex);
+    PROF_UNLOCK(&pool->client_queue.mutex);
 
     for (int i = 0; i < pool->num_threads; i++) {
         pthread_join(pool->threads[i], NULL);
     }
 
-    while (pool->client_queue.head != NULL) {
-        client* temp = pool->client_queue.head;
-        pool->client_queue.head = pool->client_queue.head->next;
-        free(temp->arg);
-        free(temp);
+    for (int i = 0; i < TASK_CLASSES; i++) {
+        while (pool->client_queue.lanes[i].head != NULL) {
+            client* temp = pool->client_queue.lanes[i].head;
+            pool->client_queue.lanes[i].head = temp->next;
+            reject_task(pool, temp->reject, temp->arg);
+            free(temp);
+        }
     }
 
     pthread_mutex_destroy(&pool->client_queue.mutex);
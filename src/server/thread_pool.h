@@ -1,12 +1,40 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct thread_pool thread_pool;
 
+/**
+ * Classe di un task, che ne sceglie la coda nel pool. I lavoratori servono
+ * le code con pesi decrescenti e senza lasciarne nessuna ferma a lungo: un
+ * login o una pubblicazione non attendono dietro a una fila di letture
+ * della bacheca.
+ *
+ * Nel server un task serve una sessione per al più `SESSION_SLICE_MS` se
+ * altri task attendono un lavoratore, poi la rimette in coda: la classe
+ * viene scelta dalla prima richiesta in attesa (`client_session_task_class`)
+ * all'accept, a ogni ritorno da `idle_sessions` e a ogni nuova parte di
+ * tempo, così i pesi e la protezione dall'attesa valgono per le richieste e
+ * non per le connessioni.
+ */
+typedef enum {
+    TASK_INTERACTIVE,   // Autenticazione e modifiche: richieste brevi
+    TASK_BULK,          // Letture della bacheca, modalità push e repliche
+    TASK_BACKGROUND,    // Manutenzione, come il caricamento in parallelo
+    TASK_CLASSES
+} task_class;
+
 thread_pool* thread_pool_create(size_t num_threads);
-void add_task(thread_pool* pool, void* (*function)(void*), void* arg);
+thread_pool* thread_pool_create_pinned(size_t num_threads, int cpu);
+void thread_pool_set_limit(thread_pool* pool, size_t max_queued, void (*reject)(void* arg));
+int add_task(thread_pool* pool, void* (*function)(void*), void* arg);
+int add_task_class(thread_pool* pool, task_class cls, void* (*function)(void*), void* arg);
+int add_task_reject(thread_pool* pool, task_class cls, void* (*function)(void*), void* arg,
+                    void (*reject)(void* arg));
+size_t thread_pool_size(thread_pool* pool);
+bool thread_pool_contended(thread_pool* pool);
 void pool_destroy(thread_pool* pool);
 
 #endif // THREAD_POOL_H
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "timer_wheel.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TIMER_TICK_MS 100
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+/*
+ * Ruota gerarchica a 4 livelli da 64 slot, con tick di 100 ms: il livello 0
+ * copre 6,4 s a risoluzione piena, ogni livello successivo 64 volte di più
+ * (circa 19 giorni in tutto). Armare e annullare un timer costa O(1); un
+ * timer lontano scende di livello ("cascata") quando la ruota inferiore
+ * compie un giro, e scade dallo slot del livello 0.
+ */
+static timer_entry* slots[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_now = 0;      // Ultimo tick elaborato
+static pthread_mutex_t wheel_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t wheel_thread;
+
+static uint64_t clock_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+/**
+ * @brief Inserisce `t` nello slot del livello adatto alla sua distanza da `wheel_now`.
+ *
+ * Richiede `t->expires >= wheel_now`.
+ */
+static void link_entry(timer_entry* t) {
+    if (t->expires - wheel_now >= WHEEL_SPAN) {
+        t->expires = wheel_now + WHEEL_SPAN - 1;
+    }
+    uint64_t delta = t->expires - wheel_now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    timer_entry** head = &slots[level][(t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    t->next = *head;
+    if (t->next) t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+}
+
+static void unlink_entry(timer_entry* t) {
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/**
+ * @brief Fa avanzare la ruota fino al tick `target`, facendo scadere i timer (chiamata con `wheel_m`).
+ */
+static void advance(uint64_t target) {
+    while (wheel_now < target) {
+        wheel_now++;
+        // All'inizio di ogni giro di un livello, lo slot corrente del livello
+        // superiore viene ridistribuito: i suoi timer ora distano meno.
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (wheel_now & ((1ULL << (WHEEL_BITS * level)) - 1)) break;
+            timer_entry** head = &slots[level][(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+            timer_entry* list = *head;
+            *head = NULL;
+            while (list) {
+                timer_entry* t = list;
+                list = t->next;
+                t->next = NULL;
+                link_entry(t);
+            }
+        }
+
+        timer_entry** head = &slots[0][wheel_now & WHEEL_MASK];
+        while (*head) {
+            timer_entry* t = *head;
+            unlink_entry(t);
+            t->expire(t);
+        }
+    }
+}
+
+static void* wheel_loop(void* arg) {
+    (void)arg;
+    struct timespec tick = { .tv_sec = 0, .tv_nsec = TIMER_TICK_MS * 1000000L };
+    while (1) {
+        nanosleep(&tick, NULL);
+        pthread_mutex_lock(&wheel_m);
+        advance(clock_ticks());
+        pthread_mutex_unlock(&wheel_m);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Avvia il thread che fa avanzare la ruota.
+ *
+ * @return 0 in caso di successo, -1 se il thread non può essere creato.
+ */
+int timer_wheel_start(void) {
+    pthread_mutex_lock(&wheel_m);
+    wheel_now = clock_ticks();
+    pthread_mutex_unlock(&wheel_m);
+    if (pthread_create(&wheel_thread, NULL, wheel_loop, NULL) != 0) {
+        perror("Impossibile avviare il thread dei timer");
+        return -1;
+    }
+    pthread_detach(wheel_thread);
+    return 0;
+}
+
+void timer_init(timer_entry* t, void (*expire)(timer_entry* t)) {
+    memset(t, 0, sizeof(*t));
+    t->expire = expire;
+}
+
+/**
+ * @brief Arma (o riarma) `t` perché scada tra `ms` millisecondi.
+ *
+ * @param tag Valore libero per `expire`, letto con il lock della ruota.
+ *
+ * La scadenza è arrotondata per eccesso al tick successivo.
+ */
+void timer_arm(timer_entry* t, unsigned ms, int tag) {
+    uint64_t expires = clock_ticks() + ((uint64_t)ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    pthread_mutex_lock(&wheel_m);
+    if (t->pprev) unlink_entry(t);
+    // Lo slot di `wheel_now` è già stato elaborato.
+    t->expires = expires > wheel_now ? expires : wheel_now + 1;
+    t->tag = tag;
+    link_entry(t);
+    pthread_mutex_unlock(&wheel_m);
+}
+
+/**
+ * @brief Disarma `t`; al ritorno `expire` non è in esecuzione e non verrà chiamata.
+ */
+void timer_cancel(timer_entry* t) {
+    pthread_mutex_lock(&wheel_m);
+    if (t->pprev) unlink_entry(t);
+    pthread_mutex_unlock(&wheel_m);
+}
@@ -0,0 +1,25 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/**
+ * Un timer della ruota. Va inizializzato con `timer_init` e può essere
+ * armato e annullato più volte; `expire` viene chiamata dal thread della
+ * ruota con il lock della ruota acquisito, quindi non deve chiamare
+ * `timer_arm` né `timer_cancel`.
+ */
+typedef struct timer_entry {
+    struct timer_entry* next;
+    struct timer_entry** pprev;     // NULL se il timer non è armato
+    uint64_t expires;
+    int tag;
+    void (*expire)(struct timer_entry* t);
+} timer_entry;
+
+int timer_wheel_start(void);
+void timer_init(timer_entry* t, void (*expire)(timer_entry* t));
+void timer_arm(timer_entry* t, unsigned ms, int tag);
+void timer_cancel(timer_entry* t);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,1245 @@
+#define _GNU_SOURCE
+
+#include "uring_server.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../common/protocol.h"
+#include "hot_restart.h"
+#include "message_store.h"
+#include "subscriptions.h"
+
+extern atomic_int active_client_count;
+extern bool log_connections;
+
+#define URING_ENTRIES 512
+#define URING_MAX_CONNS 1024
+#define URING_BUF_SIZE 4096
+#define URING_SEND_CHAIN 16
+
+/*
+ * Il tipo di operazione viaggia nei 3 bit bassi di `user_data`; il resto è il
+ * puntatore alla connessione (allineato a 8 byte), o 0 per le operazioni del
+ * server.
+ */
+enum {
+    OP_ACCEPT,
+    OP_READ,
+    OP_SEND,
+    OP_WAKE,
+    OP_ADOPT,
+    OP_CANCEL
+};
+#define OP_MASK 7ULL
+
+/**
+ * Una connessione servita dal ring. `buf` è il buffer registrato con indice
+ * `index`: le letture lo riempiono con `IORING_OP_READ_FIXED`, senza copie
+ * attraverso buffer temporanei del kernel.
+ *
+ * Una lettura e una catena di invii possono essere in corso insieme (eventi
+ * push mentre si attende la prossima richiesta): la connessione viene
+ * rilasciata solo quando non ha né l'una né l'altra.
+ *
+ * Durante la ricezione di un messaggio più lungo del buffer (`body_left > 0`)
+ * le letture scrivono con `IORING_OP_RECV` direttamente in `body`, la memoria
+ * che la bacheca terrà; se il messaggio non è stato ammesso `body` è NULL e
+ * i byte vengono letti nel buffer registrato e scartati. Allo stesso modo un
+ * lotto lungo viene ricevuto in `body`, allocato con `malloc`; `large` è
+ * l'header della richiesta lunga in corso.
+ *
+ * Una risposta a passi (la bacheca, la copia per una replica) resta in
+ * `source` e ne viene prodotto un passo alla volta, quando il precedente è
+ * stato inviato: la memoria della connessione non cresce con la bacheca.
+ * Intanto le richieste successive restano nel buffer e gli eventi push
+ * nella coda del subscriber.
+ *
+ * Le richieste che possono bloccarsi (`request_blocks`) e i passi delle
+ * risposte a passi vengono eseguiti da un thread del pool (`uring_job`):
+ * finché `offloaded` è impostato la sessione appartiene al lavoratore, e il
+ * ring non esegue altre richieste, non riarma la lettura e non invia eventi
+ * push; può solo completare gli invii già in corso.
+ */
+typedef struct uring_conn {
+    client_session* session;
+    struct uring_server* srv;
+    struct uring_conn* next_free;
+    struct uring_conn* next_ready;  // Lista delle connessioni con eventi push
+    char* buf;
+    size_t have;
+    char* body;
+    size_t body_len;
+    size_t body_left;
+    packet_header large;
+    char subject[MAX_SUBJECT_LEN];
+    reply_chunk* sending;       // Blocchi in invio o ancora da inviare
+    reply_chunk* unsent;        // Primo blocco non ancora accodato
+    reply_source* source;       // Risposta a passi in corso
+    size_t bytes_expected;
+    size_t bytes_sent;
+    unsigned pending_sends;
+    unsigned index;
+    bool reading;
+    bool send_failed;
+    bool closing;
+    bool push_ready;
+    bool offloaded;
+} uring_conn;
+
+/**
+ * Una richiesta (o un passo di `source`) eseguita da un thread del pool per
+ * una connessione del ring. Al termine `out` contiene la risposta, e il
+ * lavoro torna al ring nella lista `done`, svegliato con l'eventfd delle
+ * adozioni.
+ */
+typedef struct uring_job {
+    struct uring_job* next;
+    uring_conn* c;
+    reply_source* source;       // La risposta a passi, o NULL per una richiesta
+    packet_header header;
+    reply out;
+    char payload[CLIENT_MAX_PAYLOAD];
+} uring_job;
+
+struct uring_server {
+    int ring_fd;
+    int listen_fd;
+    int adopt_fd;
+    uint64_t adopt_value;
+
+    char* ring;
+    size_t ring_size;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    char* buffers;
+    uring_conn* conns;
+    uring_conn* free_conns;
+    unsigned n_conns;
+
+    bool multishot;
+    bool accept_armed;
+    bool accept_failed;
+    bool draining;
+
+    thread_pool* pool;                  // Esegue le richieste che possono bloccarsi
+
+    pthread_mutex_t inbox_m;            // Protegge le sessioni da adottare, `ready` e `done`
+    client_session** adopt_queue;
+    size_t adopt_len;
+    size_t adopt_cap;
+    uring_conn* ready;
+    uring_job* done;
+};
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Verifica che il kernel supporti tutte le operazioni usate dal backend.
+ */
+static bool probe_ops(int ring_fd) {
+    static const uint8_t required[] = {
+        IORING_OP_ACCEPT, IORING_OP_READ_FIXED, IORING_OP_SEND,
+        IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_READ, IORING_OP_RECV
+    };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    if (!probe) return false;
+
+    bool ok = sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(required); i++) {
+        ok = required[i] <= probe->last_op && (probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+/**
+ * @brief Pubblica le SQE accodate e, se `wait`, attende almeno un completamento.
+ */
+static void submit(uring_server* srv, bool wait) {
+    __atomic_store_n(srv->sq_tail, srv->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = srv->sq_local_tail - __atomic_load_n(srv->sq_head, __ATOMIC_ACQUIRE);
+    if (pending == 0 && !wait) return;
+    if (sys_io_uring_enter(srv->ring_fd, pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0) < 0 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        perror("io_uring_enter");
+    }
+}
+
+static unsigned sq_free(uring_server* srv) {
+    return srv->sq_entries - (srv->sq_local_tail - __atomic_load_n(srv->sq_head, __ATOMIC_ACQUIRE));
+}
+
+static struct io_uring_sqe* get_sqe(uring_server* srv) {
+    while (sq_free(srv) == 0) {
+        submit(srv, false);
+    }
+    unsigned idx = srv->sq_local_tail & srv->sq_mask;
+    struct io_uring_sqe* sqe = &srv->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    srv->sq_array[idx] = idx;
+    srv->sq_local_tail++;
+    return sqe;
+}
+
+static void arm_accept(uring_server* srv) {
+    if (srv->accept_failed) return;
+    struct io_uring_sqe* sqe = get_sqe(srv);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = srv->listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (srv->multishot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = OP_ACCEPT;
+    srv->accept_armed = true;
+}
+
+static void arm_read(uring_server* srv, uring_conn* c) {
+    struct io_uring_sqe* sqe = get_sqe(srv);
+    sqe->fd = c->session->sock;
+    if (c->body_left > 0 && c->body) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = (uintptr_t)(c->body + c->body_len - c->body_left);
+        sqe->len = (uint32_t)c->body_left;
+    } else {
+        // Senza messaggio lungo in corso `body_left` è 0 e si legge la
+        // prossima richiesta; altrimenti si scarta al più il resto del corpo.
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->addr = (uintptr_t)(c->buf + c->have);
+        sqe->len = URING_BUF_SIZE - c->have;
+        if (c->body_left > 0 && c->body_left < sqe->len) sqe->len = (uint32_t)c->body_left;
+        sqe->buf_index = c->index;
+    }
+    sqe->user_data = (uintptr_t)c | OP_READ;
+    c->reading = true;
+}
+
+static void arm_wake(uring_server* srv) {
+    struct io_uring_sqe* sqe = get_sqe(srv);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = hot_restart_wake_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = OP_WAKE;
+}
+
+static void arm_adopt(uring_server* srv) {
+    struct io_uring_sqe* sqe = get_sqe(srv);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = srv->adopt_fd;
+    sqe->addr = (uintptr_t)&srv->adopt_value;
+    sqe->len = sizeof(srv->adopt_value);
+    sqe->user_data = OP_ADOPT;
+}
+
+static void cancel(uring_server* srv, uint64_t user_data) {
+    struct io_uring_sqe* sqe = get_sqe(srv);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = user_data;
+    sqe->user_data = OP_CANCEL;
+}
+
+static void push_notify(void* ctx);
+static void conn_stream(uring_server* srv, uring_conn* c);
+
+static uring_conn* conn_alloc(uring_server* srv, client_session* session) {
+    uring_conn* c = srv->free_conns;
+    if (!c) return NULL;
+    srv->free_conns = c->next_free;
+    c->next_free = NULL;
+    c->session = session;
+    c->have = 0;
+    c->body = NULL;
+    c->body_left = 0;
+    c->sending = NULL;
+    c->unsent = NULL;
+    c->source = NULL;
+    c->pending_sends = 0;
+    c->reading = false;
+    c->send_failed = false;
+    c->closing = false;
+    c->offloaded = false;
+    session->push_notify = push_notify;
+    session->push_ctx = c;
+    srv->n_conns++;
+    return c;
+}
+
+static void conn_release(uring_server* srv, uring_conn* c, bool parked) {
+    // Dopo client_session_release il subscriber non esiste più e push_notify
+    // non può rimettere la connessione in `ready`.
+    client_session_release(c->session, parked);
+    pthread_mutex_lock(&srv->inbox_m);
+    if (c->push_ready) {
+        uring_conn** link = &srv->ready;
+        while (*link != c) link = &(*link)->next_ready;
+        *link = c->next_ready;
+        c->push_ready = false;
+    }
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    reply_free_chunks(c->sending);
+    if (c->source) {
+        c->source->free(c->source);
+        c->source = NULL;
+    }
+    if (c->large.type == C_POST_MESSAGE) {
+        message_body_release(c->body);
+    } else {
+        free(c->body);
+    }
+    c->body = NULL;
+    c->body_left = 0;
+    c->session = NULL;
+    c->sending = NULL;
+    c->unsent = NULL;
+    c->next_free = srv->free_conns;
+    srv->free_conns = c;
+    srv->n_conns--;
+}
+
+/**
+ * @brief Chiude la connessione appena non ha più operazioni in corso.
+ *
+ * Con una richiesta affidata al pool la connessione viene chiusa quando il
+ * lavoro torna al ring (`job_finish`).
+ */
+static void conn_close(uring_server* srv, uring_conn* c) {
+    c->closing = true;
+    if (c->reading) {
+        cancel(srv, (uintptr_t)c | OP_READ);
+    } else if (c->pending_sends == 0 && !c->offloaded) {
+        conn_release(srv, c, false);
+    }
+}
+
+/**
+ * @brief Riprende la lettura dopo una risposta, o parcheggia la sessione se è in corso un drain.
+ *
+ * Come nel backend bloccante, una sessione viene parcheggiata solo tra una
+ * richiesta e l'altra: con una richiesta (o un corpo) letta a metà si
+ * continua a leggere.
+ * Con una lettura ancora in corso (connessione in modalità push) la si
+ * annulla, e la sessione viene parcheggiata al suo completamento.
+ */
+static void conn_continue(uring_server* srv, uring_conn* c) {
+    if (c->pending_sends > 0 || c->offloaded) return;
+    if (srv->draining && c->have == 0 && c->body_left == 0) {
+        if (c->reading) {
+            cancel(srv, (uintptr_t)c | OP_READ);
+        } else {
+            conn_release(srv, c, true);
+        }
+        return;
+    }
+    if (!c->reading) {
+        arm_read(srv, c);
+    }
+    // La scadenza di una richiesta parte dal suo primo byte e non viene
+    // prolungata dalle letture successive.
+    if (c->have == 0 && c->body_left == 0) {
+        client_session_deadline(c->session, DEADLINE_IDLE);
+    } else if (c->session->deadline != DEADLINE_REQUEST) {
+        client_session_deadline(c->session, DEADLINE_REQUEST);
+    }
+}
+
+/**
+ * @brief Accoda gli invii dei prossimi blocchi di risposta come una catena di SQE collegate.
+ *
+ * `IOSQE_IO_LINK` garantisce che i blocchi partano in ordine; `MSG_WAITALL`
+ * fa sì che il kernel completi ogni blocco anche se il socket accetta solo una
+ * parte dei byte alla volta. La catena è limitata a `URING_SEND_CHAIN` blocchi
+ * e non viene mai spezzata tra due submit, altrimenti l'ordine non sarebbe
+ * garantito. Ogni catena riarma la scadenza di invio: scade solo se il
+ * client smette di leggere, non se la risposta è lunga.
+ */
+static void send_chain(uring_server* srv, uring_conn* c) {
+    unsigned want = 0;
+    for (reply_chunk* ch = c->unsent; ch && want < URING_SEND_CHAIN; ch = ch->next) {
+        want++;
+    }
+    if (sq_free(srv) < want) {
+        submit(srv, false);
+        if (sq_free(srv) < want) want = sq_free(srv) > 0 ? sq_free(srv) : 1;
+    }
+
+    client_session_deadline(c->session, DEADLINE_WRITE);
+    c->pending_sends = 0;
+    c->bytes_expected = 0;
+    c->bytes_sent = 0;
+    for (unsigned i = 0; i < want; i++) {
+        reply_chunk* ch = c->unsent;
+        struct io_uring_sqe* sqe = get_sqe(srv);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->session->sock;
+        sqe->addr = (uintptr_t)reply_chunk_bytes(ch);
+        sqe->len = ch->len;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        if (i + 1 < want) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        sqe->user_data = (uintptr_t)c | OP_SEND;
+        c->pending_sends++;
+        c->bytes_expected += ch->len;
+        c->unsent = ch->next;
+    }
+}
+
+/**
+ * @brief Accoda `chunks` agli invii della connessione.
+ *
+ * Se una catena è già in corso, i blocchi partiranno dopo di essa.
+ */
+static void conn_send(uring_server* srv, uring_conn* c, reply_chunk* chunks) {
+    if (!chunks) return;
+    if (c->sending) {
+        reply_chunk* tail = c->sending;
+        while (tail->next) tail = tail->next;
+        tail->next = chunks;
+        if (!c->unsent) c->unsent = chunks;
+    } else {
+        c->sending = chunks;
+        c->unsent = chunks;
+    }
+    if (c->pending_sends == 0) {
+        send_chain(srv, c);
+    }
+}
+
+/**
+ * @brief Inizia la ricezione di un `C_POST_MESSAGE` più lungo del buffer.
+ *
+ * @param payload L'inizio del payload, `avail` byte già ricevuti.
+ * @return I byte di payload consumati dal buffer, 0 se l'oggetto non è ancora
+ *         arrivato per intero, o -1 se la richiesta non è valida.
+ *
+ * Verifica autenticazione e limiti prima di allocare il corpo; vi copia la
+ * parte già nel buffer e, se ne manca ancora, lascia `body_left` alle letture
+ * successive.
+ */
+static ssize_t large_post_begin(uring_conn* c, const packet_header* header, const char* payload,
+                                size_t avail, reply* out) {
+    size_t head = avail < CLIENT_MAX_PAYLOAD - 1 ? avail : CLIENT_MAX_PAYLOAD - 1;
+    const char* subject_end = memchr(payload, '\0', head);
+    if (!subject_end) return head == CLIENT_MAX_PAYLOAD - 1 ? -1 : 0;
+
+    c->large = *header;
+    size_t body_off = subject_end + 1 - payload;
+    size_t subject_len = body_off - 1 < MAX_SUBJECT_LEN - 1 ? body_off - 1 : MAX_SUBJECT_LEN - 1;
+    memcpy(c->subject, payload, subject_len);
+    c->subject[subject_len] = '\0';
+
+    c->body_len = header->length - body_off;
+    c->body = NULL;
+    if (client_post_admit(c->session, header, c->subject, out)) {
+        c->body = message_body_alloc(c->body_len);
+        if (!c->body) reply_status(out, ERROR);
+    }
+    size_t in_buf = avail - body_off < c->body_len ? avail - body_off : c->body_len;
+    if (c->body) memcpy(c->body, payload + body_off, in_buf);
+    c->body_left = c->body_len - in_buf;
+    if (c->body_left == 0 && c->body) {
+        client_post_commit(c->session, c->subject, c->body, out);
+        c->body = NULL;
+    }
+    return (ssize_t)(body_off + in_buf);
+}
+
+/**
+ * @brief Esegue la richiesta lunga ricevuta per intero in `body`.
+ */
+static void large_commit(uring_conn* c, reply* out) {
+    if (c->large.type == C_POST_MESSAGE) {
+        client_post_commit(c->session, c->subject, c->body, out);
+    } else {
+        c->body[c->body_len] = '\0';
+        client_batch_commit(c->session, &c->large, c->body, out);
+        free(c->body);
+    }
+    c->body = NULL;
+}
+
+/**
+ * @brief Inizia la ricezione di un lotto più lungo del buffer.
+ *
+ * @param payload L'inizio del payload, `avail` byte già ricevuti.
+ * @return I byte di payload consumati dal buffer.
+ *
+ * Come `large_post_begin`, alloca il payload solo se il lotto è ammesso.
+ */
+static size_t large_batch_begin(uring_conn* c, const packet_header* header, const char* payload,
+                                size_t avail, reply* out) {
+    c->large = *header;
+    c->body_len = header->length;
+    c->body = NULL;
+    if (client_batch_admit(c->session, header, out)) {
+        c->body = malloc(c->body_len + 1);
+        if (!c->body) reply_status(out, ERROR);
+    }
+    size_t in_buf = avail < c->body_len ? avail : c->body_len;
+    if (c->body) memcpy(c->body, payload, in_buf);
+    c->body_left = c->body_len - in_buf;
+    if (c->body_left == 0 && c->body) {
+        large_commit(c, out);
+    }
+    return in_buf;
+}
+
+/**
+ * @brief Indica se una richiesta può bloccare il thread che la esegue.
+ *
+ * Il login e la registrazione scorrono il file degli utenti sotto il loro
+ * lock, `C_JOIN_BOARD` può caricare una bacheca dal disco, le letture della
+ * bacheca e la copia per una replica ne copiano e ordinano i messaggi.
+ */
+static bool request_blocks(uint8_t type) {
+    switch (type) {
+        case C_REGISTER:
+        case C_LOGIN:
+        case C_GET_BOARD:
+        case C_REPLICATE:
+        case C_CREATE_BOARD:
+        case C_LIST_BOARDS:
+        case C_JOIN_BOARD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Esegue un lavoro su un thread del pool e lo restituisce al ring.
+ *
+ * Una richiesta può iniziare una risposta a passi, che resta nel lavoro; un
+ * passo che completa la risposta ne libera la sorgente.
+ */
+static void* job_run(void* arg) {
+    uring_job* job = (uring_job*)arg;
+    uring_server* srv = job->c->srv;
+    reply_init(&job->out, -1);
+    if (job->source) {
+        if (!job->source->next(job->source, &job->out)) {
+            job->source->free(job->source);
+            job->source = NULL;
+        }
+    } else {
+        handle_request(job->c->session, &job->header, job->payload, &job->out);
+        job->source = reply_take_source(&job->out);
+    }
+
+    pthread_mutex_lock(&srv->inbox_m);
+    bool wake = srv->done == NULL;
+    job->next = srv->done;
+    srv->done = job;
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    if (wake) {
+        uint64_t one = 1;
+        if (write(srv->adopt_fd, &one, sizeof(one)) < 0) {
+            perror("write eventfd");
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Un lavoro rifiutato dal pool (coda piena) viene eseguito da chi lo ha affidato.
+ */
+static void job_reject(void* arg) {
+    job_run(arg);
+}
+
+/**
+ * @brief Prepara l'esecuzione nel pool di una richiesta o, con `source`, del suo prossimo passo.
+ *
+ * @return Il lavoro, o NULL se manca memoria: il chiamante esegue allora sul ring.
+ */
+static uring_job* job_create(uring_conn* c, const packet_header* header, const char* payload,
+                             reply_source* source) {
+    uring_job* job = malloc(sizeof(uring_job));
+    if (!job) return NULL;
+    job->next = NULL;
+    job->c = c;
+    job->source = source;
+    memset(&job->header, 0, sizeof(job->header));
+    if (header) {
+        job->header = *header;
+        memcpy(job->payload, payload, header->length);
+        job->payload[header->length] = '\0';
+    }
+    return job;
+}
+
+/**
+ * @brief Affida il lavoro al pool; la sessione resta al lavoratore fino a `job_finish`.
+ *
+ * Le letture della bacheca, le copie per le repliche e i loro passi vanno
+ * nella coda `TASK_BULK`, l'autenticazione e la scelta della bacheca in
+ * quella interattiva, come le sessioni nel backend bloccante.
+ */
+static void job_dispatch(uring_server* srv, uring_job* job) {
+    bool bulk = job->source || job->header.type == C_GET_BOARD || job->header.type == C_REPLICATE;
+    job->c->offloaded = true;
+    add_task_reject(srv->pool, bulk ? TASK_BULK : TASK_INTERACTIVE, job_run, job, job_reject);
+}
+
+/**
+ * @brief Esegue tutte le richieste complete presenti nel buffer della connessione.
+ *
+ * Le risposte di più richieste arrivate insieme vengono raccolte in un'unica
+ * `reply` e inviate con una sola catena. Una richiesta che può bloccarsi
+ * interrompe il giro: le risposte precedenti partono subito e la richiesta
+ * passa al pool, mentre le successive restano nel buffer fino al suo ritorno.
+ */
+static void conn_process(uring_server* srv, uring_conn* c) {
+    if (c->offloaded) return;
+    reply out;
+    reply_init(&out, -1);
+    size_t off = 0;
+    bool bad = false;
+    uring_job* job = NULL;
+
+    while (c->have - off >= sizeof(packet_header)) {
+        packet_header header;
+        memcpy(&header, c->buf + off, sizeof(header));
+        if (header.type == C_POST_MESSAGE && header.length >= CLIENT_MAX_PAYLOAD && header.length <= CLIENT_MAX_POST) {
+            ssize_t used = large_post_begin(c, &header, c->buf + off + sizeof(header),
+                                            c->have - off - sizeof(header), &out);
+            if (used < 0) {
+                bad = true;
+                break;
+            }
+            if (used == 0) break;
+            off += sizeof(header) + (size_t)used;
+            if (c->body_left > 0) break;
+            continue;
+        }
+        if ((header.type == C_POST_BATCH || header.type == C_DELETE_BATCH) &&
+            header.length >= CLIENT_MAX_PAYLOAD && header.length <= BATCH_MAX_LENGTH) {
+            off += sizeof(header) + large_batch_begin(c, &header, c->buf + off + sizeof(header),
+                                                      c->have - off - sizeof(header), &out);
+            if (c->body_left > 0) break;
+            continue;
+        }
+        if (header.length >= CLIENT_MAX_PAYLOAD) {
+            bad = true;
+            break;
+        }
+        if (c->have - off - sizeof(header) < header.length) break;
+
+        if (request_blocks(header.type)) {
+            job = job_create(c, &header, c->buf + off + sizeof(header), NULL);
+            if (job) {
+                off += sizeof(header) + header.length;
+                break;
+            }
+        }
+        char payload[CLIENT_MAX_PAYLOAD];
+        memcpy(payload, c->buf + off + sizeof(header), header.length);
+        payload[header.length] = '\0';
+        handle_request(c->session, &header, payload, &out);
+        off += sizeof(header) + header.length;
+        // Le risposte successive devono seguire quella a passi.
+        if (out.source) break;
+    }
+
+    if (off > 0) {
+        memmove(c->buf, c->buf + off, c->have - off);
+        c->have -= off;
+    }
+
+    c->source = reply_take_source(&out);
+    reply_chunk* chunks = reply_take(&out);
+    if (bad || out.failed) {
+        reply_free_chunks(chunks);
+        free(job);
+        conn_close(srv, c);
+        return;
+    }
+    if (chunks) {
+        conn_send(srv, c, chunks);
+    }
+    if (job) {
+        job_dispatch(srv, job);
+        return;
+    }
+    if (chunks) return;
+    if (c->source) {
+        conn_stream(srv, c);
+        return;
+    }
+    conn_continue(srv, c);
+}
+
+/**
+ * @brief Produce e invia il prossimo passo della risposta a passi in corso.
+ *
+ * Il passo viene prodotto da un thread del pool, che copia e ordina i
+ * messaggi senza fermare il ring; solo se manca memoria per il lavoro lo
+ * produce il ring. Alla fine della risposta vengono eseguite le richieste
+ * rimaste nel buffer.
+ */
+static void conn_stream(uring_server* srv, uring_conn* c) {
+    uring_job* job = job_create(c, NULL, NULL, c->source);
+    if (job) {
+        c->source = NULL;
+        job_dispatch(srv, job);
+        return;
+    }
+    reply out;
+    reply_init(&out, -1);
+    if (!c->source->next(c->source, &out)) {
+        c->source->free(c->source);
+        c->source = NULL;
+    }
+    reply_chunk* chunks = reply_take(&out);
+    if (out.failed) {
+        reply_free_chunks(chunks);
+        conn_close(srv, c);
+        return;
+    }
+    if (chunks) {
+        conn_send(srv, c, chunks);
+    } else if (c->source) {
+        conn_stream(srv, c);
+    } else {
+        conn_process(srv, c);
+    }
+}
+
+/**
+ * @brief Invia gli eventi push in coda, se non ci sono già invii in corso.
+ *
+ * Gli eventi restano nella coda limitata del subscriber finché la catena
+ * precedente non è completata: un client lento fa traboccare la propria coda
+ * (e riceverà un `EVENT_RESYNC`) invece di far crescere la memoria del ring.
+ */
+static void conn_push(uring_server* srv, uring_conn* c) {
+    if (c->closing || c->offloaded || !c->session->sub || c->pending_sends > 0 || c->source) return;
+    reply out;
+    reply_init(&out, -1);
+    if (subscriber_drain(c->session->sub, &out)) {
+        conn_send(srv, c, reply_take(&out));
+    }
+}
+
+/**
+ * @brief Riprende una connessione il cui lavoro è tornato dal pool.
+ *
+ * Invia la risposta prodotta dal lavoratore; senza risposta prosegue con il
+ * passo successivo o con le richieste rimaste nel buffer, come dopo un invio.
+ */
+static void job_finish(uring_server* srv, uring_job* job) {
+    uring_conn* c = job->c;
+    c->offloaded = false;
+    c->source = job->source;
+    reply_chunk* chunks = reply_take(&job->out);
+    bool failed = job->out.failed;
+    free(job);
+
+    if (failed || c->closing) {
+        reply_free_chunks(chunks);
+        conn_close(srv, c);
+    } else if (chunks) {
+        conn_send(srv, c, chunks);
+    } else if (c->source) {
+        conn_stream(srv, c);
+    } else {
+        conn_push(srv, c);
+        conn_process(srv, c);
+    }
+}
+
+/**
+ * @brief Avanza la ricezione di un messaggio o di un lotto lungo e lo esegue quando è completo.
+ *
+ * Ogni lettura riarma la scadenza della richiesta, come nel backend bloccante.
+ */
+static void on_body_read(uring_server* srv, uring_conn* c, size_t n) {
+    c->body_left -= n;
+    if (c->body_left > 0) {
+        client_session_deadline(c->session, DEADLINE_REQUEST);
+        arm_read(srv, c);
+        return;
+    }
+    if (!c->body) {
+        // Corpo scartato: la risposta è già stata inviata.
+        conn_continue(srv, c);
+        return;
+    }
+    reply out;
+    reply_init(&out, -1);
+    large_commit(c, &out);
+    reply_chunk* chunks = reply_take(&out);
+    if (out.failed || !chunks) {
+        reply_free_chunks(chunks);
+        conn_close(srv, c);
+        return;
+    }
+    conn_send(srv, c, chunks);
+}
+
+static void on_read(uring_server* srv, uring_conn* c, int res) {
+    c->reading = false;
+    if (c->closing) {
+        conn_close(srv, c);
+        return;
+    }
+    if (res == -ECANCELED && srv->draining) {
+        conn_continue(srv, c);
+        return;
+    }
+    if (res == -EINTR || res == -EAGAIN) {
+        arm_read(srv, c);
+        return;
+    }
+    if (res <= 0) {
+        conn_close(srv, c);
+        return;
+    }
+    if (c->body_left > 0) {
+        on_body_read(srv, c, (size_t)res);
+        return;
+    }
+    c->have += (size_t)res;
+    conn_process(srv, c);
+}
+
+static void on_send(uring_server* srv, uring_conn* c, int res) {
+    if (res > 0) {
+        c->bytes_sent += (size_t)res;
+    } else {
+        c->send_failed = true;
+    }
+    if (--c->pending_sends > 0) return;
+
+    if (c->bytes_sent != c->bytes_expected) {
+        c->send_failed = true;
+    }
+    while (c->sending != c->unsent) {
+        reply_chunk* done = c->sending;
+        c->sending = done->next;
+        done->next = NULL;
+        reply_free_chunks(done);
+    }
+    if (c->send_failed || c->closing) {
+        conn_close(srv, c);
+    } else if (c->unsent) {
+        send_chain(srv, c);
+    } else if (c->source) {
+        conn_stream(srv, c);
+    } else {
+        conn_push(srv, c);
+        // Dopo una risposta a passi il buffer può contenere altre richieste complete.
+        conn_process(srv, c);
+    }
+}
+
+static void on_accept(uring_server* srv, int res, unsigned flags) {
+    if (!(flags & IORING_CQE_F_MORE)) {
+        srv->accept_armed = false;
+    }
+
+    if (res == -EINVAL && srv->multishot) {
+        // Kernel precedente al 5.19: accept singola, riarmata a ogni connessione.
+        srv->multishot = false;
+    } else if (res == -EINVAL || res == -EBADF) {
+        perror("Accept io_uring fallita");
+        srv->accept_failed = true;
+    } else if (res < 0) {
+        if (res != -ECANCELED && res != -EINTR && res != -EAGAIN) {
+            errno = -res;
+            perror("Accept fallita");
+        }
+    } else {
+        int count = atomic_fetch_add(&active_client_count, 1) + 1;
+        client_session* session = client_session_create(res);
+        if (session && log_connections) {
+            char peer[64];
+            client_session_describe(session, peer, sizeof(peer));
+            printf("\nNuovo client connesso: %s. Client attivi: %d\n", peer, count);
+        }
+        uring_conn* c = session ? conn_alloc(srv, session) : NULL;
+        if (!c) {
+            fprintf(stderr, "Impossibile servire il client: connessioni esaurite\n");
+            if (session) {
+                client_session_reject(session);
+            } else {
+                close(res);
+                atomic_fetch_sub(&active_client_count, 1);
+            }
+        } else {
+            conn_continue(srv, c);
+        }
+    }
+
+    if (!srv->accept_armed && !srv->draining) {
+        arm_accept(srv);
+    }
+}
+
+/**
+ * @brief Inizia il drain per un hot restart: smette di accettare e annulla le letture inattive.
+ *
+ * Le connessioni con una lettura annullata vengono parcheggiate al
+ * completamento con `-ECANCELED`; quelle a metà di una richiesta la
+ * completano prima.
+ */
+static void on_wake(uring_server* srv) {
+    if (!hot_restart_draining()) {
+        arm_wake(srv);
+        return;
+    }
+    srv->draining = true;
+    if (srv->accept_armed) {
+        cancel(srv, OP_ACCEPT);
+    }
+    for (unsigned i = 0; i < URING_MAX_CONNS; i++) {
+        uring_conn* c = &srv->conns[i];
+        if (c->session && c->reading && c->have == 0 && c->body_left == 0) {
+            cancel(srv, (uintptr_t)c | OP_READ);
+        }
+    }
+}
+
+/**
+ * @brief Prende in carico le sessioni affidate al ring da altri thread.
+ */
+static void take_adopted(uring_server* srv) {
+    pthread_mutex_lock(&srv->inbox_m);
+    client_session** queue = srv->adopt_queue;
+    size_t len = srv->adopt_len;
+    srv->adopt_queue = NULL;
+    srv->adopt_len = 0;
+    srv->adopt_cap = 0;
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    for (size_t i = 0; i < len; i++) {
+        uring_conn* c = conn_alloc(srv, queue[i]);
+        if (!c) {
+            client_session_release(queue[i], false);
+            continue;
+        }
+        client_session_resume_push(c->session);
+        conn_continue(srv, c);
+    }
+    free(queue);
+}
+
+/**
+ * @brief Riprende le connessioni i cui lavori sono tornati dal pool.
+ */
+static void take_done(uring_server* srv) {
+    pthread_mutex_lock(&srv->inbox_m);
+    uring_job* job = srv->done;
+    srv->done = NULL;
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    while (job) {
+        uring_job* next = job->next;
+        job_finish(srv, job);
+        job = next;
+    }
+}
+
+/**
+ * @brief Invia gli eventi delle connessioni segnalate da `push_notify`.
+ */
+static void take_ready(uring_server* srv) {
+    pthread_mutex_lock(&srv->inbox_m);
+    uring_conn* c = srv->ready;
+    srv->ready = NULL;
+    for (uring_conn* it = c; it; it = it->next_ready) {
+        it->push_ready = false;
+    }
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    while (c) {
+        uring_conn* next = c->next_ready;
+        if (c->session) {
+            conn_push(srv, c);
+        }
+        c = next;
+    }
+}
+
+/**
+ * @brief Notifica di un subscriber servito dal ring (chiamata da qualsiasi thread).
+ *
+ * Mette la connessione nella lista `ready` e sveglia il ring tramite l'eventfd
+ * delle adozioni; l'invio vero e proprio avviene sul thread del ring.
+ */
+static void push_notify(void* ctx) {
+    uring_conn* c = (uring_conn*)ctx;
+    uring_server* srv = c->srv;
+    pthread_mutex_lock(&srv->inbox_m);
+    bool wake = srv->ready == NULL;
+    if (!c->push_ready) {
+        c->push_ready = true;
+        c->next_ready = srv->ready;
+        srv->ready = c;
+    }
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    if (wake) {
+        uint64_t one = 1;
+        if (write(srv->adopt_fd, &one, sizeof(one)) < 0) {
+            perror("write eventfd");
+        }
+    }
+}
+
+static void handle_cqe(uring_server* srv, const struct io_uring_cqe* cqe) {
+    uring_conn* c = (uring_conn*)(uintptr_t)(cqe->user_data & ~OP_MASK);
+    switch (cqe->user_data & OP_MASK) {
+        case OP_ACCEPT:
+            on_accept(srv, cqe->res, cqe->flags);
+            break;
+        case OP_READ:
+            on_read(srv, c, cqe->res);
+            break;
+        case OP_SEND:
+            on_send(srv, c, cqe->res);
+            break;
+        case OP_WAKE:
+            on_wake(srv);
+            break;
+        case OP_ADOPT:
+            arm_adopt(srv);
+            take_adopted(srv);
+            take_done(srv);
+            take_ready(srv);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Affida al ring una sessione già esistente (ricevuta da un hot restart o ripresa dopo un drain annullato).
+ *
+ * Può essere chiamata da qualsiasi thread; il chiamante ha già incrementato
+ * `active_client_count`.
+ */
+void uring_server_adopt(uring_server* srv, client_session* session) {
+    pthread_mutex_lock(&srv->inbox_m);
+    if (srv->adopt_len == srv->adopt_cap) {
+        size_t cap = srv->adopt_cap ? srv->adopt_cap * 2 : 16;
+        client_session** queue = realloc(srv->adopt_queue, cap * sizeof(client_session*));
+        if (!queue) {
+            pthread_mutex_unlock(&srv->inbox_m);
+            client_session_release(session, false);
+            return;
+        }
+        srv->adopt_queue = queue;
+        srv->adopt_cap = cap;
+    }
+    srv->adopt_queue[srv->adopt_len++] = session;
+    pthread_mutex_unlock(&srv->inbox_m);
+
+    uint64_t one = 1;
+    if (write(srv->adopt_fd, &one, sizeof(one)) < 0) {
+        perror("write eventfd");
+    }
+}
+
+/**
+ * @brief Crea un ring io_uring per il socket in ascolto `listen_fd`.
+ *
+ * @return Il server, o NULL se il kernel non supporta le funzionalità
+ *         necessarie: in quel caso il chiamante usa il backend bloccante.
+ *
+ * Registra un buffer fisso di `URING_BUF_SIZE` byte per ognuna delle
+ * `URING_MAX_CONNS` connessioni servibili dal ring. Le richieste che possono
+ * bloccarsi vengono eseguite da `pool`.
+ */
+uring_server* uring_server_create(int listen_fd, thread_pool* pool) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    int ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if (ring_fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    }
+    if (ring_fd < 0) {
+        perror("io_uring_setup");
+        return NULL;
+    }
+    fcntl(ring_fd, F_SETFD, FD_CLOEXEC);
+
+    uint32_t needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL;
+    if ((params.features & needed) != needed || !probe_ops(ring_fd)) {
+        fprintf(stderr, "io_uring: il kernel non supporta le operazioni richieste\n");
+        close(ring_fd);
+        return NULL;
+    }
+
+    uring_server* srv = calloc(1, sizeof(uring_server));
+    if (!srv) {
+        close(ring_fd);
+        return NULL;
+    }
+    srv->ring_fd = ring_fd;
+    srv->listen_fd = listen_fd;
+    srv->pool = pool;
+    srv->adopt_fd = -1;
+    srv->multishot = true;
+    pthread_mutex_init(&srv->inbox_m, NULL);
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    srv->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    srv->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    srv->ring = mmap(NULL, srv->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    srv->sqes = mmap(NULL, srv->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    srv->buffers = mmap(NULL, (size_t)URING_MAX_CONNS * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (srv->ring == MAP_FAILED || srv->sqes == MAP_FAILED || srv->buffers == MAP_FAILED) {
+        perror("mmap io_uring");
+        uring_server_destroy(srv);
+        return NULL;
+    }
+    char* ring = srv->ring;
+    srv->sq_head = (unsigned*)(ring + params.sq_off.head);
+    srv->sq_tail = (unsigned*)(ring + params.sq_off.tail);
+    srv->sq_array = (unsigned*)(ring + params.sq_off.array);
+    srv->sq_mask = *(unsigned*)(ring + params.sq_off.ring_mask);
+    srv->sq_entries = *(unsigned*)(ring + params.sq_off.ring_entries);
+    srv->sq_local_tail = *srv->sq_tail;
+    srv->cq_head = (unsigned*)(ring + params.cq_off.head);
+    srv->cq_tail = (unsigned*)(ring + params.cq_off.tail);
+    srv->cq_mask = *(unsigned*)(ring + params.cq_off.ring_mask);
+    srv->cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+
+    srv->conns = calloc(URING_MAX_CONNS, sizeof(uring_conn));
+    struct iovec* iov = calloc(URING_MAX_CONNS, sizeof(struct iovec));
+    if (!srv->conns || !iov) {
+        free(iov);
+        uring_server_destroy(srv);
+        return NULL;
+    }
+    for (unsigned i = URING_MAX_CONNS; i > 0; i--) {
+        uring_conn* c = &srv->conns[i - 1];
+        c->index = i - 1;
+        c->srv = srv;
+        c->buf = srv->buffers + (size_t)(i - 1) * URING_BUF_SIZE;
+        c->next_free = srv->free_conns;
+        srv->free_conns = c;
+        iov[i - 1].iov_base = c->buf;
+        iov[i - 1].iov_len = URING_BUF_SIZE;
+    }
+    int reg = sys_io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iov, URING_MAX_CONNS);
+    free(iov);
+    if (reg < 0) {
+        perror("io_uring: registrazione dei buffer fallita");
+        uring_server_destroy(srv);
+        return NULL;
+    }
+
+    srv->adopt_fd = eventfd(0, EFD_CLOEXEC);
+    if (srv->adopt_fd < 0) {
+        perror("eventfd");
+        uring_server_destroy(srv);
+        return NULL;
+    }
+
+    // Le accept passano dal ring, che attende la connessione senza bisogno
+    // di un socket non bloccante.
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) & ~O_NONBLOCK);
+    return srv;
+}
+
+/**
+ * @brief Libera un ring che non ha connessioni (mai avviato con `uring_server_run`).
+ *
+ * Il socket in ascolto non viene chiuso.
+ */
+void uring_server_destroy(uring_server* srv) {
+    if (srv->ring && srv->ring != MAP_FAILED) munmap(srv->ring, srv->ring_size);
+    if (srv->sqes && (void*)srv->sqes != MAP_FAILED) munmap(srv->sqes, srv->sqes_size);
+    if (srv->buffers && srv->buffers != MAP_FAILED) munmap(srv->buffers, (size_t)URING_MAX_CONNS * URING_BUF_SIZE);
+    if (srv->adopt_fd >= 0) close(srv->adopt_fd);
+    close(srv->ring_fd);
+    pthread_mutex_destroy(&srv->inbox_m);
+    free(srv->adopt_queue);
+    free(srv->conns);
+    free(srv);
+}
+
+/**
+ * @brief Ciclo degli eventi del ring: accept, letture, esecuzione delle richieste e invii.
+ *
+ * @param srv Il server creato con `uring_server_create`.
+ * @param pause Chiamata quando, durante un drain, il ring non ha più
+ *              connessioni né accept attive; ritorna quando il drain termina
+ *              (restart annullato).
+ *
+ * Le richieste brevi vengono eseguite direttamente sul thread del ring;
+ * quelle che possono bloccarsi e i passi delle risposte lunghe passano al
+ * pool e tornano al ring attraverso l'eventfd delle adozioni, così una
+ * connessione lenta non ferma le altre.
+ */
+void uring_server_run(uring_server* srv, void (*pause)(void)) {
+    arm_wake(srv);
+    arm_adopt(srv);
+    take_adopted(srv);
+    arm_accept(srv);
+
+    unsigned head = *srv->cq_head;
+    while (1) {
+        if (srv->draining && !srv->accept_armed && srv->n_conns == 0) {
+            submit(srv, false);
+            pause();
+            srv->draining = false;
+            arm_wake(srv);
+            take_adopted(srv);
+            arm_accept(srv);
+            continue;
+        }
+
+        submit(srv, true);
+        while (head != __atomic_load_n(srv->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe cqe = srv->cqes[head & srv->cq_mask];
+            head++;
+            __atomic_store_n(srv->cq_head, head, __ATOMIC_RELEASE);
+            handle_cqe(srv, &cqe);
+        }
+    }
+}
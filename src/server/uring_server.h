@@ -0,0 +1,14 @@
+#ifndef URING_SERVER_H
+#define URING_SERVER_H
+
+#include "client_handler.h"
+#include "thread_pool.h"
+
+typedef struct uring_server uring_server;
+
+uring_server* uring_server_create(int listen_fd, thread_pool* pool);
+void uring_server_destroy(uring_server* srv);
+void uring_server_adopt(uring_server* srv, client_session* session);
+void uring_server_run(uring_server* srv, void (*pause)(void));
+
+#endif // URING_SERVER_H
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include "lock_prof.h"
 
 #define USERS_FILE "data/users.txt"
 
@@ -47,7 +48,7 @@ bool register_user(const char *username, const char *password) {
     char hashed_password[64];
     hash_password(password, hashed_password, sizeof(hashed_password));
 
-    pthread_mutex_lock(&user_mutex);
+    PROF_LOCK(&user_mutex, LOCK_USERS);
 
     FILE *file = fopen(USERS_FILE, "r");
     bool user_exists = false;
@@ -67,21 +68,21 @@ bool register_user(const char *username, const char *password) {
     }
 
     if (user_exists) {
-        pthread_mutex_unlock(&user_mutex);
+        PROF_UNLOCK(&user_mutex);
         return false;
     }
 
     file = fopen(USERS_FILE, "a");
     if (!file) {
         perror("Errore in apertura del file user.txt per la scrittura");
-        pthread_mutex_unlock(&user_mutex);
+        PROF_UNLOCK(&user_mutex);
         return false;
     }
     
     fprintf(file, "%s %s\n", username, hashed_password);
     fclose(file);
 
-    pthread_mutex_unlock(&user_mutex);
+    PROF_UNLOCK(&user_mutex);
     return true; 
 }
 
@@ -105,11 +106,11 @@ bool authenticate_user(const char *username, const char *password) {
     char hashed_password[64];
     hash_password(password, hashed_password, sizeof(hashed_password));
 
-    pthread_mutex_lock(&user_mutex);
+    PROF_LOCK(&user_mutex, LOCK_USERS);
     
     FILE *file = fopen(USERS_FILE, "r");
     if (!file) {
-        pthread_mutex_unlock(&user_mutex);
+        PROF_UNLOCK(&user_mutex);
         return false;
     }
 
@@ -128,6 +129,6 @@ bool authenticate_user(const char *username, const char *password) {
     }
     
     fclose(file);
-    pthread_mutex_unlock(&user_mutex); 
+    PROF_UNLOCK(&user_mutex); 
     return found;
 }
\ No newline at end of file
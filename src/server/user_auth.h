@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "../common/common.h"
 
+void hash_password(const char *password, char *hashed_password, size_t size);
 bool register_user(const char *username, const char *password);
 bool authenticate_user(const char *username, const char *password);
 